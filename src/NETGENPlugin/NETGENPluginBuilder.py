@@ -199,6 +199,23 @@ class NETGEN_Algorithm(Mesh_Algorithm):
         self.Parameters().SetLocalSizeOnShape(shape, size)
         pass
 
+    ## Mesh one of @a nbSectors sectors around an axis and copy its mesh to the others
+    #  @param point - a point of the axis, a list of 3 coordinates
+    #  @param direction - direction of the axis, a list of 3 components
+    #  @param nbSectors - number of sectors in 360 degrees
+    def SetRotationalPeriodicity(self, point, direction, nbSectors):
+        self.Parameters().SetRotationalPeriodicity( point[0], point[1], point[2],
+                                                    direction[0], direction[1], direction[2],
+                                                    nbSectors )
+        pass
+
+    ## Mesh one period and copy its mesh to @a nbPeriods - 1 periods along the vector and back
+    #  @param vector - translation from a period to the next one, a list of 3 components
+    #  @param nbPeriods - number of periods
+    def SetTranslationalPeriodicity(self, vector, nbPeriods):
+        self.Parameters().SetTranslationalPeriodicity( vector[0], vector[1], vector[2], nbPeriods )
+        pass
+
 
     pass # end of NETGEN_Algorithm class
 
@@ -0,0 +1,299 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+//=============================================================================
+// File      : NETGENPlugin_BoundaryFile.cxx
+// Project   : SALOME
+//=============================================================================
+//
+//
+#include "NETGENPlugin_BoundaryFile.hxx"
+
+#include "NETGENPlugin_SharedMemory.hxx"
+
+#include <SMDS_MeshNode.hxx>
+#include <SMESHDS_Mesh.hxx>
+#include <SMESH_File.hxx>
+#include <SMESH_Mesh.hxx>
+#include <utilities.h>
+
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+  struct THeader
+  {
+    char     _magic[8];
+    uint32_t _version;
+    uint32_t _unused;
+    int64_t  _nbNodes;
+    int64_t  _nbFaces;
+  };
+
+  static_assert( sizeof( THeader ) % 8 == 0, "header of boundary data must be 8 bytes aligned" );
+
+  //! size of orientation flags padded to 8 bytes
+  size_t paddedSize( size_t nbFaces )
+  {
+    return ( nbFaces + 7 ) / 8 * 8;
+  }
+
+  //! number of items of a given size fitting between data and end
+  int64_t nbFitting( const char* data, const char* end, size_t itemSize )
+  {
+    return data < end ? (int64_t)(( end - data ) / itemSize ) : 0;
+  }
+
+  //! sequential writing to a memory buffer
+  struct TMemoryStream
+  {
+    char* _ptr;
+    void write( const char* data, size_t size )
+    {
+      std::memcpy( _ptr, data, size );
+      _ptr += size;
+    }
+  };
+}
+
+/**
+ * @brief Add a triangle and its nodes
+ *
+ * @param face the triangle
+ * @param isReversed true if the triangle normal is directed inside the solid
+ */
+void NETGENPlugin_BoundaryWriter::AddFace(const SMDS_MeshElement* face, bool isReversed)
+{
+  _faceIDs.push_back( face->GetID() );
+  _reversed.push_back( isReversed );
+  for ( int i = 0; i < 3; ++i )
+  {
+    const SMDS_MeshNode* node = face->GetNode( i );
+    auto id2index = _nodeIndex.insert( std::make_pair( node->GetID(), (int64_t) _nodeIDs.size() ));
+    if ( id2index.second )
+    {
+      _nodeIDs.push_back( node->GetID() );
+      _coords.push_back( node->X() );
+      _coords.push_back( node->Y() );
+      _coords.push_back( node->Z() );
+    }
+    _connectivity.push_back( id2index.first->second );
+  }
+}
+
+/**
+ * @brief Return the size of the written data in bytes
+ */
+size_t NETGENPlugin_BoundaryWriter::Size() const
+{
+  return ( sizeof( THeader ) +
+           sizeof(int64_t) * _nodeIDs.size() +
+           sizeof(double)  * _coords.size() +
+           sizeof(int64_t) * _faceIDs.size() +
+           sizeof(int64_t) * _connectivity.size() +
+           paddedSize( _reversed.size() ));
+}
+
+/**
+ * @brief Write the collected data to a stream or to a memory buffer
+ */
+template< class TOut >
+void NETGENPlugin_BoundaryWriter::write(TOut& out) const
+{
+  THeader header;
+  std::memcpy( header._magic, NETGENPlugin_BoundaryReader::Magic(), sizeof( header._magic ));
+  header._version = NETGENPlugin_BoundaryReader::Version;
+  header._unused  = 0;
+  header._nbNodes = (int64_t) _nodeIDs.size();
+  header._nbFaces = (int64_t) _faceIDs.size();
+
+  std::vector<uint8_t> reversed( _reversed );
+  reversed.resize( paddedSize( reversed.size() ), 0 );
+
+  out.write((char*) &header,              sizeof( header ));
+  out.write((char*) _nodeIDs.data(),      sizeof(int64_t) * _nodeIDs.size() );
+  out.write((char*) _coords.data(),       sizeof(double)  * _coords.size() );
+  out.write((char*) _faceIDs.data(),      sizeof(int64_t) * _faceIDs.size() );
+  out.write((char*) _connectivity.data(), sizeof(int64_t) * _connectivity.size() );
+  out.write((char*) reversed.data(),      reversed.size() );
+}
+
+/**
+ * @brief Write the collected data
+ *
+ * @param boundary_file the file name. If it starts with "shm:", the data is
+ *        written into a shared memory segment of this name which is to be
+ *        removed by NETGENPlugin_SharedMemory::Remove()
+ * @return true if the data is written
+ */
+bool NETGENPlugin_BoundaryWriter::Write(const std::string& boundary_file) const
+{
+  if ( NETGENPlugin_SharedMemory::IsSharedMemory( boundary_file ))
+  {
+    NETGENPlugin_SharedMemory shm;
+    if ( !shm.Create( boundary_file, Size(), /*removeOnClose=*/false ))
+      return false;
+    TMemoryStream out{ shm.Data() };
+    write( out );
+    return true;
+  }
+
+  std::ofstream df(boundary_file, std::ios::out|std::ios::binary);
+  if ( !df )
+    return false;
+  write( df );
+  return df.good();
+}
+
+/**
+ * @brief Map the data in memory and check it
+ *
+ * @param boundary_file the file name or the shared memory segment name
+ */
+NETGENPlugin_BoundaryReader::NETGENPlugin_BoundaryReader(const std::string& boundary_file)
+  : _isOK( false ), _nbNodes( 0 ), _nbFaces( 0 ),
+    _nodeIDs( 0 ), _coords( 0 ), _faceIDs( 0 ), _connectivity( 0 ), _reversed( 0 )
+{
+  const char* data = 0;
+  const char*  end = 0;
+  if ( NETGENPlugin_SharedMemory::IsSharedMemory( boundary_file ))
+  {
+    _shm.reset( new NETGENPlugin_SharedMemory );
+    if ( _shm->Open( boundary_file ))
+    {
+      data = _shm->Data();
+      end  = data + _shm->Size();
+    }
+  }
+  else
+  {
+    _file.reset( new SMESH_File( boundary_file ));
+    if ( _file->open() )
+    {
+      data = *_file;
+      end  = _file->end();
+    }
+  }
+  if ( !data || end - data < (long) sizeof( THeader ))
+  {
+    MESSAGE("Can't read " << boundary_file);
+    return;
+  }
+
+  const THeader* header = (const THeader*) data;
+  if ( std::strncmp( header->_magic, Magic(), sizeof( header->_magic )) != 0 ||
+       header->_version != Version )
+  {
+    MESSAGE("Wrong format of " << boundary_file);
+    return;
+  }
+  data += sizeof( THeader );
+
+  // check the counts before advancing so that the pointers never run past the end
+  if ( header->_nbNodes < 0 ||
+       header->_nbNodes > nbFitting( data, end, sizeof(int64_t) + 3 * sizeof(double) ))
+  {
+    MESSAGE("Wrong number of nodes in " << boundary_file);
+    return;
+  }
+  _nbNodes      = header->_nbNodes;
+  _nodeIDs      = (const int64_t*) data;
+  data         += sizeof(int64_t) * _nbNodes;
+  _coords       = (const double*) data;
+  data         += sizeof(double) * 3 * _nbNodes;
+
+  if ( header->_nbFaces < 0 ||
+       header->_nbFaces > nbFitting( data, end, 4 * sizeof(int64_t) + 1 ) ||
+       (int64_t) paddedSize( header->_nbFaces ) > nbFitting( data + 4 * sizeof(int64_t) * header->_nbFaces, end, 1 ))
+  {
+    MESSAGE("Wrong number of faces in " << boundary_file);
+    return;
+  }
+  _nbFaces      = header->_nbFaces;
+  _faceIDs      = (const int64_t*) data;
+  data         += sizeof(int64_t) * _nbFaces;
+  _connectivity = (const int64_t*) data;
+  data         += sizeof(int64_t) * 3 * _nbFaces;
+  _reversed     = (const uint8_t*) data;
+
+  _isOK = true;
+}
+
+NETGENPlugin_BoundaryReader::~NETGENPlugin_BoundaryReader()
+{
+}
+
+/**
+ * @brief Create the nodes and the triangles in a mesh. They are numbered
+ *        from 1 in the order they were written.
+ *
+ * @param mesh the mesh to fill in
+ * @param elemOrientation orientation of each triangle
+ * @param nodeIDs ids of the nodes in the original mesh, nodeIDs[ id-1 ]
+ *        corresponds to a node of id in \a mesh
+ * @return true if all the elements are created
+ */
+bool NETGENPlugin_BoundaryReader::Import(SMESH_Mesh&                mesh,
+                                         std::map<vtkIdType, bool>& elemOrientation,
+                                         std::vector<smIdType>&     nodeIDs) const
+{
+  if ( !_isOK )
+    return false;
+
+  SMESHDS_Mesh* meshDS = mesh.GetMeshDS();
+
+  std::vector< const SMDS_MeshNode* > nodes( _nbNodes );
+  nodeIDs.assign( _nodeIDs, _nodeIDs + _nbNodes );
+  for ( int64_t i = 0; i < _nbNodes; ++i )
+  {
+    const double* xyz = _coords + 3 * i;
+    nodes[i] = meshDS->AddNodeWithID( xyz[0], xyz[1], xyz[2], i + 1 );
+    if ( !nodes[i] )
+      return false;
+  }
+
+  // faces are written in the order of their original IDs, so the local
+  // numbering keeps the order netgen gets them in
+  const int64_t* conn = _connectivity;
+  for ( int64_t i = 0; i < _nbFaces; ++i, conn += 3 )
+  {
+    for ( int j = 0; j < 3; ++j )
+      if ( conn[j] < 0 || conn[j] >= _nbNodes )
+        return false;
+    if ( !meshDS->AddFaceWithID( nodes[ conn[0] ], nodes[ conn[1] ], nodes[ conn[2] ], i + 1 ))
+      return false;
+    elemOrientation[ i + 1 ] = _reversed[i];
+  }
+  return true;
+}
+
+/**
+ * @brief Check if a file contains boundary data rather than a MED mesh
+ */
+bool NETGENPlugin_BoundaryReader::IsBoundaryFile(const std::string& file)
+{
+  if ( NETGENPlugin_SharedMemory::IsSharedMemory( file ))
+    return true;
+
+  char magic[8];
+  std::ifstream df(file, std::ios::in|std::ios::binary);
+  return ( df.read( magic, sizeof( magic )) &&
+           std::strncmp( magic, Magic(), sizeof( magic )) == 0 );
+}
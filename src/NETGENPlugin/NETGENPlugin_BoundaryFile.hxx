@@ -0,0 +1,114 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+//=============================================================================
+// File      : NETGENPlugin_BoundaryFile.hxx
+// Project   : SALOME
+//=============================================================================
+//
+// Binary data transferring the boundary of a solid from NETGEN_3D_Remote to
+// run_mesher: the triangles bounding the solid, their orientation and their
+// nodes only, so that run_mesher does not read the whole 2D mesh. run_mesher
+// renumbers them and writes back the original node ids. The data is written
+// either to a file or to a POSIX shared memory segment whose name starts
+// with "shm:". All the blocks are 8 bytes aligned:
+//
+//   header      : magic "NGBOUNDR", uint32 version, uint32 unused,
+//                 int64 nbNodes, int64 nbFaces
+//   node ids    : int64[ nbNodes ]      ids of nodes in the mesh
+//   coordinates : double[ 3*nbNodes ]
+//   face ids    : int64[ nbFaces ]      ids of triangles in the mesh
+//   connectivity: int64[ 3*nbFaces ]    indices of triangle nodes in node ids
+//   orientation : uint8[ nbFaces ]      1 if a triangle is reversed, padded to 8 bytes
+//
+#ifndef _NETGENPlugin_BOUNDARYFILE_HXX_
+#define _NETGENPlugin_BOUNDARYFILE_HXX_
+
+#include "NETGENPlugin_Defs.hxx"
+
+#include <SMDS_MeshElement.hxx>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class SMESH_File;
+class SMESH_Mesh;
+class NETGENPlugin_SharedMemory;
+
+/*!
+ * \brief Collect triangles bounding a solid and write them at once
+ */
+class NETGENPLUGIN_EXPORT NETGENPlugin_BoundaryWriter
+{
+ public:
+  void AddFace(const SMDS_MeshElement* face, bool isReversed);
+
+  size_t Size() const;
+
+  bool Write(const std::string& boundary_file) const;
+
+ private:
+  template< class TOut > void write(TOut& out) const;
+
+  std::unordered_map< smIdType, int64_t > _nodeIndex;
+  std::vector<int64_t>                    _nodeIDs;
+  std::vector<double>                     _coords;
+  std::vector<int64_t>                    _faceIDs;
+  std::vector<int64_t>                    _connectivity;
+  std::vector<uint8_t>                    _reversed;
+};
+
+/*!
+ * \brief Read data written by NETGENPlugin_BoundaryWriter
+ */
+class NETGENPLUGIN_EXPORT NETGENPlugin_BoundaryReader
+{
+ public:
+  NETGENPlugin_BoundaryReader(const std::string& boundary_file);
+  ~NETGENPlugin_BoundaryReader();
+
+  bool IsOK() const { return _isOK; }
+
+  bool Import(SMESH_Mesh&                mesh,
+              std::map<vtkIdType, bool>& elemOrientation,
+              std::vector<smIdType>&     nodeIDs) const;
+
+  static bool IsBoundaryFile(const std::string& file);
+
+  static const char*    Magic()   { return "NGBOUNDR"; }
+  static const uint32_t Version = 1;
+
+ private:
+  std::unique_ptr<SMESH_File>                _file;
+  std::unique_ptr<NETGENPlugin_SharedMemory> _shm;
+  bool                                       _isOK;
+  int64_t                                    _nbNodes;
+  int64_t                                    _nbFaces;
+  const int64_t*                             _nodeIDs;
+  const double*                              _coords;
+  const int64_t*                             _faceIDs;
+  const int64_t*                             _connectivity;
+  const uint8_t*                             _reversed;
+};
+
+#endif
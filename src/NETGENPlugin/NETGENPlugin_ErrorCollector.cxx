@@ -0,0 +1,227 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+
+//=============================================================================
+// File      : NETGENPlugin_ErrorCollector.cxx
+// Project   : SALOME
+//=============================================================================
+//
+//
+#include "NETGENPlugin_ErrorCollector.hxx"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace
+{
+  // lines longer than this can't contain a record of interest
+  const size_t theMaxLineLength = 256;
+
+  //================================================================================
+  /*!
+   * \brief Read not negative integers from a line
+   */
+  //================================================================================
+
+  size_t getInts( const std::string& line, int* ints, size_t maxNb )
+  {
+    size_t nb = 0;
+    for ( size_t i = 0; i < line.size() && nb < maxNb; ++i )
+    {
+      if ( !isdigit( line[i] ))
+        continue;
+      int value = 0;
+      for ( ; i < line.size() && isdigit( line[i] ); ++i )
+        value = 10 * value + ( line[i] - '0' );
+      ints[ nb++ ] = value;
+    }
+    return nb;
+  }
+
+  bool startsWith( const std::string& line, const char* prefix )
+  {
+    return line.compare( 0, strlen( prefix ), prefix ) == 0;
+  }
+}
+
+NETGENPlugin_ErrorCollector::NETGENPlugin_ErrorCollector(std::ostream* target):
+  std::ostream( 0 ), _buf( target )
+{
+  rdbuf( &_buf );
+}
+
+/**
+ * @brief Return edges reported as present "multiple times in surface mesh"
+ */
+std::vector< NETGENPlugin_ErrorCollector::TEdge > NETGENPlugin_ErrorCollector::BadEdges() const
+{
+  std::lock_guard<std::mutex> lock( _buf._mutex );
+  return _buf._badEdges;
+}
+
+/**
+ * @brief Return pairs of triangles reported as "Intersecting"
+ */
+std::vector< NETGENPlugin_ErrorCollector::TFacePair >
+NETGENPlugin_ErrorCollector::IntersectingFaces() const
+{
+  std::lock_guard<std::mutex> lock( _buf._mutex );
+  return _buf._intersectingFaces;
+}
+
+/**
+ * @brief Forget the errors collected so far
+ */
+void NETGENPlugin_ErrorCollector::Clear()
+{
+  std::lock_guard<std::mutex> lock( _buf._mutex );
+  _buf._badEdges.clear();
+  _buf._intersectingFaces.clear();
+}
+
+NETGENPlugin_ErrorCollector::ErrorBuf::ErrorBuf(std::ostream* target):
+  _target( target ), _state( NONE )
+{
+  setp( _buffer, _buffer + sizeof( _buffer ));
+}
+
+NETGENPlugin_ErrorCollector::ErrorBuf::~ErrorBuf()
+{
+  sync();
+}
+
+NETGENPlugin_ErrorCollector::ErrorBuf::int_type
+NETGENPlugin_ErrorCollector::ErrorBuf::overflow(int_type c)
+{
+  flush();
+  if ( !traits_type::eq_int_type( c, traits_type::eof() ))
+  {
+    *pptr() = traits_type::to_char_type( c );
+    pbump( 1 );
+  }
+  return traits_type::not_eof( c );
+}
+
+std::streamsize NETGENPlugin_ErrorCollector::ErrorBuf::xsputn(const char* s, std::streamsize n)
+{
+  if ( n <= epptr() - pptr() )
+  {
+    std::memcpy( pptr(), s, n );
+    pbump( int( n ));
+    return n;
+  }
+  flush();
+  parse( s, n );
+  if ( _target )
+    _target->rdbuf()->sputn( s, n );
+  return n;
+}
+
+int NETGENPlugin_ErrorCollector::ErrorBuf::sync()
+{
+  flush();
+  return _target ? _target->rdbuf()->pubsync() : 0;
+}
+
+//================================================================================
+/*!
+ * \brief Process the buffered text and empty the buffer
+ */
+//================================================================================
+
+void NETGENPlugin_ErrorCollector::ErrorBuf::flush()
+{
+  if ( pptr() == pbase() )
+    return;
+  parse( pbase(), pptr() - pbase() );
+  if ( _target )
+    _target->rdbuf()->sputn( pbase(), pptr() - pbase() );
+  setp( _buffer, _buffer + sizeof( _buffer ));
+}
+
+//================================================================================
+/*!
+ * \brief Split text into lines
+ */
+//================================================================================
+
+void NETGENPlugin_ErrorCollector::ErrorBuf::parse(const char* s, size_t n)
+{
+  for ( const char* end = s + n; s < end; )
+  {
+    const char* eol = (const char*) memchr( s, '\n', end - s );
+    size_t      len = ( eol ? eol : end ) - s;
+    if ( _line.size() <= theMaxLineLength )
+      _line.append( s, std::min( len, theMaxLineLength + 1 - _line.size() ));
+    if ( !eol )
+      break;
+    if ( _line.size() <= theMaxLineLength )
+      parseLine();
+    _line.clear();
+    s = eol + 1;
+  }
+}
+
+//================================================================================
+/*!
+ * \brief Store an error record if a line is a part of it
+ */
+//================================================================================
+
+void NETGENPlugin_ErrorCollector::ErrorBuf::parseLine()
+{
+  switch ( _state )
+  {
+  case INTERSECTING:
+    _state = startsWith( _line, "openelement " ) ? OPEN_ELEMENT : NONE;
+    return;
+
+  case OPEN_ELEMENT:
+    _state = ( getInts( _line, &_facePair[0], 3 ) == 3 ) ? FIRST_FACE : NONE;
+    return;
+
+  case FIRST_FACE:
+    if ( getInts( _line, &_facePair[3], 3 ) == 3 )
+    {
+      std::lock_guard<std::mutex> lock( _mutex );
+      _intersectingFaces.push_back( _facePair );
+    }
+    _state = NONE;
+    return;
+
+  default:;
+  }
+
+  if ( startsWith( _line, "Edge " ))
+  {
+    TEdge edge;
+    if ( _line.find( " multiple times in surface mesh" ) != std::string::npos &&
+         getInts( _line, &edge[0], 2 ) == 2 )
+    {
+      std::lock_guard<std::mutex> lock( _mutex );
+      _badEdges.push_back( edge );
+    }
+  }
+  else if ( startsWith( _line, "Intersecting:" ))
+  {
+    _state = INTERSECTING;
+  }
+}
@@ -0,0 +1,102 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+
+//=============================================================================
+// File      : NETGENPlugin_ErrorCollector.hxx
+// Project   : SALOME
+//=============================================================================
+//
+#ifndef _NETGENPlugin_ERRORCOLLECTOR_HXX_
+#define _NETGENPlugin_ERRORCOLLECTOR_HXX_
+
+#include "NETGENPlugin_Defs.hxx"
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief Stream used as netgen testout. It picks up errors of input surface
+ *        mesh reported by netgen as they are written:
+ *
+ *   Edge 12 - 34 multiple times in surface mesh
+ *
+ *   Intersecting:
+ *   openelement 18 with open element 126
+ *   41  36  38
+ *   69  70  72
+ *
+ * and passes all the text to another stream, if any. The text is buffered
+ * and processed at flush, e.g. at std::endl, or when the buffer is full.
+ */
+class NETGENPLUGIN_EXPORT NETGENPlugin_ErrorCollector : public std::ostream
+{
+ public:
+  typedef std::array< int, 2 > TEdge;         // netgen ids of nodes
+  typedef std::array< int, 6 > TFacePair;     // netgen ids of nodes of two triangles
+
+  NETGENPlugin_ErrorCollector(std::ostream* target = 0);
+
+  std::ostream* Target() const { return _buf.target(); }
+
+  std::vector< TEdge >     BadEdges() const;
+  std::vector< TFacePair > IntersectingFaces() const;
+  void                     Clear();
+
+ private:
+
+  // parser of text lines
+  class ErrorBuf : public std::streambuf
+  {
+   public:
+    ErrorBuf(std::ostream* target);
+    ~ErrorBuf();
+    std::ostream* target() const { return _target.get(); }
+
+    mutable std::mutex       _mutex;
+    std::vector< TEdge >     _badEdges;
+    std::vector< TFacePair > _intersectingFaces;
+
+   protected:
+    int_type        overflow(int_type c) override;
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+    int             sync() override;
+
+   private:
+    void flush();
+    void parse(const char* s, size_t n);
+    void parseLine();
+
+    enum TState { NONE, INTERSECTING, OPEN_ELEMENT, FIRST_FACE };
+
+    std::unique_ptr< std::ostream > _target;
+    char                            _buffer[ 1024 ]; // put area
+    std::string                     _line;
+    TState                          _state;
+    TFacePair                       _facePair;
+  };
+
+  ErrorBuf _buf;
+};
+
+#endif
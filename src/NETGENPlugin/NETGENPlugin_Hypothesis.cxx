@@ -29,10 +29,22 @@
 #include "NETGENPlugin_Hypothesis.hxx"
 
 #include "NETGENPlugin_Mesher.hxx"
+#include "SMESH_Algo.hxx"
+#include "SMESH_Gen.hxx"
 #include "SMESH_Mesh.hxx"
+#include "SMESH_subMesh.hxx"
 
 #include <utilities.h>
 
+#include <BRepBndLib.hxx>
+#include <Bnd_Box.hxx>
+#include <TopExp_Explorer.hxx>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <limits>
+
 using namespace std;
 
 //=============================================================================
@@ -63,10 +75,13 @@ NETGENPlugin_Hypothesis::NETGENPlugin_Hypothesis (int hypId, SMESH_Gen * gen)
     _useDelauney        (GetDefaultUseDelauney()),
     _checkOverlapping   (GetDefaultCheckOverlapping()),
     _checkChartBoundary (GetDefaultCheckChartBoundary()),
-    _fuseEdges          (GetDefaultFuseEdges())
+    _fuseEdges          (GetDefaultFuseEdges()),
+    _periodicity        (NoPeriodicity),
+    _nbPeriods          (0)
 {
   _name = "NETGEN_Parameters";
   _param_algo_dim = 3;
+  std::fill( _periodParams, _periodParams + 6, 0. );
 }
 
 //=============================================================================
@@ -251,10 +266,11 @@ void NETGENPlugin_Hypothesis::SetChordalError(double theVal)
 //=============================================================================
 void NETGENPlugin_Hypothesis::SetLocalSizeOnEntry(const std::string& entry, double localSize)
 {
+  double oldSize = GetLocalSizeOnEntry( entry );
   if(_localSize[entry] != localSize)
   {
     _localSize[entry] = localSize;
-    NotifySubMeshesHypothesisModification();
+    notifyLocalSizeModification( entry, oldSize, localSize );
   }
 }
 
@@ -279,8 +295,84 @@ double NETGENPlugin_Hypothesis::GetLocalSizeOnEntry(const std::string& entry)
 //=============================================================================
 void NETGENPlugin_Hypothesis::UnsetLocalSizeOnEntry(const std::string& entry)
 {
+  double oldSize = GetLocalSizeOnEntry( entry );
   _localSize.erase(entry);
-  NotifySubMeshesHypothesisModification();
+  notifyLocalSizeModification( entry, oldSize, -1. );
+}
+
+//=============================================================================
+/*!
+ * \brief Clean sub-meshes whose size field is changed by modification of a local size.
+ *
+ * If SALOME_NETGEN_INCREMENTAL_LOCAL_SIZE environment variable is set, only sub-meshes
+ * lying in the zone where the size grows from the local size to the max size at the
+ * growth rate are cleaned. Other sub-meshes are kept and the next Compute() uses
+ * them as a fixed boundary. Else all sub-meshes using the hypothesis are cleaned.
+ */
+//=============================================================================
+
+void NETGENPlugin_Hypothesis::notifyLocalSizeModification(const std::string& entry,
+                                                          double             oldSize,
+                                                          double             newSize)
+{
+  if ( !std::getenv("SALOME_NETGEN_INCREMENTAL_LOCAL_SIZE") ||
+       !_gen || !_gen->GetStudyContext() || _growthRate <= 0 )
+  {
+    NotifySubMeshesHypothesisModification();
+    return;
+  }
+  double size = std::numeric_limits<double>::max();
+  if ( oldSize > 0 ) size = oldSize;
+  if ( newSize > 0 ) size = std::min( size, newSize );
+  if ( size == std::numeric_limits<double>::max() )
+    return; // no local size before and after
+
+  TopoDS_Shape shape = NETGENPlugin_Mesher::GetShapeByEntry( entry );
+  Bnd_Box zone;
+  if ( !shape.IsNull() )
+    BRepBndLib::Add( shape, zone );
+  if ( zone.IsVoid() )
+  {
+    NotifySubMeshesHypothesisModification();
+    return;
+  }
+  zone.Enlarge( std::max( 0., ( _maxSize - size ) / _growthRate ));
+
+  std::map < int, SMESH_Mesh * >& meshes = _gen->GetStudyContext()->mapMesh;
+  std::map < int, SMESH_Mesh * >::iterator id_mesh = meshes.begin();
+  for ( ; id_mesh != meshes.end(); ++id_mesh )
+  {
+    SMESH_Mesh* mesh = id_mesh->second;
+    std::list< SMESH_subMesh* > usingSM = mesh->GetSubMeshUsingHypothesis( this );
+    if ( usingSM.empty() )
+      continue;
+    std::list< SMESH_subMesh* >::iterator smIt = usingSM.begin();
+    for ( ; smIt != usingSM.end(); ++smIt )
+    {
+      SMESH_Algo* algo = _gen->GetAlgo( *smIt );
+      if ( !algo )
+        continue;
+      // clean shapes the algo meshes, the higher dimension first
+      const int maxDim = algo->GetDim();
+      const int minDim = algo->NeedDiscreteBoundary() ? maxDim : 1;
+      const TopAbs_ShapeEnum dimType[] = { TopAbs_VERTEX, TopAbs_EDGE, TopAbs_FACE, TopAbs_SOLID };
+      for ( int dim = maxDim; dim >= minDim; --dim )
+        for ( TopExp_Explorer exp( (*smIt)->GetSubShape(), dimType[ dim ]); exp.More(); exp.Next() )
+        {
+          SMESH_subMesh* sm = mesh->GetSubMesh( exp.Current() );
+          if ( sm->IsEmpty() )
+            continue;
+          Bnd_Box box;
+          BRepBndLib::Add( exp.Current(), box );
+          if ( !zone.IsOut( box ))
+            sm->ComputeStateEngine( SMESH_subMesh::CLEAN );
+        }
+    }
+    // notify the mesh of the modification as NotifySubMeshesHypothesisModification()
+    // does, except MODIF_HYP event, which would clean all sub-meshes using the hypothesis
+    mesh->SetIsModified( true );
+    mesh->GetMeshDS()->Modified();
+  }
 }
 
 //=============================================================================
@@ -451,6 +543,71 @@ void NETGENPlugin_Hypothesis::SetNbThreads( int theVal )
   }
 }
 
+//=======================================================================
+//function : SetRotationalPeriodicity
+//purpose  : mesh one of nbSectors sectors around an axis and copy it to the others
+//=======================================================================
+
+void NETGENPlugin_Hypothesis::SetRotationalPeriodicity( double x, double y, double z,
+                                                        double dx, double dy, double dz,
+                                                        int nbSectors )
+{
+  if ( nbSectors < 2 )
+    throw SALOME_Exception("Number of sectors must be more than 1");
+  if ( dx * dx + dy * dy + dz * dz == 0. )
+    throw SALOME_Exception("Null axis direction");
+
+  const double params[6] = { x, y, z, dx, dy, dz };
+  if ( _periodicity != RotationalPeriodicity || _nbPeriods != nbSectors ||
+       !std::equal( params, params + 6, _periodParams ))
+  {
+    _periodicity = RotationalPeriodicity;
+    _nbPeriods   = nbSectors;
+    std::copy( params, params + 6, _periodParams );
+    NotifySubMeshesHypothesisModification();
+  }
+}
+
+//=======================================================================
+//function : SetTranslationalPeriodicity
+//purpose  : mesh one period and copy it nbPeriods-1 times along the vector and back
+//=======================================================================
+
+void NETGENPlugin_Hypothesis::SetTranslationalPeriodicity( double dx, double dy, double dz,
+                                                           int nbPeriods )
+{
+  if ( nbPeriods < 2 )
+    throw SALOME_Exception("Number of periods must be more than 1");
+  if ( dx * dx + dy * dy + dz * dz == 0. )
+    throw SALOME_Exception("Null translation vector");
+
+  const double params[6] = { 0., 0., 0., dx, dy, dz };
+  if ( _periodicity != TranslationalPeriodicity || _nbPeriods != nbPeriods ||
+       !std::equal( params, params + 6, _periodParams ))
+  {
+    _periodicity = TranslationalPeriodicity;
+    _nbPeriods   = nbPeriods;
+    std::copy( params, params + 6, _periodParams );
+    NotifySubMeshesHypothesisModification();
+  }
+}
+
+//=======================================================================
+//function : UnsetPeriodicity
+//purpose  :
+//=======================================================================
+
+void NETGENPlugin_Hypothesis::UnsetPeriodicity()
+{
+  if ( _periodicity != NoPeriodicity )
+  {
+    _periodicity = NoPeriodicity;
+    _nbPeriods   = 0;
+    std::fill( _periodParams, _periodParams + 6, 0. );
+    NotifySubMeshesHypothesisModification();
+  }
+}
+
 //=============================================================================
 /*!
  *
@@ -495,6 +652,17 @@ ostream & NETGENPlugin_Hypothesis::SaveTo(ostream & save)
   save << " " << _checkOverlapping;
   save << " " << _checkChartBoundary;
 
+  if ( _periodicity != NoPeriodicity )
+  {
+    save << " " << "__PERIODICITY__" << " " << _periodicity << " " << _nbPeriods;
+    // full precision for the axis and the angle to transform the shape exactly
+    std::streamsize precision = save.precision();
+    save << std::setprecision( 17 );
+    for ( int i = 0; i < 6; ++i )
+      save << " " << _periodParams[ i ];
+    save << std::setprecision( precision );
+  }
+
   return save;
 }
 
@@ -646,6 +814,27 @@ istream & NETGENPlugin_Hypothesis::LoadFrom(istream & load)
   if ( isOK )
     _checkChartBoundary = (bool) is;
 
+  // periodicity is saved with a mark, as fields of a sub-class may follow;
+  // tellg() fails at the end of data saved without periodicity
+  if ( load && !load.eof() )
+  {
+    std::streampos pos = load.tellg();
+    std::string mark;
+    if ( load >> mark && mark == "__PERIODICITY__" )
+    {
+      isOK = static_cast<bool>( load >> is >> _nbPeriods );
+      for ( int i = 0; i < 6 && isOK; ++i )
+        isOK = static_cast<bool>( load >> _periodParams[ i ]);
+      if ( isOK )
+        _periodicity = (Periodicity) is;
+    }
+    else
+    {
+      load.clear();
+      load.seekg( pos );
+    }
+  }
+
   return load;
 }
 
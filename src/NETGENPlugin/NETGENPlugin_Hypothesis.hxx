@@ -129,6 +129,23 @@ public:
   void   SetNbThreads( int val );
   int    GetNbThreads() const { return _nbThreads; }
 
+  // periodicity: one sector is meshed, the others get copies of its mesh
+
+  enum Periodicity
+  {
+    NoPeriodicity,
+    RotationalPeriodicity,   // about an axis by 2*PI / nb of periods
+    TranslationalPeriodicity // by a vector, in both directions
+  };
+
+  void   SetRotationalPeriodicity( double x, double y, double z,
+                                   double dx, double dy, double dz, int nbSectors );
+  void   SetTranslationalPeriodicity( double dx, double dy, double dz, int nbPeriods );
+  void   UnsetPeriodicity();
+  Periodicity   GetPeriodicity() const { return _periodicity; }
+  const double* GetPeriodicityParameters() const { return _periodParams; } // point, direction
+  int           GetNbPeriods() const { return _nbPeriods; }
+
   // the default values (taken from NETGEN 4.5 sources)
 
   static Fineness GetDefaultFineness()          { return Moderate; }
@@ -171,6 +188,8 @@ public:
 
 private:
 
+  void notifyLocalSizeModification(const std::string& entry, double oldSize, double newSize);
+
   // General
   Fineness      _fineness;
   bool          _secondOrder;
@@ -205,6 +224,11 @@ private:
 
   // Parallelism parameters
   int _nbThreads;
+
+  // Periodicity (SALOME additions)
+  Periodicity   _periodicity;
+  double        _periodParams[6];
+  int           _nbPeriods;
 };
 
 #endif
@@ -662,6 +662,98 @@ CORBA::Boolean NETGENPlugin_Hypothesis_i::GetCheckChartBoundary()
   return GetImpl()->GetCheckChartBoundary();
 }
 
+//=======================================================================
+//function : SetRotationalPeriodicity
+//purpose  :
+//=======================================================================
+
+void NETGENPlugin_Hypothesis_i::SetRotationalPeriodicity(CORBA::Double x,
+                                                         CORBA::Double y,
+                                                         CORBA::Double z,
+                                                         CORBA::Double dx,
+                                                         CORBA::Double dy,
+                                                         CORBA::Double dz,
+                                                         CORBA::Short  nbSectors)
+{
+  try {
+    this->GetImpl()->SetRotationalPeriodicity( x, y, z, dx, dy, dz, nbSectors );
+  }
+  catch (SALOME_Exception& S_ex) {
+    THROW_SALOME_CORBA_EXCEPTION( S_ex.what(), SALOME::BAD_PARAM );
+  }
+  SMESH::TPythonDump() << _this() << ".SetRotationalPeriodicity( "
+                       << x << ", " << y << ", " << z << ", "
+                       << dx << ", " << dy << ", " << dz << ", " << nbSectors << " )";
+}
+
+//=======================================================================
+//function : SetTranslationalPeriodicity
+//purpose  :
+//=======================================================================
+
+void NETGENPlugin_Hypothesis_i::SetTranslationalPeriodicity(CORBA::Double dx,
+                                                            CORBA::Double dy,
+                                                            CORBA::Double dz,
+                                                            CORBA::Short  nbPeriods)
+{
+  try {
+    this->GetImpl()->SetTranslationalPeriodicity( dx, dy, dz, nbPeriods );
+  }
+  catch (SALOME_Exception& S_ex) {
+    THROW_SALOME_CORBA_EXCEPTION( S_ex.what(), SALOME::BAD_PARAM );
+  }
+  SMESH::TPythonDump() << _this() << ".SetTranslationalPeriodicity( "
+                       << dx << ", " << dy << ", " << dz << ", " << nbPeriods << " )";
+}
+
+//=======================================================================
+//function : UnsetPeriodicity
+//purpose  :
+//=======================================================================
+
+void NETGENPlugin_Hypothesis_i::UnsetPeriodicity()
+{
+  if ( GetPeriodicity() != ::NETGENPlugin_Hypothesis::NoPeriodicity )
+  {
+    this->GetImpl()->UnsetPeriodicity();
+    SMESH::TPythonDump() << _this() << ".UnsetPeriodicity()";
+  }
+}
+
+//=======================================================================
+//function : GetPeriodicity
+//purpose  :
+//=======================================================================
+
+CORBA::Short NETGENPlugin_Hypothesis_i::GetPeriodicity()
+{
+  return (CORBA::Short) GetImpl()->GetPeriodicity();
+}
+
+//=======================================================================
+//function : GetPeriodicityParameters
+//purpose  : Return axis point and direction, or translation vector
+//=======================================================================
+
+SMESH::double_array* NETGENPlugin_Hypothesis_i::GetPeriodicityParameters()
+{
+  SMESH::double_array_var params = new SMESH::double_array;
+  params->length( 6 );
+  for ( CORBA::ULong i = 0; i < 6; ++i )
+    params[ i ] = GetImpl()->GetPeriodicityParameters()[ i ];
+  return params._retn();
+}
+
+//=======================================================================
+//function : GetNbPeriods
+//purpose  :
+//=======================================================================
+
+CORBA::Short NETGENPlugin_Hypothesis_i::GetNbPeriods()
+{
+  return (CORBA::Short) GetImpl()->GetNbPeriods();
+}
+
 //=============================================================================
 /*!
  *  NETGENPlugin_Hypothesis_i::GetImpl
@@ -125,6 +125,16 @@ class NETGENPLUGIN_EXPORT NETGENPlugin_Hypothesis_i:
   void    SetCheckChartBoundary(CORBA::Boolean toCheck );
   CORBA::Boolean GetCheckChartBoundary();
 
+  void    SetRotationalPeriodicity(CORBA::Double x,  CORBA::Double y,  CORBA::Double z,
+                                   CORBA::Double dx, CORBA::Double dy, CORBA::Double dz,
+                                   CORBA::Short nbSectors);
+  void    SetTranslationalPeriodicity(CORBA::Double dx, CORBA::Double dy, CORBA::Double dz,
+                                      CORBA::Short nbPeriods);
+  void    UnsetPeriodicity();
+  CORBA::Short GetPeriodicity();
+  SMESH::double_array* GetPeriodicityParameters();
+  CORBA::Short GetNbPeriods();
+
   // Get implementation
   ::NETGENPlugin_Hypothesis* GetImpl();
 
@@ -28,11 +28,17 @@
 //=============================================================================
 
 #include "NETGENPlugin_Mesher.hxx"
+#include "NETGENPlugin_ErrorCollector.hxx"
 #include "NETGENPlugin_Hypothesis_2D.hxx"
+#include "NETGENPlugin_NetgenContext.hxx"
+#include "NETGENPlugin_OutputBuffer.hxx"
+#include "NETGENPlugin_ResultCache.hxx"
 #include "NETGENPlugin_SimpleHypothesis_3D.hxx"
 
 #include <SMDS_FaceOfNodes.hxx>
+#include <SMDS_FacePosition.hxx>
 #include <SMDS_LinearEdge.hxx>
+#include <SMDS_MeshCell.hxx>
 #include <SMDS_MeshElement.hxx>
 #include <SMDS_MeshNode.hxx>
 #include <SMESHDS_Mesh.hxx>
@@ -41,8 +47,10 @@
 #include <SMESH_ComputeError.hxx>
 #include <SMESH_ControlPnt.hxx>
 #include <SMESH_File.hxx>
+#include <SMESH_Gen.hxx>
 #include <SMESH_Gen_i.hxx>
 #include <SMESH_Mesh.hxx>
+#include <SMESH_MeshEditor.hxx>
 #include <SMESH_MesherHelper.hxx>
 #include <SMESH_subMesh.hxx>
 #include <StdMeshers_QuadToTriaAdaptor.hxx>
@@ -53,15 +61,24 @@
 #include <utilities.h>
 
 #include <BRepAdaptor_Surface.hxx>
+#include <BRepBndLib.hxx>
 #include <BRepBuilderAPI_Copy.hxx>
+#include <BRepGProp.hxx>
 #include <BRepLProp_SLProps.hxx>
 #include <BRepMesh_IncrementalMesh.hxx>
+#include <BRepTools_ShapeSet.hxx>
 #include <BRep_Builder.hxx>
 #include <BRep_Tool.hxx>
 #include <Bnd_B3d.hxx>
+#include <Bnd_Box.hxx>
+#include <GProp_GProps.hxx>
 #include <GeomLib_IsPlanarSurface.hxx>
+#include <IntCurvesFace_ShapeIntersector.hxx>
+#include <NCollection_DataMap.hxx>
 #include <NCollection_Map.hxx>
 #include <Poly_Triangulation.hxx>
+#include <Precision.hxx>
+#include <ShapeAnalysis_Surface.hxx>
 #include <Standard_ErrorHandler.hxx>
 #include <Standard_ProgramError.hxx>
 #include <TColStd_MapOfInteger.hxx>
@@ -73,8 +90,12 @@
 #include <TopTools_DataMapOfShapeInteger.hxx>
 #include <TopTools_DataMapOfShapeShape.hxx>
 #include <TopTools_MapOfShape.hxx>
+#include <TopTools_ShapeMapHasher.hxx>
 #include <TopoDS.hxx>
 #include <TopoDS_Compound.hxx>
+#include <gp_Ax1.hxx>
+#include <gp_Lin.hxx>
+#include <gp_Vec.hxx>
 
 #include <Basics_OCCTVersion.hxx>
 // Netgen include files
@@ -87,10 +108,10 @@
 namespace netgen {
 
   NETGENPLUGIN_DLL_HEADER
-  extern MeshingParameters mparam;
+  extern NG_THREAD_LOCAL MeshingParameters mparam;
 
   NETGENPLUGIN_DLL_HEADER
-  extern volatile multithreadt multithread;
+  extern NG_THREAD_LOCAL volatile multithreadt multithread;
 
   NETGENPLUGIN_DLL_HEADER
   extern bool merge_solids;
@@ -102,11 +123,23 @@ namespace netgen {
   };
 }
 
-#include <vector>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <exception>
 #include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
 
 #ifdef WIN32
 #include <process.h>
+#else
+#include <unistd.h>
 #endif
 using namespace nglib;
 using namespace std;
@@ -126,14 +159,15 @@ using namespace std;
 //#define DUMP_TRIANGLES_SCRIPT "/tmp/trias.py" //!< debug AddIntVerticesInSolids()
 #endif
 
-TopTools_IndexedMapOfShape ShapesWithLocalSize;
-std::map<int,double> VertexId2LocalSize;
-std::map<int,double> EdgeId2LocalSize;
-std::map<int,double> FaceId2LocalSize;
-std::map<int,double> SolidId2LocalSize;
+// local sizes are thread-local as netgen::mparam they are applied to
+NG_THREAD_LOCAL TopTools_IndexedMapOfShape ShapesWithLocalSize;
+NG_THREAD_LOCAL std::map<int,double> VertexId2LocalSize;
+NG_THREAD_LOCAL std::map<int,double> EdgeId2LocalSize;
+NG_THREAD_LOCAL std::map<int,double> FaceId2LocalSize;
+NG_THREAD_LOCAL std::map<int,double> SolidId2LocalSize;
 
-std::vector<SMESHUtils::ControlPnt> ControlPoints;
-std::set<int> ShapesWithControlPoints; // <-- allows calling SetLocalSize() several times w/o recomputing ControlPoints
+NG_THREAD_LOCAL std::vector<SMESHUtils::ControlPnt> ControlPoints;
+NG_THREAD_LOCAL std::set<int> ShapesWithControlPoints; // <-- allows calling SetLocalSize() several times w/o recomputing ControlPoints
 
 namespace
 {
@@ -184,25 +218,28 @@ namespace
    * \brief return id of netgen point corresponding to SMDS node
    */
   //================================================================================
-  typedef map< const SMDS_MeshNode*, int > TNode2IdMap;
+  typedef NETGENPlugin_NodeIdMap TNode2IdMap;
 
-  int ngNodeId( const SMDS_MeshNode* node,
-                netgen::Mesh&        ngMesh,
-                TNode2IdMap&         nodeNgIdMap)
+  int ngNodeId( const SMDS_MeshNode*          node,
+                netgen::Mesh&                 ngMesh,
+                TNode2IdMap&                  nodeNgIdMap,
+                vector<const SMDS_MeshNode*>& nodeVec)
   {
-    int newNgId = ngMesh.GetNP() + 1;
-
-    TNode2IdMap::iterator node_id = nodeNgIdMap.insert( make_pair( node, newNgId )).first;
-
-    if ( node_id->second == newNgId)
+    int& ngId = nodeNgIdMap[ node ];
+    if ( ngId == 0 )
     {
+      ngId = ngMesh.GetNP() + 1;
 #if defined(DUMP_SEGMENTS) || defined(DUMP_TRIANGLES)
-      cout << "Ng " << newNgId << " - " << node;
+      cout << "Ng " << ngId << " - " << node;
 #endif
       netgen::MeshPoint p( netgen::Point<3> (node->X(), node->Y(), node->Z()) );
       ngMesh.AddPoint( p );
+
+      if ( (int) nodeVec.size() <= ngId )
+        nodeVec.resize( ngId + 1 );
+      nodeVec[ ngId ] = node;
     }
-    return node_id->second;
+    return ngId;
   }
 
   //================================================================================
@@ -390,6 +427,269 @@ namespace
   //   }
   // }
 
+  //================================================================================
+  /*!
+   * \brief Journal of size restrictions made by SetLocalSize() and
+   *        SetLocalSizeForChordalError().
+   *
+   * The restrictions depend on geometry and local size parameters only, so the
+   * journal is stored in NETGENPlugin_ResultCache and a next Compute() replays
+   * it instead of sampling the geometry again. Netgen parameters like minh are
+   * applied at replay, hence changing them does not invalidate the journal.
+   */
+  //================================================================================
+
+  class TSizeJournal
+  {
+  public:
+
+    enum TRecordType { POINT_SIZE, EDGE_POINT_SIZE, POINT_H, LINE_H, FACE_MAXH };
+
+    TSizeJournal( const std::string& pass, const TopoDS_Shape& shape );
+    ~TSizeJournal();
+
+    NETGENPlugin_ResultCache::Key& Key() { return _key; }
+
+    // Replay the cached journal or start recording a new one
+    bool Replay( netgen::OCCGeometry& occgeo, netgen::Mesh& ngMesh );
+
+    // Store recorded restrictions in the cache
+    void Store();
+
+    void Add( TRecordType type, double h, const gp_XYZ& p1, const gp_XYZ& p2 = gp_XYZ(), int flag = 0 )
+    {
+      TRecord r = { type, flag, h, { p1.X(), p1.Y(), p1.Z(), p2.X(), p2.Y(), p2.Z() }};
+      _records.push_back( r );
+    }
+
+  private:
+
+    struct TRecord
+    {
+      int    _type;
+      int    _flag; // overrideMinH or FACE index
+      double _h;
+      double _xyz[6];
+    };
+    bool                          _isOn;
+    NETGENPlugin_ResultCache::Key _key;
+    std::vector< TRecord >        _records;
+  };
+
+  // journal recording restrictions in the current thread
+  thread_local TSizeJournal* theSizeJournal = 0;
+
+  //================================================================================
+  /*!
+   * \brief Restrict size at a point by NETGENPlugin_Mesher::RestrictLocalSize()
+   */
+  //================================================================================
+
+  void restrictLocalSize( netgen::Mesh& mesh, const gp_XYZ& p, double size, bool overrideMinH = true )
+  {
+    if ( theSizeJournal )
+      theSizeJournal->Add( TSizeJournal::POINT_SIZE, size, p, gp_XYZ(), overrideMinH );
+    NETGENPlugin_Mesher::RestrictLocalSize( mesh, p, size, overrideMinH );
+  }
+
+  //================================================================================
+  /*!
+   * \brief Restrict size at a point of an edge and make sure netgen applies it
+   */
+  //================================================================================
+
+  void restrictLocalSizeOnEdge( netgen::Mesh& mesh, const gp_XYZ& p, double size, bool overrideMinH )
+  {
+    if ( theSizeJournal )
+      theSizeJournal->Add( TSizeJournal::EDGE_POINT_SIZE, size, p, gp_XYZ(), overrideMinH );
+    NETGENPlugin_Mesher::RestrictLocalSize( mesh, p, size, overrideMinH );
+    netgen::Point3d pi(p.X(), p.Y(), p.Z());
+    double resultSize = mesh.GetH(pi);
+    if ( resultSize - size > 0.1*size )
+      // netgen does restriction iff oldH/newH > 1.2 (localh.cpp:136)
+      NETGENPlugin_Mesher::RestrictLocalSize( mesh, p, resultSize/1.201, overrideMinH );
+  }
+
+  //================================================================================
+  /*!
+   * \brief Restrict size at a point by netgen::Mesh::RestrictLocalH()
+   */
+  //================================================================================
+
+  void restrictLocalH( netgen::Mesh& mesh, const gp_XYZ& p, double h )
+  {
+    if ( theSizeJournal )
+      theSizeJournal->Add( TSizeJournal::POINT_H, h, p );
+    mesh.RestrictLocalH( netgen::Point3d( p.X(), p.Y(), p.Z() ), h );
+  }
+
+  //================================================================================
+  /*!
+   * \brief Restrict size along a segment
+   */
+  //================================================================================
+
+  void restrictLocalHLine( netgen::Mesh& mesh, const gp_XYZ& p1, const gp_XYZ& p2, double h )
+  {
+    if ( theSizeJournal )
+      theSizeJournal->Add( TSizeJournal::LINE_H, h, p1, p2 );
+    mesh.RestrictLocalHLine( netgen::Point3d( p1.X(), p1.Y(), p1.Z() ),
+                             netgen::Point3d( p2.X(), p2.Y(), p2.Z() ), h );
+  }
+
+  //================================================================================
+  /*!
+   * \brief Set max size on a FACE of given index in occgeo.fmap
+   */
+  //================================================================================
+
+  void setFaceMaxH( netgen::OCCGeometry& occgeo, int faceNgID, double h )
+  {
+    if ( theSizeJournal )
+      theSizeJournal->Add( TSizeJournal::FACE_MAXH, h, gp_XYZ(), gp_XYZ(), faceNgID );
+#ifdef NETGEN_V6
+    occgeo.SetFaceMaxH( faceNgID-1, h, netgen::mparam );
+#else
+    occgeo.SetFaceMaxH( faceNgID, h );
+#endif
+  }
+
+  //================================================================================
+  /*!
+   * \brief Add a shape to a hash key. Triangulation is not taken into account.
+   *
+   * Serializing a shape is expensive, so the hash of the serialization is kept
+   * per TShape and Location. The cached shapes are kept alive for a TShape
+   * address not to be reused by another shape.
+   */
+  //================================================================================
+
+  void addShapeToKey( NETGENPlugin_ResultCache::Key& key, const TopoDS_Shape& shape )
+  {
+    typedef NCollection_DataMap< TopoDS_Shape, std::string, TopTools_ShapeMapHasher > TShapeHashes;
+    static TShapeHashes theShapeHashes;
+    static std::mutex   theMutex;
+    const int           theMaxNbShapes = 1000;
+
+    std::string shapeHash;
+    {
+      std::lock_guard<std::mutex> lock( theMutex );
+      if ( const std::string* hash = theShapeHashes.Seek( shape ))
+        shapeHash = *hash;
+    }
+    if ( shapeHash.empty() )
+    {
+      // orientation is not a part of the cached hash as shapes of different
+      // orientation are same for TopTools_ShapeMapHasher
+      TopoDS_Shape fwdShape = shape.Oriented( TopAbs_FORWARD );
+      BRepTools_ShapeSet shapeSet( /*isWithTriangles=*/Standard_False );
+      shapeSet.Add( fwdShape );
+      std::ostringstream stream;
+      shapeSet.Write( stream );
+      shapeSet.Write( fwdShape, stream );
+      NETGENPlugin_ResultCache::Key shapeKey;
+      shapeKey.Add( stream.str() );
+      shapeHash = shapeKey.ToString();
+
+      std::lock_guard<std::mutex> lock( theMutex );
+      if ( theShapeHashes.Extent() >= theMaxNbShapes )
+        theShapeHashes.Clear();
+      theShapeHashes.Bind( shape, shapeHash );
+    }
+    key.Add( shapeHash );
+    key.Add( int( shape.Orientation() ));
+  }
+
+  TSizeJournal::TSizeJournal( const std::string& pass, const TopoDS_Shape& shape ):
+    _isOn( NETGENPlugin_ResultCache::IsEnabled() && !shape.IsNull() )
+  {
+    if ( _isOn )
+    {
+      _key.Add( pass );
+      _key.Add( sizeof( TRecord ));
+      addShapeToKey( _key, shape );
+    }
+  }
+
+  TSizeJournal::~TSizeJournal()
+  {
+    if ( theSizeJournal == this )
+      theSizeJournal = 0;
+  }
+
+  bool TSizeJournal::Replay( netgen::OCCGeometry& occgeo, netgen::Mesh& ngMesh )
+  {
+    if ( !_isOn )
+      return false;
+
+    NETGENPlugin_ResultCache cache;
+    std::vector<char> data;
+    if ( !cache.Fetch( _key, data ) ||
+         data.size() < sizeof( uint64_t ) ||
+         ( data.size() - sizeof( uint64_t )) % sizeof( TRecord ))
+    {
+      _records.clear();
+      theSizeJournal = this; // record
+      return false;
+    }
+    const TRecord* r   = (const TRecord*)( data.data() + sizeof( uint64_t ));
+    const TRecord* end = (const TRecord*)( data.data() + data.size() );
+    for ( ; r < end; ++r )
+    {
+      gp_XYZ p1( r->_xyz[0], r->_xyz[1], r->_xyz[2] );
+      gp_XYZ p2( r->_xyz[3], r->_xyz[4], r->_xyz[5] );
+      switch ( r->_type ) {
+      case POINT_SIZE:      restrictLocalSize      ( ngMesh, p1, r->_h, r->_flag ); break;
+      case EDGE_POINT_SIZE: restrictLocalSizeOnEdge( ngMesh, p1, r->_h, r->_flag ); break;
+      case POINT_H:         restrictLocalH         ( ngMesh, p1, r->_h );           break;
+      case LINE_H:          restrictLocalHLine     ( ngMesh, p1, p2, r->_h );       break;
+      case FACE_MAXH:
+        if ( 0 < r->_flag && r->_flag <= occgeo.fmap.Extent() )
+          setFaceMaxH( occgeo, r->_flag, r->_h );
+        break;
+      default:;
+      }
+    }
+    return true;
+  }
+
+  void TSizeJournal::Store()
+  {
+    if ( theSizeJournal != this )
+      return;
+    theSizeJournal = 0;
+
+    uint64_t nbRecords = _records.size();
+    std::vector<char> data( sizeof( nbRecords ) + nbRecords * sizeof( TRecord ));
+    std::memcpy( data.data(), &nbRecords, sizeof( nbRecords ));
+    if ( nbRecords > 0 )
+      std::memcpy( data.data() + sizeof( nbRecords ), _records.data(), nbRecords * sizeof( TRecord ));
+
+    NETGENPlugin_ResultCache cache;
+    cache.Store( _key, data );
+  }
+
+  //================================================================================
+  /*!
+   * \brief Add local sizes defined by SetParameters() to a hash key
+   */
+  //================================================================================
+
+  void addLocalSizesToKey( NETGENPlugin_ResultCache::Key& key )
+  {
+    const std::map<int,double>* id2size[4] = { &VertexId2LocalSize, &EdgeId2LocalSize,
+                                               &FaceId2LocalSize,   &SolidId2LocalSize };
+    for ( int i = 0; i < 4; ++i )
+    {
+      key.Add( id2size[i]->size() );
+      for ( const std::pair< const int, double >& id_size : *id2size[i] )
+      {
+        key.Add( id_size.second );
+        addShapeToKey( key, ShapesWithLocalSize.FindKey( id_size.first ));
+      }
+    }
+  }
+
   //================================================================================
   /*!
    * \brief Restrict size of elements on the given edge
@@ -410,7 +710,7 @@ namespace
       TopoDS_Iterator vIt( edge );
       if ( !vIt.More() ) return;
       gp_Pnt p = BRep_Tool::Pnt( TopoDS::Vertex( vIt.Value() ));
-      NETGENPlugin_Mesher::RestrictLocalSize( mesh, p.XYZ(), size, overrideMinH );
+      restrictLocalSize( mesh, p.XYZ(), size, overrideMinH );
     }
     else
     {
@@ -420,12 +720,7 @@ namespace
       {
         Standard_Real u = u1 + delta*i;
         gp_Pnt p = curve->Value(u);
-        NETGENPlugin_Mesher::RestrictLocalSize( mesh, p.XYZ(), size, overrideMinH );
-        netgen::Point3d pi(p.X(), p.Y(), p.Z());
-        double resultSize = mesh.GetH(pi);
-        if ( resultSize - size > 0.1*size )
-          // netgen does restriction iff oldH/newH > 1.2 (localh.cpp:136)
-          NETGENPlugin_Mesher::RestrictLocalSize( mesh, p.XYZ(), resultSize/1.201, overrideMinH );
+        restrictLocalSizeOnEdge( mesh, p.XYZ(), size, overrideMinH );
       }
     }
   }
@@ -443,6 +738,200 @@ namespace
     return Sqrt( 3 ) * Sqrt( chordalError * ( 2 * radius - chordalError ));
   }
 
+  //================================================================================
+  /*!
+   * \brief Size restriction at a point or along a segment
+   */
+  //================================================================================
+
+  struct TSizeSample
+  {
+    gp_XYZ _p1, _p2;
+    double _h;
+    bool   _isLine;
+  };
+
+  //================================================================================
+  /*!
+   * \brief Compute size restrictions achieving a chordal error on a triangulated FACE.
+   *        Called in parallel threads.
+   */
+  //================================================================================
+
+  void sampleSizeForChordalError( const TopoDS_Face&          face,
+                                  const double                chordalError,
+                                  const double                sizeCoef,
+                                  std::vector< TSizeSample >& samples )
+  {
+    try
+    {
+      OCC_CATCH_SIGNALS;
+
+      TopLoc_Location loc;
+      Handle(Poly_Triangulation) triangulation = BRep_Tool::Triangulation ( face, loc );
+      if ( triangulation.IsNull() ) return;
+
+      BRepAdaptor_Surface surf( face, false );
+      BRepLProp_SLProps surfProp( 2, 1e-6 );
+      surfProp.SetSurface( surf );
+
+      gp_XY    uv[3];
+      gp_XYZ    p[3];
+      double size[3];
+      for ( int i = 1; i <= triangulation->NbTriangles(); ++i )
+      {
+        Standard_Integer n1,n2,n3;
+        triangulation->Triangles()(i).Get( n1,n2,n3 );
+#if OCC_VERSION_LARGE < 0x07060000
+        p [0] = triangulation->Nodes()(n1).Transformed(loc).XYZ();
+        p [1] = triangulation->Nodes()(n2).Transformed(loc).XYZ();
+        p [2] = triangulation->Nodes()(n3).Transformed(loc).XYZ();
+        uv[0] = triangulation->UVNodes()(n1).XY();
+        uv[1] = triangulation->UVNodes()(n2).XY();
+        uv[2] = triangulation->UVNodes()(n3).XY();
+#else
+        p[0] = triangulation->Node(n1).Transformed(loc).XYZ();
+        p[1] = triangulation->Node(n2).Transformed(loc).XYZ();
+        p[2] = triangulation->Node(n3).Transformed(loc).XYZ();
+        uv[0] = triangulation->UVNode(n1).XY();
+        uv[1] = triangulation->UVNode(n2).XY();
+        uv[2] = triangulation->UVNode(n3).XY();
+#endif
+        surfProp.SetParameters( uv[0].X(), uv[0].Y() );
+        if ( !surfProp.IsCurvatureDefined() )
+          break;
+
+        for ( int n = 0; n < 3; ++n ) // get size at triangle nodes
+        {
+          surfProp.SetParameters( uv[n].X(), uv[n].Y() );
+          double maxCurv = Max( Abs( surfProp.MaxCurvature()), Abs( surfProp.MinCurvature() ));
+          size[n] = elemSizeForChordalError( chordalError, 1 / maxCurv );
+        }
+        for ( int n1 = 0; n1 < 3; ++n1 ) // limit size along each triangle edge
+        {
+          int n2 = ( n1 + 1 ) % 3;
+          double minSize = size[n1], maxSize = size[n2];
+          if ( size[n1] > size[n2] )
+            minSize = size[n2], maxSize = size[n1];
+
+          if ( maxSize / minSize < 1.2 ) // netgen ignores size difference < 1.2
+          {
+            samples.push_back({ p[n1], p[n2], sizeCoef * minSize, true });
+          }
+          else
+          {
+            gp_XY uvVec( uv[n2] - uv[n1] );
+            double len = ( p[n1] - p[n2] ).Modulus();
+            int     nb = int( len / minSize ) + 1;
+            for ( int j = 0; j <= nb; ++j )
+            {
+              double r = double( j ) / nb;
+              gp_XY uvj = uv[n1] + r * uvVec;
+
+              surfProp.SetParameters( uvj.X(), uvj.Y() );
+              double maxCurv = Max( Abs( surfProp.MaxCurvature()), Abs( surfProp.MinCurvature() ));
+              double       h = elemSizeForChordalError( chordalError, 1 / maxCurv );
+
+              samples.push_back({ surfProp.Value().XYZ(), gp_XYZ(), h * sizeCoef, false });
+            }
+          }
+        }
+      }
+    }
+    catch ( Standard_Failure& ex )
+    {
+      // keep samples computed so far
+      MESSAGE( "Curvature sampling for chordal error failed: " << ex.GetMessageString() );
+    }
+  }
+
+  //================================================================================
+  /*!
+   * \brief Interleave bits of 21-bit coordinates to get a Morton code
+   */
+  //================================================================================
+
+  uint64_t spreadBits( uint64_t x )
+  {
+    x &= 0x1fffff;
+    x = ( x | x << 32 ) & 0x1f00000000ffffULL;
+    x = ( x | x << 16 ) & 0x1f0000ff0000ffULL;
+    x = ( x | x << 8  ) & 0x100f00f00f00f00fULL;
+    x = ( x | x << 4  ) & 0x10c30c30c30c30c3ULL;
+    x = ( x | x << 2  ) & 0x1249249249249249ULL;
+    return x;
+  }
+
+  //================================================================================
+  /*!
+   * \brief Sort items along the Morton (Z-order) curve so that consecutive items
+   *        are close in space
+   */
+  //================================================================================
+
+  template< class TItem, class TGetPoint >
+  void sortByMortonCode( std::vector< TItem >& items, TGetPoint getPoint )
+  {
+    if ( items.size() < 2 )
+      return;
+    Bnd_B3d box;
+    for ( const TItem& item : items )
+      box.Add( getPoint( item ));
+    const gp_XYZ  minCorner = box.CornerMin();
+    const gp_XYZ       size = box.CornerMax() - minCorner;
+    const double   maxCoord = double( 0x1fffff );
+    const double      scale = maxCoord / Max( size.X(), Max( size.Y(), Max( size.Z(), 1e-100 )));
+
+    std::vector< std::pair< uint64_t, size_t > > codes( items.size() );
+    for ( size_t i = 0; i < items.size(); ++i )
+    {
+      gp_XYZ p = ( getPoint( items[i] ) - minCorner ) * scale;
+      codes[i].first = ( spreadBits( uint64_t( Min( p.X(), maxCoord ))) |
+                         spreadBits( uint64_t( Min( p.Y(), maxCoord ))) << 1 |
+                         spreadBits( uint64_t( Min( p.Z(), maxCoord ))) << 2 );
+      codes[i].second = i;
+    }
+    std::sort( codes.begin(), codes.end() );
+
+    std::vector< TItem > sorted;
+    sorted.reserve( items.size() );
+    for ( size_t i = 0; i < codes.size(); ++i )
+      sorted.push_back( items[ codes[i].second ]);
+    items.swap( sorted );
+  }
+
+  //================================================================================
+  /*!
+   * \brief Sample FACEs and SOLIDs with control points in parallel threads
+   *        and add the points to ControlPoints
+   */
+  //================================================================================
+
+  void addControlPoints( const std::vector< std::pair< TopoDS_Shape, double > >& shapeSizes )
+  {
+    // sampling triangulates shapes, so copies are sampled not to modify
+    // triangulation of shapes shared by threads
+    std::vector< TopoDS_Shape > shapes( shapeSizes.size() );
+    for ( size_t iS = 0; iS < shapeSizes.size(); ++iS )
+      shapes[ iS ] = BRepBuilderAPI_Copy( shapeSizes[ iS ].first );
+
+    std::vector< std::vector< SMESHUtils::ControlPnt > > shapePoints( shapeSizes.size() );
+    NETGENPlugin_NetgenContext::ParallelFor( shapes.size(), [&]( size_t iS )
+    {
+      if ( shapes[ iS ].ShapeType() == TopAbs_FACE )
+        SMESHUtils::createPointsSampleFromFace ( TopoDS::Face( shapes[ iS ]),
+                                                 shapeSizes[ iS ].second, shapePoints[ iS ]);
+      else
+        SMESHUtils::createPointsSampleFromSolid( TopoDS::Solid( shapes[ iS ]),
+                                                 shapeSizes[ iS ].second, shapePoints[ iS ]);
+    });
+
+    for ( size_t iS = 0; iS < shapePoints.size(); ++iS )
+      ControlPoints.insert( ControlPoints.end(), shapePoints[ iS ].begin(), shapePoints[ iS ].end() );
+    // sort for locality of LocalH tree access at RestrictLocalSize()
+    sortByMortonCode( ControlPoints, []( const SMESHUtils::ControlPnt& p ) { return p.XYZ(); });
+  }
+
   //=============================================================================
   /*!
    *
@@ -513,12 +1002,299 @@ namespace
     return faceNgID;
   }
 
-} // namespace
+  //================================================================================
+  /*!
+   * \brief Spatial hash of points used to find a point coinciding with a given one.
+   *        TPoints gives gp_XYZ of i-th point by operator[], it is not copied.
+   */
+  //================================================================================
 
+  template< class TPoints >
+  class TSpatialHash
+  {
+  public:
+    TSpatialHash( const TPoints& points, size_t nbPoints, double tol ):
+      _points( points ), _nbPoints( nbPoints ), _tol2( tol * tol )
+    {
+      double maxCoord = 0;
+      for ( size_t i = 0; i < _nbPoints; ++i )
+      {
+        gp_XYZ p = _points[ i ];
+        maxCoord = Max( maxCoord, Max( Abs( p.X() ), Max( Abs( p.Y() ), Abs( p.Z() ))));
+      }
+      // cell size is not less than tol to find a point in neighbor cells
+      // and large enough to keep cell indices far from integer overflow
+      _cellSize = Max( tol, 1e-12 * maxCoord );
+      _cells.reserve( _nbPoints );
+      for ( size_t i = 0; i < _nbPoints; ++i )
+        _cells[ cell( _points[ i ])].push_back( i );
+    }
 
+    //! return the least index, not less than minIndex, of a point at tol from p, or NbPoints()
+    size_t Find( const gp_XYZ& p, size_t minIndex = 0 ) const
+    {
+      size_t found = _nbPoints;
+      TCell c0 = cell( p ), c;
+      for ( c[0] = c0[0] - 1; c[0] <= c0[0] + 1; ++c[0] )
+        for ( c[1] = c0[1] - 1; c[1] <= c0[1] + 1; ++c[1] )
+          for ( c[2] = c0[2] - 1; c[2] <= c0[2] + 1; ++c[2] )
+          {
+            auto c2p = _cells.find( c );
+            if ( c2p == _cells.end() )
+              continue;
+            for ( size_t i : c2p->second )
+              if ( i >= minIndex && i < found &&
+                   ( gp_XYZ( _points[ i ]) - p ).SquareModulus() <= _tol2 )
+                found = i;
+          }
+      return found;
+    }
 
-//=============================================================================
-/*!
+    size_t NbPoints() const { return _nbPoints; }
+
+  private:
+    typedef std::array< long long, 3 > TCell;
+
+    struct TCellHash
+    {
+      // unsigned arithmetic wraps around while signed overflow is undefined
+      size_t operator()( const TCell& c ) const
+      {
+        return size_t(( uint64_t( c[0] ) * 73856093ULL ) ^
+                      ( uint64_t( c[1] ) * 19349663ULL ) ^
+                      ( uint64_t( c[2] ) * 83492791ULL ));
+      }
+    };
+
+    TCell cell( const gp_XYZ& p ) const
+    {
+      return {{ (long long) floor( p.X() / _cellSize ),
+                (long long) floor( p.Y() / _cellSize ),
+                (long long) floor( p.Z() / _cellSize ) }};
+    }
+
+    const TPoints&                                              _points;
+    size_t                                                      _nbPoints;
+    double                                                      _tol2;
+    double                                                      _cellSize;
+    std::unordered_map< TCell, std::vector<size_t>, TCellHash > _cells;
+  };
+
+  //! nodes as a point source of TSpatialHash
+  struct TNodePoints
+  {
+    const std::vector< const SMDS_MeshNode* >& _nodes;
+    SMESH_NodeXYZ operator[]( size_t i ) const { return SMESH_NodeXYZ( _nodes[ i ]); }
+  };
+
+  //================================================================================
+  /*!
+   * \brief Volume mesh of a solid computed in a separate thread
+   */
+  //================================================================================
+
+  struct TSolidJob
+  {
+    int                             _domain;   // solid index in netgen mesh
+    std::vector< int >              _faces;    // surface elements bounding the solid
+    std::unique_ptr< netgen::Mesh > _ngMesh;   // mesh of the solid
+    std::vector< int >              _solid2ng; // point index in _ngMesh -> index in the main mesh
+    int                             _error;
+    SMESH_Comment                   _comment;
+
+    TSolidJob( int domain ): _domain( domain ), _error( 0 ) {}
+  };
+
+  //================================================================================
+  /*!
+   * \brief Build an own local size of a solid mesh, since netgen modifies it at
+   *        volume meshing. Sizes of the main mesh are sampled at the solid surface
+   *        points and on a bounded lattice within the solid bounding box.
+   */
+  //================================================================================
+
+  void buildSolidLocalH( const netgen::Mesh& ngMesh, netgen::Mesh& solidMesh )
+  {
+    NETGENPlugin_NetgenLibWrapper::CalcLocalH( &solidMesh );
+    if ( !ngMesh.LocalHFunctionGenerated() )
+      return;
+
+    Bnd_Box box;
+    for ( int i = 1; i <= solidMesh.GetNP(); ++i )
+    {
+      const netgen::MeshPoint& p = solidMesh.Point( i );
+      solidMesh.RestrictLocalH( p, ngMesh.GetH( p ));
+      box.Add( gp_Pnt( p(0), p(1), p(2) ));
+    }
+    if ( box.IsVoid() )
+      return;
+
+    const int nbDiv = 16;
+    double xMin, yMin, zMin, xMax, yMax, zMax;
+    box.Get( xMin, yMin, zMin, xMax, yMax, zMax );
+    for ( int i = 0; i <= nbDiv; ++i )
+      for ( int j = 0; j <= nbDiv; ++j )
+        for ( int k = 0; k <= nbDiv; ++k )
+        {
+          netgen::Point3d p( xMin + ( xMax - xMin ) * i / nbDiv,
+                             yMin + ( yMax - yMin ) * j / nbDiv,
+                             zMin + ( zMax - zMin ) * k / nbDiv );
+          solidMesh.RestrictLocalH( p, ngMesh.GetH( p ));
+        }
+  }
+
+  //================================================================================
+  /*!
+   * \brief Copy surface elements bounding a solid to a separate netgen mesh.
+   *        The solid gets index 1 in the new mesh.
+   */
+  //================================================================================
+
+  void extractSolidSurface( const netgen::Mesh& ngMesh, TSolidJob& job )
+  {
+    job._solid2ng.clear();
+    for ( int iF : job._faces )
+    {
+      const netgen::Element2d& elem = ngMesh.SurfaceElement( iF );
+      for ( int j = 1; j <= elem.GetNP(); ++j )
+        job._solid2ng.push_back( elem.PNum( j ));
+    }
+    std::sort( job._solid2ng.begin(), job._solid2ng.end() );
+    job._solid2ng.erase( std::unique( job._solid2ng.begin(), job._solid2ng.end() ),
+                         job._solid2ng.end() );
+    job._solid2ng.insert( job._solid2ng.begin(), 0 ); // netgen indices start from 1
+
+    job._ngMesh.reset( new netgen::Mesh );
+    netgen::Mesh& solidMesh = *job._ngMesh;
+    for ( size_t i = 1; i < job._solid2ng.size(); ++i )
+    {
+      const netgen::MeshPoint& p = ngMesh.Point( job._solid2ng[ i ]);
+      solidMesh.AddPoint( p, p.GetLayer(), p.Type() );
+    }
+
+    std::map< int, int > ng2solidFD;
+    for ( int iF : job._faces )
+    {
+      netgen::Element2d elem = ngMesh.SurfaceElement( iF );
+      int& solidFD = ng2solidFD[ elem.GetIndex() ];
+      if ( !solidFD )
+      {
+        netgen::FaceDescriptor fd = ngMesh.GetFaceDescriptor( elem.GetIndex() );
+        fd.SetDomainIn ( fd.DomainIn()  == job._domain ? 1 : 0 );
+        fd.SetDomainOut( fd.DomainOut() == job._domain ? 1 : 0 );
+        solidFD = solidMesh.AddFaceDescriptor( fd );
+      }
+      elem.SetIndex( solidFD );
+      for ( int j = 1; j <= elem.GetNP(); ++j )
+      {
+        std::vector< int >::iterator i = std::lower_bound( job._solid2ng.begin() + 1,
+                                                           job._solid2ng.end(), (int) elem.PNum( j ));
+        elem.PNum( j ) = int( i - job._solid2ng.begin() );
+      }
+      solidMesh.AddSurfaceElement( elem );
+    }
+  }
+
+  //================================================================================
+  /*!
+   * \brief Add new points and volume elements of a solid mesh to the main mesh
+   */
+  //================================================================================
+
+  void addSolidVolume( netgen::Mesh& ngMesh, TSolidJob& job )
+  {
+    netgen::Mesh& solidMesh = *job._ngMesh;
+    const int nbSurfPoints = (int) job._solid2ng.size() - 1;
+    for ( int i = nbSurfPoints + 1; i <= solidMesh.GetNP(); ++i )
+      job._solid2ng.push_back( ngMesh.AddPoint( solidMesh.Point( i ),
+                                                solidMesh.Point( i ).GetLayer(),
+                                                solidMesh.Point( i ).Type() ));
+    for ( int i = 1; i <= solidMesh.GetNE(); ++i )
+    {
+      netgen::Element elem = solidMesh.VolumeElement( i );
+      if ( elem.IsDeleted() )
+        continue;
+      for ( int j = 1; j <= elem.GetNP(); ++j )
+        elem.PNum( j ) = job._solid2ng[ elem.PNum( j )];
+      elem.SetIndex( job._domain );
+      ngMesh.AddVolumeElement( elem );
+    }
+    job._ngMesh.reset();
+  }
+
+  //================================================================================
+  /*!
+   * \brief Return nodes of a sub-mesh
+   */
+  //================================================================================
+
+  std::vector< const SMDS_MeshNode* > subMeshNodes( SMESHDS_Mesh* meshDS, const TopoDS_Shape& shape )
+  {
+    std::vector< const SMDS_MeshNode* > nodes;
+    if ( SMESHDS_SubMesh* sm = meshDS->MeshElements( shape ))
+    {
+      nodes.reserve( sm->NbNodes() );
+      for ( SMDS_NodeIteratorPtr nIt = sm->GetNodes(); nIt->more(); )
+        nodes.push_back( nIt->next() );
+    }
+    return nodes;
+  }
+
+  //================================================================================
+  /*!
+   * \brief Return nodes on the boundary of a shape
+   */
+  //================================================================================
+
+  std::vector< const SMDS_MeshNode* > boundaryNodes( SMESHDS_Mesh* meshDS, const TopoDS_Shape& shape )
+  {
+    std::vector< const SMDS_MeshNode* > nodes;
+    TopTools_IndexedMapOfShape subShapes;
+    TopExp::MapShapes( shape, subShapes );
+    for ( int i = 1; i <= subShapes.Extent(); ++i )
+      if ( !subShapes( i ).IsSame( shape ))
+      {
+        std::vector< const SMDS_MeshNode* > subNodes = subMeshNodes( meshDS, subShapes( i ));
+        nodes.insert( nodes.end(), subNodes.begin(), subNodes.end() );
+      }
+    return nodes;
+  }
+
+  //================================================================================
+  /*!
+   * \brief VERTEXes of a shape described by values invariant to rigid motion
+   *        and by their center, used to find periodic images of the shape
+   */
+  //================================================================================
+
+  struct TVertexCloud
+  {
+    int    _nbVertices;
+    double _spread; // sum of square distances of VERTEXes from their center
+    gp_XYZ _center;
+
+    void Init( const TopoDS_Shape& shape )
+    {
+      TopTools_IndexedMapOfShape vertices;
+      TopExp::MapShapes( shape, TopAbs_VERTEX, vertices );
+      _nbVertices = vertices.Extent();
+      _center.SetCoord( 0, 0, 0 );
+      _spread = 0;
+      for ( int i = 1; i <= _nbVertices; ++i )
+        _center += BRep_Tool::Pnt( TopoDS::Vertex( vertices( i ))).XYZ();
+      if ( _nbVertices > 0 )
+        _center /= _nbVertices;
+      for ( int i = 1; i <= _nbVertices; ++i )
+        _spread += ( BRep_Tool::Pnt( TopoDS::Vertex( vertices( i ))).XYZ() - _center ).SquareModulus();
+    }
+  };
+
+} // namespace
+
+
+
+//=============================================================================
+/*!
  *
  */
 //=============================================================================
@@ -535,9 +1311,6 @@ NETGENPlugin_Mesher::NETGENPlugin_Mesher (SMESH_Mesh*         mesh,
     _chordalError(-1), // means disabled
     _ngMesh(NULL),
     _occgeom(NULL),
-    _curShapeIndex(-1),
-    _progressTic(1),
-    _totalTime(1.0),
     _simpleHyp(NULL),
     _viscousLayersHyp(NULL),
     _ptrToMe(NULL)
@@ -612,7 +1385,7 @@ void NETGENPlugin_Mesher::SetDefaultParameters()
     mparams.quad          = NETGENPlugin_Hypothesis_2D::GetDefaultQuadAllowed();
   _fineness               = NETGENPlugin_Hypothesis::GetDefaultFineness();
   mparams.uselocalh       = NETGENPlugin_Hypothesis::GetDefaultSurfaceCurvature();
-  netgen::merge_solids    = NETGENPlugin_Hypothesis::GetDefaultFuseEdges();
+  NETGENPlugin_NetgenContext::SetMergeSolids( NETGENPlugin_Hypothesis::GetDefaultFuseEdges() );
   // Unused argument but set 0 to initialise it
   mparams.elementorder = 0;
 
@@ -657,7 +1430,7 @@ void NETGENPlugin_Mesher::SetParameters(const NETGENPlugin_Hypothesis* hyp)
     _optimize                  = hyp->GetOptimize();
     _fineness                  = hyp->GetFineness();
     mparams.uselocalh          = hyp->GetSurfaceCurvature();
-    netgen::merge_solids       = hyp->GetFuseEdges();
+    NETGENPlugin_NetgenContext::SetMergeSolids( hyp->GetFuseEdges() );
     _chordalError              = hyp->GetChordalErrorEnabled() ? hyp->GetChordalError() : -1.;
     mparams.optsteps2d         = _optimize ? hyp->GetNbSurfOptSteps() : 0;
     mparams.optsteps3d         = _optimize ? hyp->GetNbVolOptSteps()  : 0;
@@ -679,22 +1452,12 @@ void NETGENPlugin_Mesher::SetParameters(const NETGENPlugin_Hypothesis* hyp)
     const NETGENPlugin_Hypothesis::TLocalSize& localSizes = hyp->GetLocalSizesAndEntries();
     if ( !localSizes.empty() )
     {
-      SMESH_Gen_i* smeshGen_i = SMESH_Gen_i::GetSMESHGen();
       NETGENPlugin_Hypothesis::TLocalSize::const_iterator it = localSizes.begin();
       for ( ; it != localSizes.end() ; it++)
       {
         std::string entry = (*it).first;
         double        val = (*it).second;
-        // --
-        GEOM::GEOM_Object_var aGeomObj;
-        SALOMEDS::SObject_var aSObj = SMESH_Gen_i::GetSMESHGen()->getStudyServant()->FindObjectID( entry.c_str() );
-        if ( !aSObj->_is_nil() ) {
-          CORBA::Object_var obj = aSObj->GetObject();
-          aGeomObj = GEOM::GEOM_Object::_narrow(obj);
-          aSObj->UnRegister();
-        }
-        TopoDS_Shape S = smeshGen_i->GeomObjectToShape( aGeomObj.in() );
-        setLocalSize(S, val);
+        setLocalSize( GetShapeByEntry( entry ), val );
       }
     }
   }
@@ -706,6 +1469,28 @@ void NETGENPlugin_Mesher::SetParameters(const NETGENPlugin_Hypothesis* hyp)
 #endif
 }
 
+//================================================================================
+/*!
+ * \brief Return a shape of a GEOM object published in the study
+ */
+//================================================================================
+
+TopoDS_Shape NETGENPlugin_Mesher::GetShapeByEntry(const std::string& entry)
+{
+  SMESH_Gen_i* smeshGen_i = SMESH_Gen_i::GetSMESHGen();
+  if ( !smeshGen_i )
+    return TopoDS_Shape();
+
+  GEOM::GEOM_Object_var aGeomObj;
+  SALOMEDS::SObject_var aSObj = smeshGen_i->getStudyServant()->FindObjectID( entry.c_str() );
+  if ( !aSObj->_is_nil() ) {
+    CORBA::Object_var obj = aSObj->GetObject();
+    aGeomObj = GEOM::GEOM_Object::_narrow(obj);
+    aSObj->UnRegister();
+  }
+  return smeshGen_i->GeomObjectToShape( aGeomObj.in() );
+}
+
 //=============================================================================
 /*!
  * Pass simple parameters to NETGEN
@@ -739,6 +1524,14 @@ void NETGENPlugin_Mesher::SetParameters(const StdMeshers_ViscousLayers* hyp )
 void NETGENPlugin_Mesher::SetLocalSize( netgen::OCCGeometry& occgeo,
                                         netgen::Mesh&        ngMesh)
 {
+  if ( ShapesWithLocalSize.IsEmpty() )
+    return;
+
+  TSizeJournal journal( "SetLocalSize", occgeo.shape );
+  addLocalSizesToKey( journal.Key() );
+  if ( journal.Replay( occgeo, ngMesh ))
+    return;
+
   // edges
   std::map<int,double>::const_iterator it;
   for( it=EdgeId2LocalSize.begin(); it!=EdgeId2LocalSize.end(); it++)
@@ -755,9 +1548,10 @@ void NETGENPlugin_Mesher::SetLocalSize( netgen::OCCGeometry& occgeo,
     double hi = (*it).second;
     const TopoDS_Shape& shape = ShapesWithLocalSize.FindKey(key);
     gp_Pnt p = BRep_Tool::Pnt( TopoDS::Vertex(shape) );
-    NETGENPlugin_Mesher::RestrictLocalSize( ngMesh, p.XYZ(), hi );
+    restrictLocalSize( ngMesh, p.XYZ(), hi );
   }
   // faces
+  std::vector< std::pair< TopoDS_Shape, double > > shapesToSample; // to sample with ControlPoints
   for(it=FaceId2LocalSize.begin(); it!=FaceId2LocalSize.end(); it++)
   {
     int    key = (*it).first;
@@ -766,17 +1560,13 @@ void NETGENPlugin_Mesher::SetLocalSize( netgen::OCCGeometry& occgeo,
     int faceNgID = occgeo.fmap.FindIndex(shape);
     if ( faceNgID >= 1 )
     {
-#ifdef NETGEN_V6
-      occgeo.SetFaceMaxH(faceNgID-1, val, netgen::mparam);
-#else
-      occgeo.SetFaceMaxH(faceNgID, val);
-#endif
+      setFaceMaxH( occgeo, faceNgID, val );
       for ( TopExp_Explorer edgeExp( shape, TopAbs_EDGE ); edgeExp.More(); edgeExp.Next() )
         setLocalSize( TopoDS::Edge( edgeExp.Current() ), val, ngMesh );
     }
     else if ( !ShapesWithControlPoints.count( key ))
     {
-      SMESHUtils::createPointsSampleFromFace( TopoDS::Face( shape ), val, ControlPoints );
+      shapesToSample.push_back( std::make_pair( shape, val ));
       ShapesWithControlPoints.insert( key );
     }
   }
@@ -788,16 +1578,19 @@ void NETGENPlugin_Mesher::SetLocalSize( netgen::OCCGeometry& occgeo,
     if ( !ShapesWithControlPoints.count( key ))
     {
       const TopoDS_Shape& shape = ShapesWithLocalSize.FindKey(key);
-      SMESHUtils::createPointsSampleFromSolid( TopoDS::Solid( shape ), val, ControlPoints );
+      shapesToSample.push_back( std::make_pair( shape, val ));
       ShapesWithControlPoints.insert( key );
     }
   }
+  if ( !shapesToSample.empty() )
+    addControlPoints( shapesToSample );
 
   if ( !ControlPoints.empty() )
   {
     for ( size_t i = 0; i < ControlPoints.size(); ++i )
-      NETGENPlugin_Mesher::RestrictLocalSize( ngMesh, ControlPoints[i].XYZ(), ControlPoints[i].Size() );
+      restrictLocalSize( ngMesh, ControlPoints[i].XYZ(), ControlPoints[i].Size() );
   }
+  journal.Store();
   return;
 }
 
@@ -813,6 +1606,11 @@ void NETGENPlugin_Mesher::SetLocalSizeForChordalError( netgen::OCCGeometry& occg
   if ( _chordalError <= 0. )
     return;
 
+  TSizeJournal journal( "SetLocalSizeForChordalError", occgeo.shape );
+  journal.Key().Add( _chordalError );
+  if ( journal.Replay( occgeo, ngMesh ))
+    return;
+
   TopLoc_Location loc;
   BRepLProp_SLProps surfProp( 2, 1e-6 );
   const double sizeCoef = 0.95;
@@ -835,11 +1633,7 @@ void NETGENPlugin_Mesher::SetLocalSizeForChordalError( netgen::OCCGeometry& occg
       surfProp.SetParameters( 0, 0 );
       double maxCurv = Max( Abs( surfProp.MaxCurvature()), Abs( surfProp.MinCurvature() ));
       double    size = elemSizeForChordalError( _chordalError, 1 / maxCurv );
-#ifdef NETGEN_V6
-      occgeo.SetFaceMaxH( i-1, size * sizeCoef, netgen::mparam );
-#else
-      occgeo.SetFaceMaxH( i, size * sizeCoef );
-#endif
+      setFaceMaxH( occgeo, i, size * sizeCoef );
       // limit size one edges
       TopTools_MapOfShape edgeMap;
       for ( TopExp_Explorer eExp( face, TopAbs_EDGE ); eExp.More(); eExp.Next() )
@@ -873,164 +1667,338 @@ void NETGENPlugin_Mesher::SetLocalSizeForChordalError( netgen::OCCGeometry& occg
                               /*theAngDeflection = */ 0.5,
                               /*isInParallel = */Standard_True);
 
-    // loop on FACEs
+    std::vector< TopoDS_Face > faces;
     for ( TopExp_Explorer fExp( allFacesCompCopy, TopAbs_FACE ); fExp.More(); fExp.Next() )
+      faces.push_back( TopoDS::Face( fExp.Current() ));
+
+    // sample curvature of FACEs in parallel threads
+    std::vector< std::vector< TSizeSample > > faceSamples( faces.size() );
+    const double chordalError = _chordalError;
+    NETGENPlugin_NetgenContext::ParallelFor( faces.size(), [&]( size_t iF )
     {
-      const TopoDS_Face& face = TopoDS::Face( fExp.Current() );
-      Handle(Poly_Triangulation) triangulation = BRep_Tool::Triangulation ( face, loc );
-      if ( triangulation.IsNull() ) continue;
+      sampleSizeForChordalError( faces[ iF ], chordalError, sizeCoef, faceSamples[ iF ]);
+    });
 
-      BRepAdaptor_Surface surf( face, false );
-      surfProp.SetSurface( surf );
+    // restrict size at spatially sorted samples for locality of LocalH tree access
+    std::vector< TSizeSample > samples;
+    for ( size_t iF = 0; iF < faceSamples.size(); ++iF )
+    {
+      samples.insert( samples.end(), faceSamples[ iF ].begin(), faceSamples[ iF ].end() );
+      std::vector< TSizeSample >().swap( faceSamples[ iF ]);
+    }
+    sortByMortonCode( samples, []( const TSizeSample& s ) { return s._p1; });
 
-      gp_XY    uv[3];
-      gp_XYZ    p[3];
-      double size[3];
-      for ( int i = 1; i <= triangulation->NbTriangles(); ++i )
-      {
-        Standard_Integer n1,n2,n3;
-        triangulation->Triangles()(i).Get( n1,n2,n3 );
-#if OCC_VERSION_LARGE < 0x07060000
-        p [0] = triangulation->Nodes()(n1).Transformed(loc).XYZ();
-        p [1] = triangulation->Nodes()(n2).Transformed(loc).XYZ();
-        p [2] = triangulation->Nodes()(n3).Transformed(loc).XYZ();
-        uv[0] = triangulation->UVNodes()(n1).XY();
-        uv[1] = triangulation->UVNodes()(n2).XY();
-        uv[2] = triangulation->UVNodes()(n3).XY();
-#else
-        p[0] = triangulation->Node(n1).Transformed(loc).XYZ();
-        p[1] = triangulation->Node(n2).Transformed(loc).XYZ();
-        p[2] = triangulation->Node(n3).Transformed(loc).XYZ();
-        uv[0] = triangulation->UVNode(n1).XY();
-        uv[1] = triangulation->UVNode(n2).XY();
-        uv[2] = triangulation->UVNode(n3).XY();
-#endif
-        surfProp.SetParameters( uv[0].X(), uv[0].Y() );
-        if ( !surfProp.IsCurvatureDefined() )
-          break;
+    for ( const TSizeSample& sample : samples )
+      if ( sample._isLine )
+        restrictLocalHLine( ngMesh, sample._p1, sample._p2, sample._h );
+      else
+        restrictLocalH( ngMesh, sample._p1, sample._h );
+  }
+  journal.Store();
+}
 
-        for ( int n = 0; n < 3; ++n ) // get size at triangle nodes
-        {
-          surfProp.SetParameters( uv[n].X(), uv[n].Y() );
-          double maxCurv = Max( Abs( surfProp.MaxCurvature()), Abs( surfProp.MinCurvature() ));
-          size[n] = elemSizeForChordalError( _chordalError, 1 / maxCurv );
-        }
-        for ( int n1 = 0; n1 < 3; ++n1 ) // limit size along each triangle edge
-        {
-          int n2 = ( n1 + 1 ) % 3;
-          double minSize = size[n1], maxSize = size[n2];
-          if ( size[n1] > size[n2] )
-            minSize = size[n2], maxSize = size[n1];
+namespace
+{
+  //================================================================================
+  /*!
+   * \brief Data of a shape given to PrepareOCCgeometry()
+   */
+  //================================================================================
 
-          if ( maxSize / minSize < 1.2 ) // netgen ignores size difference < 1.2
-          {
-            ngMesh.RestrictLocalHLine ( netgen::Point3d( p[n1].X(), p[n1].Y(), p[n1].Z() ),
-                                        netgen::Point3d( p[n2].X(), p[n2].Y(), p[n2].Z() ),
-                                        sizeCoef * minSize );
-          }
-          else
-          {
-            gp_XY uvVec( uv[n2] - uv[n1] );
-            double len = ( p[n1] - p[n2] ).Modulus();
-            int     nb = int( len / minSize ) + 1;
-            for ( int j = 0; j <= nb; ++j )
-            {
-              double r = double( j ) / nb;
-              gp_XY uvj = uv[n1] + r * uvVec;
+  struct TGeomIndex
+  {
+    struct TSubShape
+    {
+      TopoDS_Shape _shape;    // as stored by SMESH_subMesh
+      TopoDS_Shape _oriented; // as added to occgeo maps
+      int          _id;
+    };
+    Bnd_Box                                   _box;
+    std::vector< TSubShape >                  _subShapes; // in order of getDependsOnIterator()
+    int                                       _nbFaces;
+    std::vector< Handle(Poly_Triangulation) > _triangulations; // after updateTriangulation()
+  };
 
-              surfProp.SetParameters( uvj.X(), uvj.Y() );
-              double maxCurv = Max( Abs( surfProp.MaxCurvature()), Abs( surfProp.MinCurvature() ));
-              double       h = elemSizeForChordalError( _chordalError, 1 / maxCurv );
+  //================================================================================
+  /*!
+   * \brief Internal sub-shapes found by NETGENPlugin_Internals
+   */
+  //================================================================================
 
-              const gp_Pnt& pj = surfProp.Value();
-              netgen::Point3d ngP( pj.X(), pj.Y(), pj.Z());
-              ngMesh.RestrictLocalH( ngP, h * sizeCoef );
-            }
-          }
-        }
-      }
-    }
-  }
-}
+  struct TInternalsIndex
+  {
+    struct TInternalEdge
+    {
+      int                _edgeID, _faceID;
+      std::vector< int > _vertexIDs;
+    };
+    std::vector< TInternalEdge >  _intEdges; // INTERNAL edges in faces
+    std::map<int,std::list<int> > _f2v;
+    std::set<int>                 _intShapes;
+    std::set<int>                 _borderFaces;
+    std::map<int,std::list<int> > _s2v;
+  };
 
-//================================================================================
-/*!
- * \brief Initialize netgen::OCCGeometry with OCCT shape
- */
-//================================================================================
+  typedef NETGENPlugin_InstanceCopier::TOrbits TOrbits;
+  typedef std::vector< double >                 TOrbitsKey; // shape type and periodicity
 
-void NETGENPlugin_Mesher::PrepareOCCgeometry(netgen::OCCGeometry&     occgeo,
-                                             const TopoDS_Shape&      shape,
-                                             SMESH_Mesh&              mesh,
-                                             list< SMESH_subMesh* > * meshedSM,
-                                             NETGENPlugin_Internals*  intern)
-{
-  updateTriangulation( shape );
+  //================================================================================
+  /*!
+   * \brief Cache of indices of shapes of SMESH_Mesh'es.
+   *
+   * The indices depend on topology only, states of sub-meshes are checked by
+   * users of the indices. So they are kept across Compute() and Evaluate()
+   * while the shape to mesh is the same.
+   */
+  //================================================================================
 
-  Bnd_Box bb;
-  BRepBndLib::Add (shape, bb);
-  double x1,y1,z1,x2,y2,z2;
-  bb.Get (x1,y1,z1,x2,y2,z2);
-  netgen::Point<3> p1 = netgen::Point<3> (x1,y1,z1);
-  netgen::Point<3> p2 = netgen::Point<3> (x2,y2,z2);
-  occgeo.boundingbox = netgen::Box<3> (p1,p2);
+  class TShapeIndexCache
+  {
+  public:
 
-  occgeo.shape = shape;
-  occgeo.changed = 1;
+    template< class TIndex >
+    using TIndexPtr     = std::shared_ptr< const TIndex >;
+    template< class TIndex >
+    using TShapeIndices = std::vector< std::pair< TopoDS_Shape, TIndexPtr< TIndex > > >;
 
-  // fill maps of shapes of occgeo with not yet meshed subshapes
+    static TIndexPtr< TGeomIndex > GetGeomIndex( SMESH_Mesh& mesh, const TopoDS_Shape& shape )
+    {
+      return getIndex( mesh, shape, &TMeshEntry::_geomIndices );
+    }
+    static void AddGeomIndex( SMESH_Mesh& mesh, const TopoDS_Shape& shape, TIndexPtr< TGeomIndex > index )
+    {
+      addIndex( mesh, shape, &TMeshEntry::_geomIndices, index );
+    }
+    static TIndexPtr< TInternalsIndex > GetInternalsIndex( SMESH_Mesh& mesh, const TopoDS_Shape& shape, bool is3D )
+    {
+      return getIndex( mesh, shape, is3D ? &TMeshEntry::_internals3D : &TMeshEntry::_internals2D );
+    }
+    static void AddInternalsIndex( SMESH_Mesh& mesh, const TopoDS_Shape& shape, bool is3D,
+                                   TIndexPtr< TInternalsIndex > index )
+    {
+      addIndex( mesh, shape, is3D ? &TMeshEntry::_internals3D : &TMeshEntry::_internals2D, index );
+    }
+    static TIndexPtr< TOrbits > GetOrbits( SMESH_Mesh& mesh, const TOrbitsKey& key )
+    {
+      std::lock_guard<std::mutex> lock( mutex() );
+      for ( auto& key2orbits : meshEntry( mesh )._orbits )
+        if ( key2orbits.first == key )
+          return key2orbits.second;
+      return TIndexPtr< TOrbits >();
+    }
+    static void AddOrbits( SMESH_Mesh& mesh, const TOrbitsKey& key, TIndexPtr< TOrbits > orbits )
+    {
+      std::lock_guard<std::mutex> lock( mutex() );
+      meshEntry( mesh )._orbits.push_back( std::make_pair( key, orbits ));
+    }
 
-  // get root submeshes
-  list< SMESH_subMesh* > rootSM;
-  const int shapeID = mesh.GetMeshDS()->ShapeToIndex( shape );
-  if ( shapeID > 0 ) { // SMESH_subMesh with ID 0 may exist, don't use it!
-    rootSM.push_back( mesh.GetSubMesh( shape ));
-  }
-  else {
-    for ( TopoDS_Iterator it( shape ); it.More(); it.Next() )
-      rootSM.push_back( mesh.GetSubMesh( it.Value() ));
-  }
+  private:
 
-  int totNbFaces = 0;
+    struct TMeshEntry
+    {
+      int                               _meshID;
+      TopoDS_Shape                      _mainShape;
+      int                               _maxShapeIndex;
+      size_t                            _lastUse;
+      TShapeIndices< TGeomIndex >       _geomIndices;
+      TShapeIndices< TInternalsIndex >  _internals2D;
+      TShapeIndices< TInternalsIndex >  _internals3D;
+      std::vector< std::pair< TOrbitsKey, TIndexPtr< TOrbits > > > _orbits;
+    };
+    enum { MAX_NB_MESHES = 8, MAX_NB_SHAPES = 1000 };
 
-  // add subshapes of empty submeshes
-  list< SMESH_subMesh* >::iterator rootIt = rootSM.begin(), rootEnd = rootSM.end();
-  for ( ; rootIt != rootEnd; ++rootIt ) {
-    SMESH_subMesh * root = *rootIt;
-    SMESH_subMeshIteratorPtr smIt = root->getDependsOnIterator(/*includeSelf=*/true,
-                                                               /*complexShapeFirst=*/true);
-    // to find a right orientation of subshapes (PAL20462)
-    TopTools_IndexedMapOfShape subShapes;
-    TopExp::MapShapes(root->GetSubShape(), subShapes);
-    while ( smIt->more() )
+    static std::mutex& mutex()
     {
-      SMESH_subMesh*  sm = smIt->next();
-      TopoDS_Shape shape = sm->GetSubShape();
-      totNbFaces += ( shape.ShapeType() == TopAbs_FACE );
-      if ( intern && intern->isShapeToPrecompute( shape ))
-        continue;
-      if ( !meshedSM || sm->IsEmpty() )
+      static std::mutex theMutex;
+      return theMutex;
+    }
+
+    //! return data of a mesh, drop data of meshes not used for long
+    static TMeshEntry& meshEntry( SMESH_Mesh& mesh )
+    {
+      static std::map< const SMESH_Mesh*, TMeshEntry > theEntries;
+      static size_t theCounter = 0;
+
+      TMeshEntry& entry = theEntries[ &mesh ];
+      entry._lastUse = ++theCounter;
+      int maxShapeIndex = mesh.GetMeshDS()->MaxShapeIndex();
+      if ( entry._meshID        != mesh.GetId() ||
+           entry._maxShapeIndex != maxShapeIndex ||
+           !entry._mainShape.IsEqual( mesh.GetShapeToMesh() ))
       {
-        if ( shape.ShapeType() != TopAbs_VERTEX )
-          shape = subShapes( subShapes.FindIndex( shape ));// shape -> index -> oriented shape
-        if ( shape.Orientation() >= TopAbs_INTERNAL )
-          shape.Orientation( TopAbs_FORWARD ); // issue 0020676
-        switch ( shape.ShapeType() ) {
-        case TopAbs_FACE  : occgeo.fmap.Add( shape ); break;
-        case TopAbs_EDGE  : occgeo.emap.Add( shape ); break;
-        case TopAbs_VERTEX: occgeo.vmap.Add( shape ); break;
-        case TopAbs_SOLID :occgeo.somap.Add( shape ); break;
-        default:;
-        }
+        entry = TMeshEntry();
+        entry._meshID        = mesh.GetId();
+        entry._mainShape     = mesh.GetShapeToMesh();
+        entry._maxShapeIndex = maxShapeIndex;
+        entry._lastUse       = theCounter;
+      }
+      if ( theEntries.size() > MAX_NB_MESHES )
+      {
+        auto oldest = theEntries.begin();
+        for ( auto it = theEntries.begin(); it != theEntries.end(); ++it )
+          if ( it->second._lastUse < oldest->second._lastUse )
+            oldest = it;
+        theEntries.erase( oldest );
       }
-      // collect submeshes of meshed shapes
-      else if (meshedSM)
+      return entry;
+    }
+
+    template< class TIndex >
+    static TIndexPtr< TIndex > getIndex( SMESH_Mesh& mesh, const TopoDS_Shape& shape,
+                                         TShapeIndices< TIndex > TMeshEntry::* indices )
+    {
+      std::lock_guard<std::mutex> lock( mutex() );
+      TShapeIndices< TIndex >& shapeIndices = meshEntry( mesh ).*indices;
+      for ( size_t i = 0; i < shapeIndices.size(); ++i )
+        if ( shapeIndices[ i ].first.IsEqual( shape ))
+          return shapeIndices[ i ].second;
+      return TIndexPtr< TIndex >();
+    }
+
+    template< class TIndex >
+    static void addIndex( SMESH_Mesh& mesh, const TopoDS_Shape& shape,
+                          TShapeIndices< TIndex > TMeshEntry::* indices, TIndexPtr< TIndex > index )
+    {
+      std::lock_guard<std::mutex> lock( mutex() );
+      TShapeIndices< TIndex >& shapeIndices = meshEntry( mesh ).*indices;
+      for ( size_t i = 0; i < shapeIndices.size(); ++i )
+        if ( shapeIndices[ i ].first.IsEqual( shape ))
+        {
+          shapeIndices[ i ].second = index;
+          return;
+        }
+      if ( shapeIndices.size() >= MAX_NB_SHAPES )
+        shapeIndices.clear();
+      shapeIndices.push_back( std::make_pair( shape, index ));
+    }
+  };
+
+  //================================================================================
+  /*!
+   * \brief Return triangulations of FACEs of a shape
+   */
+  //================================================================================
+
+  std::vector< Handle(Poly_Triangulation) > getTriangulations( const TopoDS_Shape& shape )
+  {
+    std::vector< Handle(Poly_Triangulation) > triangulations;
+    TopLoc_Location loc;
+    for ( TopExp_Explorer f( shape, TopAbs_FACE ); f.More(); f.Next() )
+      triangulations.push_back( BRep_Tool::Triangulation( TopoDS::Face( f.Current() ), loc ));
+    return triangulations;
+  }
+
+  //================================================================================
+  /*!
+   * \brief Collect sub-shapes to add to occgeo maps
+   */
+  //================================================================================
+
+  std::shared_ptr< TGeomIndex > makeGeomIndex( SMESH_Mesh& mesh, const TopoDS_Shape& shape )
+  {
+    std::shared_ptr< TGeomIndex > index = std::make_shared< TGeomIndex >();
+
+    BRepBndLib::Add (shape, index->_box);
+    index->_triangulations = getTriangulations( shape );
+
+    // get root submeshes
+    list< SMESH_subMesh* > rootSM;
+    const int shapeID = mesh.GetMeshDS()->ShapeToIndex( shape );
+    if ( shapeID > 0 ) { // SMESH_subMesh with ID 0 may exist, don't use it!
+      rootSM.push_back( mesh.GetSubMesh( shape ));
+    }
+    else {
+      for ( TopoDS_Iterator it( shape ); it.More(); it.Next() )
+        rootSM.push_back( mesh.GetSubMesh( it.Value() ));
+    }
+
+    index->_nbFaces = 0;
+
+    list< SMESH_subMesh* >::iterator rootIt = rootSM.begin(), rootEnd = rootSM.end();
+    for ( ; rootIt != rootEnd; ++rootIt ) {
+      SMESH_subMesh * root = *rootIt;
+      SMESH_subMeshIteratorPtr smIt = root->getDependsOnIterator(/*includeSelf=*/true,
+                                                                 /*complexShapeFirst=*/true);
+      // to find a right orientation of subshapes (PAL20462)
+      TopTools_IndexedMapOfShape subShapes;
+      TopExp::MapShapes(root->GetSubShape(), subShapes);
+      while ( smIt->more() )
       {
-        const int dim = SMESH_Gen::GetShapeDim( shape );
-        meshedSM[ dim ].push_back( sm );
+        SMESH_subMesh*  sm = smIt->next();
+        TGeomIndex::TSubShape subShape;
+        subShape._shape    = sm->GetSubShape();
+        subShape._oriented = subShape._shape;
+        subShape._id       = sm->GetId();
+        index->_nbFaces += ( subShape._shape.ShapeType() == TopAbs_FACE );
+
+        if ( subShape._shape.ShapeType() != TopAbs_VERTEX )
+          subShape._oriented = subShapes( subShapes.FindIndex( subShape._shape ));// shape -> index -> oriented shape
+        if ( subShape._oriented.Orientation() >= TopAbs_INTERNAL )
+          subShape._oriented.Orientation( TopAbs_FORWARD ); // issue 0020676
+
+        index->_subShapes.push_back( subShape );
+      }
+    }
+    return index;
+  }
+}
+
+//================================================================================
+/*!
+ * \brief Initialize netgen::OCCGeometry with OCCT shape
+ */
+//================================================================================
+
+void NETGENPlugin_Mesher::PrepareOCCgeometry(netgen::OCCGeometry&     occgeo,
+                                             const TopoDS_Shape&      shape,
+                                             SMESH_Mesh&              mesh,
+                                             list< SMESH_subMesh* > * meshedSM,
+                                             NETGENPlugin_Internals*  intern)
+{
+  // topology of shape is indexed once per shape to mesh
+  std::shared_ptr< const TGeomIndex > index = TShapeIndexCache::GetGeomIndex( mesh, shape );
+  if ( !index || index->_triangulations != getTriangulations( shape ))
+  {
+    updateTriangulation( shape );
+    index = makeGeomIndex( mesh, shape );
+    TShapeIndexCache::AddGeomIndex( mesh, shape, index );
+  }
+
+  double x1,y1,z1,x2,y2,z2;
+  index->_box.Get (x1,y1,z1,x2,y2,z2);
+  netgen::Point<3> p1 = netgen::Point<3> (x1,y1,z1);
+  netgen::Point<3> p2 = netgen::Point<3> (x2,y2,z2);
+  occgeo.boundingbox = netgen::Box<3> (p1,p2);
+
+  occgeo.shape = shape;
+  occgeo.changed = 1;
+
+  // fill maps of shapes of occgeo with not yet meshed subshapes
+
+  for ( const TGeomIndex::TSubShape& subShape : index->_subShapes )
+  {
+    if ( intern && intern->isShapeToPrecompute( subShape._shape ))
+      continue;
+    SMESH_subMesh* sm = mesh.GetSubMeshContaining( subShape._id );
+    if ( !meshedSM || !sm || sm->IsEmpty() )
+    {
+      const TopoDS_Shape& s = subShape._oriented;
+      switch ( s.ShapeType() ) {
+      case TopAbs_FACE  : occgeo.fmap.Add( s ); break;
+      case TopAbs_EDGE  : occgeo.emap.Add( s ); break;
+      case TopAbs_VERTEX: occgeo.vmap.Add( s ); break;
+      case TopAbs_SOLID :occgeo.somap.Add( s ); break;
+      default:;
       }
     }
+    // collect submeshes of meshed shapes
+    else if (meshedSM)
+    {
+      const int dim = SMESH_Gen::GetShapeDim( subShape._shape );
+      meshedSM[ dim ].push_back( sm );
+    }
   }
+  int totNbFaces = index->_nbFaces;
   occgeo.facemeshstatus.SetSize (totNbFaces);
   occgeo.facemeshstatus = 0;
   occgeo.face_maxh_modified.SetSize(totNbFaces);
@@ -1141,9 +2109,14 @@ bool NETGENPlugin_Mesher::FillNgMesh(netgen::OCCGeometry&           occgeom,
                                      SMESH_MesherHelper*            quadHelper,
                                      SMESH_ProxyMesh::Ptr           proxyMesh)
 {
-  TNode2IdMap nodeNgIdMap;
+  TNode2IdMap nodeNgIdMap( _mesh->GetMeshDS() );
   for ( size_t i = 1; i < nodeVec.size(); ++i )
-    nodeNgIdMap.insert( make_pair( nodeVec[i], i ));
+    if ( nodeVec[i] )
+    {
+      int& ngId = nodeNgIdMap[ nodeVec[i] ];
+      if ( ngId == 0 )
+        ngId = (int) i;
+    }
 
   TopTools_MapOfShape visitedShapes;
   map< SMESH_subMesh*, set< int > > visitedEdgeSM2Faces;
@@ -1224,7 +2197,7 @@ bool NETGENPlugin_Mesher::FillNgMesh(netgen::OCCGeometry&           occgeom,
 
         // add segments
 
-        int prevNgId = ngNodeId( points[0].node, ngMesh, nodeNgIdMap );
+        int prevNgId = ngNodeId( points[0].node, ngMesh, nodeNgIdMap, nodeVec );
 
         for ( i = 0; i < nbSeg; ++i )
         {
@@ -1247,7 +2220,7 @@ bool NETGENPlugin_Mesher::FillNgMesh(netgen::OCCGeometry&           occgeom,
           netgen::Segment seg;
           // ng node ids
           seg[0] = prevNgId;
-          seg[1] = prevNgId = ngNodeId( p2.node, ngMesh, nodeNgIdMap );
+          seg[1] = prevNgId = ngNodeId( p2.node, ngMesh, nodeNgIdMap, nodeVec );
           // node param on curve
           seg.epgeominfo[ 0 ].dist = p1.param;
           seg.epgeominfo[ 1 ].dist = p2.param;
@@ -1391,7 +2364,7 @@ bool NETGENPlugin_Mesher::FillNgMesh(netgen::OCCGeometry&           occgeom,
             while ( nodeIt->more() )
             {
               const SMDS_MeshNode* n = nodeIt->next();
-              int ngID = ngNodeId( n, ngMesh, nodeNgIdMap );
+              int ngID = ngNodeId( n, ngMesh, nodeNgIdMap, nodeVec );
               netgen::MeshPoint& ngPoint = ngMesh.Point( ngID );
               ngPoint(0) = n->X();
               ngPoint(1) = n->Y();
@@ -1523,7 +2496,7 @@ bool NETGENPlugin_Mesher::FillNgMesh(netgen::OCCGeometry&           occgeom,
           int ind = reverse ? 3-i : i+1;
           tri.GeomInfoPi(ind).u = uv.X();
           tri.GeomInfoPi(ind).v = uv.Y();
-          tri.PNum      (ind) = ngNodeId( node, ngMesh, nodeNgIdMap );
+          tri.PNum      (ind) = ngNodeId( node, ngMesh, nodeNgIdMap, nodeVec );
         }
 
         // pass a triangle size to NG size-map
@@ -1580,7 +2553,7 @@ bool NETGENPlugin_Mesher::FillNgMesh(netgen::OCCGeometry&           occgeom,
       {
         SMDS_NodeIteratorPtr nodeIt = smDS->GetNodes();
         if ( nodeIt->more() )
-          ngNodeId( nodeIt->next(), ngMesh, nodeNgIdMap );
+          ngNodeId( nodeIt->next(), ngMesh, nodeNgIdMap, nodeVec );
       }
       break;
     }
@@ -1588,11 +2561,8 @@ bool NETGENPlugin_Mesher::FillNgMesh(netgen::OCCGeometry&           occgeom,
     } // switch
   } // loop on submeshes
 
-  // fill nodeVec
+  // nodeVec is filled by ngNodeId()
   nodeVec.resize( ngMesh.GetNP() + 1 );
-  TNode2IdMap::iterator node_NgId, nodeNgIdEnd = nodeNgIdMap.end();
-  for ( node_NgId = nodeNgIdMap.begin(); node_NgId != nodeNgIdEnd; ++node_NgId)
-    nodeVec[ node_NgId->second ] = node_NgId->first;
 
   return true;
 }
@@ -2543,6 +3513,15 @@ int NETGENPlugin_Mesher::FillSMesh(const netgen::OCCGeometry&          occgeo,
 
   if ( nbNod > nbInitNod )
     nodeVec.resize( nbNod + 1 );
+  // points of VERTEXes, index of a point == vmap index - 1
+  std::vector< gp_XYZ > vertexPoints;
+  if ( nbNod > nbInitNod )
+  {
+    vertexPoints.resize( occgeo.vmap.Extent() );
+    for ( int iV = 1; iV <= occgeo.vmap.Extent(); ++iV )
+      vertexPoints[ iV - 1 ] = BRep_Tool::Pnt( TopoDS::Vertex( occgeo.vmap( iV ))).XYZ();
+  }
+  TSpatialHash< std::vector< gp_XYZ > > vertexHash( vertexPoints, vertexPoints.size(), 1e-10 );
   for ( int i = nbInitNod+1; i <= nbNod; ++i )
   {
     const netgen::MeshPoint& ngPoint = ngMesh.Point(i);
@@ -2553,15 +3532,12 @@ int NETGENPlugin_Mesher::FillSMesh(const netgen::OCCGeometry&          occgeo,
     // but (issue 0020776) netgen does not create nodes with equal coordinates
     if ( i-nbInitNod <= occgeo.vmap.Extent() )
     {
-      gp_Pnt p ( NGPOINT_COORDS(ngPoint) );
-      for (int iV = i-nbInitNod; aVert.IsNull() && iV <= occgeo.vmap.Extent(); ++iV)
+      gp_XYZ p ( NGPOINT_COORDS(ngPoint) );
+      size_t iP = vertexHash.Find( p, i-nbInitNod-1 );
+      if ( iP < vertexHash.NbPoints() )
       {
-        aVert = TopoDS::Vertex( occgeo.vmap( iV ));
-        gp_Pnt pV = BRep_Tool::Pnt( aVert );
-        if ( p.SquareDistance( pV ) > 1e-20 )
-          aVert.Nullify();
-        else
-          node = const_cast<SMDS_MeshNode*>( SMESH_Algo::VertexNode( aVert, meshDS ));
+        aVert = TopoDS::Vertex( occgeo.vmap( int( iP + 1 )));
+        node = const_cast<SMDS_MeshNode*>( SMESH_Algo::VertexNode( aVert, meshDS ));
       }
     }
     if (!node) // node not found on vertex
@@ -2659,14 +3635,23 @@ int NETGENPlugin_Mesher::FillSMesh(const netgen::OCCGeometry&          occgeo,
     // from computation of 3D mesh
     ngMesh.AddFaceDescriptor (netgen::FaceDescriptor(quadFaceID, /*solid1=*/0, /*solid2=*/0, 0));
 
+  // SMESHDS ids of geometrical FACEs and SOLIDs by netgen index
+  NETGENPlugin_BulkFiller filler( meshDS );
+  vector< int > faceIDs, solidIDs;
+  if ( nbInitFac < nbFac )
+    faceIDs = filler.ShapeIDs( occgeo.fmap );
+  if ( nbVol > 0 )
+    solidIDs = filler.ShapeIDs( occgeo.somap );
+
   vector<const SMDS_MeshNode*> nodes;
+  nodes.reserve( 10 );
   for ( int i = nbInitFac+1; i <= nbFac; ++i )
   {
     const netgen::Element2d& elem = ngMesh.SurfaceElement(i);
     const int        aGeomFaceInd = elem.GetIndex();
-    TopoDS_Face aFace;
+    int faceID = 0;
     if (aGeomFaceInd > 0 && aGeomFaceInd <= occgeo.fmap.Extent())
-      aFace = TopoDS::Face(occgeo.fmap(aGeomFaceInd));
+      faceID = faceIDs[ aGeomFaceInd ];
     nodes.clear();
     for ( int j = 1; j <= elem.GetNP(); ++j )
     {
@@ -2676,10 +3661,10 @@ int NETGENPlugin_Mesher::FillSMesh(const netgen::OCCGeometry&          occgeo,
       if ( SMDS_MeshNode* node = nodeVec_ACCESS(pind))
       {
         nodes.push_back( node );
-        if (!aFace.IsNull() && node->GetShapeID() < 1)
+        if ( faceID > 0 && node->GetShapeID() < 1)
         {
           const netgen::PointGeomInfo& pgi = elem.GeomInfoPi(j);
-          meshDS->SetNodeOnFace(node, aFace, pgi.u, pgi.v);
+          meshDS->SetNodeOnFace(node, faceID, pgi.u, pgi.v);
         }
       }
     }
@@ -2733,8 +3718,8 @@ int NETGENPlugin_Mesher::FillSMesh(const netgen::OCCGeometry&          occgeo,
       nbSeg = nbFac = nbVol = 0;
       break;
     }
-    if ( !aFace.IsNull() )
-      meshDS->SetMeshElementOnShape( face, aFace );
+    if ( faceID > 0 )
+      meshDS->SetMeshElementOnShape( face, faceID );
   }
 
   // ------------------
@@ -2745,9 +3730,9 @@ int NETGENPlugin_Mesher::FillSMesh(const netgen::OCCGeometry&          occgeo,
   {
     const netgen::Element& elem = ngMesh.VolumeElement(i);
     int aSolidInd = elem.GetIndex();
-    TopoDS_Solid aSolid;
+    int solidID = 0;
     if ( aSolidInd > 0 && aSolidInd <= occgeo.somap.Extent() )
-      aSolid = TopoDS::Solid(occgeo.somap(aSolidInd));
+      solidID = solidIDs[ aSolidInd ];
     nodes.clear();
     for ( int j = 1; j <= elem.GetNP(); ++j )
     {
@@ -2757,8 +3742,8 @@ int NETGENPlugin_Mesher::FillSMesh(const netgen::OCCGeometry&          occgeo,
       if ( SMDS_MeshNode* node = nodeVec_ACCESS(pind) )
       {
         nodes.push_back(node);
-        if ( !aSolid.IsNull() && node->GetShapeID() < 1 )
-          meshDS->SetNodeInVolume(node, aSolid);
+        if ( solidID > 0 && node->GetShapeID() < 1 )
+          meshDS->SetNodeInVolume(node, solidID);
       }
     }
     if ((int) nodes.size() != elem.GetNP() )
@@ -2794,8 +3779,8 @@ int NETGENPlugin_Mesher::FillSMesh(const netgen::OCCGeometry&          occgeo,
       nbSeg = nbFac = nbVol = 0;
       break;
     }
-    if (!aSolid.IsNull())
-      meshDS->SetMeshElementOnShape(vol, aSolid);
+    if ( solidID > 0 )
+      meshDS->SetMeshElementOnShape(vol, solidID);
   }
   return comment.empty() ? 0 : 1;
 }
@@ -2879,13 +3864,6 @@ namespace
     }
     return false;
   }
-
-  const double edgeMeshingTime = 0.001;
-  const double faceMeshingTime = 0.019;
-  const double edgeFaceMeshingTime = edgeMeshingTime + faceMeshingTime;
-  const double faceOptimizTime = 0.06;
-  const double voluMeshingTime = 0.15;
-  const double volOptimizeTime = 0.77;
 }
 
 int NETGENPlugin_Mesher::FillInternalElements( NETGENPlugin_NetgenLibWrapper& ngLib, NETGENPlugin_Internals& internals, netgen::OCCGeometry& occgeo, 
@@ -3087,6 +4065,7 @@ int NETGENPlugin_Mesher::CallNetgenMeshEdges( NETGENPlugin_NetgenLibWrapper& ngL
   int err = 0;  
   int startWith = netgen::MESHCONST_MESHEDGES; 
   int endWith   = netgen::MESHCONST_MESHEDGES;
+  _progressModel.Start( NETGENPlugin_ProgressModel::EDGES );
   try
   {
     OCC_CATCH_SIGNALS;
@@ -3113,12 +4092,17 @@ int NETGENPlugin_Mesher::CallNetgenMeshFaces( NETGENPlugin_NetgenLibWrapper& ngL
 {
   int err = 0;  
   int startWith = netgen::MESHCONST_MESHSURFACE; 
-  int endWith   =  _optimize ? netgen::MESHCONST_OPTSURFACE : netgen::MESHCONST_MESHSURFACE;
+  int endWith   = _optimize ? netgen::MESHCONST_OPTSURFACE : netgen::MESHCONST_MESHSURFACE;
+  // GetProgress() switches to OPT_FACES by netgen task
+  typedef NETGENPlugin_ProgressModel TModel;
+  _progressModel.Start( TModel::FACES, _optimize ? TModel::OPT_FACES : TModel::FACES );
+  netgen::multithread.percent = 0; // GetProgress() reads it
   try
   {
     OCC_CATCH_SIGNALS;
 
     err = ngLib.GenerateMesh(occgeo, startWith, endWith, _ngMesh );
+
     // if(netgen::multithread.terminate)
     //   return false;
     comment << text(err);
@@ -3136,6 +4120,16 @@ int NETGENPlugin_Mesher::CallNetgenMeshFaces( NETGENPlugin_NetgenLibWrapper& ngL
 
 int NETGENPlugin_Mesher::CallNetgenMeshVolumens( NETGENPlugin_NetgenLibWrapper& ngLib, netgen::OCCGeometry& occgeo, SMESH_Comment& comment )
 {
+  const int nbThreads = std::min( NETGENPlugin_NetgenContext::NbThreads(), _ngMesh->GetNDomains() );
+  if ( nbThreads > 1 )
+  {
+    // solids are meshed and optimized at once by each job
+    _progressModel.Start( NETGENPlugin_ProgressModel::VOLUMES,
+                          _optimize ? NETGENPlugin_ProgressModel::OPT_VOLUMES : NETGENPlugin_ProgressModel::VOLUMES );
+    return CallNetgenMeshVolumensInParallel( occgeo, comment, nbThreads );
+  }
+  _progressModel.Start( NETGENPlugin_ProgressModel::VOLUMES );
+
   // Let netgen compute 3D mesh
   int err = 0;
   int startWith = netgen::MESHCONST_MESHVOLUME;
@@ -3164,11 +4158,12 @@ int NETGENPlugin_Mesher::CallNetgenMeshVolumens( NETGENPlugin_NetgenLibWrapper&
       comment << text(exc);
     err = 1;
   }
-  // _ticTime = ( doneTime += voluMeshingTime ) / _totalTime / _progressTic;
 
   // Let netgen optimize 3D mesh
   if ( !err && _optimize )
   {
+    _progressModel.Start( NETGENPlugin_ProgressModel::OPT_VOLUMES );
+    netgen::multithread.percent = 0;
     startWith = endWith = netgen::MESHCONST_OPTVOLUME;
     try
     {
@@ -3196,6 +4191,100 @@ int NETGENPlugin_Mesher::CallNetgenMeshVolumens( NETGENPlugin_NetgenLibWrapper&
   return err;
 }
 
+/**
+ * @brief Compute volume mesh of each solid in a separate netgen mesh in parallel threads
+ *
+ * Surface elements bounding a solid are copied to a netgen mesh having its own copy
+ * of the local size of the main mesh. Then the new points and volume elements are added to the main mesh
+ * in the order of solids, so the result does not depend on thread scheduling.
+ */
+int NETGENPlugin_Mesher::CallNetgenMeshVolumensInParallel( netgen::OCCGeometry& occgeo,
+                                                           SMESH_Comment&       comment,
+                                                           const int            nbThreads )
+{
+  const int nbSolids = _ngMesh->GetNDomains();
+  std::vector< std::unique_ptr< TSolidJob > > jobs;
+  for ( int iS = 1; iS <= nbSolids; ++iS )
+    jobs.emplace_back( new TSolidJob( iS ));
+  for ( int iF = 1; iF <= _ngMesh->GetNSE(); ++iF )
+  {
+    const netgen::Element2d&     elem = _ngMesh->SurfaceElement( iF );
+    const netgen::FaceDescriptor& fd = _ngMesh->GetFaceDescriptor( elem.GetIndex() );
+    if ( elem.IsDeleted() )
+      continue;
+    if ( fd.DomainIn() > 0 )
+      jobs[ fd.DomainIn() - 1 ]->_faces.push_back( iF );
+    if ( fd.DomainOut() > 0 && fd.DomainOut() != fd.DomainIn() )
+      jobs[ fd.DomainOut() - 1 ]->_faces.push_back( iF );
+  }
+
+  // start from the largest solids for better load balance
+  std::vector< TSolidJob* > queue;
+  for ( size_t iS = 0; iS < jobs.size(); ++iS )
+    if ( !jobs[ iS ]->_faces.empty() )
+      queue.push_back( jobs[ iS ].get() );
+  std::stable_sort( queue.begin(), queue.end(), []( const TSolidJob* j1, const TSolidJob* j2 )
+                    { return j1->_faces.size() > j2->_faces.size(); });
+
+  const netgen::MeshingParameters params = netgen::mparam;
+  const void*                      owner = NETGENPlugin_NetgenContext::Owner();
+  const bool                      toOptimize = _optimize;
+  netgen::Mesh&                      ngMesh = *_ngMesh;
+  std::atomic< size_t >           nextJob( 0 );
+
+  NETGENPlugin_NetgenContext::RunInThreads( nbThreads, [&]( int /*iThread*/ )
+    {
+      NETGENPlugin_NetgenContext ngContext( owner );
+      NETGENPlugin_NetgenLibWrapper ngLib;
+      netgen::mparam = params;
+      for ( size_t iJ = nextJob++; iJ < queue.size(); iJ = nextJob++ )
+      {
+        if ( netgen::multithread.terminate )
+          break;
+        TSolidJob& job = *queue[ iJ ];
+        extractSolidSurface( ngMesh, job );
+        netgen::Mesh* solidMesh = job._ngMesh.get();
+        buildSolidLocalH( ngMesh, *solidMesh );
+        try
+        {
+          OCC_CATCH_SIGNALS;
+
+          int startWith = netgen::MESHCONST_MESHVOLUME;
+          int endWith   = toOptimize ? netgen::MESHCONST_OPTVOLUME : netgen::MESHCONST_MESHVOLUME;
+          job._error = ngLib.GenerateMesh( occgeo, startWith, endWith, solidMesh );
+          job._comment << text( job._error );
+        }
+        catch (Standard_Failure& ex)
+        {
+          job._comment << text(ex);
+          job._error = 1;
+        }
+        catch (netgen::NgException& exc)
+        {
+          job._comment << text(exc);
+          job._error = 1;
+        }
+        _progressModel.AddDoneElements( solidMesh->GetNE() );
+      }
+      ngLib._isComputeOk = true;
+    });
+
+  if ( netgen::multithread.terminate )
+    return false;
+
+  int err = 0;
+  for ( size_t iS = 0; iS < jobs.size(); ++iS )
+  {
+    TSolidJob& job = *jobs[ iS ];
+    if ( job._ngMesh )
+      addSolidVolume( *_ngMesh, job );
+    err = err || job._error;
+    if ( comment.empty() ) // do not overwrite a previous error
+      comment << job._comment;
+  }
+  return err;
+}
+
 void NETGENPlugin_Mesher::MakeSecondOrder( netgen::MeshingParameters &mparams, netgen::OCCGeometry& occgeo, 
                                            list< SMESH_subMesh* >* meshedSM, NETGENPlugin_ngMeshInfo& initState, SMESH_Comment& comment )
 {
@@ -3618,21 +4707,14 @@ bool NETGENPlugin_Mesher::Compute()
   
   int err = 0;
 
-  _totalTime = edgeFaceMeshingTime;
-  if ( _optimize )
-    _totalTime += faceOptimizTime;
-  if ( _isVolume )
-    _totalTime += voluMeshingTime + ( _optimize ? volOptimizeTime : 0 );
-  double doneTime = 0;
-  _ticTime = -1;
-  _progressTic = 1;
-  _curShapeIndex = -1;
-
   // -------------------------
   // Generate the mesh
   // -------------------------
 
+  _progressModel.Start( NETGENPlugin_ProgressModel::ANALYSE );
   InitialSetup( ngLib, occgeo, meshedSM, &internals, quadHelper, initState, mparams );
+  _progressModel.SetWork( NETGENPlugin_ProgressModel::ANALYSE, occgeo.fmap.Extent() );
+  _progressModel.SetWork( NETGENPlugin_ProgressModel::EDGES,   occgeo.emap.Extent() );
   err = Fill0D1DElements( occgeo, nodeVec, meshedSM, quadHelper );  
   initState = NETGENPlugin_ngMeshInfo(_ngMesh);
   err = CallNetgenMeshEdges( ngLib, occgeo );
@@ -3643,18 +4725,10 @@ bool NETGENPlugin_Mesher::Compute()
   SMESH_Comment comment;
   
   {
-
-    if ( _isVolume )
-      _ticTime = ( doneTime += edgeMeshingTime ) / _totalTime / _progressTic;
+    SetProgressWork( occgeo, mparams );
 
     mparams.uselocalh = true; // restore as it is used at surface optimization
     err = CallNetgenMeshFaces( ngLib, occgeo, comment );
-    
-    if ( _isVolume )
-    {
-      doneTime += faceMeshingTime + ( _optimize ? faceOptimizTime : 0 );
-      _ticTime = doneTime / _totalTime / _progressTic;
-    }
 
     if ( !err )
       if ( !Fill3DViscousLayerAndQuadAdaptor( occgeo, nodeVec, mparams, initState, meshedSM, quadHelper, err ) )
@@ -3666,12 +4740,13 @@ bool NETGENPlugin_Mesher::Compute()
       err = CallNetgenMeshVolumens( ngLib, occgeo, comment );
     }
 
+    _progressModel.Start( NETGENPlugin_ProgressModel::FILL_SMESH );
+    MESSAGE("NETGEN remaining time: " << _progressModel.RemainingTime() << " s");
+
     if (!err )
       MakeSecondOrder( mparams, occgeo, meshedSM, initState, comment );
   }
 
-  _ticTime = 0.98 / _progressTic;
-
   //int nbNod = _ngMesh->GetNP();
   //int nbSeg = _ngMesh->GetNSeg();
   int nbFac = _ngMesh->GetNSE();
@@ -3684,6 +4759,10 @@ bool NETGENPlugin_Mesher::Compute()
     FillSMESH( occgeo, initState, nodeVec, quadHelper, comment );    
   }
 
+  // only a successful computation calibrates timing of next ones
+  if ( isOK && !netgen::multithread.terminate )
+    _progressModel.Finish();
+
   SMESH_ComputeErrorPtr readErr = ReadErrors(nodeVec);
   if ( readErr && readErr->HasBadElems() )
   {
@@ -3782,9 +4861,6 @@ bool NETGENPlugin_Mesher::Evaluate(MapShapeNbElems& aResMap)
   NETGENPlugin_Internals internals( *_mesh, _shape, _isVolume );
   PrepareOCCgeometry( occgeo, _shape, *_mesh, 0, &internals );
 
-  bool tooManyElems = false;
-  const int hugeNb = std::numeric_limits<int>::max() / 100;
-
   // ----------------
   // evaluate 1D
   // ----------------
@@ -3808,12 +4884,36 @@ bool NETGENPlugin_Mesher::Evaluate(MapShapeNbElems& aResMap)
   if ( _simpleHyp || ( mparams.minh == 0.0 && _fineness != NETGENPlugin_Hypothesis::UserDefined))
     mparams.minh = GetDefaultMinSize( _shape, mparams.maxh );
 
+  occgeo.face_maxh = mparams.maxh;
+
   // let netgen create _ngMesh and calculate element size on not meshed shapes
   NETGENPlugin_NetgenLibWrapper ngLib;
   netgen::Mesh *ngMesh = NULL;
-  int startWith = netgen::MESHCONST_ANALYSE;
-  int endWith   = netgen::MESHCONST_MESHEDGES;
-  int err = ngLib.GenerateMesh(occgeo, startWith, endWith, ngMesh);
+  int err = ngLib.GenerateMesh(occgeo, netgen::MESHCONST_ANALYSE, netgen::MESHCONST_ANALYSE, ngMesh);
+  if ( !err && ngMesh )
+  {
+    // restrict element size as Compute() does before meshing edges
+    if ( !mparams.uselocalh )
+      ngMesh->LocalHFunction().SetGrading( mparams.grading );
+    if ( _simpleHyp )
+    {
+      double nbSeg   = (double) _simpleHyp->GetNumberOfSegments();
+      double segSize = _simpleHyp->GetLocalLength();
+      for ( int iE = 1; iE <= occgeo.emap.Extent(); ++iE )
+      {
+        const TopoDS_Edge& e = TopoDS::Edge( occgeo.emap(iE));
+        if ( nbSeg )
+          segSize = SMESH_Algo::EdgeLength( e ) / ( nbSeg - 0.4 );
+        setLocalSize( e, segSize, *ngMesh );
+      }
+    }
+    else
+    {
+      SetLocalSize( occgeo, *ngMesh );
+      SetLocalSizeForChordalError( occgeo, *ngMesh );
+    }
+    err = ngLib.GenerateMesh(occgeo, netgen::MESHCONST_MESHEDGES, netgen::MESHCONST_MESHEDGES, ngMesh);
+  }
 
   if(netgen::multithread.terminate)
     return false;
@@ -3824,25 +4924,6 @@ bool NETGENPlugin_Mesher::Evaluate(MapShapeNbElems& aResMap)
       sm->GetComputeError().reset( new SMESH_ComputeError( COMPERR_ALGO_FAILED ));
     return false;
   }
-  // if ( _simpleHyp )
-  // {
-  //   // Pass 1D simple parameters to NETGEN
-  //   // --------------------------------
-  //   int      nbSeg = _simpleHyp->GetNumberOfSegments();
-  //   double segSize = _simpleHyp->GetLocalLength();
-  //   for ( int iE = 1; iE <= occgeo.emap.Extent(); ++iE )
-  //   {
-  //     const TopoDS_Edge& e = TopoDS::Edge( occgeo.emap(iE));
-  //     if ( nbSeg )
-  //       segSize = SMESH_Algo::EdgeLength( e ) / ( nbSeg - 0.4 );
-  //     setLocalSize( e, segSize, *ngMesh );
-  //   }
-  // }
-  // else // if ( ! _simpleHyp )
-  // {
-  //   // Local size on shapes
-  //   SetLocalSize( occgeo, *ngMesh );
-  // }
   // calculate total nb of segments and length of edges
   double fullLen = 0.0;
   smIdType fullNbSeg = 0;
@@ -3906,40 +4987,38 @@ bool NETGENPlugin_Mesher::Evaluate(MapShapeNbElems& aResMap)
       mparams.maxh = fullLen / double( fullNbSeg );
       mparams.grading = 0.2; // slow size growth
     }
+    // as Compute() does, the size grows from the edge segments up to maxh
+    mparams.maxh = min( mparams.maxh, occgeo.boundingbox.Diam()/2 );
+    ngMesh->SetGlobalH( mparams.maxh );
+    netgen::Box<3> bb = occgeo.GetBoundingBox();
+    bb.Increase( bb.Diam()/20 );
+    ngMesh->SetLocalH( bb.PMin(), bb.PMax(), mparams.grading );
+    for ( Edge2NbSegIt.Initialize( Edge2NbSeg ); Edge2NbSegIt.More(); Edge2NbSegIt.Next() )
+      if ( Edge2NbSegIt.Value() > 0 )
+        NETGENPlugin_Estimator::RestrictSize
+          ( *ngMesh, Edge2NbSegIt.Key(),
+            SMESH_Algo::EdgeLength( TopoDS::Edge( Edge2NbSegIt.Key() )) / Edge2NbSegIt.Value() );
   }
-  mparams.maxh = min( mparams.maxh, occgeo.boundingbox.Diam()/2 );
-  mparams.maxh = min( mparams.maxh, fullLen / double( fullNbSeg ) * (1. + mparams.grading));
 
+  // integrate the size field over FACEs
+  NETGENPlugin_Estimator estimator( *ngMesh, occgeo, mparams.secondorder > 0 );
+  TopTools_DataMapOfShapeInteger Face2NbTria;
   for (TopExp_Explorer exp(_shape, TopAbs_FACE); exp.More(); exp.Next())
   {
     TopoDS_Face F = TopoDS::Face( exp.Current() );
-    SMESH_subMesh *sm = _mesh->GetSubMesh(F);
-    GProp_GProps G;
-    BRepGProp::SurfaceProperties(F,G);
-    double anArea = G.Mass();
-    tooManyElems = tooManyElems || ( anArea/hugeNb > mparams.maxh*mparams.maxh );
-    int nb1d = 0;
-    if ( !tooManyElems )
-    {
-      TopTools_MapOfShape edges;
-      for (TopExp_Explorer exp1(F,TopAbs_EDGE); exp1.More(); exp1.Next())
-        if ( edges.Add( exp1.Current() ))
-          nb1d += Edge2NbSeg.Find(exp1.Current());
-    }
-    int nbFaces = tooManyElems ? hugeNb : int( 4*anArea / (mparams.maxh*mparams.maxh*sqrt(3.)));
-    int nbNodes = tooManyElems ? hugeNb : (( nbFaces*3 - (nb1d-1)*2 ) / 6 + 1 );
-
-    vector<smIdType> aVec(SMDSEntity_Last, 0);
-    if( mparams.secondorder > 0 ) {
-      int nb1d_in = (nbFaces*3 - nb1d) / 2;
-      aVec[SMDSEntity_Node] = nbNodes + nb1d_in;
-      aVec[SMDSEntity_Quad_Triangle] = nbFaces;
-    }
-    else {
-      aVec[SMDSEntity_Node] = Max ( nbNodes, 0  );
-      aVec[SMDSEntity_Triangle] = nbFaces;
-    }
-    aResMap[sm].swap(aVec);
+    if ( !Face2NbTria.Bind( F, 0 ))
+      continue;
+    smIdType nb1d = 0;
+    TopTools_MapOfShape edges;
+    for (TopExp_Explorer exp1(F,TopAbs_EDGE); exp1.More(); exp1.Next())
+      if ( edges.Add( exp1.Current() ) && Edge2NbSeg.IsBound( exp1.Current() ))
+        nb1d += Edge2NbSeg.Find(exp1.Current());
+
+    vector<smIdType> aVec;
+    estimator.EvaluateFace( F, nb1d, aVec );
+    Face2NbTria( F ) = (int) std::min( std::max( aVec[SMDSEntity_Triangle], aVec[SMDSEntity_Quad_Triangle] ),
+                                       (smIdType) std::numeric_limits<int>::max() );
+    aResMap[_mesh->GetSubMesh(F)].swap(aVec);
   }
 
   // ----------------
@@ -3960,112 +5039,183 @@ bool NETGENPlugin_Mesher::Evaluate(MapShapeNbElems& aResMap)
       }
       mparams.grading = 0.4;
       mparams.maxh = min( mparams.maxh, fullLen / double( fullNbSeg ) * (1. + mparams.grading));
+
+      // as Compute() does, the size grows from the surface triangles up to maxh
+      ngMesh->SetGlobalH( mparams.maxh );
+      netgen::Box<3> bb = occgeo.GetBoundingBox();
+      bb.Increase( bb.Diam()/20 );
+      ngMesh->SetLocalH( bb.PMin(), bb.PMax(), mparams.grading );
+      TopTools_DataMapIteratorOfDataMapOfShapeInteger Face2NbTriaIt( Face2NbTria );
+      for ( ; Face2NbTriaIt.More(); Face2NbTriaIt.Next() )
+        if ( Face2NbTriaIt.Value() > 0 )
+        {
+          GProp_GProps G;
+          BRepGProp::SurfaceProperties( Face2NbTriaIt.Key(), G );
+          double triaSize = sqrt( 4 * G.Mass() / ( sqrt(3.) * Face2NbTriaIt.Value() ));
+          NETGENPlugin_Estimator::RestrictSize( *ngMesh, Face2NbTriaIt.Key(), triaSize );
+        }
     }
-    GProp_GProps G;
-    BRepGProp::VolumeProperties(_shape,G);
-    double aVolume = G.Mass();
-    double tetrVol = 0.1179*mparams.maxh*mparams.maxh*mparams.maxh;
-    tooManyElems = tooManyElems || ( aVolume/hugeNb > tetrVol );
-    int nbVols = tooManyElems ? hugeNb : int(aVolume/tetrVol);
-    int nb1d_in = int(( nbVols*6 - fullNbSeg ) / 6 );
-    vector<smIdType> aVec(SMDSEntity_Last, 0 );
-    if ( tooManyElems ) // avoid FPE
-    {
-      aVec[SMDSEntity_Node] = hugeNb;
-      aVec[ mparams.secondorder > 0 ? SMDSEntity_Quad_Tetra : SMDSEntity_Tetra] = hugeNb;
-    }
-    else
+
+    // integrate the size field over SOLIDs
+    TopTools_MapOfShape solids;
+    for (TopExp_Explorer exp(_shape, TopAbs_SOLID); exp.More(); exp.Next())
     {
-      if( mparams.secondorder > 0 ) {
-        aVec[SMDSEntity_Node] = nb1d_in/3 + 1 + nb1d_in;
-        aVec[SMDSEntity_Quad_Tetra] = nbVols;
-      }
-      else {
-        aVec[SMDSEntity_Node] = nb1d_in/3 + 1;
-        aVec[SMDSEntity_Tetra] = nbVols;
-      }
+      if ( !solids.Add( exp.Current() ))
+        continue;
+      smIdType nbBndFaces = 0;
+      TopTools_MapOfShape faces;
+      for (TopExp_Explorer exp1(exp.Current(),TopAbs_FACE); exp1.More(); exp1.Next())
+        if ( faces.Add( exp1.Current() ) && Face2NbTria.IsBound( exp1.Current() ))
+          nbBndFaces += Face2NbTria.Find( exp1.Current() );
+
+      vector<smIdType> aVec;
+      estimator.EvaluateSolid( exp.Current(), nbBndFaces, aVec );
+      aResMap[_mesh->GetSubMesh(exp.Current())].swap(aVec);
     }
-    SMESH_subMesh *sm = _mesh->GetSubMesh(_shape);
-    aResMap[sm].swap(aVec);
   }
 
+  NETGENPlugin_Estimator::CheckPeakMemory( aResMap, _mesh->GetSubMesh(_shape) );
+
+  ngLib._isComputeOk = true;
   return true;
 }
 
-double NETGENPlugin_Mesher::GetProgress(const SMESH_Algo* /*holder*/,
-                                        const int *       algoProgressTic,
-                                        const double *    algoProgress) const
+//================================================================================
+/*!
+ * \brief Set amounts of work of meshing stages to predict their duration.
+ *        Numbers of elements are roughly estimated by areas and volumes of
+ *        shapes and by the netgen size field at their centers; an error
+ *        common to similar shapes is compensated by the calibrated rates
+ */
+//================================================================================
+
+void NETGENPlugin_Mesher::SetProgressWork( const netgen::OCCGeometry&       occgeo,
+                                           const netgen::MeshingParameters& mparams )
 {
-  ((int&) _progressTic ) = *algoProgressTic + 1;
+  const double triaArea    = sqrt( 3. ) / 4.;         // equilateral triangle of unit side
+  const double tetraVolume = 1. / ( 6. * sqrt( 2. )); // regular tetrahedron of unit edge
 
-  if ( !_occgeom ) return 0;
+  // number of elements of a size given at the center of a shape
+  auto nbElements = [&]( const GProp_GProps& props, double elemSize, int dim )
+  {
+    double size = Abs( props.Mass() ); // volume of a reversed SOLID is negative
+    if ( size <= std::numeric_limits<double>::min() )
+      return 0.;
+    gp_Pnt p = props.CentreOfMass();
+    double h = _ngMesh->GetH( netgen::Point3d( p.X(), p.Y(), p.Z() ));
+    h = Max( Min( h, (double) mparams.maxh ), (double) mparams.minh );
+    return h > 0 ? size / ( elemSize * pow( h, dim )) : 0.;
+  };
 
-  double progress = -1;
-  if ( !_isVolume )
+  double nbTria = 0;
+  for ( int i = 1; i <= occgeo.fmap.Extent(); ++i )
   {
-    if ( _ticTime < 0 && netgen::multithread.task[0] == 'O'/*Optimizing surface*/ )
-    {
-      ((double&) _ticTime ) = edgeFaceMeshingTime / _totalTime / _progressTic;
-    }
-    else if ( !_optimize /*&& _occgeom->fmap.Extent() > 1*/ )
-    {
-      int doneShapeIndex = -1;
-      while ( doneShapeIndex+1 < _occgeom->facemeshstatus.Size() &&
-              _occgeom->facemeshstatus[ doneShapeIndex+1 ])
-        doneShapeIndex++;
-      if ( doneShapeIndex+1 != _curShapeIndex )
-      {
-        ((int&) _curShapeIndex) = doneShapeIndex+1;
-        double    doneShapeRate = _curShapeIndex / double( _occgeom->fmap.Extent() );
-        double         doneTime = edgeMeshingTime + doneShapeRate * faceMeshingTime;
-        ((double&)    _ticTime) = doneTime / _totalTime / _progressTic;
-        // cout << "shape " << _curShapeIndex << " _ticTime " << _ticTime
-        //      << " " << doneTime / _totalTime / _progressTic << endl;
-      }
-    }
+    GProp_GProps props;
+    BRepGProp::SurfaceProperties( occgeo.fmap( i ), props );
+    nbTria += Max( 2., nbElements( props, triaArea, 2 ));
   }
-  else if ( !_optimize && _occgeom->somap.Extent() > 1 )
-  {
-    int curShapeIndex = _curShapeIndex;
-    if ( _ngMesh->GetNE() > 0 )
-    {
-      netgen::Element el = (*_ngMesh)[netgen::ElementIndex( _ngMesh->GetNE()-1 )];
-      curShapeIndex = el.GetIndex();
-    }
-    if ( curShapeIndex != _curShapeIndex )
+
+  double nbTetra = 0;
+  if ( _isVolume )
+    for ( int i = 1; i <= occgeo.somap.Extent(); ++i )
     {
-      ((int&) _curShapeIndex) = curShapeIndex;
-      double    doneShapeRate = _curShapeIndex / double( _occgeom->somap.Extent() );
-      double         doneTime = edgeFaceMeshingTime + doneShapeRate * voluMeshingTime;
-      ((double&)    _ticTime) = doneTime / _totalTime / _progressTic;
-      // cout << "shape " << _curShapeIndex << " _ticTime " << _ticTime
-      //      << " " << doneTime / _totalTime / _progressTic << endl;
+      GProp_GProps props;
+      BRepGProp::VolumeProperties( occgeo.somap( i ), props );
+      nbTetra += Max( 1., nbElements( props, tetraVolume, 3 ));
     }
-  }
 
-  if ( _ticTime > 0 )
-    progress  = Max( *algoProgressTic * _ticTime, *algoProgress );
+  // optimization work is proportional to number of passes
+  const double nbPasses2D = mparams.optsteps2d * std::string( mparams.optimize2d ).size();
+  const double nbPasses3D = mparams.optsteps3d * std::string( mparams.optimize3d ).size();
+
+  typedef NETGENPlugin_ProgressModel TModel;
+  _progressModel.SetWork( TModel::FACES,       nbTria );
+  _progressModel.SetWork( TModel::OPT_FACES,   _optimize ? nbTria * nbPasses2D : 0 );
+  _progressModel.SetWork( TModel::VOLUMES,     nbTetra );
+  _progressModel.SetWork( TModel::OPT_VOLUMES, _optimize ? nbTetra * nbPasses3D : 0 );
+  _progressModel.SetWork( TModel::FILL_SMESH,  ( nbTria + nbTetra ) * ( mparams.secondorder ? 2 : 1 ));
+
+  MESSAGE("NETGEN predicted time: " << _progressModel.RemainingTime() << " s for "
+          << nbTria << " triangles and " << nbTetra << " tetrahedra");
+}
+
+//================================================================================
+/*!
+ * \brief Return progress of Compute() [0.,1] according to completion of its
+ *        current stage signaled by netgen
+ */
+//================================================================================
+
+double NETGENPlugin_Mesher::GetProgress(const SMESH_Algo* holder,
+                                        const int *       algoProgressTic,
+                                        const double *    algoProgress) const
+{
+  if ( !_occgeom ) return 0;
+
+  typedef NETGENPlugin_ProgressModel TModel;
 
-  if ( progress > 0 )
+  double stageDone = -1; // unknown, the model uses elapsed time
+  switch ( _progressModel.Stage() )
+  {
+  case TModel::FACES:
   {
-    if ( _isVolume &&
-         netgen::multithread.task[0] == 'D'/*elaunay meshing*/ &&
-         progress > voluMeshingTime )
+    // surface optimization is run by the same netgen call
+    if ( _optimize &&
+         NETGENPlugin_NetgenContext::Task( holder ).compare( 0, 18, "Optimizing surface" ) == 0 )
     {
-      progress = voluMeshingTime;
-      ((double&) _ticTime) = voluMeshingTime / _totalTime / _progressTic;
+      _progressModel.Reach( TModel::OPT_FACES );
+      stageDone = 0;
+      break;
     }
-    ((int&) *algoProgressTic )++;
-    ((double&) *algoProgress) = progress;
+    // netgen percent advances by FACEs
+    int nbDone = 0;
+    for ( int i = 0; i < _occgeom->facemeshstatus.Size(); ++i )
+      nbDone += ( _occgeom->facemeshstatus[ i ] != 0 );
+    if ( _occgeom->fmap.Extent() > 0 )
+      stageDone = nbDone / double( _occgeom->fmap.Extent() );
+    stageDone = Max( stageDone, NETGENPlugin_NetgenContext::Percent( holder ) / 100. );
+    stageDone *= _progressModel.Share( TModel::FACES );
+    break;
+  }
+  case TModel::OPT_FACES:
+  case TModel::OPT_VOLUMES:
+  {
+    // netgen percent advances by optimization passes
+    stageDone = NETGENPlugin_NetgenContext::Percent( holder ) / 100.;
+    break;
+  }
+  case TModel::VOLUMES:
+  {
+    // parallel jobs add tetrahedra to _ngMesh at the end only
+    if ( double nbTetra = _progressModel.Work( TModel::VOLUMES ))
+      stageDone = Min( 0.99, ( _ngMesh->GetNE() + _progressModel.DoneElements() ) / nbTetra );
+    break;
+  }
+  default:;
   }
-  //cout << progress << " "  << *algoProgressTic << " " << netgen::multithread.task << " "<< _ticTime << endl;
 
-  return Min( progress, 0.99 );
+  double progress = _progressModel.Progress( stageDone );
+
+  ((int&) *algoProgressTic )++;
+  ((double&) *algoProgress) = progress;
+
+  return progress;
+}
+
+//================================================================================
+/*!
+ * \brief Return predicted time in seconds till the end of Compute()
+ */
+//================================================================================
+
+double NETGENPlugin_Mesher::GetRemainingTime() const
+{
+  return _progressModel.RemainingTime();
 }
 
 //================================================================================
 /*!
- * \brief Read mesh entities preventing successful computation from "test.out" file
+ * \brief Return mesh entities preventing successful computation reported by netgen to testout
  */
 //================================================================================
 
@@ -4076,57 +5226,33 @@ NETGENPlugin_Mesher::ReadErrors(const vector<const SMDS_MeshNode* >& nodeVec)
   SMESH_BadInputElements* err =
     new SMESH_BadInputElements( nodeVec.back()->GetMesh(), COMPERR_BAD_INPUT_MESH,
                                 "Some edges multiple times in surface mesh");
-  SMESH_File file("test.out");
-  vector<int> two(2);
-  vector<int> three1(3), three2(3);
-  const char* badEdgeStr = " multiple times in surface mesh";
-  const int   badEdgeStrLen = (int) strlen( badEdgeStr );
-  const int   nbNodes = (int) nodeVec.size();
-
-  while( !file.eof() )
-  {
-    if ( strncmp( file, "Edge ", 5 ) == 0 &&
-         file.getInts( two ) &&
-         strncmp( file, badEdgeStr, badEdgeStrLen ) == 0 &&
-         two[0] < nbNodes  &&  two[1] < nbNodes )
-    {
-      err->myBadElements.push_back( new SMDS_LinearEdge( nodeVec[ two[0]], nodeVec[ two[1]] ));
-      file += (int) badEdgeStrLen;
-    }
-    else if ( strncmp( file, "Intersecting: ", 14 ) == 0 )
-    {
-// Intersecting:
-// openelement 18 with open element 126
-// 41  36  38
-// 69  70  72
-      file.getLine();
-      const char* pos = file;
-      bool ok = ( strncmp( file, "openelement ", 12 ) == 0 );
-      ok = ok && file.getInts( two );
-      ok = ok && file.getInts( three1 );
-      ok = ok && file.getInts( three2 );
-      for ( int i = 0; ok && i < 3; ++i )
-        ok = ( three1[i] < nbNodes && nodeVec[ three1[i]]);
-      for ( int i = 0; ok && i < 3; ++i )
-        ok = ( three2[i] < nbNodes && nodeVec[ three2[i]]);
-      if ( ok )
-      {
-        err->myBadElements.push_back( new SMDS_FaceOfNodes( nodeVec[ three1[0]],
-                                                            nodeVec[ three1[1]],
-                                                            nodeVec[ three1[2]]));
-        err->myBadElements.push_back( new SMDS_FaceOfNodes( nodeVec[ three2[0]],
-                                                            nodeVec[ three2[1]],
-                                                            nodeVec[ three2[2]]));
-        err->myComment = "Intersecting triangles";
-      }
-      else
-      {
-        file.setPos( pos );
-      }
-    }
-    else
+  NETGENPlugin_ErrorCollector* errors =
+    dynamic_cast< NETGENPlugin_ErrorCollector* >( netgen::testout );
+  if ( !errors )
+    return SMESH_ComputeErrorPtr( err );
+
+  const int nbNodes = (int) nodeVec.size();
+
+  for ( const NETGENPlugin_ErrorCollector::TEdge& edge : errors->BadEdges() )
+  {
+    if ( edge[0] < nbNodes  &&  edge[1] < nbNodes )
+      err->myBadElements.push_back( new SMDS_LinearEdge( nodeVec[ edge[0]], nodeVec[ edge[1]] ));
+  }
+
+  for ( const NETGENPlugin_ErrorCollector::TFacePair& faces : errors->IntersectingFaces() )
+  {
+    bool ok = true;
+    for ( int i = 0; ok && i < 6; ++i )
+      ok = ( faces[i] < nbNodes && nodeVec[ faces[i]]);
+    if ( ok )
     {
-      ++file;
+      err->myBadElements.push_back( new SMDS_FaceOfNodes( nodeVec[ faces[0]],
+                                                          nodeVec[ faces[1]],
+                                                          nodeVec[ faces[2]]));
+      err->myBadElements.push_back( new SMDS_FaceOfNodes( nodeVec[ faces[3]],
+                                                          nodeVec[ faces[4]],
+                                                          nodeVec[ faces[5]]));
+      err->myComment = "Intersecting triangles";
     }
   }
 
@@ -4223,211 +5349,1200 @@ void NETGENPlugin_Mesher::toPython( const netgen::Mesh* ngMesh )
     outfile << (*ngMesh)[pi](2) << ") ## "<< pi << std::endl;
   }
 
-  int nbDom = ngMesh->GetNDomains();
-  for ( int i = 0; i < nbDom; ++i )
-    outfile<< "grp" << i+1 << " = mesh.CreateEmptyGroup( SMESH.FACE, 'domain"<< i+1 << "')"<< std::endl;
+  int nbDom = ngMesh->GetNDomains();
+  for ( int i = 0; i < nbDom; ++i )
+    outfile<< "grp" << i+1 << " = mesh.CreateEmptyGroup( SMESH.FACE, 'domain"<< i+1 << "')"<< std::endl;
+
+  int nbDel = 0;
+  SurfaceElementIndex sei;
+  for (sei = 0; sei < ngMesh->GetNSE(); sei++)
+  {
+    outfile << "mesh.AddFace([ ";
+    Element2d sel = (*ngMesh)[sei];
+    for (int j = 0; j < sel.GetNP(); j++)
+      outfile << sel[j] << ( j+1 < sel.GetNP() ? ", " : " ])");
+    if ( sel.IsDeleted() ) outfile << " ## IsDeleted ";
+    outfile << std::endl;
+    nbDel += sel.IsDeleted();
+
+    if ((*ngMesh)[sei].GetIndex())
+    {
+      if ( int dom1 = ngMesh->GetFaceDescriptor((*ngMesh)[sei].GetIndex ()).DomainIn())
+        outfile << "grp"<< dom1 <<".Add([ " << (int)sei+1 - nbDel << " ])" << std::endl;
+      if ( int dom2 = ngMesh->GetFaceDescriptor((*ngMesh)[sei].GetIndex ()).DomainOut())
+        outfile << "grp"<< dom2 <<".Add([ " << (int)sei+1 - nbDel  << " ])" << std::endl;
+    }
+  }
+
+  for (ElementIndex ei = 0; ei < ngMesh->GetNE(); ei++)
+  {
+    Element el = (*ngMesh)[ei];
+    outfile << "mesh.AddVolume([ ";
+    for (int j = 0; j < el.GetNP(); j++)
+      outfile << el[j] << ( j+1 < el.GetNP() ? ", " : " ])");
+    outfile << std::endl;
+  }
+
+  for (int i = 1; i <= ngMesh->GetNSeg(); i++)
+  {
+    const Segment & seg = ngMesh->LineSegment (i);
+    outfile << "mesh.AddEdge([ "
+            << seg[0] << ", "
+            << seg[1] << " ])" << std::endl;
+  }
+
+#endif
+
+  std::cout << "Write " << pyFile << std::endl;
+}
+
+//================================================================================
+/*!
+ * \brief Constructor of NETGENPlugin_ngMeshInfo
+ */
+//================================================================================
+
+NETGENPlugin_ngMeshInfo::NETGENPlugin_ngMeshInfo( netgen::Mesh* ngMesh,
+                                                  bool          checkRemovedElems):
+  _elementsRemoved( false ), _copyOfLocalH(0)
+{
+  if ( ngMesh )
+  {
+    _nbNodes    = ngMesh->GetNP();
+    _nbSegments = ngMesh->GetNSeg();
+    _nbFaces    = ngMesh->GetNSE();
+    _nbVolumes  = ngMesh->GetNE();
+
+    if ( checkRemovedElems )
+      for ( int i = 1; i <= ngMesh->GetNSE() &&  !_elementsRemoved; ++i )
+        _elementsRemoved = ngMesh->SurfaceElement(i).IsDeleted();
+  }
+  else
+  {
+    _nbNodes = _nbSegments = _nbFaces = _nbVolumes = 0;
+  }
+}
+
+//================================================================================
+/*!
+ * \brief Copy LocalH member from one netgen mesh to another
+ */
+//================================================================================
+
+void NETGENPlugin_ngMeshInfo::transferLocalH( netgen::Mesh* fromMesh,
+                                              netgen::Mesh* toMesh )
+{
+  if ( !fromMesh->LocalHFunctionGenerated() ) return;
+  if ( !toMesh->LocalHFunctionGenerated() )
+    NETGENPlugin_NetgenLibWrapper::CalcLocalH( toMesh );
+
+  const size_t size = sizeof( netgen::LocalH );
+  _copyOfLocalH = new char[ size ];
+  memcpy( (void*)_copyOfLocalH, (void*)&toMesh->LocalHFunction(), size );
+  memcpy( (void*)&toMesh->LocalHFunction(), (void*)&fromMesh->LocalHFunction(), size );
+}
+
+//================================================================================
+/*!
+ * \brief Restore LocalH member of a netgen mesh
+ */
+//================================================================================
+
+void NETGENPlugin_ngMeshInfo::restoreLocalH( netgen::Mesh* toMesh )
+{
+  if ( _copyOfLocalH )
+  {
+    const size_t size = sizeof( netgen::LocalH );
+    memcpy( (void*)&toMesh->LocalHFunction(), (void*)_copyOfLocalH, size );
+    delete [] _copyOfLocalH;
+    _copyOfLocalH = 0;
+  }
+}
+
+//================================================================================
+/*!
+ * \brief Create an empty map
+ */
+//================================================================================
+
+NETGENPlugin_NodeIdMap::NETGENPlugin_NodeIdMap( const SMDS_Mesh* mesh ):
+  _mesh( mesh )
+{
+  if ( _mesh )
+    _ngIDs.resize( _mesh->MaxNodeID() + 1, 0 );
+}
+
+//================================================================================
+/*!
+ * \brief Return netgen id of a node, 0 if it is not set yet
+ */
+//================================================================================
+
+int& NETGENPlugin_NodeIdMap::operator[]( const SMDS_MeshNode* node )
+{
+  smIdType id = node->GetID();
+  if ( id > 0 && node->GetMesh() == _mesh )
+  {
+    if ( id >= (smIdType) _ngIDs.size() )
+      _ngIDs.resize( id + 1, 0 );
+    return _ngIDs[ id ];
+  }
+  return _otherNodes[ node ];
+}
+
+//================================================================================
+/*!
+ * \brief Create nodes of netgen points starting from fromNgID
+ *  \param [in] ngMesh - netgen mesh
+ *  \param [inout] nodeVec - vector of nodes in which node index == netgen ID
+ *  \param [in] fromNgID - id of the first netgen point to transfer
+ *  \param [in] solidID - SMESHDS id of a SOLID to set nodes in, 0 means none
+ */
+//================================================================================
+
+void NETGENPlugin_BulkFiller::AddNodes( const netgen::Mesh&                  ngMesh,
+                                        std::vector< const SMDS_MeshNode* >& nodeVec,
+                                        int                                  fromNgID,
+                                        int                                  solidID )
+{
+  const int nbNodes = ngMesh.GetNP();
+  if ( (int) nodeVec.size() < nbNodes + 1 )
+    nodeVec.resize( nbNodes + 1, 0 );
+
+  for ( int ngID = fromNgID; ngID <= nbNodes; ++ngID )
+  {
+    const netgen::MeshPoint& ngPoint = ngMesh.Point( ngID );
+    SMDS_MeshNode* node = _meshDS->AddNode( NGPOINT_COORDS( ngPoint ));
+    if ( solidID > 0 )
+      _meshDS->SetNodeInVolume( node, solidID );
+    nodeVec[ ngID ] = node;
+  }
+}
+
+//================================================================================
+/*!
+ * \brief Create linear tetrahedra of netgen volume elements
+ *  \param [in] ngMesh - netgen mesh
+ *  \param [in] nodeVec - vector of nodes in which node index == netgen ID
+ *  \param [in] solidID - SMESHDS id of a SOLID to set tetrahedra in, 0 means none
+ *  \return int - nb of not created tetrahedra
+ */
+//================================================================================
+
+int NETGENPlugin_BulkFiller::AddTetrahedra( const netgen::Mesh&                        ngMesh,
+                                            const std::vector< const SMDS_MeshNode* >& nodeVec,
+                                            int                                        solidID )
+{
+  const int nbVol = ngMesh.GetNE();
+  const int nbNodes = (int) nodeVec.size();
+  int nbBad = 0;
+  const SMDS_MeshNode* nodes[4];
+  for ( int i = 1; i <= nbVol; ++i )
+  {
+    const netgen::Element& elem = ngMesh.VolumeElement( i );
+    int j = 0;
+    for ( ; j < 4; ++j )
+    {
+      int pind = elem.PNum( j + 1 );
+      if ( pind < 1 || pind >= nbNodes || !( nodes[ j ] = nodeVec[ pind ]))
+        break;
+    }
+    SMDS_MeshVolume* vol = 0;
+    if ( j == 4 )
+      vol = _meshDS->AddVolume( nodes[0], nodes[1], nodes[2], nodes[3] );
+    if ( !vol )
+      ++nbBad;
+    else if ( solidID > 0 )
+      _meshDS->SetMeshElementOnShape( vol, solidID );
+  }
+  return nbBad;
+}
+
+//================================================================================
+/*!
+ * \brief Return SMESHDS ids of shapes, 0 for a shape not in the mesh
+ *  \param [in] shapes - e.g. occgeo.fmap
+ *  \return std::vector< int > - ids indexed as shapes
+ */
+//================================================================================
+
+std::vector< int > NETGENPlugin_BulkFiller::ShapeIDs( const TopTools_IndexedMapOfShape& shapes ) const
+{
+  std::vector< int > ids( shapes.Extent() + 1, 0 );
+  for ( int i = 1; i <= shapes.Extent(); ++i )
+    ids[ i ] = _meshDS->ShapeToIndex( shapes( i ));
+  return ids;
+}
+
+//================================================================================
+/*!
+ * \brief Gather shapes of a given type into orbits of instances and periodic images
+ *  \param [in] mesh - the mesh
+ *  \param [in] shapeType - type of shapes to copy meshes of
+ *  \param [in] hyp - hypothesis possibly defining periodicity
+ */
+//================================================================================
+
+NETGENPlugin_InstanceCopier::NETGENPlugin_InstanceCopier( SMESH_Mesh&                    mesh,
+                                                          TopAbs_ShapeEnum               shapeType,
+                                                          const NETGENPlugin_Hypothesis* hyp )
+  : _mesh( &mesh )
+{
+  // transformations of a shape into its periodic images
+  std::vector< gp_Trsf > periods;
+  if ( hyp && hyp->GetPeriodicity() != NETGENPlugin_Hypothesis::NoPeriodicity )
+  {
+    const double* p = hyp->GetPeriodicityParameters();
+    const bool isRotation = ( hyp->GetPeriodicity() == NETGENPlugin_Hypothesis::RotationalPeriodicity );
+    gp_Trsf period, trsf;
+    if ( isRotation )
+      period.SetRotation( gp_Ax1( gp_Pnt( p[0], p[1], p[2] ), gp_Dir( p[3], p[4], p[5] )),
+                          2. * M_PI / hyp->GetNbPeriods() );
+    else
+      period.SetTranslation( gp_Vec( p[3], p[4], p[5] ));
+    for ( int i = 1; i < hyp->GetNbPeriods(); ++i )
+    {
+      trsf.Multiply( period );
+      periods.push_back( trsf );
+      if ( !isRotation )
+        periods.push_back( trsf.Inverted() );
+    }
+  }
+  const bool toFindInstances = IsEnabled();
+  if ( periods.empty() && !toFindInstances )
+  {
+    _orbits.reset( new TOrbits );
+    return;
+  }
+
+  // orbits depend on the shape only, they are found once
+  TOrbitsKey key = { double( shapeType ), double( toFindInstances ) };
+  if ( !periods.empty() )
+  {
+    const double* p = hyp->GetPeriodicityParameters();
+    key.push_back( hyp->GetPeriodicity() );
+    key.push_back( hyp->GetNbPeriods() );
+    key.insert( key.end(), p, p + 6 );
+  }
+  _orbits = TShapeIndexCache::GetOrbits( mesh, key );
+  if ( _orbits )
+    return;
+  std::shared_ptr< TOrbits > orbits( new TOrbits );
+
+  SMESHDS_Mesh* meshDS = mesh.GetMeshDS();
+  TopTools_IndexedMapOfShape shapes;
+  TopExp::MapShapes( mesh.GetShapeToMesh(), shapeType, shapes );
+  const int nbShapes = shapes.Extent();
+
+  // instances share TShape
+  std::map< const TopoDS_TShape*, std::vector< int > > instances; // indices in shapes
+  if ( toFindInstances )
+    for ( int i = 1; i <= nbShapes; ++i )
+      instances[ shapes( i ).TShape().get() ].push_back( i );
+
+  // periodic images have equally placed VERTEXes
+  std::vector< TVertexCloud >  clouds;
+  std::multimap< double, int > cloudsBySpread;
+  double tol = 0;
+  if ( !periods.empty() )
+  {
+    tol = Max( SMESH_MesherHelper::MaxTolerance( mesh.GetShapeToMesh() ), Precision::Confusion() );
+    clouds.resize( nbShapes + 1 );
+    for ( int i = 1; i <= nbShapes; ++i )
+    {
+      clouds[ i ].Init( shapes( i ));
+      cloudsBySpread.insert( std::make_pair( clouds[ i ]._spread, i ));
+    }
+  }
+
+  // gather shapes into orbits
+
+  std::vector< int >     roots( nbShapes + 1, 0 );
+  std::vector< gp_Trsf > fromRoot( nbShapes + 1 );
+  for ( int iRoot = 1; iRoot <= nbShapes; ++iRoot )
+  {
+    if ( roots[ iRoot ])
+      continue;
+    roots[ iRoot ] = iRoot;
+    std::vector< int > orbit( 1, iRoot );
+    for ( size_t iO = 0; iO < orbit.size(); ++iO )
+    {
+      const int i = orbit[ iO ];
+      if ( toFindInstances )
+        for ( int j : instances[ shapes( i ).TShape().get() ])
+          if ( !roots[ j ])
+          {
+            roots[ j ] = iRoot;
+            fromRoot[ j ] = (( shapes( j ).Location() * shapes( i ).Location().Inverted() ).Transformation() *
+                             fromRoot[ i ]);
+            orbit.push_back( j );
+          }
+      if ( periods.empty() )
+        continue;
+      const TVertexCloud& cloud = clouds[ i ];
+      const double  spreadTol = 2. * sqrt( cloud._nbVertices * cloud._spread ) * tol + 1e-9 * cloud._spread;
+      auto s2i    = cloudsBySpread.lower_bound( cloud._spread - spreadTol );
+      auto s2iEnd = cloudsBySpread.upper_bound( cloud._spread + spreadTol );
+      for ( const gp_Trsf& period : periods )
+      {
+        gp_XYZ center = cloud._center;
+        period.Transforms( center );
+        for ( auto s2j = s2i; s2j != s2iEnd; ++s2j )
+        {
+          const int j = s2j->second;
+          if ( !roots[ j ] &&
+               clouds[ j ]._nbVertices == cloud._nbVertices &&
+               ( clouds[ j ]._center - center ).SquareModulus() <= tol * tol )
+          {
+            roots[ j ] = iRoot;
+            fromRoot[ j ] = period * fromRoot[ i ];
+            orbit.push_back( j );
+            break;
+          }
+        }
+      }
+    }
+    if ( orbit.size() < 2 )
+      continue;
+
+    const int rootID = meshDS->ShapeToIndex( shapes( iRoot ));
+    std::vector< int >& ids = orbits->_shapes[ rootID ];
+    for ( int i : orbit )
+    {
+      ids.push_back( meshDS->ShapeToIndex( shapes( i )));
+      TMember& member = orbits->_members[ ids.back() ];
+      member._root     = rootID;
+      member._fromRoot = fromRoot[ i ];
+    }
+  }
+  _orbits = orbits;
+  TShapeIndexCache::AddOrbits( mesh, key, _orbits );
+}
+
+//================================================================================
+/*!
+ * \brief Return false if SALOME_NETGEN_DISABLE_INSTANCE_COPY environment variable is set.
+ *        Periodic images defined by the hypothesis are copied anyway.
+ */
+//================================================================================
+
+bool NETGENPlugin_InstanceCopier::IsEnabled()
+{
+  return !getenv( "SALOME_NETGEN_DISABLE_INSTANCE_COPY" );
+}
+
+//================================================================================
+/*!
+ * \brief Check if a shape has other instances
+ */
+//================================================================================
+
+bool NETGENPlugin_InstanceCopier::HasInstances( const TopoDS_Shape& shape ) const
+{
+  return _orbits->_members.count( _mesh->GetMeshDS()->ShapeToIndex( shape ));
+}
+
+//================================================================================
+/*!
+ * \brief Return ID of the first shape among instances of a shape
+ */
+//================================================================================
+
+int NETGENPlugin_InstanceCopier::Orbit( const TopoDS_Shape& shape ) const
+{
+  const int shapeID = _mesh->GetMeshDS()->ShapeToIndex( shape );
+  auto id2m = _orbits->_members.find( shapeID );
+  return id2m == _orbits->_members.end() ? shapeID : id2m->second._root;
+}
+
+//================================================================================
+/*!
+ * \brief Return a meshed instance of a shape computed by the same algorithm
+ *        with the same hypotheses
+ *  \param [out] trsf - transformation of the found instance into the shape
+ */
+//================================================================================
+
+TopoDS_Shape NETGENPlugin_InstanceCopier::FindComputed( const TopoDS_Shape& shape,
+                                                        SMESH_Algo*         algo,
+                                                        gp_Trsf&            trsf ) const
+{
+  SMESHDS_Mesh* meshDS = _mesh->GetMeshDS();
+  const int    shapeID = meshDS->ShapeToIndex( shape );
+  auto id2m = _orbits->_members.find( shapeID );
+  if ( id2m == _orbits->_members.end() )
+    return TopoDS_Shape();
+
+  const std::list< const SMESHDS_Hypothesis* > hyps =
+    algo->GetUsedHypothesis( *_mesh, shape, /*ignoreAuxiliary=*/false );
+
+  for ( int id : _orbits->_shapes.find( id2m->second._root )->second )
+  {
+    if ( id == shapeID )
+      continue;
+    const TopoDS_Shape& instance = meshDS->IndexToShape( id );
+    SMESH_subMesh*            sm = _mesh->GetSubMeshContaining( id );
+    if ( !sm || !sm->IsMeshComputed() ||
+         _mesh->GetGen()->GetAlgo( sm ) != algo ||
+         algo->GetUsedHypothesis( *_mesh, instance, /*ignoreAuxiliary=*/false ) != hyps )
+      continue;
+
+    if ( instance.IsPartner( shape ))
+      trsf = ( shape.Location() * instance.Location().Inverted() ).Transformation();
+    else
+      trsf = id2m->second._fromRoot * _orbits->_members.find( id )->second._fromRoot.Inverted();
+    return instance;
+  }
+  return TopoDS_Shape();
+}
+
+//================================================================================
+/*!
+ * \brief Copy the mesh of srcShape to its instance
+ *  \param [in] srcShape - a meshed FACE or SOLID
+ *  \param [in] tgtShape - not meshed instance of srcShape with meshed boundary
+ *  \param [in] trsf - transformation of srcShape into tgtShape
+ *  \return bool - false if the boundary of tgtShape is meshed differently
+ */
+//================================================================================
+
+bool NETGENPlugin_InstanceCopier::Copy( const TopoDS_Shape& srcShape,
+                                        const TopoDS_Shape& tgtShape,
+                                        const gp_Trsf&      trsf )
+{
+  if ( srcShape.IsSame( tgtShape ) || srcShape.ShapeType() != tgtShape.ShapeType() )
+    return false;
+
+  SMESHDS_Mesh* meshDS = _mesh->GetMeshDS();
+  const int srcID = meshDS->ShapeToIndex( srcShape );
+  const int tgtID = meshDS->ShapeToIndex( tgtShape );
+  SMESHDS_SubMesh* srcSM = meshDS->MeshElements( srcID );
+  SMESHDS_SubMesh* tgtSM = meshDS->MeshElements( tgtID );
+  if ( !srcSM || srcSM->NbElements() == 0 ||
+       ( tgtSM && ( tgtSM->NbElements() > 0 || tgtSM->NbNodes() > 0 )))
+    return false;
+
+  const double tol = Max( SMESH_MesherHelper::MaxTolerance( tgtShape ), Precision::Confusion() );
+
+  // map nodes of the boundary
+
+  std::vector< const SMDS_MeshNode* > srcNodes = boundaryNodes( meshDS, srcShape );
+  std::vector< const SMDS_MeshNode* > tgtNodes = boundaryNodes( meshDS, tgtShape );
+  if ( srcNodes.size() != tgtNodes.size() )
+    return false;
+
+  std::map< const SMDS_MeshNode*, const SMDS_MeshNode* > src2tgtNodes;
+  if ( !srcNodes.empty() )
+  {
+    TNodePoints tgtNodePoints{ tgtNodes };
+    TSpatialHash< TNodePoints > tgtHash( tgtNodePoints, tgtNodes.size(), tol );
+    std::vector< bool > isTgtUsed( tgtNodes.size(), false );
+    for ( const SMDS_MeshNode* n : srcNodes )
+    {
+      gp_XYZ p = SMESH_NodeXYZ( n );
+      trsf.Transforms( p );
+      size_t iTgt = tgtHash.Find( p );
+      if ( iTgt == tgtNodes.size() || isTgtUsed[ iTgt ]) // the mapping must be one-to-one
+        return false;
+      isTgtUsed[ iTgt ] = true;
+      src2tgtNodes.insert( std::make_pair( n, tgtNodes[ iTgt ]));
+    }
+  }
+
+  // check that elements of srcShape use only the mapped nodes and own ones
+
+  for ( SMDS_ElemIteratorPtr eIt = srcSM->GetElements(); eIt->more(); )
+  {
+    const SMDS_MeshElement* elem = eIt->next();
+    for ( int i = 0; i < elem->NbNodes(); ++i )
+    {
+      const SMDS_MeshNode* n = elem->GetNode( i );
+      if ( n->GetShapeID() != srcID && !src2tgtNodes.count( n ))
+        return false;
+    }
+  }
+
+  // place internal nodes; UV on a FACE of another TShape are found by projection
+
+  const bool isFace = ( srcShape.ShapeType() == TopAbs_FACE );
+  Handle(ShapeAnalysis_Surface) tgtSurface;
+  if ( isFace && !srcShape.IsPartner( tgtShape ))
+    tgtSurface = new ShapeAnalysis_Surface( BRep_Tool::Surface( TopoDS::Face( tgtShape )));
+
+  std::vector< const SMDS_MeshNode* > srcInNodes;
+  std::vector< gp_XYZ >               tgtPoints;
+  std::vector< gp_XY >                tgtUV;
+  srcInNodes.reserve( srcSM->NbNodes() );
+  tgtPoints.reserve( srcSM->NbNodes() );
+  gp_Pnt2d uv;
+  for ( SMDS_NodeIteratorPtr nIt = srcSM->GetNodes(); nIt->more(); )
+  {
+    const SMDS_MeshNode* n = nIt->next();
+    gp_XYZ p = SMESH_NodeXYZ( n );
+    trsf.Transforms( p );
+    srcInNodes.push_back( n );
+    tgtPoints.push_back( p );
+    if ( !isFace )
+      continue;
+    SMDS_FacePositionPtr pos = n->GetPosition();
+    if ( tgtSurface.IsNull() )
+    {
+      tgtUV.push_back( gp_XY( pos->GetUParameter(), pos->GetVParameter() ));
+      continue;
+    }
+    uv = ( tgtUV.empty() ? tgtSurface->ValueOfUV( p, tol ) :
+           tgtSurface->NextValueOfUV( uv, p, tol ));
+    if ( tgtSurface->Gap() > tol )
+      return false;
+    tgtUV.push_back( uv.XY() );
+  }
+
+  // create internal nodes
+
+  for ( size_t i = 0; i < srcInNodes.size(); ++i )
+  {
+    SMDS_MeshNode* tgtNode = meshDS->AddNode( tgtPoints[ i ].X(), tgtPoints[ i ].Y(), tgtPoints[ i ].Z() );
+    if ( isFace )
+      meshDS->SetNodeOnFace( tgtNode, tgtID, tgtUV[ i ].X(), tgtUV[ i ].Y() );
+    else
+      meshDS->SetNodeInVolume( tgtNode, tgtID );
+    src2tgtNodes.insert( std::make_pair( srcInNodes[ i ], tgtNode ));
+  }
+
+  // create elements
+
+  const bool reverse = ( !isFace && trsf.IsNegative() );
+  SMESH_MeshEditor editor( _mesh );
+  SMESH_MeshEditor::ElemFeatures elemType;
+  std::vector< const SMDS_MeshNode* > nodes;
+  std::vector< const SMDS_MeshElement* > newElems;
+  newElems.reserve( srcSM->NbElements() );
+  for ( SMDS_ElemIteratorPtr eIt = srcSM->GetElements(); eIt->more(); )
+  {
+    const SMDS_MeshElement* elem = eIt->next();
+    nodes.resize( elem->NbNodes() );
+    for ( int i = 0; i < elem->NbNodes(); ++i )
+      nodes[ i ] = src2tgtNodes[ elem->GetNode( i )];
+    if ( reverse )
+    {
+      const std::vector< int >& interlace =
+        SMDS_MeshCell::reverseSmdsOrder( elem->GetEntityType(), nodes.size() );
+      if ( !interlace.empty() )
+        SMDS_MeshCell::applyInterlace( interlace, nodes );
+    }
+    if ( const SMDS_MeshElement* newElem = editor.AddElement( nodes, elemType.Init( elem )))
+    {
+      meshDS->SetMeshElementOnShape( newElem, tgtID );
+      newElems.push_back( newElem );
+    }
+  }
+
+  // faces follow orientation of their FACE in the main shape
+
+  if ( isFace && !newElems.empty() )
+  {
+    SMESH_MesherHelper helper( *_mesh );
+    if ( helper.IsReversedSubMesh( TopoDS::Face( meshDS->IndexToShape( srcID ))) !=
+         helper.IsReversedSubMesh( TopoDS::Face( meshDS->IndexToShape( tgtID ))))
+      for ( const SMDS_MeshElement* f : newElems )
+        editor.Reorient( f );
+  }
+  return true;
+}
+
+//================================================================================
+/*!
+ * \brief Copy to a shape the mesh of its computed instance
+ */
+//================================================================================
+
+bool NETGENPlugin_InstanceCopier::CopyFromComputed( const TopoDS_Shape& shape,
+                                                    SMESH_Algo*         algo )
+{
+  gp_Trsf trsf;
+  TopoDS_Shape srcShape = FindComputed( shape, algo, trsf );
+  return !srcShape.IsNull() && Copy( srcShape, shape, trsf );
+}
+
+namespace
+{
+  //================================================================================
+  /*!
+   * \brief Return a node of a triangulation located in the global space
+   */
+  //================================================================================
+
+  gp_XYZ triaNode( const Handle(Poly_Triangulation)& triangulation,
+                   const int                         i,
+                   const TopLoc_Location&            loc )
+  {
+#if OCC_VERSION_HEX < 0x070600
+    gp_Pnt p = triangulation->Nodes()( i );
+#else
+    gp_Pnt p = triangulation->Node( i );
+#endif
+    if ( !loc.IsIdentity() )
+      p.Transform( loc.Transformation() );
+    return p.XYZ();
+  }
+
+  //================================================================================
+  /*!
+   * \brief Return a triangulation of a FACE, create it if missing
+   */
+  //================================================================================
+
+  Handle(Poly_Triangulation) getTriangulation( const TopoDS_Face& face, TopLoc_Location& loc )
+  {
+    Handle(Poly_Triangulation) triangulation = BRep_Tool::Triangulation( face, loc );
+    if ( triangulation.IsNull() )
+    {
+      updateTriangulation( face );
+      triangulation = BRep_Tool::Triangulation( face, loc );
+    }
+    return triangulation;
+  }
+
+  //================================================================================
+  /*!
+   * \brief Convert an estimated number of entities avoiding overflow
+   */
+  //================================================================================
+
+  smIdType toNbEntities( double nb )
+  {
+    const double hugeNb = double( std::numeric_limits<smIdType>::max() / 100 );
+    return nb < hugeNb ? smIdType( Max( 0., nb )) : smIdType( hugeNb );
+  }
+
+  const double theTetraVolumeFactor = 0.1179; // volume of regular tetrahedron of edge 1
+}
+
+//================================================================================
+/*!
+ * \brief Constructor
+ *  \param [in] ngMesh - netgen mesh whose size field is integrated
+ *  \param [in] occgeo - netgen geometry providing max size of FACEs
+ *  \param [in] isQuadratic - whether elements are quadratic
+ */
+//================================================================================
+
+NETGENPlugin_Estimator::NETGENPlugin_Estimator( const netgen::Mesh&        ngMesh,
+                                                const netgen::OCCGeometry& occgeo,
+                                                bool                       isQuadratic )
+  : _ngMesh( ngMesh ), _occgeo( occgeo ), _minh( netgen::mparam.minh ), _isQuadratic( isQuadratic )
+{
+  if ( _minh <= std::numeric_limits<double>::min() )
+    _minh = 1e-7 * occgeo.boundingbox.Diam();
+}
+
+//================================================================================
+/*!
+ * \brief Restrict the size field along an EDGE or over a FACE. Points on a FACE
+ *        are sampled on its triangulation at the step of 2*size, the grading
+ *        of netgen size field fills the rest
+ */
+//================================================================================
+
+void NETGENPlugin_Estimator::RestrictSize( netgen::Mesh&       ngMesh,
+                                           const TopoDS_Shape& shape,
+                                           double              size )
+{
+  if ( size <= std::numeric_limits<double>::min() )
+    return;
 
-  int nbDel = 0;
-  SurfaceElementIndex sei;
-  for (sei = 0; sei < ngMesh->GetNSE(); sei++)
+  switch ( shape.ShapeType() )
   {
-    outfile << "mesh.AddFace([ ";
-    Element2d sel = (*ngMesh)[sei];
-    for (int j = 0; j < sel.GetNP(); j++)
-      outfile << sel[j] << ( j+1 < sel.GetNP() ? ", " : " ])");
-    if ( sel.IsDeleted() ) outfile << " ## IsDeleted ";
-    outfile << std::endl;
-    nbDel += sel.IsDeleted();
+  case TopAbs_EDGE:
+  {
+    setLocalSize( TopoDS::Edge( shape ), size, ngMesh, /*overrideMinH=*/false );
+    break;
+  }
+  case TopAbs_FACE:
+  {
+    TopLoc_Location loc;
+    Handle(Poly_Triangulation) triangulation = getTriangulation( TopoDS::Face( shape ), loc );
+    if ( triangulation.IsNull() )
+      break;
+    std::vector< gp_XYZ > nodes( triangulation->NbNodes() + 1 );
+    for ( int i = 1; i <= triangulation->NbNodes(); ++i )
+      nodes[ i ] = triaNode( triangulation, i, loc );
 
-    if ((*ngMesh)[sei].GetIndex())
+    int i1, i2, i3;
+    const Poly_Array1OfTriangle& trias = triangulation->Triangles();
+    for ( int iT = trias.Lower(); iT <= trias.Upper(); ++iT )
     {
-      if ( int dom1 = ngMesh->GetFaceDescriptor((*ngMesh)[sei].GetIndex ()).DomainIn())
-        outfile << "grp"<< dom1 <<".Add([ " << (int)sei+1 - nbDel << " ])" << std::endl;
-      if ( int dom2 = ngMesh->GetFaceDescriptor((*ngMesh)[sei].GetIndex ()).DomainOut())
-        outfile << "grp"<< dom2 <<".Add([ " << (int)sei+1 - nbDel  << " ])" << std::endl;
+      trias( iT ).Get( i1, i2, i3 );
+      const gp_XYZ& p1 = nodes[ i1 ];
+      const gp_XYZ  v2 = nodes[ i2 ] - p1, v3 = nodes[ i3 ] - p1;
+      double maxLen = Max( Max( v2.Modulus(), v3.Modulus() ), ( v3 - v2 ).Modulus() );
+      int        nb = Min( 32, (int) ceil( maxLen / ( 2 * size )));
+      for ( int i = 0; i <= nb; ++i )
+        for ( int j = 0; i + j <= nb; ++j )
+          restrictLocalSize( ngMesh, p1 + v2 * ( double( i ) / Max( nb, 1 )) +
+                                          v3 * ( double( j ) / Max( nb, 1 )),
+                             size, /*overrideMinH=*/false );
     }
+    break;
   }
-
-  for (ElementIndex ei = 0; ei < ngMesh->GetNE(); ei++)
+  default:
   {
-    Element el = (*ngMesh)[ei];
-    outfile << "mesh.AddVolume([ ";
-    for (int j = 0; j < el.GetNP(); j++)
-      outfile << el[j] << ( j+1 < el.GetNP() ? ", " : " ])");
-    outfile << std::endl;
+    bool hasFaces = false;
+    for ( TopExp_Explorer faceExp( shape, TopAbs_FACE ); faceExp.More(); faceExp.Next() )
+    {
+      RestrictSize( ngMesh, faceExp.Current(), size );
+      hasFaces = true;
+    }
+    if ( !hasFaces )
+      for ( TopExp_Explorer edgeExp( shape, TopAbs_EDGE ); edgeExp.More(); edgeExp.Next() )
+        RestrictSize( ngMesh, edgeExp.Current(), size );
   }
-
-  for (int i = 1; i <= ngMesh->GetNSeg(); i++)
-  {
-    const Segment & seg = ngMesh->LineSegment (i);
-    outfile << "mesh.AddEdge([ "
-            << seg[0] << ", "
-            << seg[1] << " ])" << std::endl;
   }
+}
 
-#endif
+//================================================================================
+/*!
+ * \brief Return element size at a point
+ */
+//================================================================================
 
-  std::cout << "Write " << pyFile << std::endl;
+double NETGENPlugin_Estimator::size( const gp_XYZ& p ) const
+{
+  return Max( _ngMesh.GetH( netgen::Point3d( p.X(), p.Y(), p.Z() )), _minh );
 }
 
 //================================================================================
 /*!
- * \brief Constructor of NETGENPlugin_ngMeshInfo
+ * \brief Return number of triangles in a triangle of FACE triangulation.
+ *        The triangle is split while size varies much within it.
  */
 //================================================================================
 
-NETGENPlugin_ngMeshInfo::NETGENPlugin_ngMeshInfo( netgen::Mesh* ngMesh,
-                                                  bool          checkRemovedElems):
-  _elementsRemoved( false ), _copyOfLocalH(0)
+double NETGENPlugin_Estimator::nbTriangles( const gp_XYZ& p1, const gp_XYZ& p2, const gp_XYZ& p3,
+                                            double h1, double h2, double h3,
+                                            double faceMaxH, int depth ) const
 {
-  if ( ngMesh )
+  const double hc = Min( size(( p1 + p2 + p3 ) / 3. ), faceMaxH );
+  const double hMin = Min( Min( h1, h2 ), Min( h3, hc ));
+  const double hMax = Max( Max( h1, h2 ), Max( h3, hc ));
+  const double maxLen2 = Max( Max(( p2 - p1 ).SquareModulus(), ( p3 - p1 ).SquareModulus() ),
+                              ( p3 - p2 ).SquareModulus() );
+  if ( depth > 0 && hMax > 1.5 * hMin && maxLen2 > hMin * hMin )
   {
-    _nbNodes    = ngMesh->GetNP();
-    _nbSegments = ngMesh->GetNSeg();
-    _nbFaces    = ngMesh->GetNSE();
-    _nbVolumes  = ngMesh->GetNE();
+    const gp_XYZ p12 = 0.5 * ( p1 + p2 ), p23 = 0.5 * ( p2 + p3 ), p31 = 0.5 * ( p3 + p1 );
+    const double h12 = Min( size( p12 ), faceMaxH );
+    const double h23 = Min( size( p23 ), faceMaxH );
+    const double h31 = Min( size( p31 ), faceMaxH );
+    return ( nbTriangles( p1,  p12, p31, h1,  h12, h31, faceMaxH, depth - 1 ) +
+             nbTriangles( p12, p2,  p23, h12, h2,  h23, faceMaxH, depth - 1 ) +
+             nbTriangles( p31, p23, p3,  h31, h23, h3,  faceMaxH, depth - 1 ) +
+             nbTriangles( p12, p23, p31, h12, h23, h31, faceMaxH, depth - 1 ));
+  }
+  // an equilateral triangle of side h has area h*h*sqrt(3)/4
+  const double area    = 0.5 * (( p2 - p1 ) ^ ( p3 - p1 )).Modulus();
+  const double density = ( 1. / ( h1 * h1 ) + 1. / ( h2 * h2 ) + 1. / ( h3 * h3 ) +
+                           3. / ( hc * hc )) / 6.;
+  return area * density * 4. / sqrt( 3. );
+}
 
-    if ( checkRemovedElems )
-      for ( int i = 1; i <= ngMesh->GetNSE() &&  !_elementsRemoved; ++i )
-        _elementsRemoved = ngMesh->SurfaceElement(i).IsDeleted();
+//================================================================================
+/*!
+ * \brief Estimate numbers of triangles and nodes on a FACE
+ *  \param [in] face - the FACE
+ *  \param [in] nbBndSegments - number of segments on the FACE boundary
+ *  \param [out] nbEntities - numbers of entities by SMDSAbs_EntityType
+ */
+//================================================================================
+
+void NETGENPlugin_Estimator::EvaluateFace( const TopoDS_Face&      face,
+                                           smIdType                nbBndSegments,
+                                           std::vector<smIdType>&  nbEntities ) const
+{
+  double faceMaxH = netgen::mparam.maxh;
+  const int faceNgID = _occgeo.fmap.FindIndex( face );
+  if ( 0 < faceNgID && faceNgID <= (int) _occgeo.face_maxh.Size() )
+    faceMaxH = _occgeo.face_maxh[ faceNgID - 1 ];
+  if ( faceMaxH <= 0 )
+    faceMaxH = std::numeric_limits<double>::max();
+
+  double nbTria = 0;
+  TopLoc_Location loc;
+  Handle(Poly_Triangulation) triangulation = getTriangulation( face, loc );
+  if ( !triangulation.IsNull() )
+  {
+    std::vector< gp_XYZ > nodes( triangulation->NbNodes() + 1 );
+    std::vector< double > sizes( triangulation->NbNodes() + 1 );
+    for ( int i = 1; i <= triangulation->NbNodes(); ++i )
+    {
+      nodes[ i ] = triaNode( triangulation, i, loc );
+      sizes[ i ] = Min( size( nodes[ i ]), faceMaxH );
+    }
+    int i1, i2, i3;
+    const Poly_Array1OfTriangle& trias = triangulation->Triangles();
+    for ( int iT = trias.Lower(); iT <= trias.Upper(); ++iT )
+    {
+      trias( iT ).Get( i1, i2, i3 );
+      nbTria += nbTriangles( nodes[ i1 ], nodes[ i2 ], nodes[ i3 ],
+                             sizes[ i1 ], sizes[ i2 ], sizes[ i3 ], faceMaxH, /*depth=*/4 );
+    }
   }
   else
   {
-    _nbNodes = _nbSegments = _nbFaces = _nbVolumes = 0;
+    GProp_GProps props;
+    BRepGProp::SurfaceProperties( face, props );
+    const double h = Min( size( props.CentreOfMass().XYZ() ), faceMaxH );
+    nbTria = props.Mass() * 4. / ( sqrt( 3. ) * h * h );
+  }
+
+  // Euler formula: nbTria = 2 * nbInternalNodes + nbBndNodes - 2
+  const double nbNodes = 0.5 * ( nbTria - double( nbBndSegments )) + 1;
+
+  nbEntities.assign( SMDSEntity_Last, 0 );
+  if ( _isQuadratic )
+  {
+    const double nbInternalLinks = 0.5 * ( 3. * nbTria - double( nbBndSegments ));
+    nbEntities[ SMDSEntity_Node ]          = toNbEntities( nbNodes + nbInternalLinks );
+    nbEntities[ SMDSEntity_Quad_Triangle ] = toNbEntities( nbTria );
+  }
+  else
+  {
+    nbEntities[ SMDSEntity_Node ]     = toNbEntities( nbNodes );
+    nbEntities[ SMDSEntity_Triangle ] = toNbEntities( nbTria );
   }
 }
 
 //================================================================================
 /*!
- * \brief Copy LocalH member from one netgen mesh to another
+ * \brief Estimate numbers of tetrahedra and nodes in a SOLID. The size field is
+ *        sampled along parallel lines crossing the SOLID, inside parts of the
+ *        lines are found by parity of intersections with the SOLID boundary
+ *  \param [in] solid - the SOLID
+ *  \param [in] nbBndFaces - number of triangles on the SOLID boundary
+ *  \param [out] nbEntities - numbers of entities by SMDSAbs_EntityType
+ *  \param [in] nbLines - number of sampling lines, less is faster but coarser
  */
 //================================================================================
 
-void NETGENPlugin_ngMeshInfo::transferLocalH( netgen::Mesh* fromMesh,
-                                              netgen::Mesh* toMesh )
+void NETGENPlugin_Estimator::EvaluateSolid( const TopoDS_Shape&     solid,
+                                            smIdType                nbBndFaces,
+                                            std::vector<smIdType>&  nbEntities,
+                                            int                     nbLines ) const
 {
-  if ( !fromMesh->LocalHFunctionGenerated() ) return;
-  if ( !toMesh->LocalHFunctionGenerated() )
-    NETGENPlugin_NetgenLibWrapper::CalcLocalH( toMesh );
+  nbEntities.assign( SMDSEntity_Last, 0 );
 
-  const size_t size = sizeof( netgen::LocalH );
-  _copyOfLocalH = new char[ size ];
-  memcpy( (void*)_copyOfLocalH, (void*)&toMesh->LocalHFunction(), size );
-  memcpy( (void*)&toMesh->LocalHFunction(), (void*)&fromMesh->LocalHFunction(), size );
+  GProp_GProps props;
+  BRepGProp::VolumeProperties( solid, props );
+  const double volume = Abs( props.Mass() );
+
+  Bnd_Box box;
+  BRepBndLib::Add( solid, box );
+  if ( box.IsVoid() || volume <= std::numeric_limits<double>::min() )
+    return;
+  double x0,y0,z0,x1,y1,z1;
+  box.Get( x0,y0,z0,x1,y1,z1 );
+  const gp_XYZ pMin( x0,y0,z0 ), boxSize = gp_XYZ( x1,y1,z1 ) - pMin;
+
+  // lines go along the largest box dimension
+  int iL = 1;
+  for ( int i = 2; i <= 3; ++i )
+    if ( boxSize.Coord( i ) > boxSize.Coord( iL ))
+      iL = i;
+  const int iU = iL % 3 + 1, iV = iU % 3 + 1;
+
+  double step = sqrt( boxSize.Coord( iU ) * boxSize.Coord( iV ) / nbLines );
+  if ( step <= std::numeric_limits<double>::min() )
+    step = boxSize.Coord( iL ) / 20;
+  const int nbU = Max( 1, (int) ceil( boxSize.Coord( iU ) / step ));
+  const int nbV = Max( 1, (int) ceil( boxSize.Coord( iV ) / step ));
+  const double dU = boxSize.Coord( iU ) / nbU, dV = boxSize.Coord( iV ) / nbV;
+  const double length = boxSize.Coord( iL ), tol = 1e-7 * length;
+
+  gp_XYZ dir( 0,0,0 );
+  dir.SetCoord( iL, 1. );
+  const gp_Dir lineDir( dir );
+
+  double nbTetra = 0, sampledVolume = 0;
+  try
+  {
+    OCC_CATCH_SIGNALS;
+
+    IntCurvesFace_ShapeIntersector intersector;
+    intersector.Load( solid, Precision::Confusion() );
+
+    std::vector< double > params;
+    for ( int iu = 0; iu < nbU; ++iu )
+      for ( int iv = 0; iv < nbV; ++iv )
+      {
+        gp_XYZ p0 = pMin;
+        p0.SetCoord( iU, pMin.Coord( iU ) + ( iu + 0.5 ) * dU );
+        p0.SetCoord( iV, pMin.Coord( iV ) + ( iv + 0.5 ) * dV );
+        intersector.Perform( gp_Lin( gp_Pnt( p0 ), lineDir ), -tol, length + tol );
+        if ( !intersector.IsDone() )
+          continue;
+
+        params.clear();
+        for ( int i = 1; i <= intersector.NbPnt(); ++i )
+          if ( intersector.Transition( i ) != IntCurveSurface_Tangent &&
+               intersector.Face( i ).Orientation() != TopAbs_INTERNAL )
+            params.push_back( intersector.WParameter( i ));
+        std::sort( params.begin(), params.end() );
+        // points on an EDGE are found on both FACEs
+        params.erase( std::unique( params.begin(), params.end(),
+                                   [tol]( double t1, double t2 ) { return t2 - t1 < tol; }),
+                      params.end() );
+        if ( params.size() % 2 )
+          continue;
+
+        for ( size_t i = 0; i < params.size(); i += 2 )
+        {
+          const double t0 = params[ i ], t1 = params[ i + 1 ];
+          const int    nb = Max( 1, (int) ceil(( t1 - t0 ) / step ));
+          const double dt = ( t1 - t0 ) / nb;
+          for ( int k = 0; k < nb; ++k )
+          {
+            const double h = size( p0 + dir * ( t0 + ( k + 0.5 ) * dt ));
+            nbTetra       += dt * dU * dV / ( theTetraVolumeFactor * h * h * h );
+            sampledVolume += dt * dU * dV;
+          }
+        }
+      }
+  }
+  catch ( Standard_Failure& )
+  {
+    nbTetra = sampledVolume = 0;
+  }
+
+  if ( sampledVolume > 0 )
+  {
+    nbTetra *= volume / sampledVolume;
+  }
+  else
+  {
+    const double h = size( props.CentreOfMass().XYZ() );
+    nbTetra = volume / ( theTetraVolumeFactor * h * h * h );
+  }
+
+  // netgen meshes have about 5.5 tetrahedra per node; boundary nodes
+  // are counted on FACEs, a boundary node is shared by about 2 triangles
+  const double nbNodes = Max( 0., nbTetra / 5.5 - 0.5 * double( nbBndFaces ));
+
+  if ( _isQuadratic )
+  {
+    // Euler formula: nbLinks = nbNodes + nbTetra + nbBndFaces / 2 - 1
+    const double nbAllNodes = nbNodes + 0.5 * double( nbBndFaces );
+    const double nbInternalLinks = Max( 0., nbAllNodes + nbTetra - double( nbBndFaces ) - 1 );
+    nbEntities[ SMDSEntity_Node ]       = toNbEntities( nbNodes + nbInternalLinks );
+    nbEntities[ SMDSEntity_Quad_Tetra ] = toNbEntities( nbTetra );
+  }
+  else
+  {
+    nbEntities[ SMDSEntity_Node ]  = toNbEntities( nbNodes );
+    nbEntities[ SMDSEntity_Tetra ] = toNbEntities( nbTetra );
+  }
 }
 
 //================================================================================
 /*!
- * \brief Restore LocalH member of a netgen mesh
+ * \brief Return predicted peak memory in MB needed to mesh and store given
+ *        numbers of entities. Per-entity sizes take into account both netgen
+ *        and SMDS data and temporary data of netgen meshers.
  */
 //================================================================================
 
-void NETGENPlugin_ngMeshInfo::restoreLocalH( netgen::Mesh* toMesh )
+double NETGENPlugin_Estimator::PeakMemory( const MapShapeNbElems& nbEntities )
 {
-  if ( _copyOfLocalH )
+  double nbBytes = 0;
+  MapShapeNbElems::const_iterator sm2nb = nbEntities.begin();
+  for ( ; sm2nb != nbEntities.end(); ++sm2nb )
   {
-    const size_t size = sizeof( netgen::LocalH );
-    memcpy( (void*)&toMesh->LocalHFunction(), (void*)_copyOfLocalH, size );
-    delete [] _copyOfLocalH;
-    _copyOfLocalH = 0;
+    const std::vector<smIdType>& nb = sm2nb->second;
+    for ( size_t i = 0; i < nb.size() && i < SMDSEntity_Last; ++i )
+    {
+      switch ( SMDS_MeshCell::ElemType( SMDSAbs_EntityType( i ))) {
+      case SMDSAbs_Node:   nbBytes += 250. * double( nb[ i ]); break;
+      case SMDSAbs_Edge:   nbBytes += 150. * double( nb[ i ]); break;
+      case SMDSAbs_Face:   nbBytes += 300. * double( nb[ i ]); break;
+      case SMDSAbs_Volume: nbBytes += 600. * double( nb[ i ]); break;
+      default:;
+      }
+    }
   }
+  return nbBytes / 1048576.;
 }
 
 //================================================================================
 /*!
- * \brief Find "internal" sub-shapes
+ * \brief Report predicted peak memory and set a warning to a sub-mesh if the
+ *        memory exceeds the physical memory of the computer
  */
 //================================================================================
 
-NETGENPlugin_Internals::NETGENPlugin_Internals( SMESH_Mesh&         mesh,
-                                                const TopoDS_Shape& shape,
-                                                bool                is3D )
-  : _mesh( mesh ), _is3D( is3D )
+void NETGENPlugin_Estimator::CheckPeakMemory( const MapShapeNbElems& nbEntities,
+                                              SMESH_subMesh*         sm,
+                                              const SMESH_Algo*      algo )
 {
-  SMESHDS_Mesh* meshDS = mesh.GetMeshDS();
+  const double peakMB = PeakMemory( nbEntities );
+  MESSAGE( "Estimated peak memory of meshing: " << peakMB << " MB" );
+
+  double physicalMB = 0;
+#ifdef WIN32
+  MEMORYSTATUSEX status;
+  status.dwLength = sizeof( status );
+  if ( GlobalMemoryStatusEx( &status ))
+    physicalMB = double( status.ullTotalPhys ) / 1048576.;
+#else
+  const long nbPages = sysconf( _SC_PHYS_PAGES ), pageSize = sysconf( _SC_PAGE_SIZE );
+  if ( nbPages > 0 && pageSize > 0 )
+    physicalMB = double( nbPages ) * double( pageSize ) / 1048576.;
+#endif
 
-  TopExp_Explorer f,e;
-  for ( f.Init( shape, TopAbs_FACE ); f.More(); f.Next() )
+  if ( sm && physicalMB > 0 && peakMB > physicalMB )
   {
-    int faceID = meshDS->ShapeToIndex( f.Current() );
-    // find not computed internal edges
+    SMESH_ComputeErrorPtr& error = sm->GetComputeError();
+    if ( !error || error->IsOK() )
+      error.reset( new SMESH_ComputeError
+                   ( COMPERR_WARNING,
+                     SMESH_Comment( "Meshing may need about " ) << int( peakMB ) <<
+                     " MB of memory while " << int( physicalMB ) << " MB is installed",
+                     algo ));
+  }
+}
 
-    for ( e.Init( f.Current().Oriented(TopAbs_FORWARD), TopAbs_EDGE ); e.More(); e.Next() )
-      if ( e.Current().Orientation() == TopAbs_INTERNAL )
-      {
-        SMESH_subMesh* eSM = mesh.GetSubMesh( e.Current() );
-        if ( eSM->IsEmpty() )
+namespace
+{
+  //================================================================================
+  /*!
+   * \brief Find "internal" sub-shapes
+   */
+  //================================================================================
+
+  std::shared_ptr< TInternalsIndex > makeInternalsIndex( SMESH_Mesh&         mesh,
+                                                         const TopoDS_Shape& shape,
+                                                         bool                is3D )
+  {
+    std::shared_ptr< TInternalsIndex > index = std::make_shared< TInternalsIndex >();
+    SMESHDS_Mesh* meshDS = mesh.GetMeshDS();
+
+    TopExp_Explorer f,e;
+    for ( f.Init( shape, TopAbs_FACE ); f.More(); f.Next() )
+    {
+      int faceID = meshDS->ShapeToIndex( f.Current() );
+      // find internal edges
+
+      for ( e.Init( f.Current().Oriented(TopAbs_FORWARD), TopAbs_EDGE ); e.More(); e.Next() )
+        if ( e.Current().Orientation() == TopAbs_INTERNAL )
         {
-          _e2face.insert( make_pair( eSM->GetId(), faceID ));
+          TInternalsIndex::TInternalEdge intEdge;
+          intEdge._edgeID = meshDS->ShapeToIndex( e.Current() );
+          intEdge._faceID = faceID;
           for ( TopoDS_Iterator v(e.Current()); v.More(); v.Next() )
-            _e2face.insert( make_pair( meshDS->ShapeToIndex( v.Value() ), faceID ));
+            intEdge._vertexIDs.push_back( meshDS->ShapeToIndex( v.Value() ));
+          index->_intEdges.push_back( intEdge );
+        }
+
+      // find internal vertices in a face
+      set<int> intVV; // issue 0020850 where same vertex is twice in a face
+      for ( TopoDS_Iterator fSub( f.Current() ); fSub.More(); fSub.Next())
+        if ( fSub.Value().ShapeType() == TopAbs_VERTEX )
+        {
+          int vID = meshDS->ShapeToIndex( fSub.Value() );
+          if ( intVV.insert( vID ).second )
+            index->_f2v[ faceID ].push_back( vID );
         }
-      }
 
-    // find internal vertices in a face
-    set<int> intVV; // issue 0020850 where same vertex is twice in a face
-    for ( TopoDS_Iterator fSub( f.Current() ); fSub.More(); fSub.Next())
-      if ( fSub.Value().ShapeType() == TopAbs_VERTEX )
+      if ( is3D )
       {
-        int vID = meshDS->ShapeToIndex( fSub.Value() );
-        if ( intVV.insert( vID ).second )
-          _f2v[ faceID ].push_back( vID );
+        // find internal faces and their subshapes where nodes are to be doubled
+        //  to make a crack with non-sewed borders
+
+        if ( f.Current().Orientation() == TopAbs_INTERNAL )
+        {
+          index->_intShapes.insert( meshDS->ShapeToIndex( f.Current() ));
+
+          // edges
+          list< TopoDS_Shape > edges;
+          for ( e.Init( f.Current(), TopAbs_EDGE ); e.More(); e.Next())
+            if ( SMESH_MesherHelper::NbAncestors( e.Current(), mesh, TopAbs_FACE ) > 1 )
+            {
+              index->_intShapes.insert( meshDS->ShapeToIndex( e.Current() ));
+              edges.push_back( e.Current() );
+              // find border faces
+              PShapeIteratorPtr fIt =
+                SMESH_MesherHelper::GetAncestors( edges.back(),mesh,TopAbs_FACE );
+              while ( const TopoDS_Shape* pFace = fIt->next() )
+                if ( !pFace->IsSame( f.Current() ))
+                  index->_borderFaces.insert( meshDS->ShapeToIndex( *pFace ));
+            }
+          // vertices
+          // we consider vertex internal if it is shared by more than one internal edge
+          list< TopoDS_Shape >::iterator edge = edges.begin();
+          for ( ; edge != edges.end(); ++edge )
+            for ( TopoDS_Iterator v( *edge ); v.More(); v.Next() )
+            {
+              set<int> internalEdges;
+              PShapeIteratorPtr eIt =
+                SMESH_MesherHelper::GetAncestors( v.Value(),mesh,TopAbs_EDGE );
+              while ( const TopoDS_Shape* pEdge = eIt->next() )
+              {
+                int edgeID = meshDS->ShapeToIndex( *pEdge );
+                if ( index->_intShapes.count( edgeID ))
+                  internalEdges.insert( edgeID );
+              }
+              if ( internalEdges.size() > 1 )
+                index->_intShapes.insert( meshDS->ShapeToIndex( v.Value() ));
+            }
+        }
       }
+    } // loop on geom faces
 
+    // find vertices internal in solids
     if ( is3D )
     {
-      // find internal faces and their subshapes where nodes are to be doubled
-      //  to make a crack with non-sewed borders
-
-      if ( f.Current().Orientation() == TopAbs_INTERNAL )
+      for ( TopExp_Explorer so(shape, TopAbs_SOLID); so.More(); so.Next())
       {
-        _intShapes.insert( meshDS->ShapeToIndex( f.Current() ));
-
-        // edges
-        list< TopoDS_Shape > edges;
-        for ( e.Init( f.Current(), TopAbs_EDGE ); e.More(); e.Next())
-          if ( SMESH_MesherHelper::NbAncestors( e.Current(), mesh, TopAbs_FACE ) > 1 )
-          {
-            _intShapes.insert( meshDS->ShapeToIndex( e.Current() ));
-            edges.push_back( e.Current() );
-            // find border faces
-            PShapeIteratorPtr fIt =
-              SMESH_MesherHelper::GetAncestors( edges.back(),mesh,TopAbs_FACE );
-            while ( const TopoDS_Shape* pFace = fIt->next() )
-              if ( !pFace->IsSame( f.Current() ))
-                _borderFaces.insert( meshDS->ShapeToIndex( *pFace ));
-          }
-        // vertices
-        // we consider vertex internal if it is shared by more than one internal edge
-        list< TopoDS_Shape >::iterator edge = edges.begin();
-        for ( ; edge != edges.end(); ++edge )
-          for ( TopoDS_Iterator v( *edge ); v.More(); v.Next() )
-          {
-            set<int> internalEdges;
-            PShapeIteratorPtr eIt =
-              SMESH_MesherHelper::GetAncestors( v.Value(),mesh,TopAbs_EDGE );
-            while ( const TopoDS_Shape* pEdge = eIt->next() )
-            {
-              int edgeID = meshDS->ShapeToIndex( *pEdge );
-              if ( isInternalShape( edgeID ))
-                internalEdges.insert( edgeID );
-            }
-            if ( internalEdges.size() > 1 )
-              _intShapes.insert( meshDS->ShapeToIndex( v.Value() ));
-          }
+        int soID = meshDS->ShapeToIndex( so.Current() );
+        for ( TopoDS_Iterator soSub( so.Current() ); soSub.More(); soSub.Next())
+          if ( soSub.Value().ShapeType() == TopAbs_VERTEX )
+            index->_s2v[ soID ].push_back( meshDS->ShapeToIndex( soSub.Value() ));
       }
     }
-  } // loop on geom faces
+    return index;
+  }
+}
 
-  // find vertices internal in solids
-  if ( is3D )
+//================================================================================
+/*!
+ * \brief Find "internal" sub-shapes
+ */
+//================================================================================
+
+NETGENPlugin_Internals::NETGENPlugin_Internals( SMESH_Mesh&         mesh,
+                                                const TopoDS_Shape& shape,
+                                                bool                is3D )
+  : _mesh( mesh ), _is3D( is3D )
+{
+  // topology is explored once per shape to mesh
+  std::shared_ptr< const TInternalsIndex > index =
+    TShapeIndexCache::GetInternalsIndex( mesh, shape, is3D );
+  if ( !index )
+  {
+    index = makeInternalsIndex( mesh, shape, is3D );
+    TShapeIndexCache::AddInternalsIndex( mesh, shape, is3D, index );
+  }
+  _f2v         = index->_f2v;
+  _intShapes   = index->_intShapes;
+  _borderFaces = index->_borderFaces;
+  _s2v         = index->_s2v;
+
+  // not computed internal edges
+  for ( const TInternalsIndex::TInternalEdge& e : index->_intEdges )
   {
-    for ( TopExp_Explorer so(shape, TopAbs_SOLID); so.More(); so.Next())
+    SMESH_subMesh* eSM = mesh.GetSubMeshContaining( e._edgeID );
+    if ( !eSM || eSM->IsEmpty() )
     {
-      int soID = meshDS->ShapeToIndex( so.Current() );
-      for ( TopoDS_Iterator soSub( so.Current() ); soSub.More(); soSub.Next())
-        if ( soSub.Value().ShapeType() == TopAbs_VERTEX )
-          _s2v[ soID ].push_back( meshDS->ShapeToIndex( soSub.Value() ));
+      _e2face.insert( make_pair( e._edgeID, e._faceID ));
+      for ( size_t iV = 0; iV < e._vertexIDs.size(); ++iV )
+        _e2face.insert( make_pair( e._vertexIDs[ iV ], e._faceID ));
     }
   }
 }
@@ -4683,7 +6798,7 @@ SMESH_Mesh& NETGENPlugin_Internals::getMesh() const
 
 int& NETGENPlugin_NetgenLibWrapper::instanceCounter()
 {
-  static int theCouner = 0;
+  static NG_THREAD_LOCAL int theCouner = 0;
   return theCouner;
 }
 
@@ -4694,13 +6809,25 @@ int& NETGENPlugin_NetgenLibWrapper::instanceCounter()
 //================================================================================
 
 NETGENPlugin_NetgenLibWrapper::NETGENPlugin_NetgenLibWrapper():
-  _ngMesh(0),_tmpDir(SALOMEDS_Tool::GetTmpDir())
+  _ngMesh(0),
+  _workDir( SALOMEDS_Tool::GetTmpDir() ),
+  // current directory is common to all threads, don't change it if netgen is reentrant
+  _tmpDir( NETGENPlugin_NetgenContext::IsReentrant() ? std::string() : _workDir )
 {
   if ( instanceCounter() == 0 )
   {
     Ng_Init();
     if ( !netgen::testout )
-      netgen::testout = new ofstream( "test.out" );
+    {
+      if ( NETGENPlugin_OutputBuffer::IsEnabled() || NETGENPlugin_NetgenContext::IsReentrant() )
+        netgen::testout = new NETGENPlugin_ErrorCollector( new NETGENPlugin_OutputBuffer );
+      else
+        netgen::testout = new NETGENPlugin_ErrorCollector( new ofstream( "test.out" ));
+    }
+    // forget errors of a previous computation
+    if ( NETGENPlugin_ErrorCollector* errors =
+         dynamic_cast< NETGENPlugin_ErrorCollector* >( netgen::testout ))
+      errors->Clear();
   }
 
   ++instanceCounter();
@@ -4709,7 +6836,12 @@ NETGENPlugin_NetgenLibWrapper::NETGENPlugin_NetgenLibWrapper():
   _coutBuffer       = NULL;
   _ngcout           = NULL;
   _ngcerr           = NULL;
-  if ( !getenv( "KEEP_NETGEN_OUTPUT" ))
+  _outputBuffer     = NULL;
+  if ( NETGENPlugin_OutputBuffer::IsEnabled() )
+  {
+    setOutputBuffer();
+  }
+  else if ( !getenv( "KEEP_NETGEN_OUTPUT" ))
   {
     setOutputFile(getOutputFileName());
   }
@@ -4729,9 +6861,26 @@ NETGENPlugin_NetgenLibWrapper::~NETGENPlugin_NetgenLibWrapper()
 
   Ng_DeleteMesh( ngMesh() );
   Ng_Exit();
-  RemoveTmpFiles();
+
+  // testout kept in memory is written to "test.out" if it can be useful
+  bool keepTestOut = false;
+  if ( !_isComputeOk || getenv( "KEEP_NETGEN_OUTPUT" ))
+    if ( NETGENPlugin_ErrorCollector* errors =
+         dynamic_cast< NETGENPlugin_ErrorCollector* >( netgen::testout ))
+      if ( NETGENPlugin_OutputBuffer* outBuf =
+           dynamic_cast< NETGENPlugin_OutputBuffer* >( errors->Target() ))
+        keepTestOut = outBuf->Flush( _workDir + "test.out" );
+  RemoveTmpFiles( keepTestOut );
   if ( _coutBuffer )
     std::cout.rdbuf( _coutBuffer );
+  if ( _outputBuffer )
+  {
+    // write netgen output to disk if it can be useful
+    if ( !_isComputeOk || getenv( "KEEP_NETGEN_OUTPUT" ))
+      _outputBuffer->Flush( _outputFileName );
+    releaseOutputBuffer();
+    return;
+  }
 #ifdef _DEBUG_
   if( _isComputeOk )
 #endif
@@ -4780,6 +6929,28 @@ int NETGENPlugin_NetgenLibWrapper::GenerateMesh( netgen::OCCGeometry& occgeo,
   netgen::mparam.perfstepsstart = startWith;
   netgen::mparam.perfstepsend   = endWith;
   std::shared_ptr<netgen::Mesh> meshPtr( ngMesh, &NOOP_Deleter );
+
+  // threads of netgen TaskManager don't see thread-local mparam, multithread and
+  // testout of this job, hence netgen runs in the calling thread only
+  struct TSerialNetgen
+  {
+    int  _nthreads;
+    bool _parallel;
+    TSerialNetgen(): _nthreads( netgen::mparam.nthreads ), _parallel( netgen::mparam.parallel_meshing )
+    {
+      if ( NETGENPlugin_NetgenContext::IsReentrant() )
+      {
+        netgen::mparam.nthreads         = 1;
+        netgen::mparam.parallel_meshing = false;
+      }
+    }
+    ~TSerialNetgen()
+    {
+      netgen::mparam.nthreads         = _nthreads;
+      netgen::mparam.parallel_meshing = _parallel;
+    }
+  } serialNetgen;
+
   err = occgeo.GenerateMesh( meshPtr, netgen::mparam );
 
 #else
@@ -4820,9 +6991,10 @@ void NETGENPlugin_NetgenLibWrapper::CalcLocalH( netgen::Mesh * ngMesh )
 
 std::string NETGENPlugin_NetgenLibWrapper::getOutputFileName()
 {
-  std::string aTmpDir = SALOMEDS_Tool::GetTmpDir();
+  // several instances may exist at once in parallel threads
+  static std::atomic< int > theFileCounter( 0 );
 
-  TCollection_AsciiString aGenericName = aTmpDir.c_str();
+  TCollection_AsciiString aGenericName = _workDir.c_str();
   aGenericName += "NETGEN_";
 #ifndef WIN32
   aGenericName += getpid();
@@ -4830,7 +7002,7 @@ std::string NETGENPlugin_NetgenLibWrapper::getOutputFileName()
   aGenericName += _getpid();
 #endif
   aGenericName += "_";
-  aGenericName += Abs((Standard_Integer)(long) aGenericName.ToCString());
+  aGenericName += ++theFileCounter;
   aGenericName += ".out";
 
   return aGenericName.ToCString();
@@ -4844,11 +7016,15 @@ std::string NETGENPlugin_NetgenLibWrapper::getOutputFileName()
 void NETGENPlugin_NetgenLibWrapper::setOutputFile(std::string outputfile)
 {
   // redirect all netgen output (mycout,myerr,cout) to _outputFileName
+  releaseOutputBuffer();
   _outputFileName = outputfile;
   _ngcout         = netgen::mycout;
   _ngcerr         = netgen::myerr;
   netgen::mycout  = new ofstream ( _outputFileName.c_str() );
   netgen::myerr   = netgen::mycout;
+  // std::cout is common to all threads
+  if ( NETGENPlugin_NetgenContext::IsReentrant() )
+    return;
   _coutBuffer     = std::cout.rdbuf();
 #ifdef _DEBUG_
   std::cout << "NOTE: netgen output is redirected to file " << _outputFileName << std::endl;
@@ -4859,22 +7035,78 @@ void NETGENPlugin_NetgenLibWrapper::setOutputFile(std::string outputfile)
 
 //================================================================================
 /*!
- * \brief Remove "test.out" and "problemfaces" files in current directory
+ * \brief Redirect all netgen output (mycout,myerr,cout) to a memory buffer
+ *        written to _outputFileName at destruction if compute fails
  */
 //================================================================================
 
-void NETGENPlugin_NetgenLibWrapper::RemoveTmpFiles()
+void NETGENPlugin_NetgenLibWrapper::setOutputBuffer()
 {
-  bool rm =  SMESH_File("test.out").remove() ;
-#ifndef WIN32
+  _outputFileName = getOutputFileName();
+  _outputBuffer   = new NETGENPlugin_OutputBuffer;
+  _ngcout         = netgen::mycout;
+  _ngcerr         = netgen::myerr;
+  netgen::mycout  = _outputBuffer;
+  netgen::myerr   = netgen::mycout;
+  if ( NETGENPlugin_NetgenContext::IsReentrant() )
+    return;
+  _coutBuffer     = std::cout.rdbuf();
+#ifndef _DEBUG_
+  std::cout.rdbuf( _outputBuffer->rdbuf() );
+#endif
+}
+
+//================================================================================
+/*!
+ * \brief Restore netgen output redirected by setOutputBuffer()
+ */
+//================================================================================
+
+void NETGENPlugin_NetgenLibWrapper::releaseOutputBuffer()
+{
+  if ( !_outputBuffer )
+    return;
+  if ( _coutBuffer )
+    std::cout.rdbuf( _coutBuffer );
+  netgen::mycout  = _ngcout;
+  netgen::myerr   = _ngcerr;
+  _ngcout         = 0;
+  _coutBuffer     = 0;
+  _outputFileName.clear();
+  delete _outputBuffer;
+  _outputBuffer   = 0;
+}
+
+//================================================================================
+/*!
+ * \brief Remove "test.out" and "problemfaces" files in the work directory
+ *  \param [in] keepTestOut - do not remove "test.out" where testout has been flushed
+ *
+ * If netgen is reentrant, the work directory is not the current one, where
+ * files written by netgen may belong to another job, so these are not removed.
+ */
+//================================================================================
+
+void NETGENPlugin_NetgenLibWrapper::RemoveTmpFiles(bool keepTestOut)
+{
+  bool rm = !keepTestOut && SMESH_File( _workDir + "test.out" ).remove() ;
+#ifdef WIN32
+  rm = false;
+#endif
+  // testout kept in memory is not bound to "test.out"
+  if ( NETGENPlugin_ErrorCollector* errors =
+       dynamic_cast< NETGENPlugin_ErrorCollector* >( netgen::testout ))
+    rm = rm || dynamic_cast< NETGENPlugin_OutputBuffer* >( errors->Target() );
   if ( rm && netgen::testout && instanceCounter() == 0 )
   {
     delete netgen::testout;
     netgen::testout = 0;
   }
-#endif
-  SMESH_File("problemfaces").remove();
-  SMESH_File("occmesh.rep").remove();
+  SMESH_File( _workDir + "problemfaces" ).remove();
+  SMESH_File( _workDir + "occmesh.rep" ).remove();
+
+  // remove the work directory if it is empty
+  SALOMEDS_Tool::RemoveTemporaryFiles( _workDir.c_str(), SALOMEDS_Tool::ListOfFiles(), true );
 }
 
 //================================================================================
@@ -30,6 +30,7 @@
 #define _NETGENPlugin_Mesher_HXX_
 
 #include "NETGENPlugin_Defs.hxx"
+#include "NETGENPlugin_ProgressModel.hxx"
 
 #include <StdMeshers_FaceSide.hxx>
 #include <SMDS_MeshElement.hxx>
@@ -39,6 +40,8 @@
 #include "Basics_Utils.hxx"
 #include "SALOME_Basics.hxx"
 #include <TopTools_IndexedMapOfShape.hxx>
+#include <gp_Trsf.hxx>
+#include <gp_XYZ.hxx>
 
 // Netgen include files
 #ifndef OCCGEOMETRY
@@ -51,24 +54,34 @@ namespace nglib {
 #include <nglib.h>
 }
 
+// netgen not patched to have thread-local global variables
+#ifndef NG_THREAD_LOCAL
+#define NG_THREAD_LOCAL
+#endif
+
 #include <map>
+#include <memory>
 #include <vector>
 #include <set>
 
 class NETGENPlugin_Hypothesis;
 class NETGENPlugin_Internals;
+class NETGENPlugin_OutputBuffer;
 class NETGENPlugin_SimpleHypothesis_2D;
+class SMDS_Mesh;
+class SMDS_MeshNode;
 class SMESHDS_Mesh;
 class SMESH_Comment;
 class SMESH_Mesh;
 class SMESH_MesherHelper;
 class StdMeshers_ViscousLayers;
+class TopoDS_Face;
 class TopoDS_Shape;
 namespace netgen {
   class OCCGeometry;
   class Mesh;
   NETGENPLUGIN_DLL_HEADER
-  extern MeshingParameters mparam;
+  extern NG_THREAD_LOCAL MeshingParameters mparam;
 }
 
 // Class for temporary folder switching
@@ -112,6 +125,146 @@ struct NETGENPlugin_ngMeshInfo
   void restoreLocalH ( netgen::Mesh* ngMesh);
 };
 
+//================================================================================
+/*!
+ * \brief Map of SMDS nodes to netgen point ids stored in a vector indexed
+ *        by node ID. Nodes of other meshes are kept in a std::map.
+ */
+//================================================================================
+
+class NETGENPLUGIN_EXPORT NETGENPlugin_NodeIdMap
+{
+ public:
+  NETGENPlugin_NodeIdMap( const SMDS_Mesh* mesh );
+
+  //! return netgen id of a node, 0 if it is not set yet
+  int& operator[]( const SMDS_MeshNode* node );
+
+ private:
+  const SMDS_Mesh*                      _mesh;
+  std::vector< int >                    _ngIDs;      // netgen id by node ID
+  std::map< const SMDS_MeshNode*, int > _otherNodes; // nodes not from _mesh
+};
+
+//================================================================================
+/*!
+ * \brief Transfer of netgen nodes and linear elements to SMESHDS_Mesh by whole
+ *        ranges. Shapes are given by SMESHDS ids, found once per shape.
+ */
+//================================================================================
+
+class NETGENPLUGIN_EXPORT NETGENPlugin_BulkFiller
+{
+ public:
+  NETGENPlugin_BulkFiller( SMESHDS_Mesh* meshDS ): _meshDS( meshDS ) {}
+
+  void AddNodes( const netgen::Mesh&                  ngMesh,
+                 std::vector< const SMDS_MeshNode* >& nodeVec,
+                 int                                  fromNgID,
+                 int                                  solidID = 0 );
+
+  int  AddTetrahedra( const netgen::Mesh&                        ngMesh,
+                      const std::vector< const SMDS_MeshNode* >& nodeVec,
+                      int                                        solidID = 0 );
+
+  std::vector< int > ShapeIDs( const TopTools_IndexedMapOfShape& shapes ) const;
+
+ private:
+  SMESHDS_Mesh* _meshDS;
+};
+
+//================================================================================
+/*!
+ * \brief Copy of a mesh of a shape to other instances of the shape, i.e. to
+ *        shapes sharing the same TShape at different locations, and to its
+ *        periodic images defined by the hypothesis. Nodes on the boundary of
+ *        a target shape must be already there at transformed places.
+ */
+//================================================================================
+
+class NETGENPLUGIN_EXPORT NETGENPlugin_InstanceCopier
+{
+ public:
+  NETGENPlugin_InstanceCopier( SMESH_Mesh&                    mesh,
+                               TopAbs_ShapeEnum               shapeType,
+                               const NETGENPlugin_Hypothesis* hyp = 0 );
+
+  static bool IsEnabled();
+
+  bool HasInstances( const TopoDS_Shape& shape ) const;
+
+  // return ID of the first shape among instances of a shape
+  int  Orbit( const TopoDS_Shape& shape ) const;
+
+  TopoDS_Shape FindComputed( const TopoDS_Shape& shape, SMESH_Algo* algo, gp_Trsf& trsf ) const;
+
+  bool Copy( const TopoDS_Shape& srcShape, const TopoDS_Shape& tgtShape, const gp_Trsf& trsf );
+
+  bool CopyFromComputed( const TopoDS_Shape& shape, SMESH_Algo* algo );
+
+  // orbits of shapes, found once per mesh and shared by copiers
+  struct TMember
+  {
+    int     _root;     // ID of the first shape of the orbit
+    gp_Trsf _fromRoot; // transformation of the first shape into this one
+  };
+  struct TOrbits
+  {
+    std::map< int, TMember >            _members; // of orbits of several shapes, by shape ID
+    std::map< int, std::vector< int > > _shapes;  // shape IDs by ID of the first shape
+  };
+
+ private:
+  SMESH_Mesh*                      _mesh;
+  std::shared_ptr< const TOrbits > _orbits;
+};
+
+//================================================================================
+/*!
+ * \brief Estimates numbers of mesh entities without meshing by integrating
+ *        the element size field (LocalH) of a netgen mesh over triangulations
+ *        of FACEs and over lines crossing SOLIDs
+ */
+//================================================================================
+
+class NETGENPLUGIN_EXPORT NETGENPlugin_Estimator
+{
+ public:
+  NETGENPlugin_Estimator( const netgen::Mesh&        ngMesh,
+                          const netgen::OCCGeometry& occgeo,
+                          bool                       isQuadratic );
+
+  // restrict the size field over an EDGE or a FACE
+  static void RestrictSize( netgen::Mesh& ngMesh, const TopoDS_Shape& shape, double size );
+
+  void EvaluateFace( const TopoDS_Face&      face,
+                     smIdType                nbBndSegments,
+                     std::vector<smIdType>&  nbEntities ) const;
+
+  void EvaluateSolid( const TopoDS_Shape&     solid,
+                      smIdType                nbBndFaces,
+                      std::vector<smIdType>&  nbEntities,
+                      int                     nbLines = 400 ) const;
+
+  // return predicted peak memory of meshing, in MB
+  static double PeakMemory( const MapShapeNbElems& nbEntities );
+
+  // report the peak memory; warn if it exceeds the physical memory
+  static void CheckPeakMemory( const MapShapeNbElems& nbEntities,
+                               SMESH_subMesh*         sm,
+                               const SMESH_Algo*      algo = 0 );
+
+ private:
+  double size( const gp_XYZ& p ) const;
+  double nbTriangles( const gp_XYZ& p1, const gp_XYZ& p2, const gp_XYZ& p3,
+                      double h1, double h2, double h3, double faceMaxH, int depth ) const;
+
+  const netgen::Mesh&        _ngMesh;
+  const netgen::OCCGeometry& _occgeo;
+  double                     _minh;
+  bool                       _isQuadratic;
+};
+
 //================================================================================
 /*!
  * \brief It correctly initializes netgen library at constructor and
@@ -140,14 +293,18 @@ struct NETGENPLUGIN_EXPORT NETGENPlugin_NetgenLibWrapper
 
   static void CalcLocalH( netgen::Mesh * ngMesh );
 
-  static void RemoveTmpFiles();
+  void RemoveTmpFiles(bool keepTestOut=false);
   static int& instanceCounter();
   void setOutputFile(std::string);
 
  private:
   std::string getOutputFileName();
   void        removeOutputFile();
+  void        setOutputBuffer();
+  void        releaseOutputBuffer();
   std::string _outputFileName;
+  // Directory of netgen tmp files of this instance
+  std::string _workDir;
   // This will change current directory when the class is instanciated and switch
   ChdirRAII _tmpDir;
 
@@ -155,6 +312,7 @@ struct NETGENPLUGIN_EXPORT NETGENPlugin_NetgenLibWrapper
   ostream *       _ngcout;
   ostream *       _ngcerr;
   std::streambuf* _coutBuffer;   // to re-/store cout.rdbuf()
+  NETGENPlugin_OutputBuffer* _outputBuffer; // netgen output kept in memory
 };
 
 //=============================================================================
@@ -208,6 +366,7 @@ class NETGENPLUGIN_EXPORT NETGENPlugin_Mesher
   int CallNetgenMeshEdges( NETGENPlugin_NetgenLibWrapper& ngLib, netgen::OCCGeometry& occgeo );
   int CallNetgenMeshFaces( NETGENPlugin_NetgenLibWrapper& ngLib, netgen::OCCGeometry& occgeo, SMESH_Comment& comment );
   int CallNetgenMeshVolumens( NETGENPlugin_NetgenLibWrapper& ngLib, netgen::OCCGeometry& occgeo, SMESH_Comment& comment );
+  int CallNetgenMeshVolumensInParallel( netgen::OCCGeometry& occgeo, SMESH_Comment& comment, const int nbThreads );
   void MakeSecondOrder( netgen::MeshingParameters &mparams, netgen::OCCGeometry& occgeo, 
                           list< SMESH_subMesh* >* meshedSM, NETGENPlugin_ngMeshInfo& initState, SMESH_Comment& comment );
   int FillInternalElements( NETGENPlugin_NetgenLibWrapper& ngLib, NETGENPlugin_Internals& internals, netgen::OCCGeometry& occgeo,
@@ -238,6 +397,9 @@ class NETGENPLUGIN_EXPORT NETGENPlugin_Mesher
                      const int *       algoProgressTic,
                      const double *    algoProgress) const;
 
+  // return predicted time in seconds till the end of Compute()
+  double GetRemainingTime() const;
+
   static void PrepareOCCgeometry(netgen::OCCGeometry&          occgeom,
                                  const TopoDS_Shape&           shape,
                                  SMESH_Mesh&                   mesh,
@@ -247,6 +409,8 @@ class NETGENPLUGIN_EXPORT NETGENPlugin_Mesher
   static double GetDefaultMinSize(const TopoDS_Shape& shape,
                                   const double        maxSize);
 
+  static TopoDS_Shape GetShapeByEntry(const std::string& entry);
+
   static void RestrictLocalSize(netgen::Mesh& ngMesh,
                                 const gp_XYZ& p,
                                 double        size,
@@ -315,6 +479,8 @@ class NETGENPLUGIN_EXPORT NETGENPlugin_Mesher
                   vector< const SMDS_MeshNode* >& nodeVec, SMESH_MesherHelper &quadHelper, 
                   SMESH_Comment& comment);
 
+  void SetProgressWork( const netgen::OCCGeometry& occgeo, const netgen::MeshingParameters& mparams );
+
   SMESH_Mesh*          _mesh;
   const TopoDS_Shape&  _shape;
   bool                 _isVolume;
@@ -325,10 +491,7 @@ class NETGENPLUGIN_EXPORT NETGENPlugin_Mesher
   netgen::Mesh*        _ngMesh;
   netgen::OCCGeometry* _occgeom;
 
-  int                  _curShapeIndex;
-  volatile int         _progressTic;
-  volatile double      _ticTime; // normalized [0,1] compute time per a SMESH_Algo::_progressTic
-  volatile double      _totalTime;
+  mutable NETGENPlugin_ProgressModel _progressModel;
 
   const NETGENPlugin_SimpleHypothesis_2D * _simpleHyp;
   const StdMeshers_ViscousLayers*   _viscousLayersHyp;
@@ -31,6 +31,8 @@
 
 #include "NETGENPlugin_NETGEN_2D.hxx"
 #include "NETGENPlugin_NETGEN_1D2D3D_SA.hxx"
+#include "NETGENPlugin_NewElementsFile.hxx"
+#include "NETGENPlugin_NetgenContext.hxx"
 
 #include <SMESHDS_Mesh.hxx>
 #include <SMESH_ControlsDef.hxx>
@@ -192,7 +194,6 @@ bool NETGENPlugin_NETGEN_1D2D3D_SA::FillNewElementFile( std::vector< const SMDS_
   if ( isOK && !new_element_file.empty() )
   {
     MESSAGE("Writting new elements")
-    std::ofstream df(new_element_file, ios::out|ios::binary);
 
     double NetgenPoint[3];
     int    NetgenSegment[2];
@@ -202,103 +203,85 @@ bool NETGENPlugin_NETGEN_1D2D3D_SA::FillNewElementFile( std::vector< const SMDS_
     // Writing nodevec (correspondence netgen numbering mesh numbering)
     // Number of nodes
     const int NumOfPremeshedNodes = nodeVec.size();
-    df.write((char*) &NumOfPremeshedNodes, sizeof(int));
-    df.write((char*) &NetgenNodes, sizeof(int));
+    NETGENPlugin_NewElementsWriter writer( NumOfPremeshedNodes, NetgenNodes );
 
+    std::vector<int64_t>& nodeIDs = writer.NodeIDs();
+    nodeIDs.reserve( NumOfPremeshedNodes );
     for (int nodeIndex = 1 ; nodeIndex <= NumOfPremeshedNodes; ++nodeIndex )
     {
       //Id of the point
-      int id = nodeVec.at(nodeIndex)->GetID();
-      df.write((char*) &id, sizeof(int));
+      nodeIDs.push_back( nodeVec.at(nodeIndex)->GetID() );
     }
 
     // Writing all new points
+    std::vector<double>& coords = writer.Coords();
+    coords.reserve( 3 * ( NetgenNodes - NumOfPremeshedNodes ));
     for (int nodeIndex = NumOfPremeshedNodes + 1; nodeIndex <= NetgenNodes; ++nodeIndex )
     {
       Ng_GetPoint( NetgenMesh, nodeIndex, NetgenPoint );
       // Coordinates of the point
-      df.write((char *) &NetgenPoint, sizeof(double)*3);
+      coords.insert( coords.end(), NetgenPoint, NetgenPoint + 3 );
     }
 
     if ( dim >= NETGENPlugin_Mesher::D1 )
     {
       // create segments at boundaries.
-      df.write((char*) &NetgenSeg2D, sizeof(int));
+      std::vector<int64_t>& segments = writer.AddBlock( 1, 2 );
+      segments.reserve( 2 * NetgenSeg2D );
       for ( int elemIndex = 1; elemIndex <= NetgenSeg2D; ++elemIndex )
       {
         Ng_GetSegment_2D( NetgenMesh, elemIndex, NetgenSegment, &segmentId );
-        df.write((char*) &NetgenSegment, sizeof(int) * 2 );
+        segments.insert( segments.end(), NetgenSegment, NetgenSegment + 2 );
       }
     }
-    if ( dim >= NETGENPlugin_Mesher::D2 ) 
+    if ( dim >= NETGENPlugin_Mesher::D2 )
     {
       // create surface elements.
-      df.write((char*) &NetgenFaces, sizeof(int));
       for ( int elemIndex = 1; elemIndex <= NetgenFaces; ++elemIndex )
       {
         nglib::Ng_Surface_Element_Type elemType = Ng_GetSurfaceElement( NetgenMesh, elemIndex, NetgenSurface );
+        int nbNodes = 0;
         switch (elemType)
         {
-          case nglib::NG_TRIG:
-          {
-            df.write((char*) &NetgenSurface, sizeof(int) * 3 );
-            break;
-          }            
-          case nglib::NG_QUAD:
-          {
-            df.write((char*) &NetgenSurface, sizeof(int) * 4 );
-            break;
-          }            
-          case nglib::NG_TRIG6:
-          {
-            df.write((char*) &NetgenSurface, sizeof(int) * 6 );
-            break;
-          }            
-          case nglib::NG_QUAD8:
-          {
-            df.write((char*) &NetgenSurface, sizeof(int) * 8 );
-            break;
-          }
+          case nglib::NG_TRIG:  nbNodes = 3; break;
+          case nglib::NG_QUAD:  nbNodes = 4; break;
+          case nglib::NG_TRIG6: nbNodes = 6; break;
+          case nglib::NG_QUAD8: nbNodes = 8; break;
           default:
-          { break; }         
+          { break; }
+        }
+        if ( nbNodes > 0 )
+        {
+          std::vector<int64_t>& faces = writer.AddBlock( 2, nbNodes );
+          faces.insert( faces.end(), NetgenSurface, NetgenSurface + nbNodes );
         }
       }
     }
-    if ( dim >= NETGENPlugin_Mesher::D3 ) 
+    if ( dim >= NETGENPlugin_Mesher::D3 )
     {
       // create volume elements.
-      df.write((char*) &NetgenVols, sizeof(int));
       for ( int elemIndex = 1; elemIndex <= NetgenVols; ++elemIndex )
       {
         nglib::Ng_Volume_Element_Type elemType =  Ng_GetVolumeElement( NetgenMesh, elemIndex, NetgenVolumens );
+        int nbNodes = 0;
         switch (elemType)
-        {        
-          case nglib::NG_TET:
-          {
-            df.write((char*) &NetgenVolumens, sizeof(int) * 4 );
-            break;
-          } 
-          case nglib::NG_PYRAMID:
-          {
-            df.write((char*) &NetgenVolumens, sizeof(int) * 5 );
-            break;
-          }
-          case nglib::NG_PRISM:
-          {
-            df.write((char*) &NetgenVolumens, sizeof(int) * 6 );
-            break;
-          }
-          case nglib::NG_TET10:
-          {
-            df.write((char*) &NetgenVolumens, sizeof(int) * 10 );
-            break;
-          }
+        {
+          case nglib::NG_TET:     nbNodes = 4;  break;
+          case nglib::NG_PYRAMID: nbNodes = 5;  break;
+          case nglib::NG_PRISM:   nbNodes = 6;  break;
+          case nglib::NG_TET10:   nbNodes = 10; break;
           default:
           { break; }
         }
+        if ( nbNodes > 0 )
+        {
+          std::vector<int64_t>& volumes = writer.AddBlock( 3, nbNodes );
+          volumes.insert( volumes.end(), NetgenVolumens, NetgenVolumens + nbNodes );
+        }
       }
-    }          
-    df.close();
+    }
+    if ( !writer.Write( new_element_file ))
+      return true;
   }
   return false;
 }
@@ -316,7 +299,7 @@ bool NETGENPlugin_NETGEN_1D2D3D_SA::FillNewElementFile( std::vector< const SMDS_
 bool NETGENPlugin_NETGEN_1D2D3D_SA::Compute(SMESH_Mesh& aMesh, TopoDS_Shape &aShape, std::string new_element_file, bool output_mesh, NETGENPlugin_Mesher::DIM dim )
 {
   //
-  netgen::multithread.terminate = 0;
+  NETGENPlugin_NetgenContext ngContext( this );
   NETGENPlugin_Mesher mesher(&aMesh, aShape, /*is3D = */ false );
   mesher.SetParameters(dynamic_cast<const NETGENPlugin_Hypothesis*>(_hypothesis));
   if ( dim == NETGENPlugin_Mesher::D3 )
@@ -326,7 +309,11 @@ bool NETGENPlugin_NETGEN_1D2D3D_SA::Compute(SMESH_Mesh& aMesh, TopoDS_Shape &aSh
   NETGENPlugin_NetgenLibWrapper ngLib;
   vector< const SMDS_MeshNode* > nodeVec;
   bool err = mesher.Compute( ngLib, nodeVec, output_mesh, dim );  
-  FillNewElementFile( nodeVec, ngLib, new_element_file, dim );
+  if ( FillNewElementFile( nodeVec, ngLib, new_element_file, dim ))
+  {
+    std::cerr << "Can't write new elements to " << new_element_file << std::endl;
+    err = true;
+  }
   return err;
 }
 
@@ -356,6 +343,36 @@ int NETGENPlugin_NETGEN_1D2D3D_SA::run(const std::string input_mesh_file,
 
   // Importing mesh
   SMESH_DriverMesh::importMesh(input_mesh_file, *myMesh);
+
+  return runOnMesh(*myMesh,
+                   shape_file,
+                   hypo_file,
+                   element_orientation_file,
+                   new_element_file,
+                   output_mesh_file,
+                   dim);
+}
+
+/**
+ * @brief Running the mesher on an already loaded mesh
+ *
+ * @param myMesh Mesh containing lower-dimension elements
+ * @param shape_file Shape file (BREP or STEP format)
+ * @param hypo_file Ascii file containing the netgen parameters
+ * @param element_orientation_file Binary file containing the orientation of surface elemnts
+ * @param new_element_file output file containing info the elements created by the mesher
+ * @param output_mesh_file output mesh file (if empty it will not be created)
+ * @param dim dimension up to which the shape is meshed
+ * @return int
+ */
+int NETGENPlugin_NETGEN_1D2D3D_SA::runOnMesh(SMESH_Mesh&       myMesh,
+                                             const std::string shape_file,
+                                             const std::string hypo_file,
+                                             const std::string element_orientation_file,
+                                             const std::string new_element_file,
+                                             const std::string output_mesh_file,
+                                             const NETGENPlugin_Mesher::DIM dim)
+{
   // Importing shape
   TopoDS_Shape myShape;
   SMESH_DriverShape::importShape(shape_file, myShape);
@@ -367,7 +384,7 @@ int NETGENPlugin_NETGEN_1D2D3D_SA::run(const std::string input_mesh_file,
 
   if ( checkOrientationFile(element_orientation_file) )
   {
-    ret = Compute( *myMesh, myShape, new_element_file, !output_mesh_file.empty(), dim );
+    ret = Compute( myMesh, myShape, new_element_file, !output_mesh_file.empty(), dim );
     if(ret){
       std::cerr << "Meshing failed" << std::endl;
       return ret;
@@ -375,7 +392,7 @@ int NETGENPlugin_NETGEN_1D2D3D_SA::run(const std::string input_mesh_file,
 
     if(!output_mesh_file.empty()){
       std::string meshName = "MESH";
-      SMESH_DriverMesh::exportMesh(output_mesh_file, *myMesh, meshName);
+      SMESH_DriverMesh::exportMesh(output_mesh_file, myMesh, meshName);
     }
   }
   else
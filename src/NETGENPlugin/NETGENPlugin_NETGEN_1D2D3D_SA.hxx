@@ -51,6 +51,14 @@ public:
           const std::string output_mesh_file,
           const NETGENPlugin_Mesher::DIM dim );
 
+  int runOnMesh(SMESH_Mesh&       myMesh,
+                const std::string shape_file,
+                const std::string hypo_file,
+                const std::string element_orientation_file,
+                const std::string new_element_file,
+                const std::string output_mesh_file,
+                const NETGENPlugin_Mesher::DIM dim );
+
 private:
   
   bool checkOrientationFile( const std::string element_orientation_file );
@@ -31,6 +31,7 @@
 #include "NETGENPlugin_Hypothesis_2D.hxx"
 #include "NETGENPlugin_SimpleHypothesis_2D.hxx"
 #include "NETGENPlugin_Mesher.hxx"
+#include "NETGENPlugin_NetgenContext.hxx"
 
 #include <SMESHDS_Mesh.hxx>
 #include <SMESH_ControlsDef.hxx>
@@ -125,7 +126,7 @@ bool NETGENPlugin_NETGEN_2D::CheckHypothesis (SMESH_Mesh&         aMesh,
 bool NETGENPlugin_NETGEN_2D::Compute(SMESH_Mesh&         aMesh,
                                      const TopoDS_Shape& aShape)
 {
-  netgen::multithread.terminate = 0;
+  NETGENPlugin_NetgenContext ngContext( this );
 
   NETGENPlugin_Mesher mesher(&aMesh, aShape, /*is3D = */false);
   mesher.SetParameters(dynamic_cast<const NETGENPlugin_Hypothesis*>(_hypothesis));
@@ -144,7 +145,7 @@ bool NETGENPlugin_NETGEN_2D::Compute(SMESH_Mesh&         aMesh,
 void NETGENPlugin_NETGEN_2D::CancelCompute()
 {
   SMESH_Algo::CancelCompute();
-  netgen::multithread.terminate = 1;
+  NETGENPlugin_NetgenContext::Terminate( this );
 }
 
 //================================================================================
@@ -31,6 +31,7 @@
 #include "NETGENPlugin_Hypothesis.hxx"
 #include "NETGENPlugin_SimpleHypothesis_3D.hxx"
 #include "NETGENPlugin_Mesher.hxx"
+#include "NETGENPlugin_NetgenContext.hxx"
 
 #include <SMESHDS_Mesh.hxx>
 #include <SMESH_ControlsDef.hxx>
@@ -137,7 +138,7 @@ bool NETGENPlugin_NETGEN_2D3D::CheckHypothesis (SMESH_Mesh&         aMesh,
 bool NETGENPlugin_NETGEN_2D3D::Compute(SMESH_Mesh&         aMesh,
                                        const TopoDS_Shape& aShape)
 {
-  netgen::multithread.terminate = 0;
+  NETGENPlugin_NetgenContext ngContext( this );
 
   NETGENPlugin_Mesher mesher(&aMesh, aShape, true);
   mesher.SetParameters(dynamic_cast<const NETGENPlugin_Hypothesis*>(_hypothesis));
@@ -156,7 +157,7 @@ bool NETGENPlugin_NETGEN_2D3D::Compute(SMESH_Mesh&         aMesh,
 void NETGENPlugin_NETGEN_2D3D::CancelCompute()
 {
   SMESH_Algo::CancelCompute();
-  netgen::multithread.terminate = 1;
+  NETGENPlugin_NetgenContext::Terminate( this );
 }
 
 //================================================================================
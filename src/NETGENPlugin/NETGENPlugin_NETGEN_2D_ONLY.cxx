@@ -23,6 +23,7 @@
 //
 #include "NETGENPlugin_NETGEN_2D_ONLY.hxx"
 #include "NETGENPlugin_Hypothesis_2D.hxx"
+#include "NETGENPlugin_NetgenContext.hxx"
 
 #include <SMDS_MeshElement.hxx>
 #include <SMDS_MeshNode.hxx>
@@ -47,6 +48,8 @@
 #include <GEOMUtils.hxx>
 
 #include <list>
+#include <memory>
+#include <set>
 #include <vector>
 #include <limits>
 
@@ -81,7 +84,7 @@ namespace nglib {
 //#include <meshtype.hpp>
 namespace netgen {
   NETGENPLUGIN_DLL_HEADER
-  extern MeshingParameters mparam;
+  extern NG_THREAD_LOCAL MeshingParameters mparam;
 #ifdef NETGEN_V5
   extern void OCCSetLocalMeshSize(OCCGeometry & geom, Mesh & mesh);
 #endif
@@ -347,6 +350,205 @@ namespace // copied class from StdMesher_Importe_1D
     return !bb.IsOut( axRev, /*isRay=*/true, _chord );
   }
 
+  // attempts to mesh a FACE
+  enum { LOC_SIZE, NO_LOC_SIZE };
+
+  //================================================================================
+  /*!
+   * \brief Prepare netgen geometry of a FACE to mesh
+   */
+  //================================================================================
+
+  void initFaceGeometry( netgen::OCCGeometry& occgeom, const TopoDS_Face& F )
+  {
+    occgeom.shape = F;
+    occgeom.fmap.Add( F );
+    occgeom.CalcBoundingBox();
+    occgeom.facemeshstatus.SetSize(1);
+    occgeom.facemeshstatus = 0;
+    occgeom.face_maxh_modified.SetSize(1);
+    occgeom.face_maxh_modified = 0;
+    occgeom.face_maxh.SetSize(1);
+    occgeom.face_maxh = netgen::mparam.maxh;
+  }
+
+  //================================================================================
+  /*!
+   * \brief Set min and max size according to FACE boundary segments and to
+   *        local size of a mesh of the FACE where netgen failed
+   */
+  //================================================================================
+
+  void adjustSizesByWires( const TSideVector& wires, netgen::Mesh& ngMesh )
+  {
+    netgen::mparam.minh = netgen::mparam.maxh;
+    netgen::mparam.maxh = 0;
+    for ( size_t iW = 0; iW < wires.size(); ++iW )
+    {
+      StdMeshers_FaceSidePtr wire = wires[ iW ];
+      const vector<UVPtStruct>& uvPtVec = wire->GetUVPtStruct();
+      for ( size_t iP = 1; iP < uvPtVec.size(); ++iP )
+      {
+        SMESH_TNodeXYZ   p( uvPtVec[ iP ].node );
+        netgen::Point3d np( p.X(),p.Y(),p.Z());
+        double segLen = p.Distance( uvPtVec[ iP-1 ].node );
+        double   size = ngMesh.GetH( np );
+        netgen::mparam.minh = Min( netgen::mparam.minh, size );
+        netgen::mparam.maxh = Max( netgen::mparam.maxh, segLen );
+      }
+    }
+    //cerr << "min " << netgen::mparam.minh << " max " << netgen::mparam.maxh << endl;
+    netgen::mparam.minh *= 0.9;
+    netgen::mparam.maxh *= 1.1;
+  }
+
+  //================================================================================
+  /*!
+   * \brief Data of a FACE meshed in a parallel thread
+   */
+  //================================================================================
+
+  struct TFaceJob
+  {
+    TopoDS_Face                                  _face;
+    int                                          _faceID;
+    std::unique_ptr< SMESH_MesherHelper >        _helper;
+    SMESH_ProxyMesh::Ptr                         _proxyMesh;
+    TSideVector                                  _wires;
+    netgen::OCCGeometry                          _occgeom;
+    std::unique_ptr< netgen::MeshingParameters > _params;
+    std::unique_ptr< netgen::Mesh >              _ngMesh; // local size of the FACE, then result
+    vector< const SMDS_MeshNode* >               _nodeVec;
+    SMESH_ComputeErrorPtr                        _error;
+    bool                                         _toRetry; // in main thread w/o common local size
+    bool                                         _isTerminated;
+
+    TFaceJob(): _faceID( 0 ), _toRetry( false ), _isTerminated( false ) {}
+  };
+
+  //================================================================================
+  /*!
+   * \brief Return true if a job has meshed its FACE without errors
+   */
+  //================================================================================
+
+  bool isJobOk( const TFaceJob& job )
+  {
+    return ( !job._toRetry && !job._isTerminated && ( !job._error || job._error->IsOK() ));
+  }
+
+  //================================================================================
+  /*!
+   * \brief Return true if no FACE of a shape has a compute error
+   */
+  //================================================================================
+
+  bool noFaceErrors( SMESH_Mesh& mesh, const TopoDS_Shape& shape )
+  {
+    for ( TopExp_Explorer fExp( shape, TopAbs_FACE ); fExp.More(); fExp.Next() )
+    {
+      SMESH_ComputeErrorPtr& faceErr = mesh.GetSubMesh( fExp.Current() )->GetComputeError();
+      if ( faceErr && !faceErr->IsOK() )
+        return false;
+    }
+    return true;
+  }
+
+  //================================================================================
+  /*!
+   * \brief Copy nodes and faces of a netgen surface mesh
+   */
+  //================================================================================
+
+  void copySurfaceMesh( const netgen::Mesh& src, netgen::Mesh& tgt )
+  {
+    for ( int i = 1; i <= src.GetNP(); ++i )
+      tgt.AddPoint( src.Point( i ), src.Point( i ).GetLayer(), src.Point( i ).Type() );
+    for ( int i = 1; i <= src.GetNFD(); ++i )
+      tgt.AddFaceDescriptor( src.GetFaceDescriptor( i ));
+    for ( int i = 1; i <= src.GetNSE(); ++i )
+      tgt.AddSurfaceElement( src.SurfaceElement( i ));
+  }
+
+  //================================================================================
+  /*!
+   * \brief Mesh a FACE in a parallel thread
+   *  \param [in,out] job - the FACE data
+   *  \param [in] commonSizeMesh - mesh of the thread with the common local size, if any
+   *  \param [in] ngLib - netgen library wrapper of the thread
+   */
+  //================================================================================
+
+  void meshFaceInThread( TFaceJob&                      job,
+                         netgen::Mesh*                  commonSizeMesh,
+                         NETGENPlugin_NetgenLibWrapper& ngLib,
+                         const bool                     overrideMinH,
+                         const bool                     toOptimize )
+  {
+    netgen::mparam = *job._params;
+
+    netgen::Mesh * ngMesh = commonSizeMesh ? commonSizeMesh : job._ngMesh.get();
+    if ( commonSizeMesh )
+      commonSizeMesh->DeleteMesh();
+
+    job._error = NETGENPlugin_Mesher::AddSegmentsToMesh( *ngMesh, job._occgeom, job._wires,
+                                                         *job._helper, job._nodeVec, overrideMinH );
+    if ( job._error && !job._error->IsOK() )
+    {
+      job._ngMesh.reset();
+      return;
+    }
+
+    const int startWith = MESHCONST_MESHSURFACE;
+    const int endWith   = toOptimize ? MESHCONST_OPTSURFACE : MESHCONST_MESHSURFACE;
+
+    int err = 0;
+    SMESH_Comment str;
+    try {
+      OCC_CATCH_SIGNALS;
+
+      err = ngLib.GenerateMesh( job._occgeom, startWith, endWith, ngMesh );
+
+      if ( netgen::multithread.terminate )
+      {
+        job._isTerminated = true;
+        return;
+      }
+      if ( err )
+        str << "Error in netgen::OCCGenerateMesh() at " << netgen::multithread.task;
+    }
+    catch (Standard_Failure& ex)
+    {
+      err = 1;
+      str << "Exception in  netgen::OCCGenerateMesh()"
+          << " at " << netgen::multithread.task
+          << ": " << ex.DynamicType()->Name();
+      if ( ex.GetMessageString() && strlen( ex.GetMessageString() ))
+        str << ": " << ex.GetMessageString();
+    }
+    catch (...) {
+      err = 1;
+      str << "Exception in  netgen::OCCGenerateMesh()"
+          << " at " << netgen::multithread.task;
+    }
+    if ( err && !NETGENPlugin_Mesher::FixFaceMesh( job._occgeom, *ngMesh, 1 ))
+    {
+      if ( commonSizeMesh )
+      {
+        adjustSizesByWires( job._wires, *ngMesh );
+        *job._params = netgen::mparam;
+        job._toRetry = true;
+        return;
+      }
+      job._error.reset( new SMESH_ComputeError( COMPERR_ALGO_FAILED, str ));
+    }
+
+    if ( commonSizeMesh )
+    {
+      job._ngMesh.reset( new netgen::Mesh );
+      copySurfaceMesh( *commonSizeMesh, *job._ngMesh );
+    }
+  }
 }
 
 //=============================================================================
@@ -700,8 +902,6 @@ std::tuple<bool,bool> NETGENPlugin_NETGEN_2D_ONLY::SetParameteres( SMESH_Mesh& a
                                                                   NETGENPlugin_Mesher& aMesher, netgen::Mesh * ngMeshes,
                                                                   netgen::OCCGeometry& occgeoComm, bool isSubMeshSupported )
 {
-  SMESHDS_Mesh* meshDS = aMesh.GetMeshDS();
-    
   aMesher.SetParameters( _hypParameters ); // _hypParameters -> netgen::mparam
   if ( _hypMaxElementArea )
   {
@@ -715,87 +915,101 @@ std::tuple<bool,bool> NETGENPlugin_NETGEN_2D_ONLY::SetParameteres( SMESH_Mesh& a
   const bool isDefaultHyp = ( !_hypLengthFromEdges && !_hypMaxElementArea && !_hypParameters );
 
   if ( isCommonLocalSize ) // compute common local size in ngMeshes[0]
-  {
-    aMesher.PrepareOCCgeometry( occgeoComm, aShape, aMesh );//, meshedSM );
+    SetCommonLocalSize( aMesh, aShape, aMesher, ngMeshes, occgeoComm, isSubMeshSupported );
 
-    // local size set at MESHCONST_ANALYSE step depends on
-    // minh, face_maxh, grading and curvaturesafety; find minh if not set by the user
-    if ( !_hypParameters || netgen::mparam.minh < DBL_MIN )
-    {
-      if ( !_hypParameters )
-        netgen::mparam.maxh = occgeoComm.GetBoundingBox().Diam() / 3.;
-      netgen::mparam.minh = aMesher.GetDefaultMinSize( aShape, netgen::mparam.maxh );
-    }
-    // set local size depending on curvature and NOT closeness of EDGEs
+  return std::make_tuple( isCommonLocalSize, isDefaultHyp );
+}
+
+/**
+ * @brief Compute local size common for all FACEs of a shape
+ *
+ * @param ngMeshes netgen mesh to store the local size in
+ * @param occgeoComm netgen geometry of the whole shape
+ * @param isSubMeshSupported whether the existing segments are stored on EDGEs
+ */
+void NETGENPlugin_NETGEN_2D_ONLY::SetCommonLocalSize( SMESH_Mesh& aMesh, const TopoDS_Shape& aShape,
+                                                      NETGENPlugin_Mesher& aMesher, netgen::Mesh * ngMeshes,
+                                                      netgen::OCCGeometry& occgeoComm, bool isSubMeshSupported )
+{
+  SMESHDS_Mesh* meshDS = aMesh.GetMeshDS();
+
+  aMesher.PrepareOCCgeometry( occgeoComm, aShape, aMesh );//, meshedSM );
+
+  // local size set at MESHCONST_ANALYSE step depends on
+  // minh, face_maxh, grading and curvaturesafety; find minh if not set by the user
+  if ( !_hypParameters || netgen::mparam.minh < DBL_MIN )
+  {
+    if ( !_hypParameters )
+      netgen::mparam.maxh = occgeoComm.GetBoundingBox().Diam() / 3.;
+    netgen::mparam.minh = aMesher.GetDefaultMinSize( aShape, netgen::mparam.maxh );
+  }
+  // set local size depending on curvature and NOT closeness of EDGEs
 #ifdef NETGEN_V6
-    const double factor = 2; //netgen::occparam.resthcloseedgefac;
+  const double factor = 2; //netgen::occparam.resthcloseedgefac;
 #else
-    const double factor = netgen::occparam.resthcloseedgefac;
-    netgen::occparam.resthcloseedgeenable = false;
-    netgen::occparam.resthcloseedgefac = 1.0 + netgen::mparam.grading;
+  const double factor = netgen::occparam.resthcloseedgefac;
+  netgen::occparam.resthcloseedgeenable = false;
+  netgen::occparam.resthcloseedgefac = 1.0 + netgen::mparam.grading;
 #endif
-    occgeoComm.face_maxh = netgen::mparam.maxh;
+  occgeoComm.face_maxh = netgen::mparam.maxh;
 #ifdef NETGEN_V6
-    netgen::OCCParameters occparam;
-    netgen::OCCSetLocalMeshSize( occgeoComm, *ngMeshes, netgen::mparam, occparam );
+  netgen::OCCParameters occparam;
+  netgen::OCCSetLocalMeshSize( occgeoComm, *ngMeshes, netgen::mparam, occparam );
 #else
-    netgen::OCCSetLocalMeshSize( occgeoComm, *ngMeshes );
+  netgen::OCCSetLocalMeshSize( occgeoComm, *ngMeshes );
 #endif
-    occgeoComm.emap.Clear();
-    occgeoComm.vmap.Clear();
+  occgeoComm.emap.Clear();
+  occgeoComm.vmap.Clear();
 
-    if ( isSubMeshSupported )
-    {
-      // set local size according to size of existing segments
-      TopTools_IndexedMapOfShape edgeMap;
-      TopExp::MapShapes( aMesh.GetShapeToMesh(), TopAbs_EDGE, edgeMap );
-      for ( int iE = 1; iE <= edgeMap.Extent(); ++iE )
-      {
-        const TopoDS_Shape& edge = edgeMap( iE );
-        if ( SMESH_Algo::isDegenerated( TopoDS::Edge( edge )))
-          continue;
-        SMESHDS_SubMesh* smDS = meshDS->MeshElements( edge );
-        if ( !smDS ) continue;
-        SMDS_ElemIteratorPtr segIt = smDS->GetElements();
-        while ( segIt->more() )
-        {
-          const SMDS_MeshElement* seg = segIt->next();
-          SMESH_TNodeXYZ n1 = seg->GetNode(0);
-          SMESH_TNodeXYZ n2 = seg->GetNode(1);
-          gp_XYZ p = 0.5 * ( n1 + n2 );
-          netgen::Point3d pi(p.X(), p.Y(), p.Z());
-          ngMeshes->RestrictLocalH( pi, factor * ( n1 - n2 ).Modulus() );
-        }
-      }
-    }
-    else
+  if ( isSubMeshSupported )
+  {
+    // set local size according to size of existing segments
+    TopTools_IndexedMapOfShape edgeMap;
+    TopExp::MapShapes( aMesh.GetShapeToMesh(), TopAbs_EDGE, edgeMap );
+    for ( int iE = 1; iE <= edgeMap.Extent(); ++iE )
     {
-      SMDS_ElemIteratorPtr iteratorElem = meshDS->elementsIterator(SMDSAbs_Edge);
-      while ( iteratorElem->more() ) // loop on elements on a geom face
+      const TopoDS_Shape& edge = edgeMap( iE );
+      if ( SMESH_Algo::isDegenerated( TopoDS::Edge( edge )))
+        continue;
+      SMESHDS_SubMesh* smDS = meshDS->MeshElements( edge );
+      if ( !smDS ) continue;
+      SMDS_ElemIteratorPtr segIt = smDS->GetElements();
+      while ( segIt->more() )
       {
-        const SMDS_MeshElement* elem = iteratorElem->next();      
-        const SMDS_MeshNode* node0 = elem->GetNode( 0 );
-        const SMDS_MeshNode* node1 = elem->GetNode( 1 );
-        SMESH_NodeXYZ nXYZ0( node0 );
-        SMESH_NodeXYZ nXYZ1( node1 );
-        double segmentLength = ( nXYZ0 - nXYZ1 ).Modulus();
-        gp_XYZ p = 0.5 * ( nXYZ0 + nXYZ1 );
+        const SMDS_MeshElement* seg = segIt->next();
+        SMESH_TNodeXYZ n1 = seg->GetNode(0);
+        SMESH_TNodeXYZ n2 = seg->GetNode(1);
+        gp_XYZ p = 0.5 * ( n1 + n2 );
         netgen::Point3d pi(p.X(), p.Y(), p.Z());
-        ngMeshes->RestrictLocalH( pi, factor * segmentLength );
+        ngMeshes->RestrictLocalH( pi, factor * ( n1 - n2 ).Modulus() );
       }
     }
-
-    // set local size defined on shapes
-    aMesher.SetLocalSize( occgeoComm, *ngMeshes );
-    aMesher.SetLocalSizeForChordalError( occgeoComm, *ngMeshes );
-    try {
-      ngMeshes->LoadLocalMeshSize( mparam.meshsizefilename );
-    } catch (NgException & ex) {
-      throw error( COMPERR_BAD_PARMETERS, ex.What() );
+  }
+  else
+  {
+    SMDS_ElemIteratorPtr iteratorElem = meshDS->elementsIterator(SMDSAbs_Edge);
+    while ( iteratorElem->more() ) // loop on elements on a geom face
+    {
+      const SMDS_MeshElement* elem = iteratorElem->next();      
+      const SMDS_MeshNode* node0 = elem->GetNode( 0 );
+      const SMDS_MeshNode* node1 = elem->GetNode( 1 );
+      SMESH_NodeXYZ nXYZ0( node0 );
+      SMESH_NodeXYZ nXYZ1( node1 );
+      double segmentLength = ( nXYZ0 - nXYZ1 ).Modulus();
+      gp_XYZ p = 0.5 * ( nXYZ0 + nXYZ1 );
+      netgen::Point3d pi(p.X(), p.Y(), p.Z());
+      ngMeshes->RestrictLocalH( pi, factor * segmentLength );
     }
   }
 
-  return std::make_tuple( isCommonLocalSize, isDefaultHyp );
+  // set local size defined on shapes
+  aMesher.SetLocalSize( occgeoComm, *ngMeshes );
+  aMesher.SetLocalSizeForChordalError( occgeoComm, *ngMeshes );
+  try {
+    ngMeshes->LoadLocalMeshSize( mparam.meshsizefilename );
+  } catch (NgException & ex) {
+    throw error( COMPERR_BAD_PARMETERS, ex.What() );
+  }
 }
 
 bool NETGENPlugin_NETGEN_2D_ONLY::ComputeMaxhOfFace( TopoDS_Face& Face, NETGENPlugin_Mesher& aMesher, TSideVector& wires, 
@@ -912,23 +1126,21 @@ void NETGENPlugin_NETGEN_2D_ONLY::FillNodesAndElements( SMESH_Mesh& aMesh, SMESH
 {
   SMESHDS_Mesh* meshDS = aMesh.GetMeshDS();
 
-  int nbNodes = ngMesh->GetNP();
   int nbFaces = ngMesh->GetNSE();
 
   int nbInputNodes = (int) nodeVec.size()-1;
-  nodeVec.resize( nbNodes+1, 0 );
 
   // add nodes
-  for ( int ngID = nbInputNodes + 1; ngID <= nbNodes; ++ngID )
-  {
-    const MeshPoint& ngPoint = ngMesh->Point( ngID );
-    SMDS_MeshNode * node = meshDS->AddNode(ngPoint(0), ngPoint(1), ngPoint(2));
-    nodeVec[ ngID ] = node;
-  }
+  NETGENPlugin_BulkFiller filler( meshDS );
+  filler.AddNodes( *ngMesh, nodeVec, nbInputNodes + 1 );
+
+  // linear faces are added directly to SMESHDS
+  const bool isQuadratic = helper.GetIsQuadratic();
 
   // create faces
   int i,j;
   vector<const SMDS_MeshNode*> nodes;
+  nodes.reserve( 8 );
   for ( i = 1; i <= nbFaces ; ++i )
   {
     const Element2d& elem = ngMesh->SurfaceElement(i);
@@ -947,10 +1159,23 @@ void NETGENPlugin_NETGEN_2D_ONLY::FillNodesAndElements( SMESH_Mesh& aMesh, SMESH
     }
     if ( j > elem.GetNP() )
     {
-      if ( elem.GetType() == TRIG )
-        helper.AddFace(nodes[0],nodes[1],nodes[2]);
+      if ( isQuadratic )
+      {
+        if ( elem.GetType() == TRIG )
+          helper.AddFace(nodes[0],nodes[1],nodes[2]);
+        else
+          helper.AddFace(nodes[0],nodes[1],nodes[2],nodes[3]);
+      }
       else
-        helper.AddFace(nodes[0],nodes[1],nodes[2],nodes[3]);
+      {
+        SMDS_MeshFace* face;
+        if ( elem.GetType() == TRIG )
+          face = meshDS->AddFace(nodes[0],nodes[1],nodes[2]);
+        else
+          face = meshDS->AddFace(nodes[0],nodes[1],nodes[2],nodes[3]);
+        if ( face )
+          meshDS->SetMeshElementOnShape( face, faceId );
+      }
     }
   }
 }
@@ -965,10 +1190,9 @@ void NETGENPlugin_NETGEN_2D_ONLY::FillNodesAndElements( SMESH_Mesh& aMesh, SMESH
 bool NETGENPlugin_NETGEN_2D_ONLY::Compute(SMESH_Mesh&         aMesh,
                                           const TopoDS_Shape& aShape)
 {
-  netgen::multithread.terminate = 0;
+  NETGENPlugin_NetgenContext ngContext( this );
   //netgen::multithread.task = "Surface meshing";
 
-  SMESHDS_Mesh* meshDS = aMesh.GetMeshDS();
   SMESH_MesherHelper helper(aMesh);
   helper.SetElementsOnShape( true );
 
@@ -1001,188 +1225,430 @@ bool NETGENPlugin_NETGEN_2D_ONLY::Compute(SMESH_Mesh&         aMesh,
 
   netgen::mparam.uselocalh = toOptimize; // restore as it is used at surface optimization
 
+  // meshes of FACEs are copied to their other instances and periodic images
+  std::unique_ptr< NETGENPlugin_InstanceCopier > copier;
+  if ( isInstanceCopyAllowed( aMesh, aShape ))
+    copier.reset( new NETGENPlugin_InstanceCopier( aMesh, TopAbs_FACE, _hypParameters ));
+
   // ==================
   // Loop on all FACEs
   // ==================
 
+  int nbThreads = NETGENPlugin_NetgenContext::NbThreads();
+  if ( nbThreads > 1 )
+  {
+    int nbFaces = 0;
+    for ( TopExp_Explorer fExp( aShape, TopAbs_FACE ); fExp.More() && nbFaces < nbThreads; fExp.Next() )
+      ++nbFaces;
+    nbThreads = nbFaces;
+  }
+  if ( nbThreads > 1 )
+  {
+    if ( !computeInParallel( aMesh, aShape, aMesher, ngLib, ngMeshes, occgeoComm,
+                             isCommonLocalSize, isDefaultHyp, toOptimize, nbThreads,
+                             copier.get() ))
+      return false;
+    ngLib._isComputeOk = GetComputeError()->IsOK() && noFaceErrors( aMesh, aShape );
+    return true;
+  }
+
   vector< const SMDS_MeshNode* > nodeVec;
 
   TopExp_Explorer fExp( aShape, TopAbs_FACE );
   for ( int iF = 0; fExp.More(); fExp.Next(), ++iF )
   {
     TopoDS_Face F = TopoDS::Face( fExp.Current() /*.Oriented( TopAbs_FORWARD )*/);
-    int    faceID = meshDS->ShapeToIndex( F );
-    SMESH_ComputeErrorPtr& faceErr = aMesh.GetSubMesh( F )->GetComputeError();
-
-    _quadraticMesh = helper.IsQuadraticSubMesh( F );
-    const bool ignoreMediumNodes = _quadraticMesh;
-
-    // build viscous layers if required
-    if ( F.Orientation() != TopAbs_FORWARD &&
-         F.Orientation() != TopAbs_REVERSED )
-      F.Orientation( TopAbs_FORWARD ); // avoid pb with TopAbs_INTERNAL
-    SMESH_ProxyMesh::Ptr proxyMesh = StdMeshers_ViscousLayers2D::Compute( aMesh, F );
-    if ( !proxyMesh )
-      continue;
 
-    // ------------------------
-    // get all EDGEs of a FACE
-    // ------------------------
-    TSideVector wires =
-      StdMeshers_FaceSide::GetFaceWires( F, aMesh, ignoreMediumNodes, faceErr, &helper, proxyMesh );
-    if ( faceErr && !faceErr->IsOK() )
-      continue;
-    size_t nbWires = wires.size();
-    if ( nbWires == 0 )
-    {
-      faceErr.reset
-        ( new SMESH_ComputeError
-          ( COMPERR_ALGO_FAILED, "Problem in StdMeshers_FaceSide::GetFaceWires()" ));
+    // copy the mesh of an already meshed instance of the FACE
+    if ( copier && copier->HasInstances( F ) && copier->CopyFromComputed( F, this ))
       continue;
-    }
-    if ( wires[0]->NbSegments() < 3 ) // ex: a circle with 2 segments
+
+    if ( !ComputeFace( aMesh, helper, F, aMesher, ngLib, ngMeshes, occgeoComm, nodeVec,
+                       isCommonLocalSize, isDefaultHyp, toOptimize ))
+      return false;
+  } // loop on FACEs
+
+  ngLib._isComputeOk = GetComputeError()->IsOK() && noFaceErrors( aMesh, aShape );
+  return true;
+}
+
+/**
+ * @brief Mesh a FACE in the main thread
+ *
+ * @param F the FACE
+ * @param ngMeshes netgen meshes with and without the local size common for all FACEs
+ * @param nodeVec vector of nodes in which node index == netgen ID
+ * @return false if computation is to stop
+ */
+bool NETGENPlugin_NETGEN_2D_ONLY::ComputeFace( SMESH_Mesh& aMesh, SMESH_MesherHelper& helper, TopoDS_Face& F,
+                                               NETGENPlugin_Mesher& aMesher, NETGENPlugin_NetgenLibWrapper& ngLib,
+                                               netgen::Mesh** ngMeshes, netgen::OCCGeometry& occgeoComm,
+                                               vector< const SMDS_MeshNode* >& nodeVec,
+                                               bool isCommonLocalSize, bool isDefaultHyp, bool toOptimize )
+{
+  int    faceID = aMesh.GetMeshDS()->ShapeToIndex( F );
+  SMESH_ComputeErrorPtr& faceErr = aMesh.GetSubMesh( F )->GetComputeError();
+
+  // ------------------------
+  // get all EDGEs of a FACE
+  // ------------------------
+  SMESH_ProxyMesh::Ptr proxyMesh;
+  TSideVector wires;
+  if ( !GetFaceWires( aMesh, helper, F, proxyMesh, wires, faceErr ))
+    return true;
+
+  // ----------------------
+  // compute maxh of a FACE
+  // ----------------------
+
+  bool setMaxh = ComputeMaxhOfFace( F, aMesher, wires, occgeoComm, isDefaultHyp, isCommonLocalSize );
+  if (!setMaxh)
+    return setMaxh;
+
+  // prepare occgeom
+  netgen::OCCGeometry occgeom;
+  initFaceGeometry( occgeom, F );
+
+  // -------------------------
+  // Fill netgen mesh
+  // -------------------------
+
+  // MESHCONST_ANALYSE step may lead to a failure, so we make an attempt
+  // w/o MESHCONST_ANALYSE at the second loop
+  int iLoop = isCommonLocalSize ? LOC_SIZE : NO_LOC_SIZE;
+  return MeshFace( aMesh, helper, aMesher, ngLib, ngMeshes, occgeoComm, occgeom,
+                   wires, nodeVec, faceID, faceErr, iLoop, toOptimize );
+}
+
+/**
+ * @brief Check if meshes of FACEs can be copied to their other instances and periodic
+ *        images: sizes do not depend on location of a FACE and there are no viscous layers
+ */
+bool NETGENPlugin_NETGEN_2D_ONLY::isInstanceCopyAllowed( SMESH_Mesh& aMesh, const TopoDS_Shape& aShape )
+{
+  if ( _hypParameters && ( !_hypParameters->GetLocalSizesAndEntries().empty() ||
+                           !_hypParameters->GetMeshSizeFile().empty() ))
+    return false;
+
+  const std::list< const SMESHDS_Hypothesis* >& hyps =
+    GetUsedHypothesis( aMesh, aShape, /*ignoreAuxiliary=*/false );
+  for ( const SMESHDS_Hypothesis* hyp : hyps )
+    if ( hyp->GetName() == StdMeshers_ViscousLayers2D::GetHypType() )
+      return false;
+  return true;
+}
+
+/**
+ * @brief Build viscous layers on a FACE and get its wires
+ *
+ * @param F the FACE, its orientation is fixed if INTERNAL or EXTERNAL
+ * @param proxyMesh mesh of the viscous layers
+ * @param faceErr error of the FACE
+ * @return false if the FACE is not to be meshed
+ */
+bool NETGENPlugin_NETGEN_2D_ONLY::GetFaceWires( SMESH_Mesh& aMesh, SMESH_MesherHelper& helper, TopoDS_Face& F,
+                                                SMESH_ProxyMesh::Ptr& proxyMesh, TSideVector& wires,
+                                                SMESH_ComputeErrorPtr& faceErr )
+{
+  _quadraticMesh = helper.IsQuadraticSubMesh( F );
+  const bool ignoreMediumNodes = _quadraticMesh;
+
+  // build viscous layers if required
+  if ( F.Orientation() != TopAbs_FORWARD &&
+       F.Orientation() != TopAbs_REVERSED )
+    F.Orientation( TopAbs_FORWARD ); // avoid pb with TopAbs_INTERNAL
+  proxyMesh = StdMeshers_ViscousLayers2D::Compute( aMesh, F );
+  if ( !proxyMesh )
+    return false;
+
+  wires = StdMeshers_FaceSide::GetFaceWires( F, aMesh, ignoreMediumNodes, faceErr, &helper, proxyMesh );
+  if ( faceErr && !faceErr->IsOK() )
+    return false;
+  size_t nbWires = wires.size();
+  if ( nbWires == 0 )
+  {
+    faceErr.reset
+      ( new SMESH_ComputeError
+        ( COMPERR_ALGO_FAILED, "Problem in StdMeshers_FaceSide::GetFaceWires()" ));
+    return false;
+  }
+  if ( wires[0]->NbSegments() < 3 ) // ex: a circle with 2 segments
+  {
+    faceErr.reset
+      ( new SMESH_ComputeError
+        ( COMPERR_BAD_INPUT_MESH, SMESH_Comment("Too few segments: ")<<wires[0]->NbSegments()) );
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Set local size of a FACE not using the local size common for all FACEs
+ *
+ * @return false if the mesh size file can't be read
+ */
+bool NETGENPlugin_NETGEN_2D_ONLY::SetFaceLocalSize( NETGENPlugin_Mesher& aMesher, netgen::Mesh* ngMesh,
+                                                    netgen::OCCGeometry& occgeom, netgen::OCCGeometry& occgeoComm )
+{
+  ngMesh->SetGlobalH ( mparam.maxh );
+  ngMesh->SetMinimalH( mparam.minh );
+  Box<3> bb = occgeom.GetBoundingBox();
+  bb.Increase (bb.Diam()/10);
+  ngMesh->SetLocalH (bb.PMin(), bb.PMax(), mparam.grading);
+  aMesher.SetLocalSize( occgeom, *ngMesh );
+  aMesher.SetLocalSizeForChordalError( occgeoComm, *ngMesh );
+  try {
+    ngMesh->LoadLocalMeshSize( mparam.meshsizefilename );
+  } catch (NgException & ex) {
+    return error( COMPERR_BAD_PARMETERS, ex.What() );
+  }
+  return true;
+}
+
+/**
+ * @brief Generate mesh of a FACE and fill SMESHDS with the generated nodes and faces
+ *
+ * @param ngMeshes netgen meshes with and without the local size common for all FACEs
+ * @param occgeom netgen geometry of the FACE
+ * @param nodeVec vector of nodes in which node index == netgen ID
+ * @param faceErr error of the FACE
+ * @param iLoop attempt to start from, with common local size or not
+ * @return false if computation is to stop
+ */
+bool NETGENPlugin_NETGEN_2D_ONLY::MeshFace( SMESH_Mesh& aMesh, SMESH_MesherHelper& helper,
+                                            NETGENPlugin_Mesher& aMesher, NETGENPlugin_NetgenLibWrapper& ngLib,
+                                            netgen::Mesh** ngMeshes, netgen::OCCGeometry& occgeoComm,
+                                            netgen::OCCGeometry& occgeom, TSideVector& wires,
+                                            vector< const SMDS_MeshNode* >& nodeVec, int faceID,
+                                            SMESH_ComputeErrorPtr& faceErr, int iLoop, bool toOptimize )
+{
+  int err = 0;
+  for ( ; iLoop < 2; iLoop++ )
+  {
+    //bool isMESHCONST_ANALYSE = false;
+    InitComputeError();
+
+    netgen::Mesh * ngMesh = ngMeshes[ iLoop ];
+    ngMesh->DeleteMesh();
+
+    if ( iLoop == NO_LOC_SIZE )
     {
-      faceErr.reset
-        ( new SMESH_ComputeError
-          ( COMPERR_BAD_INPUT_MESH, SMESH_Comment("Too few segments: ")<<wires[0]->NbSegments()) );
-      continue;
+      if ( !SetFaceLocalSize( aMesher, ngMesh, occgeom, occgeoComm ))
+        return false;
     }
 
-    // ----------------------
-    // compute maxh of a FACE
-    // ----------------------
+    nodeVec.clear();
+    faceErr = aMesher.AddSegmentsToMesh( *ngMesh, occgeom, wires, helper, nodeVec,
+                                         /*overrideMinH=*/!_hypParameters);
+    if ( faceErr && !faceErr->IsOK() )
+      break;
 
-    bool setMaxh = ComputeMaxhOfFace( F, aMesher, wires, occgeoComm, isDefaultHyp, isCommonLocalSize );
-    if (!setMaxh)
-      return setMaxh;
-      
-    // prepare occgeom
-    netgen::OCCGeometry occgeom;
-    occgeom.shape = F;
-    occgeom.fmap.Add( F );
-    occgeom.CalcBoundingBox();
-    occgeom.facemeshstatus.SetSize(1);
-    occgeom.facemeshstatus = 0;
-    occgeom.face_maxh_modified.SetSize(1);
-    occgeom.face_maxh_modified = 0;
-    occgeom.face_maxh.SetSize(1);
-    occgeom.face_maxh = netgen::mparam.maxh;
+    //if ( !isCommonLocalSize )
+    //limitSize( ngMesh, mparam.maxh * 0.8);
 
     // -------------------------
-    // Fill netgen mesh
+    // Generate surface mesh
     // -------------------------
 
-    // MESHCONST_ANALYSE step may lead to a failure, so we make an attempt
-    // w/o MESHCONST_ANALYSE at the second loop
-    int err = 0;
-    enum { LOC_SIZE, NO_LOC_SIZE };
-    int iLoop = isCommonLocalSize ? 0 : 1;
-    for ( ; iLoop < 2; iLoop++ )
-    {
-      //bool isMESHCONST_ANALYSE = false;
-      InitComputeError();
+    const int startWith = MESHCONST_MESHSURFACE;
+    const int endWith   = toOptimize ? MESHCONST_OPTSURFACE : MESHCONST_MESHSURFACE;
+
+    SMESH_Comment str;
+    try {
+      OCC_CATCH_SIGNALS;
 
-      netgen::Mesh * ngMesh = ngMeshes[ iLoop ];
-      ngMesh->DeleteMesh();
+      err = ngLib.GenerateMesh(occgeom, startWith, endWith, ngMesh);
 
-      if ( iLoop == NO_LOC_SIZE )
+      if ( netgen::multithread.terminate )
+        return false;
+      if ( err )
+        str << "Error in netgen::OCCGenerateMesh() at " << netgen::multithread.task;
+    }
+    catch (Standard_Failure& ex)
+    {
+      err = 1;
+      str << "Exception in  netgen::OCCGenerateMesh()"
+          << " at " << netgen::multithread.task
+          << ": " << ex.DynamicType()->Name();
+      if ( ex.GetMessageString() && strlen( ex.GetMessageString() ))
+        str << ": " << ex.GetMessageString();
+    }
+    catch (...) {
+      err = 1;
+      str << "Exception in  netgen::OCCGenerateMesh()"
+          << " at " << netgen::multithread.task;
+    }
+    if ( err )
+    {
+      if ( aMesher.FixFaceMesh( occgeom, *ngMesh, 1 ))
+        break;
+      if ( iLoop == LOC_SIZE )
       {
-        ngMesh->SetGlobalH ( mparam.maxh );
-        ngMesh->SetMinimalH( mparam.minh );
-        Box<3> bb = occgeom.GetBoundingBox();
-        bb.Increase (bb.Diam()/10);
-        ngMesh->SetLocalH (bb.PMin(), bb.PMax(), mparam.grading);
-        aMesher.SetLocalSize( occgeom, *ngMesh );
-        aMesher.SetLocalSizeForChordalError( occgeoComm, *ngMesh );
-        try {
-          ngMesh->LoadLocalMeshSize( mparam.meshsizefilename );
-        } catch (NgException & ex) {
-          return error( COMPERR_BAD_PARMETERS, ex.What() );
-        }
+        adjustSizesByWires( wires, *ngMesh );
+        continue;
+      }
+      else
+      {
+        faceErr.reset( new SMESH_ComputeError( COMPERR_ALGO_FAILED, str ));
       }
+    }
 
-      nodeVec.clear();
-      faceErr = aMesher.AddSegmentsToMesh( *ngMesh, occgeom, wires, helper, nodeVec,
-                                           /*overrideMinH=*/!_hypParameters);
-      if ( faceErr && !faceErr->IsOK() )
-        break;
+    // ----------------------------------------------------
+    // Fill the SMESHDS with the generated nodes and faces
+    // ----------------------------------------------------
+    FillNodesAndElements( aMesh, helper, ngMesh, nodeVec, faceID );      
 
-      //if ( !isCommonLocalSize )
-      //limitSize( ngMesh, mparam.maxh * 0.8);
+    break;
+  } // two attempts
 
-      // -------------------------
-      // Generate surface mesh
-      // -------------------------
+  return true;
+}
 
-      const int startWith = MESHCONST_MESHSURFACE;
-      const int endWith   = toOptimize ? MESHCONST_OPTSURFACE : MESHCONST_MESHSURFACE;
+/**
+ * @brief Mesh FACEs in parallel threads
+ *
+ * FACEs are prepared by batches in the main thread. Each thread meshes every
+ * nbThreads-th FACE of a batch using its own netgen mesh, geometry and parameters.
+ * Then the generated nodes and faces are added to SMESHDS in the order of FACEs.
+ * A thread gets its own copy of the local size common for all FACEs, as the size
+ * is modified at meshing; so the result does not depend on thread scheduling.
+ */
+bool NETGENPlugin_NETGEN_2D_ONLY::computeInParallel( SMESH_Mesh&                    aMesh,
+                                                     const TopoDS_Shape&            aShape,
+                                                     NETGENPlugin_Mesher&           aMesher,
+                                                     NETGENPlugin_NetgenLibWrapper& ngLib,
+                                                     netgen::Mesh**                 ngMeshes,
+                                                     netgen::OCCGeometry&           occgeoComm,
+                                                     const bool                     isCommonLocalSize,
+                                                     const bool                     isDefaultHyp,
+                                                     const bool                     toOptimize,
+                                                     const int                      nbThreads,
+                                                     NETGENPlugin_InstanceCopier*   copier )
+{
+  SMESHDS_Mesh* meshDS = aMesh.GetMeshDS();
 
-      SMESH_Comment str;
-      try {
-        OCC_CATCH_SIGNALS;
+  // meshes with the common local size
+  vector< netgen::Mesh* > threadMeshes( nbThreads, (netgen::Mesh*) 0 );
+  vector< std::unique_ptr< netgen::Mesh > > threadMeshHolder;
+  if ( isCommonLocalSize )
+  {
+    netgen::MeshingParameters params = netgen::mparam;
+    threadMeshes[ 0 ] = ngMeshes[ 0 ];
+    for ( int iT = 1; iT < nbThreads; ++iT )
+    {
+      threadMeshHolder.emplace_back( new netgen::Mesh );
+      threadMeshes[ iT ] = threadMeshHolder.back().get();
+      netgen::OCCGeometry occgeo;
+      SetCommonLocalSize( aMesh, aShape, aMesher, threadMeshes[ iT ], occgeo );
+    }
+    netgen::mparam = params;
+  }
 
-        err = ngLib.GenerateMesh(occgeom, startWith, endWith, ngMesh);
+  const size_t batchSize = 16 * nbThreads;
+  vector< std::unique_ptr< TFaceJob > > jobs;
+  vector< const SMDS_MeshNode* > nodeVec;
 
-        if ( netgen::multithread.terminate )
-          return false;
-        if ( err )
-          str << "Error in netgen::OCCGenerateMesh() at " << netgen::multithread.task;
-      }
-      catch (Standard_Failure& ex)
-      {
-        err = 1;
-        str << "Exception in  netgen::OCCGenerateMesh()"
-            << " at " << netgen::multithread.task
-            << ": " << ex.DynamicType()->Name();
-        if ( ex.GetMessageString() && strlen( ex.GetMessageString() ))
-          str << ": " << ex.GetMessageString();
-      }
-      catch (...) {
-        err = 1;
-        str << "Exception in  netgen::OCCGenerateMesh()"
-            << " at " << netgen::multithread.task;
-      }
-      if ( err )
+  // instances of FACEs meshed in parallel are treated at the end
+  std::set< int >       meshedOrbits;
+  vector< TopoDS_Face > otherInstances;
+
+  TopExp_Explorer fExp( aShape, TopAbs_FACE );
+  while ( fExp.More() )
+  {
+    // prepare FACEs
+    jobs.clear();
+    for ( ; fExp.More() && jobs.size() < batchSize; fExp.Next() )
+    {
+      const TopoDS_Face& face = TopoDS::Face( fExp.Current() );
+      if ( copier && copier->HasInstances( face ))
       {
-        if ( aMesher.FixFaceMesh( occgeom, *ngMesh, 1 ))
-          break;
-        if ( iLoop == LOC_SIZE )
+        if ( copier->CopyFromComputed( face, this ))
+          continue;
+        if ( !meshedOrbits.insert( copier->Orbit( face )).second )
         {
-          netgen::mparam.minh = netgen::mparam.maxh;
-          netgen::mparam.maxh = 0;
-          for ( size_t iW = 0; iW < wires.size(); ++iW )
-          {
-            StdMeshers_FaceSidePtr wire = wires[ iW ];
-            const vector<UVPtStruct>& uvPtVec = wire->GetUVPtStruct();
-            for ( size_t iP = 1; iP < uvPtVec.size(); ++iP )
-            {
-              SMESH_TNodeXYZ   p( uvPtVec[ iP ].node );
-              netgen::Point3d np( p.X(),p.Y(),p.Z());
-              double segLen = p.Distance( uvPtVec[ iP-1 ].node );
-              double   size = ngMesh->GetH( np );
-              netgen::mparam.minh = Min( netgen::mparam.minh, size );
-              netgen::mparam.maxh = Max( netgen::mparam.maxh, segLen );
-            }
-          }
-          //cerr << "min " << netgen::mparam.minh << " max " << netgen::mparam.maxh << endl;
-          netgen::mparam.minh *= 0.9;
-          netgen::mparam.maxh *= 1.1;
+          otherInstances.push_back( face );
           continue;
         }
-        else
+      }
+
+      std::unique_ptr< TFaceJob > job( new TFaceJob );
+      job->_face   = face;
+      job->_faceID = meshDS->ShapeToIndex( job->_face );
+      job->_helper.reset( new SMESH_MesherHelper( aMesh ));
+      job->_helper->SetElementsOnShape( true );
+      SMESH_ComputeErrorPtr& faceErr = aMesh.GetSubMesh( job->_face )->GetComputeError();
+
+      if ( !GetFaceWires( aMesh, *job->_helper, job->_face, job->_proxyMesh, job->_wires, faceErr ))
+        continue;
+      if ( !ComputeMaxhOfFace( job->_face, aMesher, job->_wires, occgeoComm, isDefaultHyp, isCommonLocalSize ))
+        return false;
+      for ( size_t iW = 0; iW < job->_wires.size(); ++iW )
+        job->_wires[ iW ]->GetUVPtStruct(); // not to compute it in parallel
+
+      initFaceGeometry( job->_occgeom, job->_face );
+      if ( !isCommonLocalSize )
+      {
+        job->_ngMesh.reset( new netgen::Mesh );
+        if ( !SetFaceLocalSize( aMesher, job->_ngMesh.get(), job->_occgeom, occgeoComm ))
+          return false;
+      }
+      job->_params.reset( new netgen::MeshingParameters( netgen::mparam ));
+      jobs.push_back( std::move( job ));
+    }
+
+    // mesh FACEs
+    NETGENPlugin_NetgenContext::RunInThreads( nbThreads, [&]( int iT )
+      {
+        NETGENPlugin_NetgenContext ngContext( this );
+        NETGENPlugin_NetgenLibWrapper threadLib;
+        bool isOk = true;
+        for ( size_t iJ = iT; iJ < jobs.size() && !netgen::multithread.terminate; iJ += nbThreads )
         {
-          faceErr.reset( new SMESH_ComputeError( COMPERR_ALGO_FAILED, str ));
+          meshFaceInThread( *jobs[ iJ ], threadMeshes[ iT ], threadLib, !_hypParameters, toOptimize );
+          isOk = isOk && isJobOk( *jobs[ iJ ]);
         }
-      }
+        threadLib._isComputeOk = isOk && !netgen::multithread.terminate;
+      });
 
-      // ----------------------------------------------------
-      // Fill the SMESHDS with the generated nodes and faces
-      // ----------------------------------------------------
-      FillNodesAndElements( aMesh, helper, ngMesh, nodeVec, faceID );      
+    // fill SMESHDS in the order of FACEs
+    for ( size_t iJ = 0; iJ < jobs.size(); ++iJ )
+    {
+      TFaceJob& job = *jobs[ iJ ];
+      if ( netgen::multithread.terminate || job._isTerminated )
+        return false;
 
-      break;
-    } // two attempts
-  } // loop on FACEs
+      SMESH_ComputeErrorPtr& faceErr = aMesh.GetSubMesh( job._face )->GetComputeError();
+      if ( job._toRetry )
+      {
+        netgen::mparam = *job._params;
+        if ( !MeshFace( aMesh, *job._helper, aMesher, ngLib, ngMeshes, occgeoComm, job._occgeom,
+                        job._wires, nodeVec, job._faceID, faceErr, NO_LOC_SIZE, toOptimize ))
+          return false;
+      }
+      else
+      {
+        if ( job._error )
+          faceErr = job._error;
+        if ( job._ngMesh )
+          FillNodesAndElements( aMesh, *job._helper, job._ngMesh.get(), job._nodeVec, job._faceID );
+      }
+      jobs[ iJ ].reset();
+    }
+  }
+
+  // copy meshes to the rest instances; mesh an instance if its boundary differs
+  SMESH_MesherHelper helper( aMesh );
+  helper.SetElementsOnShape( true );
+  for ( size_t i = 0; i < otherInstances.size(); ++i )
+  {
+    if ( netgen::multithread.terminate )
+      return false;
+    if ( copier->CopyFromComputed( otherInstances[ i ], this ))
+      continue;
+    if ( !ComputeFace( aMesh, helper, otherInstances[ i ], aMesher, ngLib, ngMeshes, occgeoComm,
+                       nodeVec, isCommonLocalSize, isDefaultHyp, toOptimize ))
+      return false;
+  }
 
   return true;
 }
@@ -1190,7 +1656,7 @@ bool NETGENPlugin_NETGEN_2D_ONLY::Compute(SMESH_Mesh&         aMesh,
 void NETGENPlugin_NETGEN_2D_ONLY::CancelCompute()
 {
   SMESH_Algo::CancelCompute();
-  netgen::multithread.terminate = 1;
+  NETGENPlugin_NetgenContext::Terminate( this );
 }
 
 //================================================================================
@@ -1242,7 +1708,7 @@ bool NETGENPlugin_NETGEN_2D_ONLY::Evaluate(SMESH_Mesh& aMesh,
   smIdType nb0d = 0, nb1d = 0;
   bool IsQuadratic = false;
   bool IsFirst = true;
-  double fullLen = 0.0;
+  double fullLen = 0.0, maxSegLen = 0.0;
   TopTools_MapOfShape tmpMap;
   for (TopExp_Explorer exp(F, TopAbs_EDGE); exp.More(); exp.Next()) {
     TopoDS_Edge E = TopoDS::Edge(exp.Current());
@@ -1262,6 +1728,8 @@ bool NETGENPlugin_NETGEN_2D_ONLY::Evaluate(SMESH_Mesh& aMesh,
     nb1d += std::max(aVec[SMDSEntity_Edge],aVec[SMDSEntity_Quad_Edge]);
     double aLen = SMESH_Algo::EdgeLength(E);
     fullLen += aLen;
+    if ( smIdType nbSeg = std::max(aVec[SMDSEntity_Edge],aVec[SMDSEntity_Quad_Edge]) )
+      maxSegLen = Max( maxSegLen, aLen / double( nbSeg ));
     if(IsFirst) {
       IsQuadratic = (aVec[SMDSEntity_Quad_Edge] > aVec[SMDSEntity_Edge]);
       IsFirst = false;
@@ -1269,40 +1737,54 @@ bool NETGENPlugin_NETGEN_2D_ONLY::Evaluate(SMESH_Mesh& aMesh,
   }
   tmpMap.Clear();
 
-  // compute edge length
-  double ELen = 0;
-  if (( _hypLengthFromEdges ) || ( !_hypLengthFromEdges && !_hypMaxElementArea )) {
-    if ( nb1d > 0 )
-      ELen = fullLen / double( nb1d );
-  }
-  if ( _hypMaxElementArea ) {
-    double maxArea = _hypMaxElementArea->GetMaxArea();
-    ELen = sqrt(2. * maxArea/sqrt(3.0));
-  }
-  GProp_GProps G;
-  BRepGProp::SurfaceProperties(F,G);
-  double anArea = G.Mass();
+  // make the size field as Compute() does: maxh, segments on EDGEs and local sizes
+  NETGENPlugin_NetgenLibWrapper ngLib;
+  netgen::Mesh* ngMesh = ngLib._ngMesh;
+
+  NETGENPlugin_Mesher aMesher( &aMesh, F, /*isVolume=*/false );
+  aMesher.SetParameters( _hypParameters ); // _hypParameters -> netgen::mparam
+  if ( _hypMaxElementArea )
+    netgen::mparam.maxh = sqrt( 2. * _hypMaxElementArea->GetMaxArea() / sqrt(3.0) );
+  else if ( _hypLengthFromEdges && nb1d > 0 )
+    netgen::mparam.maxh = fullLen / double( nb1d );
+  else if ( !_hypParameters )
+    netgen::mparam.maxh = maxSegLen * 1.05; // by a longest segment
+
+  netgen::OCCGeometry occgeo;
+  NETGENPlugin_Mesher::PrepareOCCgeometry( occgeo, F, aMesh );
+  if ( netgen::mparam.maxh < DBL_MIN )
+    netgen::mparam.maxh = occgeo.boundingbox.Diam();
+  if ( !_hypParameters )
+    netgen::mparam.minh = aMesher.GetDefaultMinSize( F, netgen::mparam.maxh );
+  occgeo.face_maxh = netgen::mparam.maxh;
 
-  const int hugeNb = numeric_limits<int>::max()/10;
-  if ( anArea / hugeNb > ELen*ELen )
+  netgen::Box<3> bb = occgeo.GetBoundingBox();
+  bb.Increase( bb.Diam() / 10 );
+  ngMesh->SetGlobalH ( netgen::mparam.maxh );
+  ngMesh->SetMinimalH( netgen::mparam.minh );
+  ngMesh->SetLocalH( bb.PMin(), bb.PMax(), netgen::mparam.grading );
+
+  for ( TopExp_Explorer exp( F, TopAbs_EDGE ); exp.More(); exp.Next() )
   {
-    SMESH_subMesh *sm = aMesh.GetSubMesh(F);
-    SMESH_ComputeErrorPtr& smError = sm->GetComputeError();
-    smError.reset( new SMESH_ComputeError(COMPERR_ALGO_FAILED,"Submesh can not be evaluated.\nToo small element length",this));
-    return false;
-  }
-  smIdType nbFaces = (smIdType) ( anArea / ( ELen*ELen*sqrt(3.) / 4 ) );
-  smIdType nbNodes = (smIdType) ( ( nbFaces*3 - (nb1d-1)*2 ) / 6 + 1 );
-  std::vector<smIdType> aVec(SMDSEntity_Last);
-  for(smIdType i=SMDSEntity_Node; i<SMDSEntity_Last; i++) aVec[i]=0;
-  if( IsQuadratic ) {
-    aVec[SMDSEntity_Node] = nbNodes;
-    aVec[SMDSEntity_Quad_Triangle] = nbFaces;
+    if ( !tmpMap.Add( exp.Current() ))
+      continue;
+    const std::vector<smIdType>& aVec = aResMap[ aMesh.GetSubMesh( exp.Current() )];
+    smIdType nbSeg = std::max( aVec[SMDSEntity_Edge], aVec[SMDSEntity_Quad_Edge] );
+    if ( nbSeg > 0 )
+      NETGENPlugin_Estimator::RestrictSize
+        ( *ngMesh, exp.Current(), SMESH_Algo::EdgeLength( TopoDS::Edge( exp.Current() )) / nbSeg );
   }
-  else {
-    aVec[SMDSEntity_Node] = nbNodes;
-    aVec[SMDSEntity_Triangle] = nbFaces;
+  if ( _hypParameters )
+  {
+    aMesher.SetLocalSize( occgeo, *ngMesh );
+    aMesher.SetLocalSizeForChordalError( occgeo, *ngMesh );
   }
+
+  // integrate the size field over the FACE
+  NETGENPlugin_Estimator estimator( *ngMesh, occgeo, IsQuadratic );
+  std::vector<smIdType> aVec;
+  estimator.EvaluateFace( F, nb1d, aVec );
+
   SMESH_subMesh *sm = aMesh.GetSubMesh(F);
   aResMap.insert(std::make_pair(sm,aVec));
 
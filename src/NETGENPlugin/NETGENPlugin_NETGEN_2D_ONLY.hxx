@@ -28,6 +28,7 @@
 #include <SMESH_Mesh.hxx>
 #include <SMESH_Group.hxx>
 #include <SMESHDS_GroupBase.hxx>
+#include <SMESH_ProxyMesh.hxx>
 
 #include "NETGENPlugin_Mesher.hxx"
 
@@ -75,6 +76,30 @@ public:
                                         NETGENPlugin_Mesher& aMesher,  netgen::Mesh * ngMeshes,
                                         netgen::OCCGeometry& occgeoComm, bool isSubMeshSupported = true );     
 
+  void SetCommonLocalSize( SMESH_Mesh& aMesh, const TopoDS_Shape& aShape,
+                           NETGENPlugin_Mesher& aMesher, netgen::Mesh * ngMeshes,
+                           netgen::OCCGeometry& occgeoComm, bool isSubMeshSupported = true );
+
+  bool GetFaceWires( SMESH_Mesh& aMesh, SMESH_MesherHelper& helper, TopoDS_Face& F,
+                     SMESH_ProxyMesh::Ptr& proxyMesh, TSideVector& wires,
+                     SMESH_ComputeErrorPtr& faceErr );
+
+  bool SetFaceLocalSize( NETGENPlugin_Mesher& aMesher, netgen::Mesh* ngMesh,
+                         netgen::OCCGeometry& occgeom, netgen::OCCGeometry& occgeoComm );
+
+  bool MeshFace( SMESH_Mesh& aMesh, SMESH_MesherHelper& helper,
+                 NETGENPlugin_Mesher& aMesher, NETGENPlugin_NetgenLibWrapper& ngLib,
+                 netgen::Mesh** ngMeshes, netgen::OCCGeometry& occgeoComm,
+                 netgen::OCCGeometry& occgeom, TSideVector& wires,
+                 vector< const SMDS_MeshNode* >& nodeVec, int faceID,
+                 SMESH_ComputeErrorPtr& faceErr, int iLoop, bool toOptimize );
+
+  bool ComputeFace( SMESH_Mesh& aMesh, SMESH_MesherHelper& helper, TopoDS_Face& F,
+                    NETGENPlugin_Mesher& aMesher, NETGENPlugin_NetgenLibWrapper& ngLib,
+                    netgen::Mesh** ngMeshes, netgen::OCCGeometry& occgeoComm,
+                    vector< const SMDS_MeshNode* >& nodeVec,
+                    bool isCommonLocalSize, bool isDefaultHyp, bool toOptimize );
+
   bool ComputeMaxhOfFace( TopoDS_Face& Face, NETGENPlugin_Mesher& aMesher, TSideVector& wires, 
                           netgen::OCCGeometry& occgeoComm, bool isDefaultHyp, bool isCommonLocalSize );
   
@@ -87,6 +112,15 @@ public:
                               std::map<int,std::vector<double>>& newNetgenCoordinates, std::map<int,std::vector<smIdType>>& newNetgenElements, const int numberOfPremeshedNodes );
 
 protected:
+  bool computeInParallel( SMESH_Mesh& aMesh, const TopoDS_Shape& aShape,
+                          NETGENPlugin_Mesher& aMesher, NETGENPlugin_NetgenLibWrapper& ngLib,
+                          netgen::Mesh** ngMeshes, netgen::OCCGeometry& occgeoComm,
+                          const bool isCommonLocalSize, const bool isDefaultHyp,
+                          const bool toOptimize, const int nbThreads,
+                          NETGENPlugin_InstanceCopier* copier );
+
+  bool isInstanceCopyAllowed( SMESH_Mesh& aMesh, const TopoDS_Shape& aShape );
+
   const StdMeshers_MaxElementArea*       _hypMaxElementArea;
   const StdMeshers_LengthFromEdges*      _hypLengthFromEdges;
   const SMESHDS_Hypothesis*              _hypQuadranglePreference;
@@ -31,7 +31,10 @@
 #include "NETGENPlugin_NETGEN_2D_Remote.hxx"
 
 #include "NETGENPlugin_DriverParam.hxx"
+#include "NETGENPlugin_NETGEN_3D_Remote.hxx"
 #include "NETGENPlugin_Hypothesis.hxx"
+#include "NETGENPlugin_RemoteJob.hxx"
+#include "NETGENPlugin_RemoteLauncher.hxx"
 
 #include "Utils_SALOME_Exception.hxx"
 
@@ -43,9 +46,14 @@
 #include <SMESH_DriverMesh.hxx>
 #include <SMESHDS_Mesh.hxx>
 #include <SMESH_MeshLocker.hxx>
+#include <SMESH_subMesh.hxx>
 
-#include <QString>
-#include <QProcess>
+#include <TopExp_Explorer.hxx>
+#include <TopTools_ListIteratorOfListOfShape.hxx>
+#include <TopTools_MapOfShape.hxx>
+
+#include <memory>
+#include <set>
 
 #include <boost/filesystem.hpp>
 namespace fs = boost::filesystem;
@@ -71,13 +79,76 @@ namespace nglib {
 namespace netgen {
 
   NETGENPLUGIN_DLL_HEADER
-  extern MeshingParameters mparam;
+  extern NG_THREAD_LOCAL MeshingParameters mparam;
 
   NETGENPLUGIN_DLL_HEADER
-  extern volatile multithreadt multithread;
+  extern NG_THREAD_LOCAL volatile multithreadt multithread;
 }
 using namespace nglib;
 
+namespace
+{
+  //================================================================================
+  /*!
+   * \brief Submits the volume job of a solid as soon as the faces bounding it
+   *        are meshed (see NETGENPlugin_RemoteLauncher::IsPipelineEnabled())
+   */
+  //================================================================================
+
+  struct TSolidPipeline
+  {
+    SMESH_Mesh*          _mesh;
+    std::set< int >      _facesToMesh;   // IDs of faces being meshed
+    std::map< int, int > _nbFacesToMesh; // per solid ID
+
+    TSolidPipeline( SMESH_Mesh& mesh, const std::vector< TopoDS_Shape >& faces ): _mesh( &mesh )
+    {
+      for ( const TopoDS_Shape& face : faces )
+        if ( face.ShapeType() == TopAbs_FACE )
+          _facesToMesh.insert( _mesh->GetMeshDS()->ShapeToIndex( face ));
+
+      for ( int faceID : _facesToMesh )
+      {
+        TopTools_MapOfShape solids;
+        const TopoDS_Shape& face = _mesh->GetMeshDS()->IndexToShape( faceID );
+        for ( TopTools_ListIteratorOfListOfShape a( _mesh->GetAncestors( face )); a.More(); a.Next() )
+          if ( a.Value().ShapeType() == TopAbs_SOLID && solids.Add( a.Value() ))
+            ++_nbFacesToMesh[ _mesh->GetMeshDS()->ShapeToIndex( a.Value() )];
+      }
+    }
+
+    //! Submit volume jobs of solids whose last face is meshed
+    void FaceDone( const TopoDS_Shape& face )
+    {
+      TopTools_MapOfShape solids;
+      for ( TopTools_ListIteratorOfListOfShape a( _mesh->GetAncestors( face )); a.More(); a.Next() )
+        if ( a.Value().ShapeType() == TopAbs_SOLID && solids.Add( a.Value() ))
+          if ( --_nbFacesToMesh[ _mesh->GetMeshDS()->ShapeToIndex( a.Value() )] == 0 )
+            submit( a.Value() );
+    }
+
+  private:
+
+    void submit( const TopoDS_Shape& solid )
+    {
+      SMESH_Algo* algo;
+      {
+        SMESH_MeshLocker myLocker( _mesh );
+
+        // faces not meshed by this run must be already computed
+        for ( TopExp_Explorer exFa( solid, TopAbs_FACE ); exFa.More(); exFa.Next() )
+          if ( !_facesToMesh.count( _mesh->GetMeshDS()->ShapeToIndex( exFa.Current() )) &&
+               !_mesh->GetSubMesh( exFa.Current() )->IsMeshComputed() )
+            return;
+
+        algo = _mesh->GetGen()->GetAlgo( _mesh->GetSubMesh( solid ));
+      }
+      if ( NETGENPlugin_NETGEN_3D_Remote* algo3D = dynamic_cast< NETGENPlugin_NETGEN_3D_Remote* >( algo ))
+        algo3D->SubmitInAdvance( *_mesh, solid );
+    }
+  };
+}
+
 //=============================================================================
 /*!
  * Constructor
@@ -159,6 +230,11 @@ void NETGENPlugin_NETGEN_2D_Remote::exportElementOrientation(const std::string o
 /**
  * @brief Compute mesh associate to shape
  *
+ * If asynchronous launching is enabled (see
+ * NETGENPlugin_RemoteLauncher::IsAsyncEnabled()), a run_mesher job is
+ * submitted for each face and the elements of each face are added as
+ * soon as its job is over.
+ *
  * @param aMesh The mesh
  * @param aShape The shape
  * @return true fi there are some error
@@ -173,167 +249,73 @@ bool NETGENPlugin_NETGEN_2D_Remote::Compute(SMESH_Mesh&         aMesh,
   }
   SMESH_ParallelMesh& aParMesh = dynamic_cast<SMESH_ParallelMesh&>(aMesh);
 
-  // Temporary folder for run
-#ifdef WIN32
-  fs::path tmp_folder = aParMesh.GetTmpFolder() / fs::path("Volume-%%%%-%%%%");
-#else
-  fs::path tmp_folder = aParMesh.GetTmpFolder() / fs::unique_path(fs::path("Volume-%%%%-%%%%"));
-#endif
-  fs::create_directories(tmp_folder);
+  std::vector< TopoDS_Shape > faces;
+  if ( NETGENPlugin_RemoteLauncher::IsAsyncEnabled() )
+    for ( TopExp_Explorer exFa( aShape, TopAbs_FACE ); exFa.More(); exFa.Next() )
+      faces.push_back( exFa.Current() );
+  if ( faces.size() < 2 )
+    faces.assign( 1, aShape );
+
   // Using MESH2D generated after all triangles where created.
   fs::path mesh_file=aParMesh.GetTmpFolder() / fs::path("Mesh1D.med"); // read the premeshed elements from 2D version
-  fs::path element_orientation_file=tmp_folder / fs::path("element_orientation.dat");
-  fs::path new_element_file=tmp_folder / fs::path("new_elements.dat");
-  // Not used kept for debug
-  //fs::path output_mesh_file=tmp_folder / fs::path("output_mesh.med");
-  fs::path shape_file=tmp_folder / fs::path("shape.brep");
-  fs::path param_file=tmp_folder / fs::path("netgen_lenghtfromedge.txt"); /*becuase name contain 'lenghtfromedge' set length of 2D from premeshed 1D elements*/
-  fs::path log_file=tmp_folder / fs::path("run.log");
-  fs::path cmd_file=tmp_folder / fs::path("cmd.txt");
   std::string mesh_name = "MESH";
 
+  // Temporary folder and files of each run
+  std::vector< NETGENPlugin_RemoteJob > jobs( faces.size() );
+  for ( NETGENPlugin_RemoteJob& job : jobs )
   {
-    SMESH_MeshLocker myLocker(&aMesh);
-    //Writing Shape
-    SMESH_DriverShape::exportShape(shape_file.string(), aShape);
+    /*becuase name contain 'lenghtfromedge' set length of 2D from premeshed 1D elements*/
+    job.Init(aParMesh, "netgen_lenghtfromedge.txt");
+    job.input_mesh = mesh_file.string();
+  }
 
-    //Writing hypo
-    // netgen_params aParams;
-    // fillParameters(_hypParameters, aParams);
-    // exportNetgenParams(param_file.string(), aParams);
+  {
+    SMESH_MeshLocker myLocker(&aMesh);
+    for ( size_t i = 0; i < faces.size(); ++i )
     {
-      // Simply write the file with the proper name
-      std::ofstream myfile(param_file.string());
-      myfile << 1 << std::endl;
-      myfile.close();
+      //Writing Shape
+      SMESH_DriverShape::exportShape(jobs[i].shape_file.string(), faces[i]);
+
+      //Writing hypo
+      // netgen_params aParams;
+      // fillParameters(_hypParameters, aParams);
+      // exportNetgenParams(param_file.string(), aParams);
+      {
+        // Simply write the file with the proper name
+        std::ofstream myfile(jobs[i].param_file.string());
+        myfile << 1 << std::endl;
+        myfile.close();
+      }
+
+      // Exporting element orientation
+      exportElementOrientation(jobs[i].element_orientation_file.string());
     }
-      
-    // Exporting element orientation
-    exportElementOrientation(element_orientation_file.string());
   }
 
   // Calling run_mesher
-  // Path to mesher script
-  fs::path mesher_launcher = fs::path(std::getenv("SMESH_ROOT_DIR"))/
-       fs::path("bin")/
-       fs::path("salome")/
-       fs::path("mesher_launcher.py");
-
-
-  std::string s_program="python3";
-  std::list<std::string> params;
-  params.push_back(mesher_launcher.string());
-  params.push_back("NETGEN2D");
-  params.push_back(mesh_file.string());
-  params.push_back(shape_file.string());
-  params.push_back(param_file.string());
-  params.push_back("--elem-orient-file=" + element_orientation_file.string());
-  params.push_back("--new-element-file=" + new_element_file.string());
-  // params.push_back("--output-mesh-file=" + output_mesh_file.string());
-
-  // Parallelism method parameters
-  int method = aParMesh.GetParallelismMethod();
-  if(method == ParallelismMethod::MultiThread){
-    params.push_back("--method=local");
-  } else if (method == ParallelismMethod::MultiNode){
-    params.push_back("--method=cluster");
-    params.push_back("--resource="+aParMesh.GetResource());
-    params.push_back("--wc-key="+aParMesh.GetWcKey());
-    params.push_back("--nb-proc=1");
-    params.push_back("--nb-proc-per-node="+to_string(aParMesh.GetNbProcPerNode()));
-    params.push_back("--nb-node="+to_string(aParMesh.GetNbNode()));
-    params.push_back("--walltime="+aParMesh.GetWalltime());
-  } else {
-    throw SALOME_Exception("Unknown parallelism method "+method);
-  }
-  std::string cmd = "";
-  cmd += s_program;
-  for(auto arg: params){
-    cmd += " " + arg;
-  }
-  MESSAGE("Running command: ");
-  MESSAGE(cmd);
-  // Writing command in cmd.log
+  for ( NETGENPlugin_RemoteJob& job : jobs )
   {
-    std::ofstream flog(cmd_file.string());
-    flog << cmd << endl;
+    std::list<std::string> options;
+    options.push_back("--elem-orient-file=" + job.element_orientation_file.string());
+    options.push_back("--new-element-file=" + job.new_element_file.string());
+    // options.push_back("--output-mesh-file=" + output_mesh_file.string());
+    job.Submit(aParMesh, "NETGEN2D", options, /*mergeChannels=*/false);
   }
 
-  // Building arguments for QProcess
-  QString program = QString::fromStdString(s_program);
-  QStringList arguments;
-  for(auto arg : params){
-    arguments << arg.c_str();
-  }
-
-  QString out_file = log_file.string().c_str();
-  QProcess myProcess;
-  // myProcess.setProcessChannelMode(QProcess::MergedChannels);
-  myProcess.setProcessChannelMode(QProcess::ForwardedChannels);
-  myProcess.setStandardOutputFile(out_file);
-
-  myProcess.start(program, arguments);
-  // Waiting for process to finish (argument -1 make it wait until the end of
-  // the process otherwise it just waits 30 seconds)
-  bool finished = myProcess.waitForFinished(-1);
-  int ret = myProcess.exitCode();
-  if(ret != 0 || !finished){
-    // Run crahed
-    std::string msg = "Issue with mesh_launcher: \n";
-    msg += "See log for more details: " + log_file.string() + "\n";
-    msg += cmd + "\n";
-    throw SALOME_Exception(msg);
-  }
+  // Start volume meshing of a solid as soon as its faces are meshed
+  std::unique_ptr< TSolidPipeline > pipeline;
+  if ( faces.size() > 1 && NETGENPlugin_RemoteLauncher::IsPipelineEnabled() )
+    pipeline.reset( new TSolidPipeline( aMesh, faces ));
 
+  // Adding elements of each face as soon as its run is over
+  std::string msg = NETGENPlugin_RemoteJob::WaitAll( jobs, [&]( size_t i )
   {
-    SMESH_MeshLocker myLocker(&aMesh);
-    std::ifstream df(new_element_file.string(), ios::binary);
-
-    int totalPremeshedNodes;
-    int NetgenNbOfNodes;
-    int NetgenNbOfNodesNew;
-    int NetgenNbOfTriangles;
-    double NetgenPoint[3];
-    int    NetgenTriangle[3];
-    int nodeID;
-
-    SMESH_MesherHelper helper(aMesh);
-    // This function is mandatory for setElementsOnShape to work
-    helper.IsQuadraticSubMesh(aShape);
-    helper.SetElementsOnShape( true );
-
-    df.read((char*) &totalPremeshedNodes, sizeof(int));
-    // Number of nodes in intial mesh
-    df.read((char*) &NetgenNbOfNodes, sizeof(int));
-    // Number of nodes added by netgen
-    df.read((char*) &NetgenNbOfNodesNew, sizeof(int));
-
-    // Filling nodevec (correspondence netgen numbering mesh numbering)
-    vector< const SMDS_MeshNode* > nodeVec ( NetgenNbOfNodesNew + 2 );
-    SMESHDS_Mesh * meshDS = helper.GetMeshDS();
-    for (int nodeIndex = 1; nodeIndex <= NetgenNbOfNodes; ++nodeIndex )
-    {
-      //Id of the point
-      df.read((char*) &nodeID, sizeof(int));
-      nodeVec.at(nodeID) = meshDS->FindNode(nodeID);
-    }
-
-    // Add new points and update nodeVec
-    for (int nodeIndex = totalPremeshedNodes + 1; nodeIndex <= NetgenNbOfNodesNew; ++nodeIndex )
-    {
-      df.read((char *) &NetgenPoint, sizeof(double)*3);
-      nodeVec.at(nodeIndex) = helper.AddNode(NetgenPoint[0], NetgenPoint[1], NetgenPoint[2]);
-    }
-
-    // Add triangles
-    df.read((char*) &NetgenNbOfTriangles, sizeof(int));
-    for ( int elemIndex = 1; elemIndex <= NetgenNbOfTriangles; ++elemIndex )
-    {
-      df.read((char*) &NetgenTriangle, sizeof(int)*3);
-      if ( nodeVec.at( NetgenTriangle[0] ) && nodeVec.at( NetgenTriangle[1] ) && nodeVec.at( NetgenTriangle[2] ) )
-        helper.AddFace(nodeVec.at( NetgenTriangle[0] ), nodeVec.at( NetgenTriangle[1] ), nodeVec.at( NetgenTriangle[2] ) );            
-    }
-  }
+    NETGENPlugin_RemoteJob::FillNewElements(aMesh, faces[i], jobs[i].new_element_file.string(), 2);
+    if ( pipeline )
+      pipeline->FaceDone( faces[i] );
+  });
+  if ( !msg.empty() )
+    throw SALOME_Exception(msg);
 
   return true;
 }
@@ -34,6 +34,8 @@
 
 #include <vector>
 #include <map>
+#include <list>
+#include <string>
 
 class StdMeshers_ViscousLayers;
 class StdMeshers_MaxElementVolume;
@@ -41,6 +43,7 @@ class NETGENPlugin_Hypothesis;
 class NETGENPlugin_NetgenLibWrapper;
 class netgen_params;
 class SMDS_MeshNode;
+class SMESH_ParallelMesh;
 
 using namespace std;
 
@@ -28,6 +28,8 @@
 #include "NETGENPlugin_Hypothesis_2D.hxx"
 #include "NETGENPlugin_SimpleHypothesis_2D.hxx"
 #include "NETGENPlugin_Mesher.hxx"
+#include "NETGENPlugin_NewElementsFile.hxx"
+#include "NETGENPlugin_ResultCache.hxx"
 
 #include <SMESHDS_Mesh.hxx>
 #include <SMESH_ControlsDef.hxx>
@@ -40,6 +42,11 @@
 #include <StdMeshers_MaxElementArea.hxx>
 #include <utilities.h>
 
+#include <Bnd_Box.hxx>
+#include <GEOMUtils.hxx>
+#include <TopExp.hxx>
+#include <TopTools_IndexedMapOfShape.hxx>
+
 #ifdef WIN32
 #include <filesystem>
 namespace fs = std::filesystem;
@@ -55,6 +62,72 @@ namespace nglib {
 
 using namespace nglib;
 
+namespace
+{
+  //================================================================================
+  /*!
+   * \brief Compute the cache key of a face meshing: hash of the shape, of the
+   *        boundary segments of the faces and of the parameters
+   *  \param [in] meshDS - the input mesh
+   *  \param [in] shape - the faces to mesh
+   *  \param [in] shape_file - the BRep file
+   *  \param [in] hypo_file - the file of netgen_params, whose name defines the hypothesis type
+   *  \param [in] aParams - the parameters
+   *  \param [out] key - the key
+   *  \return bool - false if some data can't be read
+   */
+  //================================================================================
+
+  bool getCacheKey(SMESHDS_Mesh*                  meshDS,
+                   const TopoDS_Shape&            shape,
+                   const std::string&             shape_file,
+                   const std::string&             hypo_file,
+                   const netgen_params&           aParams,
+                   NETGENPlugin_ResultCache::Key& key)
+  {
+    key.Add( std::string( "NETGEN2D" ));
+    key.Add( NETGENPlugin_NewElementsReader::Version );
+    key.Add( fs::path( hypo_file ).filename().string() );
+    if ( !key.AddFile( shape_file ) || !key.AddFile( hypo_file ))
+      return false;
+    if ( !aParams.meshsizefilename.empty() && !key.AddFile( aParams.meshsizefilename ))
+      return false;
+
+    // numbering of new nodes starts after all nodes of the input mesh
+    key.Add( meshDS->NbNodes() );
+
+    // MapSegmentsToEdges() takes segments whose middle is inside the face box,
+    // so only these segments and their nodes define the result
+    TopTools_IndexedMapOfShape faces;
+    TopExp::MapShapes( shape, TopAbs_FACE, faces );
+    for ( int i = 1; i <= faces.Size(); ++i )
+    {
+      Bnd_Box faceBox;
+      GEOMUtils::PreciseBoundingBox( faces( i ), faceBox );
+
+      SMDS_ElemIteratorPtr eIt = meshDS->elementsIterator( SMDSAbs_Edge );
+      while ( eIt->more() )
+      {
+        const SMDS_MeshElement* segment = eIt->next();
+        gp_XYZ middle = ( SMESH_NodeXYZ( segment->GetNode( 0 )) +
+                          SMESH_NodeXYZ( segment->GetNode( 1 ))) / 2.;
+        if ( faceBox.IsOut( middle ))
+          continue;
+        key.Add( segment->GetID() );
+        for ( int iN = 0; iN < segment->NbNodes(); ++iN )
+        {
+          SMESH_NodeXYZ node( segment->GetNode( iN ));
+          key.Add( node.Node()->GetID() );
+          key.Add( node.X() );
+          key.Add( node.Y() );
+          key.Add( node.Z() );
+        }
+      }
+    }
+    return true;
+  }
+}
+
 //=============================================================================
 /*!
  *  
@@ -174,32 +247,30 @@ bool NETGENPlugin_NETGEN_2D_SA::fillNewElementFile( std::string new_element_file
   bool isOK = ( NetgenNbOfTriangles > 0 );
   if ( isOK && !new_element_file.empty() )
   {
-    int    NetgenElement[3];
-    std::ofstream df(new_element_file, ios::out|ios::binary);
+    NETGENPlugin_NewElementsWriter writer( numberOfGlobalPremeshedNodes, NetgenNbOfNodesNew );
+
     // Writing nodevec (correspondence netgen numbering mesh numbering)
-    // Number of nodes
-    df.write((char*) &numberOfGlobalPremeshedNodes, sizeof(int));
-    df.write((char*) &NetgenNbOfNodes, sizeof(int));
-    df.write((char*) &NetgenNbOfNodesNew, sizeof(int));
-    for (auto k : premeshedNodes )
-      df.write((char*) &k.first, sizeof(int));      
-        
+    std::vector<int64_t>& nodeIDs = writer.NodeIDs();
+    nodeIDs.reserve( NetgenNbOfNodes );
+    for (auto& k : premeshedNodes )
+      nodeIDs.push_back( k.first );
+
     // Writing info on new points
-    for (auto k : newNetgenCoordinates )
-      df.write((char*) k.second.data(), sizeof(double)*3 ); 
-      
-    // create triangles
-    df.write((char*) &NetgenNbOfTriangles, sizeof(int));
+    std::vector<double>& coords = writer.Coords();
+    coords.reserve( 3 * newNetgenCoordinates.size() );
+    for (auto& k : newNetgenCoordinates )
+      coords.insert( coords.end(), k.second.begin(), k.second.begin() + 3 );
+
+    // create triangles (elements of other number of nodes go to other blocks)
     for ( int elemIndex = 1; elemIndex <= NetgenNbOfTriangles; ++elemIndex )
     {
-      int nodes = newNetgenElements[ elemIndex ].size();
-      for (int i = 0; i < nodes; i++)
-        NetgenElement[ i ] = (int) newNetgenElements[ elemIndex ][ i ];
-      
-      df.write((char*) &NetgenElement, sizeof(int)* nodes );
+      std::vector<smIdType>& nodes = newNetgenElements[ elemIndex ];
+      std::vector<int64_t>&  faces = writer.AddBlock( 2, (int) nodes.size() );
+      faces.insert( faces.end(), nodes.begin(), nodes.end() );
     }
 
-    df.close();
+    if ( !writer.Write( new_element_file ))
+      return true;
   }
   return false;
 }
@@ -234,16 +305,20 @@ bool NETGENPlugin_NETGEN_2D_SA::Compute( SMESH_Mesh& aMesh, TopoDS_Shape &aShape
   std::map<int,std::vector<double>> newNetgenCoordinates;
   std::map<int,std::vector<smIdType>> newNetgenElements;
   const int numberOfTotalPremeshedNodes = aMesh.NbNodes();
-  bool compute = NETGENPlugin_NETGEN_2D_ONLY::MapSegmentsToEdges( aMesh, aShape, ngLib, nodeVec,
-                                                                  premeshedNodes, newNetgenCoordinates, 
-                                                                  newNetgenElements );
+  bool err = NETGENPlugin_NETGEN_2D_ONLY::MapSegmentsToEdges( aMesh, aShape, ngLib, nodeVec,
+                                                              premeshedNodes, newNetgenCoordinates, 
+                                                              newNetgenElements );
   
-  compute = fillNewElementFile(new_element_file, 
-                                numberOfTotalPremeshedNodes, 
-                                premeshedNodes, 
-                                newNetgenCoordinates, 
-                                newNetgenElements);
-  return compute;
+  if ( fillNewElementFile(new_element_file, 
+                          numberOfTotalPremeshedNodes, 
+                          premeshedNodes, 
+                          newNetgenCoordinates, 
+                          newNetgenElements))
+  {
+    std::cerr << "Can't write new elements to " << new_element_file << std::endl;
+    err = true;
+  }
+  return err;
 }
 
 /**
@@ -268,6 +343,33 @@ int NETGENPlugin_NETGEN_2D_SA::run(const std::string input_mesh_file,
   std::unique_ptr<SMESH_Mesh> myMesh(_gen->CreateMesh(false));
   
   SMESH_DriverMesh::importMesh(input_mesh_file, *myMesh);
+
+  return runOnMesh(*myMesh,
+                   shape_file,
+                   hypo_file,
+                   element_orientation_file,
+                   new_element_file,
+                   output_mesh_file);
+}
+
+/**
+ * @brief Running the mesher on an already loaded mesh
+ *
+ * @param myMesh Mesh containing lower-dimension elements
+ * @param shape_file Shape file (BREP or STEP format)
+ * @param hypo_file Ascii file containing the netgen parameters
+ * @param element_orientation_file Binary file containing the orientation of surface elemnts
+ * @param new_element_file output file containing info the elements created by the mesher
+ * @param output_mesh_file output mesh file (if empty it will not be created)
+ * @return int
+ */
+int NETGENPlugin_NETGEN_2D_SA::runOnMesh(SMESH_Mesh&       myMesh,
+                                         const std::string shape_file,
+                                         const std::string hypo_file,
+                                         const std::string element_orientation_file,
+                                         const std::string new_element_file,
+                                         const std::string output_mesh_file)
+{
   // Importing shape
   TopoDS_Shape myShape;
   SMESH_DriverShape::importShape(shape_file, myShape);
@@ -279,16 +381,28 @@ int NETGENPlugin_NETGEN_2D_SA::run(const std::string input_mesh_file,
   int ret = 1;
   if ( checkOrientationFile(element_orientation_file) )
   {
-    ret = (int) Compute( *myMesh, myShape, new_element_file );
+    // Looking for the result of a previous run on the same data
+    NETGENPlugin_ResultCache cache;
+    NETGENPlugin_ResultCache::Key cacheKey;
+    bool useCache = ( NETGENPlugin_ResultCache::IsEnabled() &&
+                      !new_element_file.empty() && output_mesh_file.empty() &&
+                      getCacheKey( myMesh.GetMeshDS(), myShape, shape_file, hypo_file, myParams, cacheKey ));
+    if ( useCache && cache.Fetch( cacheKey, new_element_file ))
+      return 0;
+
+    ret = (int) Compute( myMesh, myShape, new_element_file );
 
     if(ret){
       std::cerr << "Meshing failed" << std::endl;
       return ret;
     }
 
+    if ( useCache )
+      cache.Store( cacheKey, new_element_file );
+
     if(!output_mesh_file.empty()){
       std::string meshName = "MESH";
-      SMESH_DriverMesh::exportMesh(output_mesh_file, *myMesh, meshName);
+      SMESH_DriverMesh::exportMesh(output_mesh_file, myMesh, meshName);
     }
   }
   else
@@ -50,6 +50,13 @@ public:
           const std::string new_element_file,
           const std::string output_mesh_file);
 
+  int runOnMesh(SMESH_Mesh&       myMesh,
+                const std::string shape_file,
+                const std::string hypo_file,
+                const std::string element_orientation_file,
+                const std::string new_element_file,
+                const std::string output_mesh_file);
+
   bool fillNewElementFile( std::string new_element_file, 
                            const int numberOfGlobalPremeshedNodes,
                            std::map<int,const SMDS_MeshNode*>& premeshedNodes, 
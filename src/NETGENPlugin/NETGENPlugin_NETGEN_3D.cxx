@@ -31,6 +31,7 @@
 #include "NETGENPlugin_NETGEN_3D.hxx"
 
 #include "NETGENPlugin_Hypothesis.hxx"
+#include "NETGENPlugin_NetgenContext.hxx"
 
 #include <SMDS_MeshElement.hxx>
 #include <SMDS_MeshNode.hxx>
@@ -61,6 +62,7 @@
 
 #include <utilities.h>
 
+#include <algorithm>
 #include <list>
 #include <vector>
 #include <map>
@@ -89,14 +91,48 @@ namespace nglib {
 namespace netgen {
 
   NETGENPLUGIN_DLL_HEADER
-  extern MeshingParameters mparam;
+  extern NG_THREAD_LOCAL MeshingParameters mparam;
 
   NETGENPLUGIN_DLL_HEADER
-  extern volatile multithreadt multithread;
+  extern NG_THREAD_LOCAL volatile multithreadt multithread;
 }
 using namespace nglib;
 using namespace std;
 
+namespace
+{
+  //================================================================================
+  /*!
+   * \brief Sort surface elements by ID. Of elements with equal IDs, keep the first
+   *        one with flags of the last one, like std::map with TIDCompare does
+   */
+  //================================================================================
+
+  void sortByID( NETGENPlugin_NETGEN_3D::TSurfaceElements& elements )
+  {
+    typedef NETGENPlugin_NETGEN_3D::TSurfaceElement TElem;
+    std::stable_sort( elements.begin(), elements.end(),
+                      []( const TElem& e1, const TElem& e2 )
+                      { return get<0>( e1 )->GetID() < get<0>( e2 )->GetID(); });
+
+    size_t nbUnique = 0;
+    for ( size_t i = 0; i < elements.size(); ++i )
+    {
+      if ( nbUnique > 0 &&
+           get<0>( elements[ nbUnique-1 ])->GetID() == get<0>( elements[ i ])->GetID() )
+      {
+        get<1>( elements[ nbUnique-1 ]) = get<1>( elements[ i ]);
+        get<2>( elements[ nbUnique-1 ]) = get<2>( elements[ i ]);
+      }
+      else
+      {
+        elements[ nbUnique++ ] = elements[ i ];
+      }
+    }
+    elements.resize( nbUnique );
+  }
+}
+
 //=============================================================================
 /*!
  *
@@ -208,7 +244,7 @@ bool NETGENPlugin_NETGEN_3D::CheckHypothesis (SMESH_Mesh&         aMesh,
  * @param proxyMesh pointer to mesh used fo find the elements
  * @param internals information on internal sub shapes
  * @param helper helper associated to the mesh
- * @param listElements map of surface element associated with
+ * @param listElements surface elements associated with
  *                     their orientation and internal status
  * @return true if their was some error
  */
@@ -218,7 +254,7 @@ bool NETGENPlugin_NETGEN_3D::getSurfaceElements(
     SMESH_ProxyMesh::Ptr proxyMesh,
     NETGENPlugin_Internals &internals,
     SMESH_MesherHelper &helper,
-    std::map<const SMDS_MeshElement*, tuple<bool, bool>, TIDCompare>& listElements
+    TSurfaceElements& listElements
 )
 {
   SMESHDS_Mesh* meshDS = aMesh.GetMeshDS();
@@ -259,7 +295,7 @@ bool NETGENPlugin_NETGEN_3D::getSurfaceElements(
       if ( elem->NbCornerNodes() != 3 ){
         return error( COMPERR_BAD_INPUT_MESH, "Not triangle element encounters");
       }
-      listElements[elem] = tuple<bool, bool>(isRev, isInternalFace);
+      listElements.emplace_back( elem, isRev, isInternalFace );
     }
   }
 
@@ -303,17 +339,12 @@ bool NETGENPlugin_NETGEN_3D::computeFillNgMesh(
   Ng_Mesh * Netgen_mesh = (Ng_Mesh*)ngLib._ngMesh;
 
   {
-    const int invalid_ID = -1;
-
     SMESH::Controls::Area areaControl;
     SMESH::Controls::TSequenceOfXYZ nodesCoords;
 
     // maps nodes to ng ID
-    // map must be sorted by ID to ensure that we will have the same number of
-    // 3D element if we recompute
-    typedef map< const SMDS_MeshNode*, int, TIDCompare > TNodeToIDMap;
-    typedef TNodeToIDMap::value_type                     TN2ID;
-    TNodeToIDMap nodeToNetgenID;
+    NETGENPlugin_NodeIdMap nodeToNetgenID( meshDS );
+    nodeVec.assign( 1, 0 );
 
     // find internal shapes
     NETGENPlugin_Internals internals( aMesh, aShape, /*is3D=*/true );
@@ -340,17 +371,19 @@ bool NETGENPlugin_NETGEN_3D::computeFillNgMesh(
       proxyMesh.reset( Adaptor );
     }
 
-    // map must be sorted by ID to ensure that we will have the same number of
-    // 3D element if we recompute
-    std::map<const SMDS_MeshElement*, tuple<bool, bool>, TIDCompare> listElements;
+    TSurfaceElements listElements;
     bool ret = getSurfaceElements(aMesh, aShape, proxyMesh, internals, helper, listElements);
     if(ret)
       return ret;
 
-    for ( auto const& [elem, info] : listElements ) // loop on elements on a geom face
+    // elements must be sorted by ID to ensure that we will have the same number of
+    // 3D element if we recompute
+    sortByID( listElements );
+
+    for ( auto const& [elem, isRevElem, isInternalElem] : listElements ) // loop on elements on a geom face
     {
-      isRev = get<0>(info);
-      isInternalFace = get<1>(info);
+      isRev = isRevElem;
+      isInternalFace = isInternalElem;
       // Add nodes of triangles and triangles them-selves to netgen mesh
 
       // add three nodes of triangle
@@ -367,14 +400,16 @@ bool NETGENPlugin_NETGEN_3D::computeFillNgMesh(
           node = SMESH_Algo::VertexNode( TopoDS::Vertex( vertex ), meshDS );
           hasDegen = true;
         }
-        int& ngID = nodeToNetgenID.insert(TN2ID( node, invalid_ID )).first->second;
-        if ( ngID == invalid_ID )
+        int& ngID = nodeToNetgenID[ node ];
+        if ( ngID == 0 )
         {
           ngID = ++Netgen_NbOfNodes;
           Netgen_point [ 0 ] = node->X();
           Netgen_point [ 1 ] = node->Y();
           Netgen_point [ 2 ] = node->Z();
           Ng_AddPoint(Netgen_mesh, Netgen_point);
+          // insert old nodes into nodeVec
+          nodeVec.push_back( node );
         }
         Netgen_triangle[ isRev ? 2-iN : iN ] = ngID;
       }
@@ -393,12 +428,6 @@ bool NETGENPlugin_NETGEN_3D::computeFillNgMesh(
       }
     } // loop on elements on a face
 
-    // insert old nodes into nodeVec
-    nodeVec.resize( nodeToNetgenID.size() + 1, 0 );
-    TNodeToIDMap::iterator n_id = nodeToNetgenID.begin();
-    for ( ; n_id != nodeToNetgenID.end(); ++n_id )
-      nodeVec[ n_id->second ] = n_id->first;
-    nodeToNetgenID.clear();
 
     if ( internals.hasInternalVertexInSolid() )
     {
@@ -576,7 +605,15 @@ bool NETGENPlugin_NETGEN_3D::computeFillMesh(
   int Netgen_NbOfTetra    = Ng_GetNE(Netgen_mesh);
 
   bool isOK = ( /*status == NG_OK &&*/ Netgen_NbOfTetra > 0 );// get whatever built
-  if ( isOK )
+  if ( isOK && !helper.GetIsQuadratic() )
+  {
+    // add all nodes and tetrahedra at once directly to SMESHDS
+    NETGENPlugin_BulkFiller filler( helper.GetMeshDS() );
+    filler.AddNodes( *(netgen::Mesh*) Netgen_mesh, nodeVec, Netgen_NbOfNodes + 1, helper.GetSubShapeID() );
+    if ( int nbBad = filler.AddTetrahedra( *(netgen::Mesh*) Netgen_mesh, nodeVec, helper.GetSubShapeID() ))
+      return !error( COMPERR_ALGO_FAILED, SMESH_Comment( nbBad ) << " tetrahedra not created" );
+  }
+  else if ( isOK )
   {
     double Netgen_point[3];
     int    Netgen_tetrahedron[4];
@@ -621,6 +658,20 @@ bool NETGENPlugin_NETGEN_3D::Compute(
   SMESH_Mesh&         aMesh,
   const TopoDS_Shape& aShape)
 {
+  // copy the mesh of an instance or a periodic image of the SOLID computed
+  // with the same hypotheses
+  if ( aShape.ShapeType() == TopAbs_SOLID &&
+       !_viscousLayersHyp &&
+       ( !_hypParameters || ( _hypParameters->GetLocalSizesAndEntries().empty() &&
+                              _hypParameters->GetMeshSizeFile().empty() )))
+  {
+    NETGENPlugin_InstanceCopier copier( aMesh, TopAbs_SOLID, _hypParameters );
+    if ( copier.HasInstances( aShape ) && copier.CopyFromComputed( aShape, this ))
+      return true;
+  }
+
+  NETGENPlugin_NetgenContext ngContext( this );
+
   // vector of nodes in which node index == netgen ID
   vector< const SMDS_MeshNode* > nodeVec;
   NETGENPlugin_NetgenLibWrapper ngLib;
@@ -636,6 +687,7 @@ bool NETGENPlugin_NETGEN_3D::Compute(
   computeRunMesher(occgeo, nodeVec, ngLib._ngMesh, ngLib, startWith, endWith);
 
   computeFillMesh(nodeVec, ngLib, helper, Netgen_NbOfNodes);
+  ngLib._isComputeOk = GetComputeError()->IsOK();
   return false;
 
 }
@@ -762,7 +814,16 @@ bool NETGENPlugin_NETGEN_3D::compute(SMESH_Mesh&                     aMesh,
   }
 
   bool isOK = ( /*status == NG_OK &&*/ Netgen_NbOfTetra > 0 );// get whatever built
-  if ( isOK )
+  if ( isOK && !helper.GetIsQuadratic() )
+  {
+    // add all nodes and tetrahedra at once directly to SMESHDS
+    NETGENPlugin_BulkFiller filler( helper.GetMeshDS() );
+    filler.AddNodes( *(netgen::Mesh*) Netgen_mesh, nodeVec, Netgen_NbOfNodes + 1, helper.GetSubShapeID() );
+    if ( int nbBad = filler.AddTetrahedra( *(netgen::Mesh*) Netgen_mesh, nodeVec, helper.GetSubShapeID() ))
+      if ( !err )
+        err = !error( COMPERR_ALGO_FAILED, SMESH_Comment( nbBad ) << " tetrahedra not created" );
+  }
+  else if ( isOK )
   {
     double Netgen_point[3];
     int    Netgen_tetrahedron[4];
@@ -805,9 +866,7 @@ bool NETGENPlugin_NETGEN_3D::compute(SMESH_Mesh&                     aMesh,
 bool NETGENPlugin_NETGEN_3D::Compute(SMESH_Mesh&         aMesh,
                                      SMESH_MesherHelper* aHelper)
 {
-  const int invalid_ID = -1;
-
-  netgen::multithread.terminate = 0;
+  NETGENPlugin_NetgenContext ngContext( this );
   _progressByTic = -1.;
 
   SMESH_MesherHelper::MType MeshType = aHelper->IsQuadraticMesh();
@@ -844,9 +903,10 @@ bool NETGENPlugin_NETGEN_3D::Compute(SMESH_Mesh&         aMesh,
   }
 
   // maps nodes to ng ID
-  typedef map< const SMDS_MeshNode*, int, TIDCompare > TNodeToIDMap;
-  typedef TNodeToIDMap::value_type                     TN2ID;
-  TNodeToIDMap nodeToNetgenID;
+  NETGENPlugin_NodeIdMap nodeToNetgenID( aMesh.GetMeshDS() );
+
+  // vector of nodes in which node index == netgen ID
+  vector< const SMDS_MeshNode* > nodeVec ( 1 );
 
   SMDS_ElemIteratorPtr fIt = proxyMesh->GetFaces();
   while( fIt->more())
@@ -862,14 +922,16 @@ bool NETGENPlugin_NETGEN_3D::Compute(SMESH_Mesh&         aMesh,
     for ( int iN = 0; iN < 3; ++iN )
     {
       const SMDS_MeshNode* node = elem->GetNode( iN );
-      int& ngID = nodeToNetgenID.insert(TN2ID( node, invalid_ID )).first->second;
-      if ( ngID == invalid_ID )
+      int& ngID = nodeToNetgenID[ node ];
+      if ( ngID == 0 )
       {
         ngID = ++Netgen_NbOfNodes;
         Netgen_point [ 0 ] = node->X();
         Netgen_point [ 1 ] = node->Y();
         Netgen_point [ 2 ] = node->Z();
         Ng_AddPoint(Netgen_mesh, Netgen_point);
+        // insert old nodes into nodeVec
+        nodeVec.push_back( node );
       }
       Netgen_triangle[ iN ] = ngID;
     }
@@ -877,14 +939,6 @@ bool NETGENPlugin_NETGEN_3D::Compute(SMESH_Mesh&         aMesh,
   }
   proxyMesh.reset(); // delete tmp faces
 
-  // vector of nodes in which node index == netgen ID
-  vector< const SMDS_MeshNode* > nodeVec ( nodeToNetgenID.size() + 1 );
-  // insert old nodes into nodeVec
-  TNodeToIDMap::iterator n_id = nodeToNetgenID.begin();
-  for ( ; n_id != nodeToNetgenID.end(); ++n_id )
-    nodeVec.at( n_id->second ) = n_id->first;
-  nodeToNetgenID.clear();
-
   // -------------------------
   // Generate the volume mesh
   // -------------------------
@@ -895,7 +949,7 @@ bool NETGENPlugin_NETGEN_3D::Compute(SMESH_Mesh&         aMesh,
 void NETGENPlugin_NETGEN_3D::CancelCompute()
 {
   SMESH_Algo::CancelCompute();
-  netgen::multithread.terminate = 1;
+  NETGENPlugin_NetgenContext::Terminate( this );
 }
 
 //================================================================================
@@ -912,11 +966,12 @@ double NETGENPlugin_NETGEN_3D::GetProgress() const
   const double meshingRatio = 0.15;
   const_cast<NETGENPlugin_NETGEN_3D*>( this )->_progressTic++;
 
+  const std::string task = NETGENPlugin_NetgenContext::Task( this );
   if ( _progressByTic < 0. &&
-       ( strncmp( netgen::multithread.task, dlnMeshing, 3 ) == 0 ||
-         strncmp( netgen::multithread.task, volMeshing, 3 ) == 0 ))
+       ( strncmp( task.c_str(), dlnMeshing, 3 ) == 0 ||
+         strncmp( task.c_str(), volMeshing, 3 ) == 0 ))
   {
-    res = 0.001 + meshingRatio * netgen::multithread.percent / 100.;
+    res = 0.001 + meshingRatio * NETGENPlugin_NetgenContext::Percent( this ) / 100.;
   }
   else // different otimizations
   {
@@ -938,7 +993,6 @@ bool NETGENPlugin_NETGEN_3D::Evaluate(SMESH_Mesh& aMesh,
                                       MapShapeNbElems& aResMap)
 {
   smIdType nbtri = 0, nbqua = 0;
-  double fullArea = 0.0;
   for (TopExp_Explorer expF(aShape, TopAbs_FACE); expF.More(); expF.Next()) {
     TopoDS_Face F = TopoDS::Face( expF.Current() );
     SMESH_subMesh *sm = aMesh.GetSubMesh(F);
@@ -951,10 +1005,6 @@ bool NETGENPlugin_NETGEN_3D::Evaluate(SMESH_Mesh& aMesh,
     std::vector<smIdType> aVec = (*anIt).second;
     nbtri += std::max(aVec[SMDSEntity_Triangle],aVec[SMDSEntity_Quad_Triangle]);
     nbqua += std::max(aVec[SMDSEntity_Quadrangle],aVec[SMDSEntity_Quad_Quadrangle]);
-    GProp_GProps G;
-    BRepGProp::SurfaceProperties(F,G);
-    double anArea = G.Mass();
-    fullArea += anArea;
   }
 
   // collect info from edges
@@ -985,33 +1035,66 @@ bool NETGENPlugin_NETGEN_3D::Evaluate(SMESH_Mesh& aMesh,
   }
   tmpMap.Clear();
 
-  double ELen_face = sqrt(2.* ( fullArea/double(nbtri+nbqua*2) ) / sqrt(3.0) );
-  double ELen_vol = pow( 72, 1/6. ) * pow( _maxElementVolume, 1/3. );
-  double ELen = Min(ELen_vol,ELen_face*2);
-
-  GProp_GProps G;
-  BRepGProp::VolumeProperties(aShape,G);
-  double aVolume = G.Mass();
-  double tetrVol = 0.1179*ELen*ELen*ELen;
-  double CoeffQuality = 0.9;
-  smIdType nbVols = (smIdType)( aVolume/tetrVol/CoeffQuality );
-  smIdType nb1d_f = (nbtri*3 + nbqua*4 - nb1d_e) / 2;
-  smIdType nb1d_in = (nbVols*6 - nb1d_e - nb1d_f ) / 5;
-  std::vector<smIdType> aVec(SMDSEntity_Last);
-  for(smIdType i=SMDSEntity_Node; i<SMDSEntity_Last; i++) aVec[i]=0;
+  // make the size field as Compute() does: maxh, surface triangles and local sizes
+  NETGENPlugin_NetgenLibWrapper ngLib;
+  netgen::Mesh* ngMesh = ngLib._ngMesh;
+
+  NETGENPlugin_Mesher aMesher( &aMesh, aShape, /*isVolume=*/true );
+  netgen::OCCGeometry occgeo;
+  NETGENPlugin_Mesher::PrepareOCCgeometry( occgeo, aShape, aMesh );
+  if ( _hypParameters )
+    aMesher.SetParameters( _hypParameters );
+  else if ( _hypMaxElementVolume )
+    netgen::mparam.maxh = pow( 72, 1/6. ) * pow( _maxElementVolume, 1/3. );
+  else
+    netgen::mparam.maxh = occgeo.GetBoundingBox().Diam()/2;
+  if ( netgen::mparam.maxh < DBL_MIN )
+    netgen::mparam.maxh = occgeo.GetBoundingBox().Diam();
+  if ( !_hypParameters )
+    netgen::mparam.minh = aMesher.GetDefaultMinSize( aShape, netgen::mparam.maxh );
+
+  netgen::Box<3> bb = occgeo.GetBoundingBox();
+  bb.Increase( bb.Diam()/20 );
+  ngMesh->SetGlobalH ( netgen::mparam.maxh );
+  ngMesh->SetMinimalH( netgen::mparam.minh );
+  ngMesh->SetLocalH( bb.PMin(), bb.PMax(), netgen::mparam.grading );
+
+  for (TopExp_Explorer expF(aShape, TopAbs_FACE); expF.More(); expF.Next()) {
+    if( !tmpMap.Add( expF.Current() ))
+      continue;
+    const std::vector<smIdType>& aVec = aResMap[ aMesh.GetSubMesh( expF.Current() )];
+    smIdType nbFaces = ( std::max(aVec[SMDSEntity_Triangle],aVec[SMDSEntity_Quad_Triangle]) +
+                         std::max(aVec[SMDSEntity_Quadrangle],aVec[SMDSEntity_Quad_Quadrangle]) * 2 );
+    if ( nbFaces > 0 ) {
+      GProp_GProps G;
+      BRepGProp::SurfaceProperties(expF.Current(),G);
+      double triaSize = sqrt( 4. * G.Mass() / ( sqrt(3.) * double( nbFaces )));
+      NETGENPlugin_Estimator::RestrictSize( *ngMesh, expF.Current(), triaSize );
+    }
+  }
+  tmpMap.Clear();
+  if ( _hypParameters )
+    aMesher.SetLocalSize( occgeo, *ngMesh );
+
+  // integrate the size field over the SOLID
+  NETGENPlugin_Estimator estimator( *ngMesh, occgeo, IsQuadratic );
+  std::vector<smIdType> aVec;
+  estimator.EvaluateSolid( aShape, nbtri + nbqua*2, aVec );
+
+  // quadrangles are bound by pyramids, each replacing two tetrahedra
   if( IsQuadratic ) {
-    aVec[SMDSEntity_Node] = nb1d_in/6 + 1 + nb1d_in;
-    aVec[SMDSEntity_Quad_Tetra] = nbVols - nbqua*2;
+    aVec[SMDSEntity_Quad_Tetra] = std::max( aVec[SMDSEntity_Quad_Tetra] - nbqua*2, smIdType(0) );
     aVec[SMDSEntity_Quad_Pyramid] = nbqua;
   }
   else {
-    aVec[SMDSEntity_Node] = nb1d_in/6 + 1;
-    aVec[SMDSEntity_Tetra] = nbVols - nbqua*2;
+    aVec[SMDSEntity_Tetra] = std::max( aVec[SMDSEntity_Tetra] - nbqua*2, smIdType(0) );
     aVec[SMDSEntity_Pyramid] = nbqua;
   }
   SMESH_subMesh *sm = aMesh.GetSubMesh(aShape);
   aResMap.insert(std::make_pair(sm,aVec));
 
+  NETGENPlugin_Estimator::CheckPeakMemory( aResMap, sm, this );
+
   return true;
 }
 
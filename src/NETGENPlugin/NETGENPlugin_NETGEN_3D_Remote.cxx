@@ -30,7 +30,12 @@
 //
 #include "NETGENPlugin_NETGEN_3D_Remote.hxx"
 
+#include "NETGENPlugin_BoundaryFile.hxx"
 #include "NETGENPlugin_NETGEN_3D.hxx"
+#include "NETGENPlugin_NETGEN_3D_SA.hxx"
+#include "NETGENPlugin_RemoteJob.hxx"
+#include "NETGENPlugin_RemoteLauncher.hxx"
+#include "NETGENPlugin_SharedMemory.hxx"
 
 #include "NETGENPlugin_DriverParam.hxx"
 #include "NETGENPlugin_Hypothesis.hxx"
@@ -45,10 +50,26 @@
 #include <SMESH_DriverMesh.hxx>
 #include <SMESHDS_Mesh.hxx>
 #include <SMESH_MeshLocker.hxx>
+#include <SMESH_subMesh.hxx>
+#include <SMESH_subMeshEventListener.hxx>
+
+#include <TopExp.hxx>
+#include <TopoDS_Iterator.hxx>
+#include <TopTools_IndexedMapOfShape.hxx>
 
 #include <QString>
 #include <QProcess>
 
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+
 #include <boost/filesystem.hpp>
 namespace fs = boost::filesystem;
 /*
@@ -73,13 +94,359 @@ namespace nglib {
 namespace netgen {
 
   NETGENPLUGIN_DLL_HEADER
-  extern MeshingParameters mparam;
+  extern NG_THREAD_LOCAL MeshingParameters mparam;
 
   NETGENPLUGIN_DLL_HEADER
-  extern volatile multithreadt multithread;
+  extern NG_THREAD_LOCAL volatile multithreadt multithread;
 }
 using namespace nglib;
 
+namespace
+{
+  //================================================================================
+  /*!
+   * \brief Long-lived run_mesher process loading once Mesh2D.med and the shape to
+   *        mesh, then meshing solids one by one (see NETGENPlugin_NETGEN_3D_SA::runWorker)
+   */
+  //================================================================================
+
+  struct TNetgenWorker
+  {
+    QProcess                   _process;
+    fs::path                   _folder;
+
+    ~TNetgenWorker()
+    {
+      // the worker stops at the end of its standard input
+      _process.closeWriteChannel();
+      if ( !_process.waitForFinished( 30000 ))
+        _process.kill();
+      boost::system::error_code err;
+      fs::remove_all( _folder, err );
+    }
+
+    bool isRunning() const
+    {
+      return _process.state() == QProcess::Running;
+    }
+
+    //================================================================================
+    /*!
+     * \brief Start the worker
+     *  \param [in] mesh_file - Mesh2D.med
+     *  \param [in] shapeToMesh - main shape of the mesh
+     *  \param [in] worker_folder - folder for the shape file and the worker log
+     *  \return bool - is the worker ready for jobs
+     */
+    //================================================================================
+
+    bool start( const fs::path&     mesh_file,
+                const TopoDS_Shape& shapeToMesh,
+                const fs::path&     worker_folder )
+    {
+      const char* rootDir = std::getenv("NETGENPLUGIN_ROOT_DIR");
+      if ( !rootDir )
+        return false;
+      fs::path runner = fs::path(rootDir) / fs::path("bin") / fs::path("salome") /
+        fs::path("NETGENPlugin_Runner");
+
+      _folder = worker_folder;
+      fs::create_directories(worker_folder);
+      fs::path shape_file = worker_folder / fs::path("shape.brep");
+      fs::path log_file   = worker_folder / fs::path("run.log");
+      SMESH_DriverShape::exportShape(shape_file.string(), shapeToMesh);
+
+      QStringList arguments;
+      arguments << "--worker" << "NETGEN3D" << mesh_file.string().c_str() << shape_file.string().c_str();
+      MESSAGE("Starting worker: " << runner.string() << " on " << mesh_file.string());
+
+      _process.setStandardErrorFile( log_file.string().c_str() );
+      _process.start( QString::fromStdString( runner.string() ), arguments );
+      return _process.waitForStarted( -1 );
+    }
+
+    //================================================================================
+    /*!
+     * \brief Mesh a solid
+     *  \param [in] isCanceled - tells if the worker is to be stopped
+     *  \return int - the error code, -1 if the worker died, was stopped or
+     *          replied something unexpected
+     */
+    //================================================================================
+
+    int run( const int                     solidIndex,
+             const fs::path&               param_file,
+             const fs::path&               element_orientation_file,
+             const fs::path&               new_element_file,
+             const std::function<bool()>&  isCanceled )
+    {
+      std::string job = ( to_string( solidIndex ) + "\n" +
+                          param_file.string() + "\n" +
+                          element_orientation_file.string() + "\n" +
+                          new_element_file.string() + "\n" );
+      _process.write( job.c_str(), job.size() );
+
+      const std::string doneTag = NETGENPlugin_NETGEN_3D_SA::WorkerDoneTag();
+      const int pollTime = 500; // msec
+      while ( true )
+      {
+        while ( !_process.canReadLine() )
+        {
+          if ( _process.waitForReadyRead( pollTime ))
+            continue;
+          if ( !isRunning() )
+            return -1;
+          if ( isCanceled() )
+          {
+            _process.kill();
+            _process.waitForFinished( pollTime );
+            return -1;
+          }
+        }
+        // skip whatever else may be printed on the standard output
+        std::string line = _process.readLine().toStdString();
+        if ( line.compare( 0, doneTag.size(), doneTag ) == 0 )
+        {
+          const char* value = line.c_str() + doneTag.size();
+          char*    valueEnd = nullptr;
+          errno = 0;
+          long ret = std::strtol( value, &valueEnd, 10 );
+          if ( valueEnd == value || errno != 0 || ret < 0 || ret > INT_MAX )
+          {
+            MESSAGE("Unexpected reply of worker: " << line);
+            return -1;
+          }
+          return (int) ret;
+        }
+      }
+    }
+  };
+
+  //================================================================================
+  /*!
+   * \brief Workers of a mesh shared by the threads computing its solids. The
+   *        pool is shut down once all the solids are meshed, when Mesh2D.med is
+   *        rewritten or when the mesh of a solid is cleaned or deleted
+   */
+  //================================================================================
+
+  struct TWorkerPool
+  {
+    std::string                                     _meshFile;
+    std::time_t                                     _meshFileTime = 0;
+    TopTools_IndexedMapOfShape                      _solids;
+    std::set< int >                                 _meshedSolids;
+    std::vector< std::unique_ptr< TNetgenWorker > > _idleWorkers;
+    bool                                            _isShutDown = false;
+
+    //! Check if the workers have loaded the current Mesh2D.med
+    bool isFor( const fs::path& mesh_file ) const
+    {
+      boost::system::error_code err;
+      return ( _meshFile == mesh_file.string() &&
+               _meshFileTime == fs::last_write_time( mesh_file, err ));
+    }
+
+    //! Check if all the solids of the shape are meshed, so the workers are no more needed
+    bool isDone() const
+    {
+      return (int) _meshedSolids.size() == _solids.Extent();
+    }
+  };
+  typedef std::shared_ptr< TWorkerPool > TWorkerPoolPtr;
+
+  std::map< const SMESH_Mesh*, TWorkerPoolPtr >& workerPools()
+  {
+    static std::map< const SMESH_Mesh*, TWorkerPoolPtr > thePools;
+    return thePools;
+  }
+  std::mutex& workerPoolsMutex()
+  {
+    static std::mutex theMutex;
+    return theMutex;
+  }
+
+  //! stop the idle workers of a mesh, the busy ones are stopped when released
+  void shutdownWorkers( const SMESH_Mesh* mesh )
+  {
+    std::vector< std::unique_ptr< TNetgenWorker > > workers;
+    {
+      std::lock_guard<std::mutex> lock( workerPoolsMutex() );
+      auto mesh2pool = workerPools().find( mesh );
+      if ( mesh2pool == workerPools().end() )
+        return;
+      mesh2pool->second->_isShutDown = true;
+      workers.swap( mesh2pool->second->_idleWorkers );
+      workerPools().erase( mesh2pool );
+    }
+    // workers are destroyed out of the lock as they wait for their process to exit
+  }
+
+  //================================================================================
+  /*!
+   * \brief Return the worker pool of a mesh and take an idle worker from it
+   *  \param [in] mesh_file - Mesh2D.med
+   *  \param [out] worker - the idle worker, null if there is no one
+   */
+  //================================================================================
+
+  TWorkerPoolPtr takeWorker( SMESH_Mesh&                     mesh,
+                             const fs::path&                 mesh_file,
+                             std::unique_ptr<TNetgenWorker>& worker )
+  {
+    TWorkerPoolPtr pool;
+    {
+      std::lock_guard<std::mutex> lock( workerPoolsMutex() );
+      auto mesh2pool = workerPools().find( &mesh );
+      if ( mesh2pool != workerPools().end() && mesh2pool->second->isFor( mesh_file ))
+      {
+        pool = mesh2pool->second;
+        while ( !worker && !pool->_idleWorkers.empty() )
+        {
+          worker = std::move( pool->_idleWorkers.back() );
+          pool->_idleWorkers.pop_back();
+          if ( !worker->isRunning() )
+            worker.reset();
+        }
+        return pool;
+      }
+    }
+    // the workers of an out of date pool are useless
+    shutdownWorkers( &mesh );
+
+    pool.reset( new TWorkerPool );
+    boost::system::error_code err;
+    pool->_meshFile     = mesh_file.string();
+    pool->_meshFileTime = fs::last_write_time( mesh_file, err );
+    TopExp::MapShapes( mesh.GetShapeToMesh(), TopAbs_SOLID, pool->_solids );
+
+    std::lock_guard<std::mutex> lock( workerPoolsMutex() );
+    TWorkerPoolPtr& meshPool = workerPools()[ &mesh ];
+    if ( !meshPool ) // not added by another thread meanwhile
+      meshPool = pool;
+    return meshPool;
+  }
+
+  //================================================================================
+  /*!
+   * \brief Give a worker back to its pool, shut down the pool if all solids are meshed
+   *  \param [in] solidIndex - index of the solid meshed by the worker, 0 if the
+   *         worker failed
+   */
+  //================================================================================
+
+  void releaseWorker( const SMESH_Mesh*               mesh,
+                      const TWorkerPoolPtr&           pool,
+                      std::unique_ptr<TNetgenWorker>& worker,
+                      const int                       solidIndex )
+  {
+    bool isDone = false;
+    {
+      std::lock_guard<std::mutex> lock( workerPoolsMutex() );
+      if ( solidIndex > 0 )
+        pool->_meshedSolids.insert( solidIndex );
+      isDone = pool->isDone();
+      if ( solidIndex > 0 && !isDone && !pool->_isShutDown && worker->isRunning() )
+        pool->_idleWorkers.push_back( std::move( worker ));
+    }
+    worker.reset();
+    if ( isDone )
+      shutdownWorkers( mesh );
+  }
+}
+
+namespace
+{
+  typedef std::pair< const SMESH_Mesh*, int > TMeshSolid; // mesh and solid ID
+
+  //! jobs submitted by SubmitInAdvance() and not yet taken by Compute(),
+  //! a job with zero id is being submitted
+  std::map< TMeshSolid, NETGENPlugin_RemoteJob >& submittedJobs()
+  {
+    static std::map< TMeshSolid, NETGENPlugin_RemoteJob > theJobs;
+    return theJobs;
+  }
+  std::mutex& submittedJobsMutex()
+  {
+    static std::mutex theMutex;
+    return theMutex;
+  }
+  //! notified when a job being submitted is submitted or forgotten
+  std::condition_variable& submittedJobsCond()
+  {
+    static std::condition_variable theCond;
+    return theCond;
+  }
+
+  //! forget a job submitted in advance, its process is stopped
+  void forgetSubmittedJob( const TMeshSolid& meshSolid )
+  {
+    NETGENPlugin_RemoteJob job;
+    {
+      std::lock_guard<std::mutex> lock( submittedJobsMutex() );
+      auto ms2job = submittedJobs().find( meshSolid );
+      if ( ms2job == submittedJobs().end() )
+        return;
+      job = ms2job->second;
+      submittedJobs().erase( ms2job );
+      submittedJobsCond().notify_all();
+    }
+    // a job being submitted is canceled by SubmitInAdvance()
+    if ( job.id )
+      job.Cancel();
+  }
+
+  //! cancel jobs taken by Compute() that are not waited for, e.g. on exception
+  struct TJobsGuard
+  {
+    std::vector< NETGENPlugin_RemoteJob >& _jobs;
+    ~TJobsGuard()
+    {
+      for ( NETGENPlugin_RemoteJob& job : _jobs )
+        job.Cancel();
+    }
+  };
+
+  //================================================================================
+  /*!
+   * \brief Listener forgetting the job submitted in advance for a solid and
+   *        stopping the workers of the mesh when the sub-mesh of the solid is
+   *        cleaned, its computation is canceled or it is deleted
+   */
+  //================================================================================
+
+  struct TSubmittedJobCleaner : public SMESH_subMeshEventListener
+  {
+    TSubmittedJobCleaner(): SMESH_subMeshEventListener( /*isDeletable=*/false,
+                                                        "NETGENPlugin_NETGEN_3D_Remote::TSubmittedJobCleaner" ) {}
+
+    static TSubmittedJobCleaner* Get()
+    {
+      static TSubmittedJobCleaner theCleaner;
+      return &theCleaner;
+    }
+    virtual void ProcessEvent(const int                       event,
+                              const int                       eventType,
+                              SMESH_subMesh*                  subMesh,
+                              SMESH_subMeshEventListenerData* /*data*/,
+                              const SMESH_Hypothesis*         /*hyp*/)
+    {
+      if ( eventType == SMESH_subMesh::COMPUTE_EVENT &&
+           ( event == SMESH_subMesh::CLEAN || event == SMESH_subMesh::COMPUTE_CANCELED ))
+      {
+        forgetSubmittedJob( TMeshSolid( subMesh->GetFather(), subMesh->GetId() ));
+        shutdownWorkers( subMesh->GetFather() );
+      }
+    }
+    virtual void BeforeDelete(SMESH_subMesh*                  subMesh,
+                              SMESH_subMeshEventListenerData* /*data*/)
+    {
+      forgetSubmittedJob( TMeshSolid( subMesh->GetFather(), subMesh->GetId() ));
+      shutdownWorkers( subMesh->GetFather() );
+    }
+  };
+}
+
 //=============================================================================
 /*!
  * Constructor
@@ -90,6 +457,8 @@ NETGENPlugin_NETGEN_3D_Remote::NETGENPlugin_NETGEN_3D_Remote(int hypId, SMESH_Ge
   : NETGENPlugin_NETGEN_3D(hypId, gen)
 {
   _name = "NETGEN_3D_Remote";
+  // get all the solids at once to launch their runs together
+  _onlyUnaryInput = !NETGENPlugin_RemoteLauncher::IsAsyncEnabled();
 }
 
 //=============================================================================
@@ -146,20 +515,19 @@ void NETGENPlugin_NETGEN_3D_Remote::fillParameters(const NETGENPlugin_Hypothesis
 //
 
 /**
- * @brief write in a binary file the orientation for each surface element of the mesh
+ * @brief Get the surface elements bounding a solid along with their orientation
  *
  * @param aMesh The mesh
  * @param aShape the shape associated to the mesh
- * @param output_file name of the binary file
+ * @param elemOrientation the elements and their orientation
  */
-void NETGENPlugin_NETGEN_3D_Remote::exportElementOrientation(SMESH_Mesh& aMesh,
-                                                      const TopoDS_Shape& aShape,
-                                                      const std::string output_file)
+void NETGENPlugin_NETGEN_3D_Remote::getElementOrientation(SMESH_Mesh&         aMesh,
+                                                          const TopoDS_Shape& aShape,
+                                                          std::map<const SMDS_MeshElement*, bool, TIDCompare>& elemOrientation)
 {
   SMESH_MesherHelper helper(aMesh);
   NETGENPlugin_Internals internals( aMesh, aShape, /*is3D=*/true );
   SMESH_ProxyMesh::Ptr proxyMesh( new SMESH_ProxyMesh( aMesh ));
-  std::map<vtkIdType, bool> elemOrientation;
 
   for ( TopExp_Explorer exFa( aShape, TopAbs_FACE ); exFa.More(); exFa.Next())
   {
@@ -194,25 +562,193 @@ void NETGENPlugin_NETGEN_3D_Remote::exportElementOrientation(SMESH_Mesh& aMesh,
         error( COMPERR_BAD_INPUT_MESH, "Null element encounters");
       if ( elem->NbCornerNodes() != 3 )
         error( COMPERR_BAD_INPUT_MESH, "Not triangle element encounters");
-      elemOrientation[elem->GetID()] = isRev;
+      elemOrientation[elem] = isRev;
     } // loop on elements on a face
   } // loop on faces of a SOLID or SHELL
+}
+
+/**
+ * @brief write in a binary file the orientation for each surface element of the mesh
+ *
+ * @param aMesh The mesh
+ * @param aShape the shape associated to the mesh
+ * @param output_file name of the binary file
+ */
+void NETGENPlugin_NETGEN_3D_Remote::exportElementOrientation(SMESH_Mesh& aMesh,
+                                                      const TopoDS_Shape& aShape,
+                                                      const std::string output_file)
+{
+  std::map<const SMDS_MeshElement*, bool, TIDCompare> elemOrientation;
+  getElementOrientation(aMesh, aShape, elemOrientation);
 
   {
     std::ofstream df(output_file, ios::out|ios::binary);
     int size=elemOrientation.size();
 
     df.write((char*)&size, sizeof(int));
-    for(auto const& [id, orient]:elemOrientation){
+    for(auto const& [elem, orient]:elemOrientation){
+      vtkIdType id = elem->GetID();
       df.write((char*)&id, sizeof(vtkIdType));
       df.write((char*)&orient, sizeof(bool));
     }
   }
 }
 
+/**
+ * @brief Write the surface elements bounding a solid, their orientation and
+ *        their nodes, so that run_mesher does not have to read the whole mesh
+ *
+ * @param aMesh The mesh
+ * @param aShape the solid
+ * @param output_file name of the file or of the shared memory segment ("shm:...")
+ */
+void NETGENPlugin_NETGEN_3D_Remote::exportBoundary(SMESH_Mesh&         aMesh,
+                                                   const TopoDS_Shape& aShape,
+                                                   const std::string   output_file)
+{
+  std::map<const SMDS_MeshElement*, bool, TIDCompare> elemOrientation;
+  getElementOrientation(aMesh, aShape, elemOrientation);
+
+  NETGENPlugin_BoundaryWriter writer;
+  for ( auto const& [elem, orient] : elemOrientation )
+    writer.AddFace( elem, orient );
+
+  if ( !writer.Write( output_file ))
+    throw SALOME_Exception("Can't write boundary to " + output_file);
+}
+
+/**
+ * @brief Create the temporary folder of a job and define its files
+ *
+ * @param aParMesh the mesh
+ * @param job the job
+ * @param useSharedMemory whether the boundary and the new elements are exchanged
+ *        via shared memory
+ */
+void NETGENPlugin_NETGEN_3D_Remote::initJob(SMESH_ParallelMesh&     aParMesh,
+                                            NETGENPlugin_RemoteJob& job,
+                                            bool                    useSharedMemory)
+{
+  job.Init(aParMesh, "netgen3d_param.txt");
+  // Only the boundary of the solid is given to run_mesher
+  job.input_mesh=(job.tmp_folder / fs::path("boundary.dat")).string();
+  if ( useSharedMemory )
+  {
+    job.input_mesh=NETGENPlugin_SharedMemory::NewName();
+    job.new_element_file=NETGENPlugin_SharedMemory::NewName();
+  }
+}
+
+/**
+ * @brief Submit a run_mesher job to NETGENPlugin_RemoteLauncher
+ *
+ * @param aParMesh the mesh
+ * @param job the job, its files must be written
+ * @param runFirst whether to run the job before the already queued ones
+ */
+void NETGENPlugin_NETGEN_3D_Remote::submitJob(SMESH_ParallelMesh&     aParMesh,
+                                              NETGENPlugin_RemoteJob& job,
+                                              bool                    runFirst)
+{
+  std::list<std::string> options;
+  // orientation of elements is given along with the boundary
+  options.push_back("--elem-orient-file=NONE");
+  options.push_back("--new-element-file=" + job.new_element_file.string());
+  job.Submit(aParMesh, "NETGEN3D", options, /*mergeChannels=*/true, runFirst);
+}
+
+/**
+ * @brief Submit the job of a solid whose boundary is already meshed, before
+ *        Compute() is called for it.
+ *
+ * It is used by NETGEN_2D_Remote in pipeline mode (see
+ * NETGENPlugin_RemoteLauncher::IsPipelineEnabled()) to start volume meshing of
+ * a solid as soon as the faces bounding it are meshed. Compute() then only
+ * waits for the job.
+ *
+ * @param aMesh The mesh
+ * @param aSolid The solid
+ * @return true if the job is submitted
+ */
+bool NETGENPlugin_NETGEN_3D_Remote::SubmitInAdvance(SMESH_Mesh&         aMesh,
+                                                    const TopoDS_Shape& aSolid)
+{
+  SMESH_ParallelMesh* aParMesh = dynamic_cast<SMESH_ParallelMesh*>(&aMesh);
+  if ( !aParMesh || aSolid.ShapeType() != TopAbs_SOLID )
+    return false;
+  const TMeshSolid meshSolid( &aMesh, aMesh.GetMeshDS()->ShapeToIndex( aSolid ));
+  {
+    // reserve the slot of the job
+    std::lock_guard<std::mutex> lock( submittedJobsMutex() );
+    if ( !submittedJobs().insert( std::make_pair( meshSolid, NETGENPlugin_RemoteJob() )).second )
+      return true;
+  }
+
+  bool useSharedMemory = ( NETGENPlugin_SharedMemory::IsEnabled() &&
+                           aParMesh->GetParallelismMethod() == ParallelismMethod::MultiThread );
+  NETGENPlugin_RemoteJob job;
+  try
+  {
+    SMESH_MeshLocker myLocker(&aMesh);
+    SMESH_Hypothesis::Hypothesis_Status hypStatus;
+    if ( !NETGENPlugin_NETGEN_3D::CheckHypothesis(aMesh, aSolid, hypStatus))
+    {
+      forgetSubmittedJob( meshSolid );
+      return false;
+    }
+    // forget the job if the mesh of the solid is cleaned before Compute()
+    SMESH_subMesh* solidSM = aMesh.GetSubMesh( aSolid );
+    solidSM->SetEventListener( TSubmittedJobCleaner::Get(), 0, solidSM );
+
+    initJob(*aParMesh, job, useSharedMemory);
+
+    netgen_params aParams;
+    fillParameters(_hypParameters, aParams);
+    SMESH_DriverShape::exportShape(job.shape_file.string(), aSolid);
+    exportNetgenParams(job.param_file.string(), aParams);
+    exportBoundary(aMesh, aSolid, job.input_mesh);
+  }
+  catch (...)
+  {
+    job.Cancel();
+    forgetSubmittedJob( meshSolid );
+    return false; // Compute() will retry and report the error
+  }
+  // let the volume job overtake the queued surface jobs
+  try
+  {
+    submitJob(*aParMesh, job, /*runFirst=*/true);
+  }
+  catch (...)
+  {
+    job.Cancel();
+    forgetSubmittedJob( meshSolid );
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock( submittedJobsMutex() );
+    auto ms2job = submittedJobs().find( meshSolid );
+    if ( ms2job != submittedJobs().end() )
+    {
+      ms2job->second = job;
+      submittedJobsCond().notify_all();
+      return true;
+    }
+  }
+  job.Cancel(); // forgotten meanwhile
+  return false;
+}
+
 /**
  * @brief Compute mesh associate to shape
  *
+ * If the algorithm is given several solids at once (see
+ * NETGENPlugin_RemoteLauncher::IsAsyncEnabled()), a run_mesher job is
+ * submitted for each of them and the elements of each solid are added as
+ * soon as its job is over. Jobs already submitted by SubmitInAdvance()
+ * are only waited for.
+ *
  * @param aMesh The mesh
  * @param aShape The shape
  * @return true fi there are some error
@@ -227,169 +763,137 @@ bool NETGENPlugin_NETGEN_3D_Remote::Compute(SMESH_Mesh&         aMesh,
   }
   SMESH_ParallelMesh& aParMesh = dynamic_cast<SMESH_ParallelMesh&>(aMesh);
 
-  // Temporary folder for run
-#ifdef WIN32
-  fs::path tmp_folder = aParMesh.GetTmpFolder() / fs::path("Volume-%%%%-%%%%");
-#else
-  fs::path tmp_folder = aParMesh.GetTmpFolder() / fs::unique_path(fs::path("Volume-%%%%-%%%%"));
-#endif
-  fs::create_directories(tmp_folder);
-  // Using MESH2D generated after all triangles where created.
+  std::vector< TopoDS_Shape > solids;
+  if ( aShape.ShapeType() == TopAbs_COMPOUND )
+    for ( TopoDS_Iterator it( aShape ); it.More(); it.Next() )
+      solids.push_back( it.Value() );
+  else
+    solids.push_back( aShape );
+
+  // MESH2D generated after all triangles where created, used by the worker
   fs::path mesh_file=aParMesh.GetTmpFolder() / fs::path("Mesh2D.med");
-  fs::path element_orientation_file=tmp_folder / fs::path("element_orientation.dat");
-  fs::path new_element_file=tmp_folder / fs::path("new_elements.dat");
-  fs::path tmp_mesh_file=tmp_folder / fs::path("tmp_mesh.med");
-  // Not used kept for debug
-  //fs::path output_mesh_file=tmp_folder / fs::path("output_mesh.med");
-  fs::path shape_file=tmp_folder / fs::path("shape.brep");
-  fs::path param_file=tmp_folder / fs::path("netgen3d_param.txt");
-  fs::path log_file=tmp_folder / fs::path("run.log");
-  fs::path cmd_file=tmp_folder / fs::path("cmd.txt");
   // TODO: See if we can retreived name from aMesh ?
   std::string mesh_name = "MESH";
 
+  // Exchanging the boundary and the new elements with run_mesher via shared memory
+  bool useSharedMemory = ( NETGENPlugin_SharedMemory::IsEnabled() &&
+                           aParMesh.GetParallelismMethod() == ParallelismMethod::MultiThread );
+
+  // Jobs submitted in advance
+  std::vector< NETGENPlugin_RemoteJob > jobs( solids.size() );
+  TJobsGuard jobsGuard{ jobs };
+  {
+    std::unique_lock<std::mutex> lock( submittedJobsMutex() );
+    for ( size_t i = 0; i < solids.size(); ++i )
+    {
+      TMeshSolid meshSolid( &aMesh, aMesh.GetMeshDS()->ShapeToIndex( solids[i] ));
+      auto ms2job = submittedJobs().find( meshSolid );
+      // wait for a job being submitted
+      while ( ms2job != submittedJobs().end() && ms2job->second.id == 0 )
+      {
+        submittedJobsCond().wait( lock );
+        ms2job = submittedJobs().find( meshSolid );
+      }
+      if ( ms2job == submittedJobs().end() )
+        continue;
+      jobs[i] = ms2job->second;
+      submittedJobs().erase( ms2job );
+    }
+  }
+
+  // Using a worker that loads Mesh2D.med once for all the solids
+  bool useWorker = ( aParMesh.GetParallelismMethod() == ParallelismMethod::MultiThread &&
+                     solids.size() == 1 &&
+                     solids[0].ShapeType() == TopAbs_SOLID &&
+                     jobs[0].id == 0 &&
+                     std::getenv("SALOME_NETGEN_REMOTE_WORKER") );
+
+  std::unique_ptr< TNetgenWorker > worker;
+  TWorkerPoolPtr                   workerPool;
   {
     SMESH_MeshLocker myLocker(&aMesh);
-    //Writing Shape
-    SMESH_DriverShape::exportShape(shape_file.string(), aShape);
+    if ( useWorker )
+    {
+      workerPool = takeWorker( aMesh, mesh_file, worker );
+      useWorker = workerPool->_solids.Contains( solids[0] );
+    }
+    if ( useWorker && !worker )
+    {
+      worker.reset( new TNetgenWorker );
+#ifdef WIN32
+      fs::path worker_folder = aParMesh.GetTmpFolder() / fs::path("Worker-%%%%-%%%%");
+#else
+      fs::path worker_folder = aParMesh.GetTmpFolder() / fs::unique_path(fs::path("Worker-%%%%-%%%%"));
+#endif
+      if ( !worker->start( mesh_file, aMesh.GetShapeToMesh(), worker_folder ))
+        worker.reset();
+    }
+    useWorker = ( useWorker && worker );
+    if ( useWorker )
+    {
+      // stop the workers if the mesh of the solid is cleaned or deleted
+      SMESH_subMesh* solidSM = aMesh.GetSubMesh( solids[0] );
+      solidSM->SetEventListener( TSubmittedJobCleaner::Get(), 0, solidSM );
+    }
 
     //Writing hypo
     netgen_params aParams;
     fillParameters(_hypParameters, aParams);
 
-    exportNetgenParams(param_file.string(), aParams);
-
-    // Exporting element orientation
-    exportElementOrientation(aMesh, aShape, element_orientation_file.string());
-  }
+    for ( size_t i = 0; i < solids.size(); ++i )
+    {
+      if ( jobs[i].id )
+        continue;
+      initJob(aParMesh, jobs[i], useSharedMemory);
 
-  // Calling run_mesher
-  // Path to mesher script
-  fs::path mesher_launcher = fs::path(std::getenv("SMESH_ROOT_DIR"))/
-       fs::path("bin")/
-       fs::path("salome")/
-       fs::path("mesher_launcher.py");
-
-
-  std::string s_program="python3";
-  std::list<std::string> params;
-  params.push_back(mesher_launcher.string());
-  params.push_back("NETGEN3D");
-  params.push_back(mesh_file.string());
-  params.push_back(shape_file.string());
-  params.push_back(param_file.string());
-  params.push_back("--elem-orient-file=" + element_orientation_file.string());
-  params.push_back("--new-element-file=" + new_element_file.string());
-
-  // Parallelism method parameters
-  int method = aParMesh.GetParallelismMethod();
-  if(method == ParallelismMethod::MultiThread){
-    params.push_back("--method=local");
-  } else if (method == ParallelismMethod::MultiNode){
-    params.push_back("--method=cluster");
-    params.push_back("--resource="+aParMesh.GetResource());
-    params.push_back("--wc-key="+aParMesh.GetWcKey());
-    params.push_back("--nb-proc=1");
-    params.push_back("--nb-proc-per-node="+to_string(aParMesh.GetNbProcPerNode()));
-    params.push_back("--nb-node="+to_string(aParMesh.GetNbNode()));
-    params.push_back("--walltime="+aParMesh.GetWalltime());
-  } else {
-    throw SALOME_Exception("Unknown parallelism method "+method);
-  }
-  std::string cmd = "";
-  cmd += s_program;
-  for(auto arg: params){
-    cmd += " " + arg;
-  }
-  MESSAGE("Running command: ");
-  MESSAGE(cmd);
-  // Writing command in cmd.log
-  {
-    std::ofstream flog(cmd_file.string());
-    flog << cmd << endl;
-  }
+      //Writing Shape
+      SMESH_DriverShape::exportShape(jobs[i].shape_file.string(), solids[i]);
 
-  // Building arguments for QProcess
-  QString program = QString::fromStdString(s_program);
-  QStringList arguments;
-  for(auto arg : params){
-    arguments << arg.c_str();
-  }
+      exportNetgenParams(jobs[i].param_file.string(), aParams);
 
-  QString out_file = log_file.string().c_str();
-  QProcess myProcess;
-  myProcess.setProcessChannelMode(QProcess::MergedChannels);
-  myProcess.setStandardOutputFile(out_file);
-
-  myProcess.start(program, arguments);
-  // Waiting for process to finish (argument -1 make it wait until the end of
-  // the process otherwise it just waits 30 seconds)
-  bool finished = myProcess.waitForFinished(-1);
-  int ret = myProcess.exitCode();
-
-  if(ret != 0 || !finished){
-    // Run crahed
-    std::string msg = "Issue with mesh_launcher: \n";
-    msg += "See log for more details: " + log_file.string() + "\n";
-    msg += cmd + "\n";
-    throw SALOME_Exception(msg);
+      // Exporting the elements bounding the solid with their orientation,
+      // the worker reads the whole mesh instead
+      if ( useWorker )
+        exportElementOrientation(aMesh, solids[i], jobs[i].element_orientation_file.string());
+      else
+        exportBoundary(aMesh, solids[i], jobs[i].input_mesh);
+    }
   }
 
+  if ( useWorker )
   {
-    SMESH_MeshLocker myLocker(&aMesh);
-    std::ifstream df(new_element_file.string(), ios::binary);
-
-    int Netgen_NbOfNodes;
-    int Netgen_NbOfNodesNew;
-    int Netgen_NbOfTetra;
-    double Netgen_point[3];
-    int    Netgen_tetrahedron[4];
-    int nodeID;
-
-    SMESH_MesherHelper helper(aMesh);
-    // This function is mandatory for setElementsOnShape to work
-    helper.IsQuadraticSubMesh(aShape);
-    helper.SetElementsOnShape( true );
-
-    // Number of nodes in intial mesh
-    df.read((char*) &Netgen_NbOfNodes, sizeof(int));
-    // Number of nodes added by netgen
-    df.read((char*) &Netgen_NbOfNodesNew, sizeof(int));
-
-    // Filling nodevec (correspondence netgen numbering mesh numbering)
-    vector< const SMDS_MeshNode* > nodeVec ( Netgen_NbOfNodesNew + 1 );
-    //vector<int> nodeTmpVec ( Netgen_NbOfNodesNew + 1 );
-    SMESHDS_Mesh * meshDS = helper.GetMeshDS();
-    for (int nodeIndex = 1 ; nodeIndex <= Netgen_NbOfNodes; ++nodeIndex )
+    const int solidIndex = workerPool->_solids.FindIndex( solids[0] );
+    int ret = worker->run( solidIndex, jobs[0].param_file,
+                           jobs[0].element_orientation_file, jobs[0].new_element_file,
+                           [this]() { return computeCanceled(); });
+    releaseWorker( &aMesh, workerPool, worker, ret == -1 ? 0 : solidIndex );
+    if ( ret != 0 && computeCanceled() )
     {
-      //Id of the point
-      df.read((char*) &nodeID, sizeof(int));
-      nodeVec.at(nodeIndex) = meshDS->FindNode(nodeID);
+      NETGENPlugin_SharedMemory::Remove(jobs[0].new_element_file.string());
+      return false;
     }
-
-    // Add new points and update nodeVec
-    for (int nodeIndex = Netgen_NbOfNodes +1 ; nodeIndex <= Netgen_NbOfNodesNew; ++nodeIndex )
+    if ( ret != 0 )
     {
-      df.read((char *) &Netgen_point, sizeof(double)*3);
-
-      nodeVec.at(nodeIndex) = helper.AddNode(Netgen_point[0],
-                                 Netgen_point[1],
-                                 Netgen_point[2]);
+      NETGENPlugin_SharedMemory::Remove(jobs[0].new_element_file.string());
+      std::string msg = "Issue with NETGENPlugin_Runner worker on " + jobs[0].tmp_folder.string();
+      throw SALOME_Exception(msg);
     }
+    NETGENPlugin_RemoteJob::FillNewElements(aMesh, solids[0], jobs[0].new_element_file.string(), 3);
+    return true;
+  }
 
-    // Add tetrahedrons
-    df.read((char*) &Netgen_NbOfTetra, sizeof(int));
+  // Calling run_mesher
+  for ( size_t i = 0; i < jobs.size(); ++i )
+    if ( !jobs[i].id )
+      submitJob(aParMesh, jobs[i]);
 
-    for ( int elemIndex = 1; elemIndex <= Netgen_NbOfTetra; ++elemIndex )
-    {
-      df.read((char*) &Netgen_tetrahedron, sizeof(int)*4);
-      helper.AddVolume(
-                    nodeVec.at( Netgen_tetrahedron[0] ),
-                    nodeVec.at( Netgen_tetrahedron[1] ),
-                    nodeVec.at( Netgen_tetrahedron[2] ),
-                    nodeVec.at( Netgen_tetrahedron[3] ));
-    }
-  }
+  // Adding elements of each solid as soon as its run is over
+  std::string msg = NETGENPlugin_RemoteJob::WaitAll( jobs, [&]( size_t i )
+  {
+    NETGENPlugin_RemoteJob::FillNewElements(aMesh, solids[i], jobs[i].new_element_file.string(), 3);
+  });
+  if ( !msg.empty() )
+    throw SALOME_Exception(msg);
 
   return true;
 }
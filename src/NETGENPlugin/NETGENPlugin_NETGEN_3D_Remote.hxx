@@ -34,6 +34,8 @@
 
 #include <vector>
 #include <map>
+#include <list>
+#include <string>
 
 class StdMeshers_ViscousLayers;
 class StdMeshers_MaxElementVolume;
@@ -41,6 +43,8 @@ class NETGENPlugin_Hypothesis;
 class NETGENPlugin_NetgenLibWrapper;
 class netgen_params;
 class SMDS_MeshNode;
+class SMESH_ParallelMesh;
+struct NETGENPlugin_RemoteJob;
 
 using namespace std;
 
@@ -60,15 +64,34 @@ class NETGENPLUGIN_EXPORT NETGENPlugin_NETGEN_3D_Remote: public NETGENPlugin_NET
 
   void setSubMeshesToCompute(SMESH_subMesh * aSubMesh) override;
 
+  bool SubmitInAdvance(SMESH_Mesh&         aMesh,
+                       const TopoDS_Shape& aSolid);
+
 
  protected:
+  void getElementOrientation(SMESH_Mesh&         aMesh,
+                             const TopoDS_Shape& aShape,
+                             std::map<const SMDS_MeshElement*, bool, TIDCompare>& elemOrientation);
+
   void exportElementOrientation(SMESH_Mesh& aMesh,
                                 const TopoDS_Shape& aShape,
                                 const std::string output_file);
 
+  void exportBoundary(SMESH_Mesh&         aMesh,
+                      const TopoDS_Shape& aShape,
+                      const std::string   output_file);
+
   void fillParameters(const NETGENPlugin_Hypothesis* hyp,
                       netgen_params &aParams);
 
+  void initJob(SMESH_ParallelMesh&     aParMesh,
+               NETGENPlugin_RemoteJob& job,
+               bool                    useSharedMemory);
+
+  void submitJob(SMESH_ParallelMesh&     aParMesh,
+                 NETGENPlugin_RemoteJob& job,
+                 bool                    runFirst = false);
+
 
 };
 
@@ -30,8 +30,12 @@
 //
 #include "NETGENPlugin_NETGEN_3D_SA.hxx"
 
+#include "NETGENPlugin_BoundaryFile.hxx"
 #include "NETGENPlugin_DriverParam.hxx"
 #include "NETGENPlugin_Hypothesis.hxx"
+#include "NETGENPlugin_NewElementsFile.hxx"
+#include "NETGENPlugin_ResultCache.hxx"
+#include "NETGENPlugin_SharedMemory.hxx"
 #include "StdMeshers_MaxElementVolume.hxx"
 
 #include <SMESH_Gen.hxx>
@@ -41,6 +45,8 @@
 #include <SMESH_DriverMesh.hxx>
 #include <SMESHDS_Mesh.hxx>
 
+#include <TopExp.hxx>
+#include <TopTools_IndexedMapOfShape.hxx>
 
 #ifdef WIN32
 #include <filesystem>
@@ -72,13 +78,65 @@ namespace nglib {
 namespace netgen {
 
   NETGENPLUGIN_DLL_HEADER
-  extern MeshingParameters mparam;
+  extern NG_THREAD_LOCAL MeshingParameters mparam;
 
   NETGENPLUGIN_DLL_HEADER
-  extern volatile multithreadt multithread;
+  extern NG_THREAD_LOCAL volatile multithreadt multithread;
 }
 using namespace nglib;
 
+namespace
+{
+  //================================================================================
+  /*!
+   * \brief Compute the cache key of a solid meshing: hash of the shape, of the
+   *        boundary triangles and of the parameters
+   *  \param [in] meshDS - the mesh
+   *  \param [in] elemOrientation - the boundary triangles and their orientation
+   *  \param [in] globalNodeIDs - node ids in the original mesh, if renumbered
+   *  \param [in] shape_file - the BRep file
+   *  \param [in] hypo_file - the file of netgen_params
+   *  \param [in] aParams - the parameters
+   *  \param [out] key - the key
+   *  \return bool - false if some data can't be read
+   */
+  //================================================================================
+
+  bool getCacheKey(SMESHDS_Mesh*                    meshDS,
+                   const std::map<vtkIdType, bool>& elemOrientation,
+                   const std::vector<smIdType>&     globalNodeIDs,
+                   const std::string&               shape_file,
+                   const std::string&               hypo_file,
+                   const netgen_params&             aParams,
+                   NETGENPlugin_ResultCache::Key&   key)
+  {
+    key.Add( std::string( "NETGEN3D" ));
+    key.Add( NETGENPlugin_NewElementsReader::Version );
+    if ( !key.AddFile( shape_file ) || !key.AddFile( hypo_file ))
+      return false;
+    if ( !aParams.meshsizefilename.empty() && !key.AddFile( aParams.meshsizefilename ))
+      return false;
+
+    // ids of the nodes are hashed as they are written to new_elements
+    for ( auto const& [id, isRev] : elemOrientation )
+    {
+      const SMDS_MeshElement* elem = meshDS->FindElement( id );
+      if ( !elem )
+        return false;
+      key.Add( isRev );
+      for ( int i = 0; i < elem->NbNodes(); ++i )
+      {
+        const SMDS_MeshNode* node = elem->GetNode( i );
+        key.Add( globalNodeIDs.empty() ? node->GetID() : globalNodeIDs.at( node->GetID() - 1 ));
+        key.Add( node->X() );
+        key.Add( node->Y() );
+        key.Add( node->Z() );
+      }
+    }
+    return true;
+  }
+}
+
 //=============================================================================
 /*!
  * Constructor
@@ -111,6 +169,7 @@ NETGENPlugin_NETGEN_3D_SA::~NETGENPlugin_NETGEN_3D_SA()
  */
 void NETGENPlugin_NETGEN_3D_SA::fillHyp(netgen_params aParams)
 {
+  resetHyp();
   if(aParams.has_netgen_param){
     NETGENPlugin_Hypothesis * hypParameters = new NETGENPlugin_Hypothesis(0, GetGen());
 
@@ -146,6 +205,18 @@ void NETGENPlugin_NETGEN_3D_SA::fillHyp(netgen_params aParams)
   // TODO: Handle viscous layer
 }
 
+/**
+ * @brief Remove the hypotheses created by a previous call to fillHyp
+ */
+void NETGENPlugin_NETGEN_3D_SA::resetHyp()
+{
+  delete _hypParameters;
+  delete _hypMaxElementVolume;
+  _hypParameters = NULL;
+  _hypMaxElementVolume = NULL;
+  _maxElementVolume = 0.;
+}
+
 /**
  * @brief Write a binary file containing information on the elements/nodes
  *        created by the mesher
@@ -169,39 +240,46 @@ bool NETGENPlugin_NETGEN_3D_SA::computeFillNewElementFile(
   int Netgen_NbOfNodesNew = Ng_GetNP(Netgen_mesh);
   int Netgen_NbOfTetra    = Ng_GetNE(Netgen_mesh);
   bool isOK = ( Netgen_NbOfTetra > 0 );
-  if ( isOK && !new_element_file.empty() )
+  if ( !isOK )
+    return true;
+  if ( !new_element_file.empty() )
   {
-    std::ofstream df(new_element_file, ios::out|ios::binary);
+    NETGENPlugin_NewElementsWriter writer( /*nbPremeshedNodes=*/0, Netgen_NbOfNodesNew );
 
     double Netgen_point[3];
     int    Netgen_tetrahedron[4];
 
     // Writing nodevec (correspondence netgen numbering mesh numbering)
-    // Number of nodes
-    df.write((char*) &Netgen_NbOfNodes, sizeof(int));
-    df.write((char*) &Netgen_NbOfNodesNew, sizeof(int));
+    std::vector<int64_t>& nodeIDs = writer.NodeIDs();
+    nodeIDs.reserve( Netgen_NbOfNodes );
     for (int nodeIndex = 1 ; nodeIndex <= Netgen_NbOfNodes; ++nodeIndex )
     {
-      //Id of the point
-      int id = nodeVec.at(nodeIndex)->GetID();
-      df.write((char*) &id, sizeof(int));
+      //Id of the point in the original mesh
+      smIdType id = nodeVec.at(nodeIndex)->GetID();
+      nodeIDs.push_back( _globalNodeIDs.empty() ? id : _globalNodeIDs.at( id - 1 ));
     }
 
     // Writing info on new points
+    std::vector<double>& coords = writer.Coords();
+    coords.reserve( 3 * ( Netgen_NbOfNodesNew - Netgen_NbOfNodes ));
     for (int nodeIndex = Netgen_NbOfNodes +1 ; nodeIndex <= Netgen_NbOfNodesNew; ++nodeIndex )
     {
       Ng_GetPoint(Netgen_mesh, nodeIndex, Netgen_point );
       // Coordinates of the point
-      df.write((char *) &Netgen_point, sizeof(double)*3);
+      coords.insert( coords.end(), Netgen_point, Netgen_point + 3 );
     }
 
     // create tetrahedrons
-    df.write((char*) &Netgen_NbOfTetra, sizeof(int));
+    std::vector<int64_t>& tetras = writer.AddBlock( 3, 4 );
+    tetras.reserve( 4 * Netgen_NbOfTetra );
     for ( int elemIndex = 1; elemIndex <= Netgen_NbOfTetra; ++elemIndex )
     {
       Ng_GetVolumeElement(Netgen_mesh, elemIndex, Netgen_tetrahedron);
-      df.write((char*) &Netgen_tetrahedron, sizeof(int)*4);
+      tetras.insert( tetras.end(), Netgen_tetrahedron, Netgen_tetrahedron + 4 );
     }
+
+    if ( !writer.Write( new_element_file ))
+      return true;
   }
   return false;
 }
@@ -233,31 +311,50 @@ bool NETGENPlugin_NETGEN_3D_SA::Compute(
   int Netgen_NbOfNodes=0;
 
   // Changing netgen log_file putting it next to new_element_file
+  // or next to the hypothesis file if elements are passed via shared memory
   fs::path netgen_log_file = fs::path(new_element_file).remove_filename() / fs::path("NETGEN.out");
+  if ( NETGENPlugin_SharedMemory::IsSharedMemory( new_element_file ))
+    netgen_log_file = fs::path(_netgen_log_folder) / fs::path("NETGEN.out");
   MESSAGE("netgen ouput"<<netgen_log_file.string());
 
   ngLib.setOutputFile(netgen_log_file.string());
 
-  NETGENPlugin_NETGEN_3D::computeFillNgMesh(aMesh, aShape, nodeVec, ngLib, helper, Netgen_NbOfNodes);
+  // errors of a previous solid meshed by the worker
+  InitComputeError();
+
+  bool err = NETGENPlugin_NETGEN_3D::computeFillNgMesh(aMesh, aShape, nodeVec, ngLib, helper, Netgen_NbOfNodes);
 
   netgen::OCCGeometry occgeo;
-  NETGENPlugin_NETGEN_3D::computePrepareParam(aMesh, ngLib, occgeo, helper, endWith);
+  if ( !err )
+    err = NETGENPlugin_NETGEN_3D::computePrepareParam(aMesh, ngLib, occgeo, helper, endWith);
 
-  NETGENPlugin_NETGEN_3D::computeRunMesher(occgeo, nodeVec, ngLib._ngMesh, ngLib, startWith, endWith);
+  if ( !err )
+    err = NETGENPlugin_NETGEN_3D::computeRunMesher(occgeo, nodeVec, ngLib._ngMesh, ngLib, startWith, endWith);
 
-  computeFillNewElementFile(nodeVec, ngLib, new_element_file, Netgen_NbOfNodes);
+  // the compute steps report errors via error()
+  err = ( err || !GetComputeError()->IsOK() );
+  if ( err )
+    std::cerr << "Meshing error: " << GetComputeError()->CommonName()
+              << " " << GetComputeError()->myComment << std::endl;
+
+  if ( computeFillNewElementFile(nodeVec, ngLib, new_element_file, Netgen_NbOfNodes) )
+  {
+    std::cerr << "Can't write new elements to " << new_element_file << std::endl;
+    err = true;
+  }
 
   if(output_mesh)
     NETGENPlugin_NETGEN_3D::computeFillMesh(nodeVec, ngLib, helper, Netgen_NbOfNodes);
 
-  return false;
+  return err;
 }
 
 
 /**
  * @brief Running the mesher on the given files
  *
- * @param input_mesh_file Mesh file (containing 2D elements)
+ * @param input_mesh_file Mesh file (containing 2D elements) or boundary data
+ *        written by NETGENPlugin_BoundaryWriter to a file or a shared memory segment
  * @param shape_file Shape file (BREP or STEP format)
  * @param hypo_file Ascii file containing the netgen parameters
  * @param element_orientation_file Binary file containing the orientation of surface elemnts
@@ -273,11 +370,54 @@ int NETGENPlugin_NETGEN_3D_SA::run(const std::string input_mesh_file,
           const std::string output_mesh_file)
 {
 
-  _element_orientation_file = element_orientation_file;
+  _elemOrientation.clear();
+  _globalNodeIDs.clear();
 
   std::unique_ptr<SMESH_Mesh> myMesh(_gen->CreateMesh(false));
 
-  SMESH_DriverMesh::importMesh(input_mesh_file, *myMesh);
+  if ( NETGENPlugin_BoundaryReader::IsBoundaryFile(input_mesh_file) )
+  {
+    // Only the triangles bounding the solid are given, with their orientation
+    NETGENPlugin_BoundaryReader boundary(input_mesh_file);
+    if ( !boundary.Import(*myMesh, _elemOrientation, _globalNodeIDs) )
+    {
+      std::cerr << "Can't read boundary from " << input_mesh_file << std::endl;
+      return 1;
+    }
+  }
+  else
+  {
+    SMESH_DriverMesh::importMesh(input_mesh_file, *myMesh);
+  }
+
+  return runOnMesh(*myMesh,
+                   shape_file,
+                   hypo_file,
+                   element_orientation_file,
+                   new_element_file,
+                   output_mesh_file);
+}
+
+/**
+ * @brief Running the mesher on an already loaded mesh
+ *
+ * @param myMesh Mesh containing 2D elements
+ * @param shape_file Shape file (BREP or STEP format)
+ * @param hypo_file Ascii file containing the netgen parameters
+ * @param element_orientation_file Binary file containing the orientation of surface elemnts
+ * @param new_element_file output file containing info the elements created by the mesher
+ * @param output_mesh_file output mesh file (if empty it will not be created)
+ * @return int
+ */
+int NETGENPlugin_NETGEN_3D_SA::runOnMesh(SMESH_Mesh&       myMesh,
+                                         const std::string shape_file,
+                                         const std::string hypo_file,
+                                         const std::string element_orientation_file,
+                                         const std::string new_element_file,
+                                         const std::string output_mesh_file)
+{
+  _element_orientation_file = element_orientation_file;
+  _netgen_log_folder = fs::path(hypo_file).parent_path().string();
 
   // Importing shape
   TopoDS_Shape myShape;
@@ -288,8 +428,19 @@ int NETGENPlugin_NETGEN_3D_SA::run(const std::string input_mesh_file,
 
   importNetgenParams(hypo_file, myParams);
   fillHyp(myParams);
+
+  // Looking for the result of a previous run on the same data
+  NETGENPlugin_ResultCache cache;
+  NETGENPlugin_ResultCache::Key cacheKey;
+  bool useCache = ( NETGENPlugin_ResultCache::IsEnabled() &&
+                    !new_element_file.empty() && output_mesh_file.empty() &&
+                    getCacheKey( myMesh.GetMeshDS(), readElementOrientation( myMesh ), _globalNodeIDs,
+                                 shape_file, hypo_file, myParams, cacheKey ));
+  if ( useCache && cache.Fetch( cacheKey, new_element_file ))
+    return 0;
+
   MESSAGE("Meshing with netgen3d");
-  int ret = Compute(myShape, *myMesh, myParams,
+  int ret = Compute(myShape, myMesh, myParams,
                       new_element_file,
                       !output_mesh_file.empty());
 
@@ -299,45 +450,31 @@ int NETGENPlugin_NETGEN_3D_SA::run(const std::string input_mesh_file,
     return ret;
   }
 
+  if ( useCache )
+    cache.Store( cacheKey, new_element_file );
+
   if(!output_mesh_file.empty()){
     std::string meshName = "MESH";
-    SMESH_DriverMesh::exportMesh(output_mesh_file, *myMesh, meshName);
+    SMESH_DriverMesh::exportMesh(output_mesh_file, myMesh, meshName);
   }
 
   return ret;
 }
 
 /**
- * @brief Compute the list of already meshed Surface elements and info
- *        on their orientation and if they are internal
+ * @brief Return the surface elements to take into account along with their
+ *        orientation. They are read from the element orientation file unless
+ *        they have been read along with the boundary of the solid.
  *
- * @param aMesh Global Mesh
- * @param aShape Shape associated to the mesh
- * @param proxyMesh pointer to mesh used fo find the elements
- * @param internals information on internal sub shapes
- * @param helper helper associated to the mesh
- * @param listElements map of surface element associated with
- *                     their orientation and internal status
- * @return true if their was some error
+ * @param aMesh the mesh
+ * @return map of element ID to "is reversed" flag
  */
-bool NETGENPlugin_NETGEN_3D_SA::getSurfaceElements(
-    SMESH_Mesh&         aMesh,
-    const TopoDS_Shape& aShape,
-    SMESH_ProxyMesh::Ptr proxyMesh,
-    NETGENPlugin_Internals &internals,
-    SMESH_MesherHelper &helper,
-    std::map<const SMDS_MeshElement*, tuple<bool, bool>, TIDCompare>& listElements
-    )
+const std::map<vtkIdType, bool>& NETGENPlugin_NETGEN_3D_SA::readElementOrientation(SMESH_Mesh& aMesh)
 {
-  // To remove compilation warnings
-  (void) aShape;
-  (void) proxyMesh;
-  (void) internals;
-  (void) helper;
   SMESHDS_Mesh* meshDS = aMesh.GetMeshDS();
 
-  // Get list of elements + their orientation from element_orientation file
-  std::map<vtkIdType, bool> elemOrientation;
+  std::map<vtkIdType, bool>& elemOrientation = _elemOrientation;
+  if ( elemOrientation.empty() )
   {
     // Setting all element orientation to false if there no element orientation file
     if(_element_orientation_file.empty()){
@@ -369,6 +506,40 @@ bool NETGENPlugin_NETGEN_3D_SA::getSurfaceElements(
       }
     }
   }
+  return elemOrientation;
+}
+
+/**
+ * @brief Compute the list of already meshed Surface elements and info
+ *        on their orientation and if they are internal
+ *
+ * @param aMesh Global Mesh
+ * @param aShape Shape associated to the mesh
+ * @param proxyMesh pointer to mesh used fo find the elements
+ * @param internals information on internal sub shapes
+ * @param helper helper associated to the mesh
+ * @param listElements map of surface element associated with
+ *                     their orientation and internal status
+ * @return true if their was some error
+ */
+bool NETGENPlugin_NETGEN_3D_SA::getSurfaceElements(
+    SMESH_Mesh&         aMesh,
+    const TopoDS_Shape& aShape,
+    SMESH_ProxyMesh::Ptr proxyMesh,
+    NETGENPlugin_Internals &internals,
+    SMESH_MesherHelper &helper,
+    TSurfaceElements& listElements
+    )
+{
+  // To remove compilation warnings
+  (void) aShape;
+  (void) proxyMesh;
+  (void) internals;
+  (void) helper;
+  SMESHDS_Mesh* meshDS = aMesh.GetMeshDS();
+
+  // Get list of elements + their orientation
+  const std::map<vtkIdType, bool>& elemOrientation = readElementOrientation(aMesh);
 
   // Adding elements from Mesh
   SMDS_ElemIteratorPtr iteratorElem = meshDS->elementsIterator(SMDSAbs_Face);
@@ -392,9 +563,86 @@ bool NETGENPlugin_NETGEN_3D_SA::getSurfaceElements(
       continue;
     // Get orientation
     // Netgen requires that all the triangle point outside
-    isRev = elemOrientation[elem->GetID()];
-    listElements[elem] = tuple<bool, bool>(isRev, false);
+    isRev = elemOrientation.at(elem->GetID());
+    listElements.emplace_back( elem, isRev, false );
   }
 
   return false;
 }
+
+/**
+ * @brief Run the mesher as a worker serving several solids of the same shape
+ *
+ * The input mesh and the shape are loaded only once. Each job is then read
+ * from the jobs stream as four lines:
+ *   - index of the solid in the shape (as given by TopExp::MapShapes)
+ *   - hypothesis file
+ *   - element orientation file
+ *   - new element file
+ * Once a job is over a line "WorkerDoneTag() <error code>" is written on the
+ * replies stream. The worker stops at the end of the jobs stream.
+ *
+ * @param input_mesh_file Mesh file (containing 2D elements)
+ * @param shape_file Shape file (BREP or STEP format) containing all the solids
+ * @param jobs stream the jobs are read from
+ * @param replies stream the end of each job is notified to
+ * @return int
+ */
+int NETGENPlugin_NETGEN_3D_SA::runWorker(const std::string input_mesh_file,
+                                         const std::string shape_file,
+                                         std::istream& jobs,
+                                         std::ostream& replies)
+{
+  std::unique_ptr<SMESH_Mesh> myMesh(_gen->CreateMesh(false));
+
+  SMESH_DriverMesh::importMesh(input_mesh_file, *myMesh);
+
+  // Importing shape
+  TopoDS_Shape myShape;
+  SMESH_DriverShape::importShape(shape_file, myShape);
+
+  TopTools_IndexedMapOfShape solids;
+  TopExp::MapShapes(myShape, TopAbs_SOLID, solids);
+
+  std::string index, hypo_file, element_orientation_file, new_element_file;
+  while ( std::getline(jobs, index) &&
+          std::getline(jobs, hypo_file) &&
+          std::getline(jobs, element_orientation_file) &&
+          std::getline(jobs, new_element_file))
+  {
+    int ret = 1;
+    try
+    {
+      int solidIndex = std::stoi(index);
+      if ( solidIndex < 1 || solidIndex > solids.Extent() )
+        throw SALOME_Exception("Wrong solid index " + index);
+
+      TopoDS_Shape aSolid = solids( solidIndex );
+
+      _element_orientation_file = element_orientation_file;
+      _netgen_log_folder = fs::path(hypo_file).parent_path().string();
+      _elemOrientation.clear();
+
+      // Importing hypothesis
+      netgen_params myParams;
+
+      importNetgenParams(hypo_file, myParams);
+      fillHyp(myParams);
+      MESSAGE("Meshing solid " << solidIndex << " with netgen3d");
+      ret = Compute(aSolid, *myMesh, myParams, new_element_file, /*output_mesh=*/false);
+    }
+    catch ( std::exception& ex )
+    {
+      std::cerr << "Meshing failed: " << ex.what() << std::endl;
+      ret = 1;
+    }
+    catch (...)
+    {
+      std::cerr << "Meshing failed" << std::endl;
+      ret = 1;
+    }
+    replies << WorkerDoneTag() << " " << ret << std::endl;
+  }
+
+  return 0;
+}
@@ -34,6 +34,7 @@
 
 #include <vector>
 #include <map>
+#include <iostream>
 
 class NETGENPlugin_NetgenLibWrapper;
 class netgen_params;
@@ -58,24 +59,49 @@ class NETGENPLUGIN_EXPORT NETGENPlugin_NETGEN_3D_SA: public NETGENPlugin_NETGEN_
           const std::string new_element_file,
           const std::string output_mesh_file);
 
+  int runOnMesh(SMESH_Mesh&       myMesh,
+                const std::string shape_file,
+                const std::string hypo_file,
+                const std::string element_orientation_file,
+                const std::string new_element_file,
+                const std::string output_mesh_file);
+
+  int runWorker(const std::string input_mesh_file,
+                const std::string shape_file,
+                std::istream& jobs,
+                std::ostream& replies);
+
+  // Line written by a worker on its reply stream once a job is over
+  static const char* WorkerDoneTag() { return "NETGEN_WORKER_DONE"; }
+
  protected:
 
+  void resetHyp();
+
   bool computeFillNewElementFile(
     std::vector< const SMDS_MeshNode* > &nodeVec,
     NETGENPlugin_NetgenLibWrapper &ngLib,
     std::string new_element_file,
     int &Netgen_NbOfNodes);
 
+  const std::map<vtkIdType, bool>& readElementOrientation(SMESH_Mesh& aMesh);
+
   bool getSurfaceElements(
     SMESH_Mesh&         aMesh,
     const TopoDS_Shape& aShape,
     SMESH_ProxyMesh::Ptr proxyMesh,
     NETGENPlugin_Internals &internals,
     SMESH_MesherHelper &helper,
-    std::map<const SMDS_MeshElement*, tuple<bool, bool>, TIDCompare>& listElements
+    TSurfaceElements& listElements
     ) override;
 
    std::string _element_orientation_file="";
+   std::string _netgen_log_folder="";
+   // orientation of elements read along with the boundary of a solid
+   // or from _element_orientation_file
+   std::map<vtkIdType, bool> _elemOrientation;
+   // ids of nodes in the mesh the boundary was extracted from
+   std::vector<smIdType> _globalNodeIDs;
 };
 
 #endif
@@ -0,0 +1,333 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+//=============================================================================
+// File      : NETGENPlugin_NetgenContext.cxx
+// Project   : SALOME
+//=============================================================================
+//
+//
+#include "NETGENPlugin_NetgenContext.hxx"
+
+#include "NETGENPlugin_Mesher.hxx"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <map>
+#include <thread>
+#include <vector>
+
+namespace netgen {
+  NETGENPLUGIN_DLL_HEADER
+  extern NG_THREAD_LOCAL volatile multithreadt multithread;
+
+  NETGENPLUGIN_DLL_HEADER
+  extern bool merge_solids;
+}
+
+namespace
+{
+  typedef std::multimap< const void*, volatile netgen::multithreadt* > TOwner2State;
+
+  //! running jobs
+  TOwner2State& registry()
+  {
+    static TOwner2State theRegistry;
+    return theRegistry;
+  }
+  std::mutex& registryMutex()
+  {
+    static std::mutex theMutex;
+    return theMutex;
+  }
+
+  //! owner of the innermost context of a thread
+  thread_local const void* theCurrentOwner = 0;
+
+  //! nb of contexts of a thread
+  thread_local int theNbContexts = 0;
+
+  //! true in threads of RunInThreads(), where jobs are not split further
+  thread_local bool theIsWorkerThread = false;
+
+  //! netgen::merge_solids is process-wide: jobs running in parallel share its value
+  std::mutex              theMergeSolidsMutex;
+  std::condition_variable theMergeSolidsReleased;
+  int                     theNbMergeSolidsUsers = 0;   //!< nb of threads using the value
+  thread_local bool       theUsesMergeSolids    = false;
+
+  //! stop using netgen::merge_solids by the calling thread
+  void releaseMergeSolids( std::unique_lock< std::mutex >& /*lock*/ )
+  {
+    if ( !theUsesMergeSolids )
+      return;
+    theUsesMergeSolids = false;
+    if ( --theNbMergeSolidsUsers == 0 )
+      theMergeSolidsReleased.notify_all();
+  }
+
+  //! mutex serializing jobs if netgen state is process-wide
+  std::recursive_mutex& jobMutex()
+  {
+    static std::recursive_mutex theMutex;
+    return theMutex;
+  }
+}
+
+/**
+ * @brief Start a meshing job in the current thread
+ *  @param [in] owner - an object the job is run by, usually an algorithm
+ *  @param [in] serialize - run exclusively even if netgen state is thread-local
+ */
+NETGENPlugin_NetgenContext::NETGENPlugin_NetgenContext( const void* owner,
+                                                        bool        serialize ):
+  _lock( IsReentrant() && !serialize ?
+         std::unique_lock< std::recursive_mutex >() :
+         std::unique_lock< std::recursive_mutex >( jobMutex() )),
+  _owner( owner ),
+  _prevOwner( theCurrentOwner ),
+  _multithread( &netgen::multithread ),
+  _savedParams( new netgen::MeshingParameters( netgen::mparam )),
+  _savedCout( netgen::mycout ),
+  _savedCerr( netgen::myerr )
+{
+  _multithread->terminate = 0;
+  _multithread->percent   = 0;
+  theCurrentOwner = _owner;
+  ++theNbContexts;
+
+  std::lock_guard< std::mutex > lock( registryMutex() );
+  registry().insert( std::make_pair( _owner, _multithread ));
+}
+
+/**
+ * @brief Finish the job: restore state of the thread
+ */
+NETGENPlugin_NetgenContext::~NETGENPlugin_NetgenContext()
+{
+  {
+    std::lock_guard< std::mutex > lock( registryMutex() );
+    TOwner2State::iterator o2s = registry().lower_bound( _owner );
+    for ( ; o2s != registry().end() && o2s->first == _owner; ++o2s )
+      if ( o2s->second == _multithread )
+      {
+        registry().erase( o2s );
+        break;
+      }
+  }
+  netgen::mparam = *_savedParams;
+  netgen::mycout = _savedCout;
+  netgen::myerr  = _savedCerr;
+  theCurrentOwner = _prevOwner;
+
+  if ( --theNbContexts == 0 && theUsesMergeSolids )
+  {
+    std::unique_lock< std::mutex > lock( theMergeSolidsMutex );
+    releaseMergeSolids( lock );
+  }
+}
+
+/**
+ * @brief Return true if jobs can run in parallel threads
+ *        (netgen global variables are thread-local)
+ */
+bool NETGENPlugin_NetgenContext::IsReentrant()
+{
+#ifdef NETGEN_THREAD_LOCAL_GLOBALS
+  return true;
+#else
+  return false;
+#endif
+}
+
+/**
+ * @brief Return number of threads to mesh independent sub-shapes in parallel.
+ *
+ * It exceeds one only if netgen is reentrant and SALOME_NETGEN_PARALLEL_SHAPES
+ * environment variable is set. Then it is given by netgen::mparam.nthreads,
+ * i.e. by NbThreads parameter of the hypothesis.
+ */
+int NETGENPlugin_NetgenContext::NbThreads()
+{
+  if ( theIsWorkerThread || !IsReentrant() || !std::getenv( "SALOME_NETGEN_PARALLEL_SHAPES" ))
+    return 1;
+#ifdef NETGEN_V6
+  int nbThreads = netgen::mparam.nthreads;
+#else
+  int nbThreads = (int) std::thread::hardware_concurrency();
+#endif
+  return std::max( 1, nbThreads );
+}
+
+/**
+ * @brief Run a work in parallel threads and wait for its end.
+ *
+ * The work must not throw. NbThreads() returns 1 inside the work, so that
+ * jobs run by it don't start more threads.
+ *
+ *  @param [in] nbThreads - number of threads
+ *  @param [in] work - function called in each thread with the thread index
+ */
+void NETGENPlugin_NetgenContext::RunInThreads( int                               nbThreads,
+                                               const std::function< void( int ) >& work )
+{
+  auto runWork = [&work]( int iThread )
+  {
+    const bool wasWorker = theIsWorkerThread;
+    theIsWorkerThread = true;
+    work( iThread );
+    theIsWorkerThread = wasWorker;
+  };
+  if ( nbThreads < 2 )
+  {
+    runWork( 0 );
+    return;
+  }
+  std::vector< std::thread > threads;
+  threads.reserve( nbThreads );
+  for ( int iT = 0; iT < nbThreads; ++iT )
+    threads.emplace_back( runWork, iT );
+  for ( std::thread& t : threads )
+    t.join();
+}
+
+/**
+ * @brief Run independent jobs in NbThreads() threads
+ *  @param [in] nbJobs - number of jobs
+ *  @param [in] job - function called with the job index
+ */
+void NETGENPlugin_NetgenContext::ParallelFor( size_t                                 nbJobs,
+                                              const std::function< void( size_t ) >& job )
+{
+  std::vector< std::exception_ptr > errors( nbJobs );
+  std::atomic< size_t >             nextJob( 0 );
+
+  int nbThreads = (int) std::min( (size_t) NbThreads(), nbJobs );
+  RunInThreads( nbThreads, [&]( int /*iThread*/ )
+  {
+    for ( size_t iJ = nextJob++; iJ < nbJobs; iJ = nextJob++ )
+      try
+      {
+        job( iJ );
+      }
+      catch (...)
+      {
+        errors[ iJ ] = std::current_exception();
+      }
+  });
+
+  for ( std::exception_ptr& error : errors )
+    if ( error )
+      std::rethrow_exception( error );
+}
+
+/**
+ * @brief Return owner of the innermost context of the calling thread.
+ *
+ * It is used to register jobs run in helper threads under the same owner.
+ */
+const void* NETGENPlugin_NetgenContext::Owner()
+{
+  return theCurrentOwner;
+}
+
+/**
+ * @brief Ask all jobs of an owner to stop
+ */
+void NETGENPlugin_NetgenContext::Terminate( const void* owner )
+{
+  std::lock_guard< std::mutex > lock( registryMutex() );
+  TOwner2State::iterator o2s = registry().lower_bound( owner );
+  if ( o2s == registry().end() || o2s->first != owner )
+    netgen::multithread.terminate = 1; // job run without a context
+  for ( ; o2s != registry().end() && o2s->first == owner; ++o2s )
+    o2s->second->terminate = 1;
+}
+
+/**
+ * @brief Return mean progress in percents of jobs of an owner
+ */
+double NETGENPlugin_NetgenContext::Percent( const void* owner )
+{
+  std::lock_guard< std::mutex > lock( registryMutex() );
+  std::pair< TOwner2State::iterator, TOwner2State::iterator > jobs = registry().equal_range( owner );
+  if ( jobs.first == jobs.second )
+    return netgen::multithread.percent;
+  double percent = 0;
+  int    nbJobs  = 0;
+  for ( TOwner2State::iterator o2s = jobs.first; o2s != jobs.second; ++o2s, ++nbJobs )
+    percent += o2s->second->percent;
+  return percent / nbJobs;
+}
+
+/**
+ * @brief Return name of the current task of the least advanced job of an owner
+ */
+std::string NETGENPlugin_NetgenContext::Task( const void* owner )
+{
+  std::lock_guard< std::mutex > lock( registryMutex() );
+  std::pair< TOwner2State::iterator, TOwner2State::iterator > jobs = registry().equal_range( owner );
+  const char* task = netgen::multithread.task;
+  if ( jobs.first != jobs.second )
+  {
+    TOwner2State::iterator minJob = jobs.first;
+    for ( TOwner2State::iterator o2s = jobs.first; o2s != jobs.second; ++o2s )
+      if ( o2s->second->percent < minJob->second->percent )
+        minJob = o2s;
+    task = minJob->second->task;
+  }
+  return task ? task : "";
+}
+
+/**
+ * @brief Set netgen::merge_solids for the job of the calling thread.
+ *
+ * The variable is not thread-local even in a reentrant netgen, so a job
+ * needing a value other than the one used by jobs of other threads waits
+ * until they finish. The value is kept until the outermost context of the
+ * thread is destroyed.
+ */
+void NETGENPlugin_NetgenContext::SetMergeSolids( bool merge )
+{
+  if ( !IsReentrant() || theNbContexts == 0 )
+  {
+    netgen::merge_solids = merge;
+    return;
+  }
+  std::unique_lock< std::mutex > lock( theMergeSolidsMutex );
+  if ( theUsesMergeSolids )
+  {
+    if ( netgen::merge_solids == merge )
+      return;
+    if ( theNbMergeSolidsUsers == 1 )
+    {
+      netgen::merge_solids = merge;
+      return;
+    }
+    releaseMergeSolids( lock );
+  }
+  theMergeSolidsReleased.wait( lock, [merge]() { return ( theNbMergeSolidsUsers == 0 ||
+                                                          netgen::merge_solids == merge ); });
+  netgen::merge_solids = merge;
+  theUsesMergeSolids   = true;
+  ++theNbMergeSolidsUsers;
+}
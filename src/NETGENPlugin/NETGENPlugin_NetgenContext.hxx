@@ -0,0 +1,99 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+//=============================================================================
+// File      : NETGENPlugin_NetgenContext.hxx
+// Project   : SALOME
+//=============================================================================
+//
+#ifndef _NETGENPlugin_NETGENCONTEXT_HXX_
+#define _NETGENPlugin_NETGENCONTEXT_HXX_
+
+#include "NETGENPlugin_Defs.hxx"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+namespace netgen
+{
+  class MeshingParameters;
+  class multithreadt;
+}
+
+/*!
+ * \brief State of netgen used by a meshing job run in the current thread:
+ *        meshing parameters, terminate flag and progress, log streams.
+ *
+ * Netgen patched by netgen62ForSalome.patch keeps this state in thread-local
+ * variables (NETGEN_THREAD_LOCAL_GLOBALS is defined), so several jobs can run
+ * in parallel threads of one process. Otherwise the state is process-wide and
+ * jobs are serialized: a context locks a global mutex until its destruction.
+ * A job using other global variables of netgen is always serialized.
+ * Worker threads of netgen TaskManager don't see the thread-local state of
+ * a job, so with such netgen a job runs netgen in its own thread only.
+ *
+ * The context registers the state of its thread under an owner (an algorithm)
+ * to let other threads cancel the job or read its progress. At destruction,
+ * meshing parameters and log streams of the thread are restored.
+ */
+class NETGENPLUGIN_EXPORT NETGENPlugin_NetgenContext
+{
+ public:
+  NETGENPlugin_NetgenContext( const void* owner, bool serialize = false );
+  ~NETGENPlugin_NetgenContext();
+
+  static bool IsReentrant();
+  static int  NbThreads();
+
+  // run work( iThread ) in nbThreads threads, inside which NbThreads() is 1
+  static void RunInThreads( int nbThreads, const std::function< void( int ) >& work );
+
+  // run job( iJob ) for iJob in [0,nbJobs) in NbThreads() threads,
+  // rethrow an exception of the first failed job
+  static void ParallelFor( size_t nbJobs, const std::function< void( size_t ) >& job );
+
+  // set process-wide netgen::merge_solids, waiting for jobs using another value
+  static void SetMergeSolids( bool merge );
+
+  // owner of the innermost context of the calling thread
+  static const void* Owner();
+
+  // access from any thread to the jobs of an owner;
+  // Percent() is mean of the jobs, Task() is of the least advanced one
+  static void        Terminate( const void* owner );
+  static double      Percent  ( const void* owner );
+  static std::string Task     ( const void* owner );
+
+ private:
+  NETGENPlugin_NetgenContext( const NETGENPlugin_NetgenContext& ) = delete;
+  NETGENPlugin_NetgenContext& operator=( const NETGENPlugin_NetgenContext& ) = delete;
+
+  std::unique_lock< std::recursive_mutex >     _lock;
+  const void*                                  _owner;
+  const void*                                  _prevOwner;
+  volatile netgen::multithreadt*               _multithread;
+  std::unique_ptr< netgen::MeshingParameters > _savedParams;
+  std::ostream*                                _savedCout;
+  std::ostream*                                _savedCerr;
+};
+
+#endif
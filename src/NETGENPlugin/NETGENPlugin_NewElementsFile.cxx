@@ -0,0 +1,282 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+//=============================================================================
+// File      : NETGENPlugin_NewElementsFile.cxx
+// Project   : SALOME
+//=============================================================================
+//
+//
+#include "NETGENPlugin_NewElementsFile.hxx"
+
+#include "NETGENPlugin_SharedMemory.hxx"
+
+#include "Utils_SALOME_Exception.hxx"
+
+#include <SMESH_File.hxx>
+#include <utilities.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+  struct THeader
+  {
+    char     _magic[8];
+    uint32_t _version;
+    uint32_t _nbBlocks;
+    int64_t  _nbPremeshedNodes;
+    int64_t  _nbNodesNew;
+    int64_t  _nbOldNodes;
+    int64_t  _nbNewNodes;
+  };
+
+  struct TBlockHeader
+  {
+    int32_t _nbNodes;
+    int32_t _dim;
+    int64_t _nbElements;
+  };
+
+  static_assert( sizeof( THeader ) % 8 == 0 && sizeof( TBlockHeader ) % 8 == 0,
+                 "blocks of new_elements.dat must be 8 bytes aligned" );
+
+  //! number of items of a given size fitting between two pointers
+  int64_t nbFitting( const char* data, const char* end, size_t itemSize )
+  {
+    return data < end ? (int64_t)(( end - data ) / itemSize ) : 0;
+  }
+
+  //! max number of nodes per element, of a TET10
+  const int theMaxNbNodes = 10;
+
+  //! sequential writing to a memory buffer
+  struct TMemoryStream
+  {
+    char* _ptr;
+    void write( const char* data, size_t size )
+    {
+      std::memcpy( _ptr, data, size );
+      _ptr += size;
+    }
+  };
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param nbPremeshedNodes number of nodes in the input mesh (used by NETGEN2D)
+ * @param nbNodesNew number of nodes in the netgen mesh
+ */
+NETGENPlugin_NewElementsWriter::NETGENPlugin_NewElementsWriter(int64_t nbPremeshedNodes,
+                                                               int64_t nbNodesNew)
+  : _nbPremeshedNodes( nbPremeshedNodes ), _nbNodesNew( nbNodesNew )
+{
+}
+
+/**
+ * @brief Return connectivity of elements of a given type to fill in.
+ *        A new block is started unless the last one is of the same dimension
+ *        and number of nodes per element, so the order of elements is kept.
+ *
+ * @param dim dimension of elements
+ * @param nbNodesPerElement number of nodes per element
+ * @return the connectivity to fill in
+ */
+std::vector<int64_t>& NETGENPlugin_NewElementsWriter::AddBlock(int dim, int nbNodesPerElement)
+{
+  if ( _blocks.empty() ||
+       _blocks.back()._dim     != dim ||
+       _blocks.back()._nbNodes != nbNodesPerElement )
+  {
+    _blocks.push_back( Block() );
+    _blocks.back()._dim     = dim;
+    _blocks.back()._nbNodes = nbNodesPerElement;
+  }
+  return _blocks.back()._connectivity;
+}
+
+/**
+ * @brief Return the size of the written data in bytes
+ */
+size_t NETGENPlugin_NewElementsWriter::Size() const
+{
+  size_t size = sizeof( THeader ) + sizeof(int64_t) * _nodeIDs.size() + sizeof(double) * _coords.size();
+  for ( const Block& block : _blocks )
+    size += sizeof( TBlockHeader ) + sizeof(int64_t) * block._connectivity.size();
+  return size;
+}
+
+/**
+ * @brief Write the collected data to a stream or to a memory buffer
+ */
+template< class TOut >
+void NETGENPlugin_NewElementsWriter::write(TOut& out) const
+{
+  THeader header;
+  std::memcpy( header._magic, NETGENPlugin_NewElementsReader::Magic(), sizeof( header._magic ));
+  header._version          = NETGENPlugin_NewElementsReader::Version;
+  header._nbBlocks         = (uint32_t) _blocks.size();
+  header._nbPremeshedNodes = _nbPremeshedNodes;
+  header._nbNodesNew       = _nbNodesNew;
+  header._nbOldNodes       = (int64_t) _nodeIDs.size();
+  header._nbNewNodes       = (int64_t) _coords.size() / 3;
+
+  out.write((char*) &header, sizeof( header ));
+  out.write((char*) _nodeIDs.data(), sizeof(int64_t) * _nodeIDs.size() );
+  out.write((char*) _coords.data(),  sizeof(double)  * header._nbNewNodes * 3 );
+
+  for ( const Block& block : _blocks )
+  {
+    TBlockHeader blockHeader;
+    blockHeader._nbNodes    = block._nbNodes;
+    blockHeader._dim        = block._dim;
+    blockHeader._nbElements = block._nbNodes ? (int64_t) block._connectivity.size() / block._nbNodes : 0;
+
+    out.write((char*) &blockHeader, sizeof( blockHeader ));
+    out.write((char*) block._connectivity.data(),
+              sizeof(int64_t) * blockHeader._nbElements * block._nbNodes );
+  }
+}
+
+/**
+ * @brief Write the collected data
+ *
+ * @param new_element_file the file name. If it starts with "shm:", the data is
+ *        written into a shared memory segment of this name which is left for
+ *        the reader to remove
+ * @return true if the data is written
+ */
+bool NETGENPlugin_NewElementsWriter::Write(const std::string& new_element_file) const
+{
+  if ( NETGENPlugin_SharedMemory::IsSharedMemory( new_element_file ))
+  {
+    NETGENPlugin_SharedMemory shm;
+    if ( !shm.Create( new_element_file, Size(), /*removeOnClose=*/false ))
+      return false;
+    TMemoryStream out{ shm.Data() };
+    write( out );
+    return true;
+  }
+
+  std::ofstream df(new_element_file, std::ios::out|std::ios::binary);
+  if ( !df )
+    return false;
+  write( df );
+  return df.good();
+}
+
+/**
+ * @brief Map a file in memory and check its contents
+ *
+ * @param new_element_file the file name. If it starts with "shm:", the data is
+ *        read from a shared memory segment of this name, which is then removed
+ * @throw SALOME_Exception if the contents is inconsistent with the data size
+ */
+NETGENPlugin_NewElementsReader::NETGENPlugin_NewElementsReader(const std::string& new_element_file)
+  : _isOK( false ),
+    _nbPremeshedNodes( 0 ), _nbNodesNew( 0 ), _nbOldNodes( 0 ), _nbNewNodes( 0 ),
+    _nodeIDs( 0 ), _coords( 0 )
+{
+  const char* data = 0;
+  const char*  end = 0;
+  if ( NETGENPlugin_SharedMemory::IsSharedMemory( new_element_file ))
+  {
+    _shm.reset( new NETGENPlugin_SharedMemory );
+    bool opened = _shm->Open( new_element_file );
+    _shm->Unlink(); // the mapping is valid until destruction
+    if ( opened )
+    {
+      data = _shm->Data();
+      end  = data + _shm->Size();
+    }
+  }
+  else
+  {
+    _file.reset( new SMESH_File( new_element_file ));
+    if ( _file->open() )
+    {
+      data = *_file;
+      end  = _file->end();
+    }
+  }
+  if ( !data || end - data < (long) sizeof( THeader ))
+  {
+    MESSAGE("Can't read " << new_element_file);
+    return;
+  }
+
+  // counts are checked against the data size before use, so that a truncated
+  // or corrupted file is not read beyond its end
+  auto check = [&]( bool isValid, const char* what )
+  {
+    if ( !isValid )
+      throw SALOME_Exception( std::string( what ) + " in " + new_element_file );
+  };
+
+  const THeader* header = (const THeader*) data;
+  check( std::strncmp( header->_magic, Magic(), sizeof( header->_magic )) == 0 &&
+         header->_version == Version, "Wrong format" );
+  data += sizeof( THeader );
+
+  check( header->_nbOldNodes >= 0 && header->_nbOldNodes <= nbFitting( data, end, sizeof(int64_t) ),
+         "Wrong number of old nodes" );
+  _nbOldNodes = header->_nbOldNodes;
+  _nodeIDs    = (const int64_t*) data;
+  data       += sizeof(int64_t) * _nbOldNodes;
+
+  check( header->_nbNewNodes >= 0 && header->_nbNewNodes <= nbFitting( data, end, 3 * sizeof(double) ),
+         "Wrong number of new nodes" );
+  _nbNewNodes = header->_nbNewNodes;
+  _coords     = (const double*) data;
+  data       += sizeof(double) * 3 * _nbNewNodes;
+
+  // netgen nodes are the premeshed or the old ones followed by the new ones
+  check( header->_nbPremeshedNodes >= 0 &&
+         header->_nbNodesNew == std::max( header->_nbPremeshedNodes, _nbOldNodes ) + _nbNewNodes,
+         "Wrong number of nodes" );
+  _nbPremeshedNodes = header->_nbPremeshedNodes;
+  _nbNodesNew       = header->_nbNodesNew;
+
+  check( header->_nbBlocks <= nbFitting( data, end, sizeof( TBlockHeader )),
+         "Wrong number of blocks" );
+  _blocks.resize( header->_nbBlocks );
+  for ( Block& block : _blocks )
+  {
+    check( nbFitting( data, end, sizeof( TBlockHeader )) >= 1, "Truncated block of elements" );
+    const TBlockHeader* blockHeader = (const TBlockHeader*) data;
+    data += sizeof( TBlockHeader );
+    check( blockHeader->_nbNodes >= 1 && blockHeader->_nbNodes <= theMaxNbNodes &&
+           blockHeader->_nbElements >= 0 &&
+           blockHeader->_nbElements <= nbFitting( data, end, sizeof(int64_t) * blockHeader->_nbNodes ),
+           "Wrong block of elements" );
+    block._dim          = blockHeader->_dim;
+    block._nbNodes      = blockHeader->_nbNodes;
+    block._nbElements   = blockHeader->_nbElements;
+    block._connectivity = (const int64_t*) data;
+    data               += sizeof(int64_t) * block._nbNodes * block._nbElements;
+  }
+  _isOK = true;
+}
+
+NETGENPlugin_NewElementsReader::~NETGENPlugin_NewElementsReader()
+{
+}
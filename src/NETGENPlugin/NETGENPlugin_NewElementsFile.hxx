@@ -0,0 +1,134 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+//=============================================================================
+// File      : NETGENPlugin_NewElementsFile.hxx
+// Project   : SALOME
+//=============================================================================
+//
+// Binary file transferring elements created by run_mesher to the remote
+// algorithms (new_elements.dat). The same data may be exchanged via a POSIX
+// shared memory segment whose name starts with "shm:" instead of a file.
+// All the blocks are 8 bytes aligned:
+//
+//   header      : magic "NGNEWELM", uint32 version, uint32 nbBlocks,
+//                 int64 nbPremeshedNodes, int64 nbNodesNew,
+//                 int64 nbOldNodes, int64 nbNewNodes
+//   node ids    : int64[ nbOldNodes ]     ids of already existing nodes
+//   coordinates : double[ 3*nbNewNodes ]  coordinates of created nodes
+//   nbBlocks element blocks, each one being
+//     int32 nbNodesPerElement, int32 dimension, int64 nbElements,
+//     int64[ nbNodesPerElement*nbElements ] netgen indices of element nodes
+//
+#ifndef _NETGENPlugin_NEWELEMENTSFILE_HXX_
+#define _NETGENPlugin_NEWELEMENTSFILE_HXX_
+
+#include "NETGENPlugin_Defs.hxx"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class SMESH_File;
+class NETGENPlugin_SharedMemory;
+
+/*!
+ * \brief Collect elements created by the mesher and write them at once
+ */
+class NETGENPLUGIN_EXPORT NETGENPlugin_NewElementsWriter
+{
+ public:
+  NETGENPlugin_NewElementsWriter(int64_t nbPremeshedNodes, int64_t nbNodesNew);
+
+  std::vector<int64_t>& NodeIDs() { return _nodeIDs; }
+  std::vector<double>&  Coords()  { return _coords; }
+
+  std::vector<int64_t>& AddBlock(int dim, int nbNodesPerElement);
+
+  size_t Size() const;
+
+  bool Write(const std::string& new_element_file) const;
+
+ private:
+  template< class TOut > void write(TOut& out) const;
+
+  struct Block
+  {
+    int                  _dim;
+    int                  _nbNodes;
+    std::vector<int64_t> _connectivity;
+  };
+  int64_t              _nbPremeshedNodes;
+  int64_t              _nbNodesNew;
+  std::vector<int64_t> _nodeIDs;
+  std::vector<double>  _coords;
+  std::vector<Block>   _blocks;
+};
+
+/*!
+ * \brief Access to the data of a file written by NETGENPlugin_NewElementsWriter.
+ *        The file is mapped in memory. IsOK() is false if the file can't be read,
+ *        SALOME_Exception is thrown if its contents does not fit its size.
+ */
+class NETGENPLUGIN_EXPORT NETGENPlugin_NewElementsReader
+{
+ public:
+  NETGENPlugin_NewElementsReader(const std::string& new_element_file);
+  ~NETGENPlugin_NewElementsReader();
+
+  bool IsOK() const { return _isOK; }
+
+  int64_t        NbPremeshedNodes() const { return _nbPremeshedNodes; }
+  int64_t        NbNodesNew()       const { return _nbNodesNew; }
+  int64_t        NbOldNodes()       const { return _nbOldNodes; }
+  const int64_t* NodeIDs()          const { return _nodeIDs; }
+  int64_t        NbNewNodes()       const { return _nbNewNodes; }
+  const double*  Coords()           const { return _coords; }
+
+  int            NbBlocks()                        const { return (int) _blocks.size(); }
+  int            BlockDim(int iBlock)              const { return _blocks[iBlock]._dim; }
+  int            BlockNbNodes(int iBlock)          const { return _blocks[iBlock]._nbNodes; }
+  int64_t        BlockNbElements(int iBlock)       const { return _blocks[iBlock]._nbElements; }
+  const int64_t* BlockConnectivity(int iBlock)     const { return _blocks[iBlock]._connectivity; }
+
+  static const char*   Magic()   { return "NGNEWELM"; }
+  static const uint32_t Version = 2;
+
+ private:
+  struct Block
+  {
+    int            _dim;
+    int            _nbNodes;
+    int64_t        _nbElements;
+    const int64_t* _connectivity;
+  };
+  std::unique_ptr<SMESH_File>                _file;
+  std::unique_ptr<NETGENPlugin_SharedMemory> _shm;
+  bool                                       _isOK;
+  int64_t                                    _nbPremeshedNodes;
+  int64_t                                    _nbNodesNew;
+  int64_t                                    _nbOldNodes;
+  int64_t                                    _nbNewNodes;
+  const int64_t*                             _nodeIDs;
+  const double*                              _coords;
+  std::vector<Block>                         _blocks;
+};
+
+#endif
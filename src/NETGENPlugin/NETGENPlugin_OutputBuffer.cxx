@@ -0,0 +1,175 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+//=============================================================================
+// File      : NETGENPlugin_OutputBuffer.cxx
+// Project   : SALOME
+//=============================================================================
+//
+//
+#include "NETGENPlugin_OutputBuffer.hxx"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+
+NETGENPlugin_OutputBuffer::NETGENPlugin_OutputBuffer(size_t capacity):
+  std::ostream( 0 ), _buf( capacity )
+{
+  rdbuf( &_buf );
+}
+
+/**
+ * @brief Return true if netgen output is to be kept in memory
+ *        (NETGEN_OUTPUT_IN_MEMORY environment variable is set)
+ */
+bool NETGENPlugin_OutputBuffer::IsEnabled()
+{
+  return std::getenv("NETGEN_OUTPUT_IN_MEMORY");
+}
+
+/**
+ * @brief Return the capacity given by NETGEN_OUTPUT_BUFFER_SIZE environment variable
+ */
+size_t NETGENPlugin_OutputBuffer::DefaultCapacity()
+{
+  int sizeKB = 0;
+  if ( const char* size = std::getenv("NETGEN_OUTPUT_BUFFER_SIZE"))
+    sizeKB = std::atoi( size );
+  if ( sizeKB < 1 )
+    sizeKB = 1024;
+  return size_t( sizeKB ) * 1024;
+}
+
+/**
+ * @brief Return the stored characters
+ */
+std::string NETGENPlugin_OutputBuffer::Contents() const
+{
+  return _buf.contents();
+}
+
+/**
+ * @brief Return true if the oldest characters were dropped
+ */
+bool NETGENPlugin_OutputBuffer::IsTruncated() const
+{
+  return _buf.isTruncated();
+}
+
+/**
+ * @brief Write the stored characters to a file
+ */
+bool NETGENPlugin_OutputBuffer::Flush(const std::string& file) const
+{
+  std::ofstream out( file.c_str() );
+  if ( IsTruncated() )
+    out << "... (beginning of output is lost)" << std::endl;
+  out << Contents();
+  return out.good();
+}
+
+/**
+ * @brief Forget the stored characters
+ */
+void NETGENPlugin_OutputBuffer::Clear()
+{
+  _buf.clear();
+}
+
+NETGENPlugin_OutputBuffer::RingBuf::RingBuf(size_t capacity):
+  _data( std::max( capacity, size_t( 1 ))), _start( 0 ), _size( 0 ), _truncated( false )
+{
+}
+
+std::string NETGENPlugin_OutputBuffer::RingBuf::contents() const
+{
+  std::lock_guard<std::mutex> lock( _mutex );
+  std::string s;
+  s.reserve( _size );
+  size_t n1 = std::min( _size, _data.size() - _start );
+  s.append( &_data[ _start ], n1 );
+  s.append( &_data[ 0 ], _size - n1 );
+  return s;
+}
+
+bool NETGENPlugin_OutputBuffer::RingBuf::isTruncated() const
+{
+  std::lock_guard<std::mutex> lock( _mutex );
+  return _truncated;
+}
+
+void NETGENPlugin_OutputBuffer::RingBuf::clear()
+{
+  std::lock_guard<std::mutex> lock( _mutex );
+  _start = _size = 0;
+  _truncated = false;
+}
+
+NETGENPlugin_OutputBuffer::RingBuf::int_type
+NETGENPlugin_OutputBuffer::RingBuf::overflow(int_type c)
+{
+  if ( !traits_type::eq_int_type( c, traits_type::eof() ))
+  {
+    char ch = traits_type::to_char_type( c );
+    put( &ch, 1 );
+  }
+  return traits_type::not_eof( c );
+}
+
+std::streamsize NETGENPlugin_OutputBuffer::RingBuf::xsputn(const char* s, std::streamsize n)
+{
+  put( s, n );
+  return n;
+}
+
+//================================================================================
+/*!
+ * \brief Append characters, overwriting the oldest ones if the buffer is full
+ */
+//================================================================================
+
+void NETGENPlugin_OutputBuffer::RingBuf::put(const char* s, size_t n)
+{
+  std::lock_guard<std::mutex> lock( _mutex );
+  const size_t capacity = _data.size();
+  if ( n >= capacity )
+  {
+    // only the last characters fit
+    _truncated = _truncated || ( n > capacity || _size > 0 );
+    std::copy( s + n - capacity, s + n, _data.begin() );
+    _start = 0;
+    _size  = capacity;
+    return;
+  }
+  size_t end = ( _start + _size ) % capacity;
+  size_t n1  = std::min( n, capacity - end );
+  std::copy( s, s + n1, _data.begin() + end );
+  std::copy( s + n1, s + n, _data.begin() );
+  if ( _size + n > capacity )
+  {
+    _truncated = true;
+    _start = ( _start + _size + n - capacity ) % capacity;
+    _size  = capacity;
+  }
+  else
+  {
+    _size += n;
+  }
+}
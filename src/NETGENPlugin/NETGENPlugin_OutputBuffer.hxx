@@ -0,0 +1,83 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+//=============================================================================
+// File      : NETGENPlugin_OutputBuffer.hxx
+// Project   : SALOME
+//=============================================================================
+//
+#ifndef _NETGENPlugin_OUTPUTBUFFER_HXX_
+#define _NETGENPlugin_OUTPUTBUFFER_HXX_
+
+#include "NETGENPlugin_Defs.hxx"
+
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief Stream keeping in memory the last characters written to it.
+ *
+ * It replaces the files netgen output (mycout, myerr, testout) is
+ * redirected to if NETGEN_OUTPUT_IN_MEMORY environment variable is set.
+ * Its capacity is given by NETGEN_OUTPUT_BUFFER_SIZE (in KB, 1024 by default).
+ */
+class NETGENPLUGIN_EXPORT NETGENPlugin_OutputBuffer : public std::ostream
+{
+ public:
+  NETGENPlugin_OutputBuffer(size_t capacity = DefaultCapacity());
+
+  static bool   IsEnabled();
+  static size_t DefaultCapacity();
+
+  std::string Contents() const;
+  bool        IsTruncated() const;
+  bool        Flush(const std::string& file) const;
+  void        Clear();
+
+ private:
+
+  // circular buffer of characters
+  class RingBuf : public std::streambuf
+  {
+   public:
+    RingBuf(size_t capacity);
+    std::string contents() const;
+    bool        isTruncated() const;
+    void        clear();
+
+   protected:
+    int_type        overflow(int_type c) override;
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+
+   private:
+    void put(const char* s, size_t n);
+
+    mutable std::mutex _mutex;
+    std::vector<char>  _data;
+    size_t             _start;     // index of the oldest character
+    size_t             _size;      // number of stored characters
+    bool               _truncated; // some characters were dropped
+  };
+
+  RingBuf _buf;
+};
+
+#endif
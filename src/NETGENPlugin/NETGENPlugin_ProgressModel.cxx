@@ -0,0 +1,384 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+
+//=============================================================================
+// File      : NETGENPlugin_ProgressModel.cxx
+// Project   : SALOME
+//=============================================================================
+//
+#include "NETGENPlugin_ProgressModel.hxx"
+
+#include <utilities.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#ifdef WIN32
+#include <filesystem>
+namespace fs = std::filesystem;
+#else
+#include <unistd.h>
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+#endif
+
+namespace
+{
+  //! names of stages in the timing history
+  const char* theStageNames[ NETGENPlugin_ProgressModel::NB_STAGES ] =
+    { "analyse", "edges", "faces", "optimize_faces", "volumes", "optimize_volumes", "fill_smesh" };
+
+  //! seconds per unit of work used while there is no history
+  const double theDefaultRates[ NETGENPlugin_ProgressModel::NB_STAGES ] =
+    { 1e-2,    // per FACE
+      1e-3,    // per EDGE
+      2e-5,    // per triangle
+      1.7e-6,  // per triangle and optimization pass
+      2e-5,    // per tetrahedron
+      4e-6,    // per tetrahedron and optimization pass
+      3e-6 };  // per element
+
+  //! weight of a new measurement in a calibrated rate
+  const double theNewRateWeight = 0.3;
+
+  //! shorter stages are not measured reliably
+  const double theMinMeasuredTime = 0.01;
+
+  double now()
+  {
+    return std::chrono::duration<double>
+      ( std::chrono::steady_clock::now().time_since_epoch() ).count();
+  }
+
+  std::string hostName()
+  {
+#ifdef WIN32
+    if ( const char* name = std::getenv("COMPUTERNAME"))
+      return name;
+#else
+    char name[256];
+    if ( gethostname( name, sizeof( name )) == 0 )
+    {
+      name[ sizeof( name ) - 1 ] = '\0';
+      return name;
+    }
+#endif
+    return "localhost";
+  }
+
+  //! rates of the timing history shared by computations of this process
+  struct THistory
+  {
+    std::mutex _mutex;
+    double     _rate[ NETGENPlugin_ProgressModel::NB_STAGES ];
+
+    THistory()
+    {
+      for ( int i = 0; i < NETGENPlugin_ProgressModel::NB_STAGES; ++i )
+        _rate[ i ] = theDefaultRates[ i ];
+      std::ifstream history( NETGENPlugin_ProgressModel::HistoryFile() );
+      std::string name;
+      double rate;
+      while ( history >> name >> rate )
+        for ( int i = 0; i < NETGENPlugin_ProgressModel::NB_STAGES; ++i )
+          if ( name == theStageNames[ i ] && rate > 0 )
+            _rate[ i ] = rate;
+    }
+  };
+
+  //! return the timing history read at the first call
+  THistory& theHistory()
+  {
+    static THistory history;
+    return history;
+  }
+}
+
+//================================================================================
+/*!
+ * \brief Initialize rates by default ones
+ */
+//================================================================================
+
+NETGENPlugin_ProgressModel::NETGENPlugin_ProgressModel()
+  : _first( ANALYSE ), _last( ANALYSE ), _startTime( now() ),
+    _stageDone( 0 ), _progress( 0 ), _nbDoneElems( 0 ), _isCalibrated( false )
+{
+  for ( int i = 0; i < NB_STAGES; ++i )
+  {
+    _work[ i ] = 0;
+    _rate[ i ] = theDefaultRates[ i ];
+    _time[ i ] = 0;
+  }
+}
+
+//================================================================================
+/*!
+ * \brief Return path of the timing history of this computer
+ */
+//================================================================================
+
+std::string NETGENPlugin_ProgressModel::HistoryFile()
+{
+  if ( const char* file = std::getenv("SALOME_NETGEN_TIMING_FILE"))
+    return file;
+#ifdef WIN32
+  const char* home = std::getenv("USERPROFILE");
+#else
+  const char* home = std::getenv("HOME");
+#endif
+  if ( !home )
+    return std::string();
+  fs::path file = fs::path( home ) / ".config" / "salome" / ( "netgen_timing_" + hostName() );
+  return file.string();
+}
+
+//================================================================================
+/*!
+ * \brief Set amount of work of a stage
+ */
+//================================================================================
+
+void NETGENPlugin_ProgressModel::SetWork( TStage stage, double work )
+{
+  std::lock_guard<std::mutex> lock( _mutex );
+  _work[ stage ] = std::max( 0., work );
+}
+
+double NETGENPlugin_ProgressModel::Work( TStage stage ) const
+{
+  std::lock_guard<std::mutex> lock( _mutex );
+  return _work[ stage ];
+}
+
+//================================================================================
+/*!
+ * \brief Start one or several successive stages
+ */
+//================================================================================
+
+void NETGENPlugin_ProgressModel::Start( TStage stage, TStage lastStage )
+{
+  std::lock_guard<std::mutex> lock( _mutex );
+  if ( !_isCalibrated )
+  {
+    THistory& history = theHistory();
+    std::lock_guard<std::mutex> historyLock( history._mutex );
+    std::copy( history._rate, history._rate + NB_STAGES, _rate );
+    _isCalibrated = true;
+  }
+  stopStages();
+  _first       = stage;
+  _last        = std::max( stage, lastStage == NB_STAGES ? stage : lastStage );
+  _startTime   = now();
+  _stageDone   = 0;
+  _nbDoneElems = 0;
+}
+
+//================================================================================
+/*!
+ * \brief Finish current stages preceding a given one, which becomes the first current.
+ *        This is for stages run at once but signaling a switch between them.
+ */
+//================================================================================
+
+void NETGENPlugin_ProgressModel::Reach( TStage stage )
+{
+  std::lock_guard<std::mutex> lock( _mutex );
+  if ( stage <= _first || stage > _last )
+    return;
+  const int last = _last;
+  _last = stage - 1;
+  stopStages();
+  _first     = stage;
+  _last      = last;
+  _stageDone = 0;
+}
+
+//================================================================================
+/*!
+ * \brief Return predicted part of the current stages taken by a given stage
+ */
+//================================================================================
+
+double NETGENPlugin_ProgressModel::Share( TStage stage ) const
+{
+  std::lock_guard<std::mutex> lock( _mutex );
+  if ( stage < _first || stage > _last )
+    return 0;
+  double current = 0;
+  for ( int i = _first; i <= _last; ++i )
+    current += predicted( i );
+  return current > 0 ? predicted( stage ) / current : 1. / ( _last - _first + 1 );
+}
+
+//================================================================================
+/*!
+ * \brief Share time of current stages among them as they are predicted to take
+ */
+//================================================================================
+
+void NETGENPlugin_ProgressModel::stopStages()
+{
+  double elapsed = now() - _startTime, predictedSum = 0;
+  for ( int i = _first; i <= _last; ++i )
+    predictedSum += predicted( i );
+  for ( int i = _first; i <= _last; ++i )
+    if ( predictedSum > 0 )
+      _time[ i ] += elapsed * predicted( i ) / predictedSum;
+    else
+      _time[ i ] += elapsed / ( _last - _first + 1 );
+  _startTime = now();
+}
+
+//================================================================================
+/*!
+ * \brief Count elements generated by parallel jobs
+ */
+//================================================================================
+
+void NETGENPlugin_ProgressModel::AddDoneElements( double nbElems )
+{
+  double nbDone = _nbDoneElems;
+  while ( !_nbDoneElems.compare_exchange_weak( nbDone, nbDone + nbElems ));
+}
+
+double NETGENPlugin_ProgressModel::DoneElements() const
+{
+  return _nbDoneElems;
+}
+
+NETGENPlugin_ProgressModel::TStage NETGENPlugin_ProgressModel::Stage() const
+{
+  std::lock_guard<std::mutex> lock( _mutex );
+  return TStage( _first );
+}
+
+//================================================================================
+/*!
+ * \brief Return progress of the whole computation
+ *  \param [in] stageDone - completion of the current stages; if negative,
+ *         it is estimated by time elapsed since their start
+ *  \return double - progress never decreasing and below 1.
+ */
+//================================================================================
+
+double NETGENPlugin_ProgressModel::Progress( double stageDone )
+{
+  std::lock_guard<std::mutex> lock( _mutex );
+
+  double total = 0, done = 0, current = 0;
+  for ( int i = 0; i < NB_STAGES; ++i )
+  {
+    total += predicted( i );
+    if      ( i < _first ) done    += predicted( i );
+    else if ( i <= _last ) current += predicted( i );
+  }
+  if ( total <= 0 )
+    return _progress;
+
+  if ( stageDone < 0 )
+    stageDone = current > 0 ? std::min( 0.95, ( now() - _startTime ) / current ) : 0;
+  _stageDone = std::max( _stageDone, std::min( 1., stageDone ));
+
+  double progress = ( done + _stageDone * current ) / total;
+  _progress = std::max( _progress, std::min( 0.99, progress ));
+  return _progress;
+}
+
+//================================================================================
+/*!
+ * \brief Return predicted remaining time corrected by the speed observed so far
+ */
+//================================================================================
+
+double NETGENPlugin_ProgressModel::RemainingTime() const
+{
+  std::lock_guard<std::mutex> lock( _mutex );
+
+  double total = 0, elapsed = now() - _startTime;
+  for ( int i = 0; i < NB_STAGES; ++i )
+  {
+    total   += predicted( i );
+    elapsed += _time[ i ];
+  }
+  double remaining = ( 1. - _progress ) * total;
+  double predictedDone = _progress * total;
+  if ( predictedDone > 0 && elapsed > theMinMeasuredTime )
+    remaining *= elapsed / predictedDone;
+
+  return remaining;
+}
+
+//================================================================================
+/*!
+ * \brief Merge measured rates into the timing history
+ */
+//================================================================================
+
+void NETGENPlugin_ProgressModel::Finish()
+{
+  std::lock_guard<std::mutex> lock( _mutex );
+  stopStages();
+  _first = _last = NB_STAGES - 1;
+  _progress = 1.;
+
+  // merge into the history shared with other computations
+  THistory& history = theHistory();
+  std::lock_guard<std::mutex> historyLock( history._mutex );
+  for ( int i = 0; i < NB_STAGES; ++i )
+    if ( _work[ i ] > 0 && _time[ i ] > theMinMeasuredTime )
+      history._rate[ i ] = (( 1. - theNewRateWeight ) * history._rate[ i ] +
+                            theNewRateWeight * _time[ i ] / _work[ i ]);
+  std::copy( history._rate, history._rate + NB_STAGES, _rate );
+
+  std::string file = HistoryFile();
+  if ( file.empty() )
+    return;
+  try
+  {
+    fs::path path( file );
+    if ( path.has_parent_path() )
+      fs::create_directories( path.parent_path() );
+#ifdef WIN32
+    fs::path tmp = path.string() + ".tmp";
+#else
+    fs::path tmp = fs::unique_path( path.string() + "-%%%%-%%%%.tmp" );
+#endif
+    // computations of other processes may finish at once, so the history is written aside
+    {
+      std::ofstream stream( tmp.string() );
+      stream.precision( 6 );
+      for ( int i = 0; i < NB_STAGES; ++i )
+        stream << theStageNames[ i ] << " " << _rate[ i ] << std::endl;
+      if ( !stream )
+        return;
+    }
+    fs::rename( tmp, path );
+  }
+  catch ( std::exception& ex )
+  {
+    MESSAGE("Timing history error: " << ex.what());
+  }
+}
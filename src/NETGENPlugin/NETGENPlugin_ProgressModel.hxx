@@ -0,0 +1,112 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+
+//=============================================================================
+// File      : NETGENPlugin_ProgressModel.hxx
+// Project   : SALOME
+//=============================================================================
+//
+#ifndef _NETGENPlugin_PROGRESSMODEL_HXX_
+#define _NETGENPlugin_PROGRESSMODEL_HXX_
+
+#include "NETGENPlugin_Defs.hxx"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+
+/*!
+ * \brief Progress of NETGENPlugin_Mesher::Compute() by stages of meshing.
+ *
+ * Each stage has an amount of work (e.g. an estimated number of triangles)
+ * and a time rate per unit of work. The current stage reports its completion
+ * by its own signal: number of meshed FACEs, netgen percent, number of
+ * generated tetrahedra or an optimization pass. Without a signal, completion
+ * is the elapsed time compared with the predicted one.
+ *
+ * The rates are calibrated on this computer: measured ones are merged into
+ * a timing history stored in a file given by SALOME_NETGEN_TIMING_FILE
+ * environment variable, by default ~/.config/salome/netgen_timing_<host>.
+ * The file is read once per process, at the first start of a computation.
+ */
+class NETGENPLUGIN_EXPORT NETGENPlugin_ProgressModel
+{
+ public:
+
+  enum TStage { ANALYSE,
+                EDGES,
+                FACES,
+                OPT_FACES,
+                VOLUMES,
+                OPT_VOLUMES,
+                FILL_SMESH, // second order and transfer to SMESH
+                NB_STAGES };
+
+  NETGENPlugin_ProgressModel();
+
+  // set amount of work of a stage, zero for a stage not to pass
+  void   SetWork( TStage stage, double work );
+  double Work( TStage stage ) const;
+
+  // start a stage or several successive stages run at once
+  void Start( TStage stage, TStage lastStage = NB_STAGES );
+
+  // finish stages preceding a given one among the current ones
+  void Reach( TStage stage );
+
+  // predicted part of the current stages taken by a given stage
+  double Share( TStage stage ) const;
+
+  // number of elements generated by parallel jobs of the current stage;
+  // AddDoneElements() is called from the job threads
+  void   AddDoneElements( double nbElems );
+  double DoneElements() const;
+
+  TStage Stage() const;
+
+  // return progress in [0,1] given completion of the current stage, negative if unknown
+  double Progress( double stageDone );
+
+  // return predicted time in seconds till the end of computation
+  double RemainingTime() const;
+
+  // store the measured rates in the timing history
+  void Finish();
+
+  static std::string HistoryFile();
+
+ private:
+
+  double predicted( int stage ) const { return _work[ stage ] * _rate[ stage ]; }
+  void   stopStages();
+
+  mutable std::mutex  _mutex;
+  double              _work[ NB_STAGES ];
+  double              _rate[ NB_STAGES ]; // seconds per unit of work
+  double              _time[ NB_STAGES ]; // measured seconds
+  int                 _first, _last;      // current stages
+  double              _startTime;         // of the current stages
+  double              _stageDone;         // completion of the current stages
+  double              _progress;
+  std::atomic<double> _nbDoneElems;
+  bool                _isCalibrated;      // _rate is taken from the history
+};
+
+#endif
@@ -27,6 +27,7 @@
 #include "NETGENPlugin_Remesher_2D.hxx"
 
 #include "NETGENPlugin_Mesher.hxx"
+#include "NETGENPlugin_NetgenContext.hxx"
 #include "NETGENPlugin_Hypothesis_2D.hxx"
 
 #include <SMDS_SetIterator.hxx>
@@ -55,7 +56,7 @@ using namespace nglib;
 namespace netgen {
 
   NETGENPLUGIN_DLL_HEADER
-  extern MeshingParameters mparam;
+  extern NG_THREAD_LOCAL MeshingParameters mparam;
 
   NETGENPLUGIN_DLL_HEADER
   extern STLParameters stlparam;
@@ -585,12 +586,14 @@ bool NETGENPlugin_Remesher_2D::Compute(SMESH_Mesh&         theMesh,
   if ( theMesh.NbFaces() == 0 )
     return !error( COMPERR_WARNING, "No faces in input mesh");
 
+  // STL global variables of netgen are not thread-local
+  NETGENPlugin_NetgenContext ngContext( this, /*serialize=*/true );
+
   NETGENPlugin_Mesher mesher( &theMesh, theMesh.GetShapeToMesh(), /*isVol=*/false);
   NETGENPlugin_NetgenLibWrapper ngLib;
   netgen::Mesh *        ngMesh = (netgen::Mesh*) ngLib._ngMesh;
   Ng_STL_Geometry *   ngStlGeo = Ng_STL_NewGeometry();
   netgen::STLTopology* stlTopo = (netgen::STLTopology*) ngStlGeo;
-  netgen::multithread.terminate = 0;
 
   const NETGENPlugin_RemesherHypothesis_2D* hyp =
     dynamic_cast<const NETGENPlugin_RemesherHypothesis_2D*>( _hypothesis );
@@ -744,6 +747,7 @@ bool NETGENPlugin_Remesher_2D::Compute(SMESH_Mesh&         theMesh,
   int nbF = ngMesh->GetNSE();
   if ( nbF == 0 )
     return error( "Error in Surface Meshing" );
+  ngLib._isComputeOk = true;
 
   // remove existing mesh
   holeFiller.ClearCapElements();
@@ -882,7 +886,7 @@ bool NETGENPlugin_Remesher_2D::Compute(SMESH_Mesh&         /*theMesh*/,
 void NETGENPlugin_Remesher_2D::CancelCompute()
 {
   SMESH_Algo::CancelCompute();
-  netgen::multithread.terminate = 1;
+  NETGENPlugin_NetgenContext::Terminate( this );
 }
 
 //================================================================================
@@ -893,7 +897,7 @@ void NETGENPlugin_Remesher_2D::CancelCompute()
 
 double NETGENPlugin_Remesher_2D::GetProgress() const
 {
-  return netgen::multithread.percent / 100.;
+  return NETGENPlugin_NetgenContext::Percent( this ) / 100.;
 }
 
 //=============================================================================
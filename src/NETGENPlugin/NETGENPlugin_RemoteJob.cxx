@@ -0,0 +1,307 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+
+//=============================================================================
+// File      : NETGENPlugin_RemoteJob.cxx
+// Project   : SALOME
+//=============================================================================
+//
+#include "NETGENPlugin_RemoteJob.hxx"
+
+#include "NETGENPlugin_NewElementsFile.hxx"
+#include "NETGENPlugin_RemoteLauncher.hxx"
+#include "NETGENPlugin_SharedMemory.hxx"
+
+#include "Utils_SALOME_Exception.hxx"
+
+#include <SMESHDS_Mesh.hxx>
+#include <SMESH_ComputeError.hxx>
+#include <SMESH_MeshLocker.hxx>
+#include <SMESH_MesherHelper.hxx>
+#include <SMESH_ParallelMesh.hxx>
+#include <SMESH_subMesh.hxx>
+
+#include <utilities.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <set>
+
+namespace fs = boost::filesystem;
+
+/**
+ * @brief Create the temporary folder of a job and define its files
+ *
+ * @param aParMesh the mesh
+ * @param param_file_name name of the netgen parameters file
+ */
+void NETGENPlugin_RemoteJob::Init(SMESH_ParallelMesh& aParMesh,
+                                  const std::string&  param_file_name)
+{
+#ifdef WIN32
+  tmp_folder = aParMesh.GetTmpFolder() / fs::path("Volume-%%%%-%%%%");
+#else
+  tmp_folder = aParMesh.GetTmpFolder() / fs::unique_path(fs::path("Volume-%%%%-%%%%"));
+#endif
+  fs::create_directories(tmp_folder);
+  element_orientation_file=tmp_folder / fs::path("element_orientation.dat");
+  new_element_file=tmp_folder / fs::path("new_elements.dat");
+  // Not used kept for debug
+  //fs::path output_mesh_file=tmp_folder / fs::path("output_mesh.med");
+  shape_file=tmp_folder / fs::path("shape.brep");
+  param_file=tmp_folder / fs::path(param_file_name);
+  log_file=tmp_folder / fs::path("run.log");
+  cmd_file=tmp_folder / fs::path("cmd.txt");
+}
+
+/**
+ * @brief Submit the job to NETGENPlugin_RemoteLauncher, its files must be written
+ *
+ * @param aParMesh the mesh
+ * @param mesher the mesher_launcher.py mesher (NETGEN2D, NETGEN3D)
+ * @param options mesher_launcher.py options other than the parallelism ones
+ * @param mergeChannels whether the error output goes to the log too
+ * @param runFirst whether to run the job before the already queued ones
+ */
+void NETGENPlugin_RemoteJob::Submit(SMESH_ParallelMesh&            aParMesh,
+                                    const std::string&             mesher,
+                                    const std::list<std::string>&  options,
+                                    bool                           mergeChannels,
+                                    bool                           runFirst)
+{
+  // Path to mesher script
+  fs::path mesher_launcher = fs::path(std::getenv("SMESH_ROOT_DIR"))/
+       fs::path("bin")/
+       fs::path("salome")/
+       fs::path("mesher_launcher.py");
+
+  std::string s_program="python3";
+  std::list<std::string> params;
+  params.push_back(mesher_launcher.string());
+  params.push_back(mesher);
+  params.push_back(input_mesh);
+  params.push_back(shape_file.string());
+  params.push_back(param_file.string());
+  params.insert(params.end(), options.begin(), options.end());
+  AddParallelismParams(aParMesh, params);
+
+  cmd = s_program;
+  for(auto arg: params){
+    cmd += " " + arg;
+  }
+  MESSAGE("Running command: ");
+  MESSAGE(cmd);
+  // Writing command in cmd.log
+  {
+    std::ofstream flog(cmd_file.string());
+    flog << cmd << std::endl;
+  }
+
+  id = NETGENPlugin_RemoteLauncher::Instance().Submit(s_program, params, log_file.string(),
+                                                      mergeChannels, runFirst);
+}
+
+/**
+ * @brief Stop the job if it is queued or running and remove its shared memory
+ *        segments. It does nothing to the process of an already waited job.
+ */
+void NETGENPlugin_RemoteJob::Cancel()
+{
+  if ( id )
+    NETGENPlugin_RemoteLauncher::Instance().Cancel(id);
+  id = 0;
+  NETGENPlugin_SharedMemory::Remove(input_mesh);
+  NETGENPlugin_SharedMemory::Remove(new_element_file.string());
+}
+
+/**
+ * @brief Wait for the jobs in the order they are over
+ *
+ * @param jobs the submitted jobs
+ * @param onJobDone function called with the index of each successful job
+ * @return std::string - error message on failed jobs
+ */
+std::string NETGENPlugin_RemoteJob::WaitAll(std::vector< NETGENPlugin_RemoteJob >& jobs,
+                                            const std::function< void( size_t ) >& onJobDone)
+{
+  NETGENPlugin_RemoteLauncher& launcher = NETGENPlugin_RemoteLauncher::Instance();
+  std::map< int, size_t > jobId2Index;
+  std::set< int >         jobIds;
+  for ( size_t i = 0; i < jobs.size(); ++i )
+  {
+    jobId2Index[ jobs[i].id ] = i;
+    jobIds.insert( jobs[i].id );
+  }
+
+  std::string msg;
+  int ret;
+  while ( int jobId = launcher.WaitAny( jobIds, ret ))
+  {
+    NETGENPlugin_RemoteJob& job = jobs[ jobId2Index[ jobId ]];
+    NETGENPlugin_SharedMemory::Remove(job.input_mesh);
+    if(ret != 0){
+      NETGENPlugin_SharedMemory::Remove(job.new_element_file.string());
+      // Run crahed
+      msg += "Issue with mesh_launcher: \n";
+      msg += "See log for more details: " + job.log_file.string() + "\n";
+      msg += job.cmd + "\n";
+      continue;
+    }
+    onJobDone( jobId2Index[ jobId ]);
+  }
+  return msg;
+}
+
+/**
+ * @brief Add to the list of mesher_launcher.py arguments those defining
+ *        the parallelism method
+ *
+ * @param aParMesh the mesh
+ * @param params the arguments
+ */
+void NETGENPlugin_RemoteJob::AddParallelismParams(SMESH_ParallelMesh&     aParMesh,
+                                                  std::list<std::string>& params)
+{
+  // Parallelism method parameters
+  int method = aParMesh.GetParallelismMethod();
+  if(method == ParallelismMethod::MultiThread){
+    params.push_back("--method=local");
+  } else if (method == ParallelismMethod::MultiNode){
+    params.push_back("--method=cluster");
+    params.push_back("--resource="+aParMesh.GetResource());
+    params.push_back("--wc-key="+aParMesh.GetWcKey());
+    params.push_back("--nb-proc=1");
+    params.push_back("--nb-proc-per-node="+std::to_string(aParMesh.GetNbProcPerNode()));
+    params.push_back("--nb-node="+std::to_string(aParMesh.GetNbNode()));
+    params.push_back("--walltime="+aParMesh.GetWalltime());
+  } else {
+    throw SALOME_Exception("Unknown parallelism method "+std::to_string(method));
+  }
+}
+
+/**
+ * @brief Add to the mesh the nodes and the elements written by run_mesher
+ *
+ * Nodes of the 2D mesher are numbered as in the mesh up to the number of
+ * premeshed nodes, nodes of the 3D mesher are numbered in the order of their IDs.
+ *
+ * @param aMesh The mesh
+ * @param aShape The shape the elements are to be set on
+ * @param new_element_file binary file written by run_mesher
+ * @param dim dimension of elements to add: 2 - triangles and quadrangles, 3 - tetrahedra
+ *
+ * Nothing is added if a node index is out of range, a compute error of aShape is set instead.
+ */
+void NETGENPlugin_RemoteJob::FillNewElements(SMESH_Mesh&         aMesh,
+                                             const TopoDS_Shape& aShape,
+                                             const std::string&  new_element_file,
+                                             const int           dim)
+{
+  SMESH_MeshLocker myLocker(&aMesh);
+  NETGENPlugin_NewElementsReader df(new_element_file);
+  if ( !df.IsOK() )
+    throw SALOME_Exception("Can't read elements from " + new_element_file);
+
+  SMESH_MesherHelper helper(aMesh);
+  // This function is mandatory for setElementsOnShape to work
+  helper.IsQuadraticSubMesh(aShape);
+  helper.SetElementsOnShape( true );
+
+  const int64_t totalPremeshedNodes = df.NbPremeshedNodes();
+  // Number of nodes in intial mesh
+  const int64_t NetgenNbOfNodes     = df.NbOldNodes();
+  // Number of nodes added by netgen
+  const int64_t NetgenNbOfNodesNew  = df.NbNodesNew();
+  // Max netgen index of a node
+  const int64_t NetgenMaxNodeIndex  = std::max( NetgenNbOfNodesNew, totalPremeshedNodes );
+
+  // Check netgen indices of nodes before adding anything
+  const int64_t* nodeIDs = df.NodeIDs();
+  bool isValid = true;
+  for (int64_t nodeIndex = 0; nodeIndex < NetgenNbOfNodes && isValid; ++nodeIndex )
+  {
+    const int64_t ngID = totalPremeshedNodes > 0 ? nodeIDs[ nodeIndex ] : nodeIndex + 1;
+    isValid = ( 0 < ngID && ngID <= NetgenMaxNodeIndex );
+  }
+  for ( int iBlock = 0; iBlock < df.NbBlocks() && isValid; ++iBlock )
+  {
+    const int64_t* NetgenElement = df.BlockConnectivity( iBlock );
+    const int64_t  nbIndices     = df.BlockNbElements( iBlock ) * df.BlockNbNodes( iBlock );
+    for ( int64_t i = 0; i < nbIndices && isValid; ++i )
+      isValid = ( 0 < NetgenElement[i] && NetgenElement[i] <= NetgenMaxNodeIndex );
+  }
+  if ( !isValid )
+  {
+    SMESH_subMesh* sm = aMesh.GetSubMesh( aShape );
+    sm->GetComputeError().reset
+      ( new SMESH_ComputeError( COMPERR_ALGO_FAILED, "Wrong node index in " + new_element_file ));
+    return;
+  }
+
+  // Filling nodevec (correspondence netgen numbering mesh numbering)
+  std::vector< const SMDS_MeshNode* > nodeVec ( NetgenMaxNodeIndex + 2 );
+  SMESHDS_Mesh * meshDS = helper.GetMeshDS();
+  for (int64_t nodeIndex = 0; nodeIndex < NetgenNbOfNodes; ++nodeIndex )
+  {
+    //Id of the point
+    const int64_t nodeID = nodeIDs[ nodeIndex ];
+    const int64_t ngID   = totalPremeshedNodes > 0 ? nodeID : nodeIndex + 1;
+    nodeVec[ngID] = meshDS->FindNode(nodeID);
+  }
+
+  // Add new points and update nodeVec
+  const double* NetgenPoint = df.Coords();
+  for (int64_t nodeIndex = std::max( totalPremeshedNodes, NetgenNbOfNodes ) + 1;
+       nodeIndex <= NetgenNbOfNodesNew;
+       ++nodeIndex )
+  {
+    nodeVec[nodeIndex] = helper.AddNode(NetgenPoint[0], NetgenPoint[1], NetgenPoint[2]);
+    NetgenPoint += 3;
+  }
+
+  // Add triangles and quadrangles or tetrahedra
+  for ( int iBlock = 0; iBlock < df.NbBlocks(); ++iBlock )
+  {
+    const int nbNodes = df.BlockNbNodes( iBlock );
+    if ( df.BlockDim( iBlock ) != dim )
+      continue;
+    if ( dim == 2 ? ( nbNodes != 3 && nbNodes != 4 ) : ( nbNodes != 4 ))
+      continue;
+    const int64_t* NetgenElement = df.BlockConnectivity( iBlock );
+    const int64_t  NetgenNbOfElements = df.BlockNbElements( iBlock );
+    std::vector< const SMDS_MeshNode* > nodes( nbNodes );
+    for ( int64_t elemIndex = 1; elemIndex <= NetgenNbOfElements; ++elemIndex, NetgenElement += nbNodes )
+    {
+      bool allNodes = true;
+      for ( int i = 0; i < nbNodes; ++i )
+        allNodes = ( nodes[i] = nodeVec[ NetgenElement[i] ]) && allNodes;
+      if ( !allNodes )
+        continue;
+      if ( dim == 3 )
+        helper.AddVolume( nodes[0], nodes[1], nodes[2], nodes[3] );
+      else if ( nbNodes == 3 )
+        helper.AddFace( nodes[0], nodes[1], nodes[2] );
+      else
+        helper.AddFace( nodes[0], nodes[1], nodes[2], nodes[3] );
+    }
+  }
+}
@@ -0,0 +1,80 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+
+//=============================================================================
+// File      : NETGENPlugin_RemoteJob.hxx
+// Project   : SALOME
+//=============================================================================
+//
+#ifndef _NETGENPlugin_REMOTEJOB_HXX_
+#define _NETGENPlugin_REMOTEJOB_HXX_
+
+#include "NETGENPlugin_Defs.hxx"
+
+#include <functional>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+class SMESH_Mesh;
+class SMESH_ParallelMesh;
+class TopoDS_Shape;
+
+/*!
+ * \brief Temporary folder and files of a run_mesher job of the remote
+ *        algorithms, submitted to NETGENPlugin_RemoteLauncher
+ */
+struct NETGENPLUGIN_EXPORT NETGENPlugin_RemoteJob
+{
+  boost::filesystem::path tmp_folder, element_orientation_file, new_element_file,
+    shape_file, param_file, log_file, cmd_file;
+  std::string input_mesh, cmd;
+  int id = 0; // given by NETGENPlugin_RemoteLauncher
+
+  // create the temporary folder and define the files in it
+  void Init(SMESH_ParallelMesh& aParMesh, const std::string& param_file_name);
+
+  // submit mesher_launcher.py to NETGENPlugin_RemoteLauncher
+  void Submit(SMESH_ParallelMesh&            aParMesh,
+              const std::string&             mesher,
+              const std::list<std::string>&  options,
+              bool                           mergeChannels,
+              bool                           runFirst = false);
+
+  // stop the job if it is queued or running and remove its shared memory segments
+  void Cancel();
+
+  // wait for jobs and call a function on each successful one as soon as it is over
+  static std::string WaitAll(std::vector< NETGENPlugin_RemoteJob >& jobs,
+                             const std::function< void( size_t ) >& onJobDone);
+
+  static void AddParallelismParams(SMESH_ParallelMesh&      aParMesh,
+                                   std::list<std::string>&  params);
+
+  // add to the mesh the nodes and the elements of a given dimension written by run_mesher
+  static void FillNewElements(SMESH_Mesh&         aMesh,
+                              const TopoDS_Shape& aShape,
+                              const std::string&  new_element_file,
+                              const int           dim);
+};
+
+#endif
@@ -0,0 +1,266 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+//=============================================================================
+// File      : NETGENPlugin_RemoteLauncher.cxx
+// Project   : SALOME
+//=============================================================================
+//
+//
+#include "NETGENPlugin_RemoteLauncher.hxx"
+
+#include <utilities.h>
+
+#include <QString>
+#include <QStringList>
+#include <QProcess>
+
+#include <algorithm>
+#include <cstdlib>
+
+/**
+ * @brief Return the launcher shared by all the remote algorithms
+ */
+NETGENPlugin_RemoteLauncher& NETGENPlugin_RemoteLauncher::Instance()
+{
+  static NETGENPlugin_RemoteLauncher theLauncher;
+  return theLauncher;
+}
+
+/**
+ * @brief Return true if the remote algorithms are to submit several jobs at once
+ *        (SALOME_NETGEN_REMOTE_ASYNC environment variable is set)
+ */
+bool NETGENPlugin_RemoteLauncher::IsAsyncEnabled()
+{
+  return std::getenv("SALOME_NETGEN_REMOTE_ASYNC");
+}
+
+/**
+ * @brief Return true if the volume job of a solid is to be submitted as soon as
+ *        the faces bounding it are meshed, before the surface meshing of other
+ *        solids is over (SALOME_NETGEN_REMOTE_PIPELINE environment variable is
+ *        set along with SALOME_NETGEN_REMOTE_ASYNC)
+ */
+bool NETGENPlugin_RemoteLauncher::IsPipelineEnabled()
+{
+  return IsAsyncEnabled() && std::getenv("SALOME_NETGEN_REMOTE_PIPELINE");
+}
+
+/**
+ * @brief Return the maximal number of processes running at once.
+ *
+ * It is given by SALOME_NETGEN_REMOTE_MAX_JOBS environment variable and
+ * defaults to the number of cores.
+ */
+int NETGENPlugin_RemoteLauncher::MaxJobs()
+{
+  int nbJobs = 0;
+  if ( const char* maxJobs = std::getenv("SALOME_NETGEN_REMOTE_MAX_JOBS"))
+    nbJobs = std::atoi( maxJobs );
+  if ( nbJobs < 1 )
+    nbJobs = std::thread::hardware_concurrency();
+  return std::max( 1, nbJobs );
+}
+
+NETGENPlugin_RemoteLauncher::NETGENPlugin_RemoteLauncher():
+  _lastId(0), _stop(false)
+{
+}
+
+NETGENPlugin_RemoteLauncher::~NETGENPlugin_RemoteLauncher()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _jobQueued.notify_all();
+  for ( std::thread& t : _threads )
+    t.join();
+}
+
+/**
+ * @brief Queue a process to run
+ *
+ * @param program the program
+ * @param arguments its arguments
+ * @param log_file file the standard output of the process is written to
+ * @param mergeChannels if true the standard error is written to log_file as well,
+ *        else it is forwarded to the one of the current process
+ * @param runFirst if true the job is run before the already queued ones
+ * @return the job identifier to give to Wait() or WaitAny()
+ */
+int NETGENPlugin_RemoteLauncher::Submit(const std::string&            program,
+                                        const std::list<std::string>& arguments,
+                                        const std::string&            log_file,
+                                        bool                          mergeChannels,
+                                        bool                          runFirst)
+{
+  int jobId;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    jobId = ++_lastId;
+    if ( runFirst )
+      _queue.push_front( Job{ jobId, program, arguments, log_file, mergeChannels });
+    else
+      _queue.push_back( Job{ jobId, program, arguments, log_file, mergeChannels });
+
+    // threads are started on demand up to the size of the window
+    if ((int) _threads.size() < MaxJobs() )
+      _threads.emplace_back( &NETGENPlugin_RemoteLauncher::runJobs, this );
+  }
+  _jobQueued.notify_one();
+  return jobId;
+}
+
+/**
+ * @brief Wait for the end of a job
+ *
+ * @param jobId the job identifier returned by Submit()
+ * @return the exit code of the process, -1 if it crashed
+ */
+int NETGENPlugin_RemoteLauncher::Wait(const int jobId)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _jobDone.wait( lock, [&]{ return _exitCodes.count( jobId ); });
+
+  int exitCode = _exitCodes[ jobId ];
+  _exitCodes.erase( jobId );
+  return exitCode;
+}
+
+/**
+ * @brief Wait for the end of any of given jobs
+ *
+ * @param jobIds the identifiers of jobs to wait for. The finished job is removed from it
+ * @param exitCode the exit code of the finished process, -1 if it crashed
+ * @return the identifier of the finished job, 0 if jobIds is empty
+ */
+int NETGENPlugin_RemoteLauncher::WaitAny(std::set<int>& jobIds, int& exitCode)
+{
+  if ( jobIds.empty() )
+    return 0;
+
+  int doneId = 0;
+  std::unique_lock<std::mutex> lock(_mutex);
+  _jobDone.wait( lock, [&]
+  {
+    for ( int id : jobIds )
+      if ( _exitCodes.count( id ))
+      {
+        doneId = id;
+        return true;
+      }
+    return false;
+  });
+
+  exitCode = _exitCodes[ doneId ];
+  _exitCodes.erase( doneId );
+  jobIds.erase( doneId );
+  return doneId;
+}
+
+/**
+ * @brief Cancel a job: remove it from the queue or kill its process and
+ *        wait for its end. Nothing is done for an already waited job.
+ *
+ * @param jobId the job identifier returned by Submit()
+ */
+void NETGENPlugin_RemoteLauncher::Cancel(const int jobId)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  auto queued = std::find_if( _queue.begin(), _queue.end(),
+                              [jobId]( const Job& job ) { return job._id == jobId; });
+  if ( queued != _queue.end() )
+  {
+    _queue.erase( queued );
+    return;
+  }
+  if ( _running.count( jobId ))
+  {
+    _canceled.insert( jobId );
+    _jobDone.wait( lock, [&]{ return _exitCodes.count( jobId ); });
+  }
+  _exitCodes.erase( jobId );
+}
+
+/**
+ * @brief Check if the process of a running job is to be killed
+ */
+bool NETGENPlugin_RemoteLauncher::isCanceled(const int jobId)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _canceled.count( jobId );
+}
+
+/**
+ * @brief Loop of a launcher thread: run queued processes one by one
+ */
+void NETGENPlugin_RemoteLauncher::runJobs()
+{
+  while ( true )
+  {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _jobQueued.wait( lock, [&]{ return _stop || !_queue.empty(); });
+      if ( _queue.empty() )
+        return;
+      job = std::move( _queue.front() );
+      _queue.pop_front();
+      _running.insert( job._id );
+    }
+
+    QStringList arguments;
+    for ( const std::string& arg : job._arguments )
+      arguments << arg.c_str();
+
+    QProcess myProcess;
+    myProcess.setProcessChannelMode( job._mergeChannels ?
+                                     QProcess::MergedChannels : QProcess::ForwardedChannels );
+    myProcess.setStandardOutputFile( QString::fromStdString( job._logFile ));
+
+    MESSAGE("Launching job " << job._id);
+    myProcess.start( QString::fromStdString( job._program ), arguments );
+    // Waiting for process to finish, it is killed if the job is canceled
+    const int pollTime = 100; // msec
+    bool finished = false;
+    while ( !finished && myProcess.state() != QProcess::NotRunning )
+    {
+      finished = myProcess.waitForFinished( pollTime );
+      if ( !finished && isCanceled( job._id ))
+      {
+        MESSAGE("Killing job " << job._id);
+        myProcess.kill();
+        myProcess.waitForFinished(-1);
+      }
+    }
+    int exitCode = -1;
+    if ( finished && myProcess.exitStatus() == QProcess::NormalExit )
+      exitCode = myProcess.exitCode();
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _exitCodes[ job._id ] = exitCode;
+      _running.erase( job._id );
+      _canceled.erase( job._id );
+    }
+    _jobDone.notify_all();
+  }
+}
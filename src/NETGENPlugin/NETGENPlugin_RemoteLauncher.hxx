@@ -0,0 +1,103 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+//=============================================================================
+// File      : NETGENPlugin_RemoteLauncher.hxx
+// Project   : SALOME
+//=============================================================================
+//
+#ifndef _NETGENPlugin_REMOTELAUNCHER_HXX_
+#define _NETGENPlugin_REMOTELAUNCHER_HXX_
+
+#include "NETGENPlugin_Defs.hxx"
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*!
+ * \brief Asynchronous launcher of the mesher_launcher.py processes of the
+ *        remote algorithms.
+ *
+ * Submitted jobs are queued and at most MaxJobs() processes run at once.
+ * A job can be waited for as soon as it is submitted, results are available
+ * in the order the processes finish, not in the order of submission.
+ */
+class NETGENPLUGIN_EXPORT NETGENPlugin_RemoteLauncher
+{
+ public:
+
+  static NETGENPlugin_RemoteLauncher& Instance();
+
+  static bool IsAsyncEnabled();
+
+  static bool IsPipelineEnabled();
+
+  static int MaxJobs();
+
+  int Submit(const std::string&            program,
+             const std::list<std::string>& arguments,
+             const std::string&            log_file,
+             bool                          mergeChannels,
+             bool                          runFirst = false);
+
+  int Wait(const int jobId);
+
+  int WaitAny(std::set<int>& jobIds, int& exitCode);
+
+  void Cancel(const int jobId);
+
+  ~NETGENPlugin_RemoteLauncher();
+
+ private:
+
+  NETGENPlugin_RemoteLauncher();
+
+  struct Job
+  {
+    int                    _id;
+    std::string            _program;
+    std::list<std::string> _arguments;
+    std::string            _logFile;
+    bool                   _mergeChannels;
+  };
+
+  void runJobs();
+
+  bool isCanceled(const int jobId);
+
+  std::mutex               _mutex;
+  std::condition_variable  _jobQueued;
+  std::condition_variable  _jobDone;
+  std::deque< Job >        _queue;
+  std::map< int, int >     _exitCodes; // of finished jobs
+  std::set< int >          _running;
+  std::set< int >          _canceled;  // running jobs to kill
+  std::vector<std::thread> _threads;
+  int                      _lastId;
+  bool                     _stop;
+};
+
+#endif
@@ -0,0 +1,296 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+//=============================================================================
+// File      : NETGENPlugin_ResultCache.cxx
+// Project   : SALOME
+//=============================================================================
+//
+//
+#include "NETGENPlugin_ResultCache.hxx"
+
+#include "NETGENPlugin_SharedMemory.hxx"
+
+#include <utilities.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+#ifdef WIN32
+#include <filesystem>
+namespace fs = std::filesystem;
+#else
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+#endif
+
+namespace
+{
+  //! read the whole content of a file or a shared memory segment
+  bool readPayload( const std::string& file, std::vector<char>& payload )
+  {
+    if ( NETGENPlugin_SharedMemory::IsSharedMemory( file ))
+    {
+      NETGENPlugin_SharedMemory shm;
+      if ( !shm.Open( file ))
+        return false;
+      payload.assign( shm.Data(), shm.Data() + shm.Size() );
+      return true;
+    }
+    std::ifstream df( file, std::ios::in|std::ios::binary );
+    if ( !df )
+      return false;
+    payload.assign( std::istreambuf_iterator<char>( df ), std::istreambuf_iterator<char>() );
+    return !payload.empty();
+  }
+
+  //! write data to a file or a shared memory segment
+  bool writePayload( const std::string& file, const std::vector<char>& payload )
+  {
+    if ( NETGENPlugin_SharedMemory::IsSharedMemory( file ))
+    {
+      NETGENPlugin_SharedMemory shm;
+      if ( !shm.Create( file, payload.size(), /*removeOnClose=*/false ))
+        return false;
+      std::memcpy( shm.Data(), payload.data(), payload.size() );
+      return true;
+    }
+    std::ofstream df( file, std::ios::out|std::ios::binary );
+    df.write( payload.data(), payload.size() );
+    return df.good();
+  }
+
+  //! mark a cache entry as used now
+  void touch( const fs::path& entry )
+  {
+#ifdef WIN32
+    fs::last_write_time( entry, fs::file_time_type::clock::now() );
+#else
+    fs::last_write_time( entry, std::time(0) );
+#endif
+  }
+}
+
+NETGENPlugin_ResultCache::Key::Key():
+  _h1( 0xcbf29ce484222325ULL ), _h2( 0 )
+{
+}
+
+/**
+ * @brief Add data to hash
+ */
+void NETGENPlugin_ResultCache::Key::Add(const void* data, size_t size)
+{
+  const unsigned char* bytes = (const unsigned char*) data;
+  for ( size_t i = 0; i < size; ++i )
+  {
+    // FNV-1a
+    _h1 = ( _h1 ^ bytes[i] ) * 0x100000001b3ULL;
+    // FxHash
+    _h2 = ((( _h2 << 5 ) | ( _h2 >> 59 )) ^ bytes[i] ) * 0x9e3779b97f4a7c15ULL;
+  }
+}
+
+/**
+ * @brief Add the content of a file to hash
+ *
+ * @return false if the file can't be read
+ */
+bool NETGENPlugin_ResultCache::Key::AddFile(const std::string& file)
+{
+  std::ifstream df( file, std::ios::in|std::ios::binary );
+  if ( !df )
+    return false;
+  char buffer[ 65536 ];
+  size_t size = 0;
+  while ( df.read( buffer, sizeof( buffer )) || df.gcount() > 0 )
+  {
+    Add( buffer, df.gcount() );
+    size += df.gcount();
+  }
+  Add( size );
+  return true;
+}
+
+/**
+ * @brief Return the hash as a string of hexadecimal digits
+ */
+std::string NETGENPlugin_ResultCache::Key::ToString() const
+{
+  std::ostringstream s;
+  s << std::hex << std::setfill('0') << std::setw(16) << _h1 << std::setw(16) << _h2;
+  return s.str();
+}
+
+/**
+ * @brief Return true if SALOME_NETGEN_CACHE_DIR environment variable is set
+ */
+bool NETGENPlugin_ResultCache::IsEnabled()
+{
+  return std::getenv("SALOME_NETGEN_CACHE_DIR");
+}
+
+NETGENPlugin_ResultCache::NETGENPlugin_ResultCache():
+  _maxSize( 1024 )
+{
+  if ( const char* dir = std::getenv("SALOME_NETGEN_CACHE_DIR"))
+    _dir = dir;
+  if ( const char* size = std::getenv("SALOME_NETGEN_CACHE_SIZE"))
+    _maxSize = std::max( 1, std::atoi( size ));
+  _maxSize *= 1024 * 1024;
+}
+
+/**
+ * @brief Copy the cached data to new_element_file
+ *
+ * @param key the hash of the input data
+ * @param new_element_file the file or the shared memory segment to write
+ * @return true if the data was found in the cache
+ */
+bool NETGENPlugin_ResultCache::Fetch(const Key& key, const std::string& new_element_file)
+{
+  std::vector<char> payload;
+  return Fetch( key, payload ) && writePayload( new_element_file, payload );
+}
+
+/**
+ * @brief Store the data written to new_element_file
+ *
+ * @param key the hash of the input data
+ * @param new_element_file the file or the shared memory segment to read
+ * @return true if the data is stored
+ */
+bool NETGENPlugin_ResultCache::Store(const Key& key, const std::string& new_element_file)
+{
+  std::vector<char> payload;
+  return readPayload( new_element_file, payload ) && Store( key, payload );
+}
+
+/**
+ * @brief Read the cached data
+ *
+ * @param key the hash of the input data
+ * @param data the read data
+ * @return true if the data was found in the cache
+ */
+bool NETGENPlugin_ResultCache::Fetch(const Key& key, std::vector<char>& data)
+{
+  if ( _dir.empty() )
+    return false;
+  try
+  {
+    fs::path entry = fs::path( _dir ) / fs::path( key.ToString() + ".dat" );
+    if ( !fs::exists( entry ) || !readPayload( entry.string(), data ))
+      return false;
+    touch( entry );
+    MESSAGE("Result found in cache: " << entry.string());
+    return true;
+  }
+  catch ( std::exception& ex )
+  {
+    MESSAGE("Cache error: " << ex.what());
+  }
+  return false;
+}
+
+/**
+ * @brief Store data in the cache
+ *
+ * @param key the hash of the input data
+ * @param data the data to store
+ * @return true if the data is stored
+ */
+bool NETGENPlugin_ResultCache::Store(const Key& key, const std::vector<char>& data)
+{
+  if ( _dir.empty() || data.empty() || data.size() > _maxSize )
+    return false;
+  try
+  {
+    fs::create_directories( _dir );
+    fs::path entry = fs::path( _dir ) / fs::path( key.ToString() + ".dat" );
+#ifdef WIN32
+    fs::path tmp = fs::path( _dir ) / fs::path( key.ToString() + ".tmp" );
+#else
+    fs::path tmp = fs::path( _dir ) / fs::unique_path( fs::path( key.ToString() + "-%%%%-%%%%.tmp" ));
+#endif
+    // several runners may store at once, so an entry is written aside then renamed
+    if ( !writePayload( tmp.string(), data ))
+    {
+      fs::remove( tmp );
+      return false;
+    }
+    fs::rename( tmp, entry );
+
+    evict();
+    return true;
+  }
+  catch ( std::exception& ex )
+  {
+    MESSAGE("Cache error: " << ex.what());
+  }
+  return false;
+}
+
+/**
+ * @brief Remove the least recently used entries while the cache is too large
+ */
+void NETGENPlugin_ResultCache::evict()
+{
+  struct TEntry
+  {
+    fs::path  _path;
+    uintmax_t _size;
+    decltype( fs::last_write_time( fs::path() )) _time;
+  };
+  std::vector< TEntry > entries;
+  uintmax_t totalSize = 0;
+  for ( fs::directory_iterator it( _dir ), end; it != end; ++it )
+  {
+    if ( it->path().extension() != ".dat" )
+      continue;
+    TEntry entry{ it->path(), fs::file_size( it->path() ), fs::last_write_time( it->path() )};
+    totalSize += entry._size;
+    entries.push_back( entry );
+  }
+  if ( totalSize <= _maxSize )
+    return;
+
+  std::sort( entries.begin(), entries.end(),
+             []( const TEntry& e1, const TEntry& e2 ) { return e1._time < e2._time; });
+  for ( const TEntry& entry : entries )
+  {
+    if ( totalSize <= _maxSize )
+      break;
+    try
+    {
+      fs::remove( entry._path ); // may be already removed by another runner
+    }
+    catch ( std::exception& )
+    {
+    }
+    totalSize -= entry._size;
+  }
+}
@@ -0,0 +1,92 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+//=============================================================================
+// File      : NETGENPlugin_ResultCache.hxx
+// Project   : SALOME
+//=============================================================================
+//
+#ifndef _NETGENPlugin_RESULTCACHE_HXX_
+#define _NETGENPlugin_RESULTCACHE_HXX_
+
+#include "NETGENPlugin_Defs.hxx"
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/*!
+ * \brief Cache of new_elements data computed by the standalone meshers
+ *        and of other data expensive to recompute, e.g. size restrictions.
+ *
+ * The data is stored in a directory given by SALOME_NETGEN_CACHE_DIR
+ * environment variable, under a name made of a hash of everything the
+ * result depends on. The size of the directory is limited by
+ * SALOME_NETGEN_CACHE_SIZE (in MB, 1024 by default); the least recently
+ * used entries are removed when it is exceeded.
+ */
+class NETGENPLUGIN_EXPORT NETGENPlugin_ResultCache
+{
+ public:
+
+  /*!
+   * \brief 128 bits hash of the input data of a mesher
+   */
+  class NETGENPLUGIN_EXPORT Key
+  {
+   public:
+    Key();
+
+    void Add(const void* data, size_t size);
+    void Add(const std::string& s) { Add( s.data(), s.size() ); Add( s.size() ); }
+    template< typename T >
+    typename std::enable_if< std::is_arithmetic< T >::value >::type Add(const T value)
+    {
+      Add( &value, sizeof( value ));
+    }
+    bool AddFile(const std::string& file);
+
+    std::string ToString() const;
+
+   private:
+    uint64_t _h1, _h2;
+  };
+
+  NETGENPlugin_ResultCache();
+
+  static bool IsEnabled();
+
+  bool Fetch(const Key& key, const std::string& new_element_file);
+
+  bool Store(const Key& key, const std::string& new_element_file);
+
+  bool Fetch(const Key& key, std::vector<char>& data);
+
+  bool Store(const Key& key, const std::vector<char>& data);
+
+ private:
+
+  void evict();
+
+  std::string _dir;
+  uintmax_t   _maxSize;
+};
+
+#endif
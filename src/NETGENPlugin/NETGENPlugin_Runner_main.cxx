@@ -28,11 +28,248 @@
 #include "NETGENPlugin_NETGEN_2D_SA.hxx"
 #include "NETGENPlugin_NETGEN_3D_SA.hxx"
 #include "NETGENPlugin_NETGEN_1D2D3D_SA.hxx"
+#include "NETGENPlugin_BoundaryFile.hxx"
+
+#include <SMESH_DriverMesh.hxx>
+#include <SMESH_Gen.hxx>
+#include <SMESH_Mesh.hxx>
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <chrono>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#ifndef WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  /**
+   * @brief Arguments of a run of a mesher
+   */
+  struct TMesherJob
+  {
+    std::string mesher;
+    std::string input_mesh_file;
+    std::string shape_file;
+    std::string hypo_file;
+    std::string element_orientation_file;
+    std::string new_element_file;
+    std::string output_mesh_file;
+  };
+
+  /**
+   * @brief Run a mesher
+   *
+   * @param job the arguments, NONE meaning an empty one
+   * @param inputMesh the already loaded input mesh, if any
+   * @return error code
+   */
+  int runMesher(TMesherJob job, SMESH_Mesh* inputMesh = 0)
+  {
+    if (job.output_mesh_file == "NONE")
+      job.output_mesh_file = "";
+    if (job.element_orientation_file == "NONE")
+      job.element_orientation_file = "";
+    if (job.new_element_file == "NONE")
+      job.new_element_file = "";
+    int ret = 0;
+    if (job.mesher=="NETGEN3D"){
+      NETGENPlugin_NETGEN_3D_SA myplugin;
+      if ( inputMesh )
+        ret = myplugin.runOnMesh(*inputMesh,
+                                 job.shape_file,
+                                 job.hypo_file,
+                                 job.element_orientation_file,
+                                 job.new_element_file,
+                                 job.output_mesh_file );
+      else
+        ret = myplugin.run(job.input_mesh_file,
+                           job.shape_file,
+                           job.hypo_file,
+                           job.element_orientation_file,
+                           job.new_element_file,
+                           job.output_mesh_file );
+    }
+    else if ( job.mesher=="NETGEN1D" ||
+              job.mesher=="NETGEN1D2D" ||
+              job.mesher=="NETGEN1D2D3D" )
+    {
+      NETGENPlugin_NETGEN_1D2D3D_SA myplugin;
+      NETGENPlugin_Mesher::DIM DIM = job.mesher=="NETGEN1D" ? NETGENPlugin_Mesher::D1
+                                      : ( job.mesher=="NETGEN1D2D" ? NETGENPlugin_Mesher::D2
+                                      : NETGENPlugin_Mesher::D3 );
+      if ( inputMesh )
+        ret = myplugin.runOnMesh(*inputMesh,
+                                 job.shape_file,
+                                 job.hypo_file,
+                                 job.element_orientation_file,
+                                 job.new_element_file,
+                                 job.output_mesh_file,
+                                 DIM );
+      else
+        ret = myplugin.run(job.input_mesh_file,
+                           job.shape_file,
+                           job.hypo_file,
+                           job.element_orientation_file,
+                           job.new_element_file,
+                           job.output_mesh_file,
+                           DIM );
+    }
+    else if ( job.mesher=="NETGEN2D" )
+    {
+      NETGENPlugin_NETGEN_2D_SA myplugin;
+      if ( inputMesh )
+        ret = myplugin.runOnMesh(*inputMesh,
+                                 job.shape_file,
+                                 job.hypo_file,
+                                 job.element_orientation_file,
+                                 job.new_element_file,
+                                 job.output_mesh_file );
+      else
+        ret = myplugin.run(job.input_mesh_file,
+                           job.shape_file,
+                           job.hypo_file,
+                           job.element_orientation_file,
+                           job.new_element_file,
+                           job.output_mesh_file );
+    }
+    else {
+      std::cerr << "Unknown mesher:" << job.mesher << std::endl;
+      return 1;
+    }
+    return ret;
+  }
+
+  /**
+   * @brief Run the jobs listed in a manifest file
+   *
+   * Each non empty line of the manifest, except those starting with '#',
+   * holds the seven arguments of a run separated by blanks.
+   *
+   * Netgen is not reentrant, hence each job runs in its own process forked
+   * from this one, so that its netgen context is isolated. At most nbWorkers
+   * jobs run at once, a new one is started as soon as one is over. An input
+   * mesh used by several jobs is loaded once before forking, each job
+   * getting its own copy-on-write image of it.
+   *
+   * @param manifest_file the manifest file
+   * @param nbWorkers maximal number of jobs running at once
+   * @return error code, 0 if all the jobs succeeded
+   */
+  int runBatch(const std::string& manifest_file, int nbWorkers)
+  {
+    std::ifstream manifest(manifest_file);
+    if ( !manifest )
+    {
+      std::cerr << "Can't read " << manifest_file << std::endl;
+      return 1;
+    }
+    std::vector< TMesherJob > jobs;
+    std::string line;
+    while ( std::getline( manifest, line ))
+    {
+      std::istringstream args( line );
+      TMesherJob job;
+      if ( !( args >> job.mesher ) || job.mesher[0] == '#' )
+        continue;
+      if ( !( args >> job.input_mesh_file >> job.shape_file >> job.hypo_file
+                   >> job.element_orientation_file >> job.new_element_file >> job.output_mesh_file ))
+      {
+        std::cerr << "Wrong job in " << manifest_file << ": " << line << std::endl;
+        return 1;
+      }
+      jobs.push_back( job );
+    }
+
+    std::vector< int > results( jobs.size(), 1 );
+
+#ifdef WIN32
+    // no fork(): run the jobs one by one
+    for ( size_t i = 0; i < jobs.size(); ++i )
+      results[i] = runMesher( jobs[i] );
+#else
+    // load once the input meshes shared by several jobs
+    std::map< std::string, int > nbUses;
+    for ( const TMesherJob& job : jobs )
+      if ( job.input_mesh_file != "NONE" &&
+           !NETGENPlugin_BoundaryReader::IsBoundaryFile( job.input_mesh_file ))
+        ++nbUses[ job.input_mesh_file ];
+
+    SMESH_Gen gen;
+    std::map< std::string, std::unique_ptr< SMESH_Mesh > > sharedMeshes;
+    for ( auto const& [file, nb] : nbUses )
+      if ( nb > 1 )
+      {
+        sharedMeshes[ file ].reset( gen.CreateMesh( false ));
+        SMESH_DriverMesh::importMesh( file, *sharedMeshes[ file ]);
+      }
+
+    std::map< pid_t, size_t > runningJobs;
+    size_t nextJob = 0;
+    while ( nextJob < jobs.size() || !runningJobs.empty() )
+    {
+      while ( nextJob < jobs.size() && (int) runningJobs.size() < nbWorkers )
+      {
+        auto mesh = sharedMeshes.find( jobs[ nextJob ].input_mesh_file );
+        pid_t pid = fork();
+        if ( pid == 0 )
+        {
+          int ret = 1;
+          try
+          {
+            ret = runMesher( jobs[ nextJob ], mesh == sharedMeshes.end() ? 0 : mesh->second.get() );
+          }
+          catch ( std::exception& ex )
+          {
+            std::cerr << "Meshing failed: " << ex.what() << std::endl;
+          }
+          catch (...)
+          {
+            std::cerr << "Meshing failed" << std::endl;
+          }
+          std::cout.flush();
+          std::cerr.flush();
+          _exit( ret == 0 ? 0 : 1 );
+        }
+        if ( pid < 0 )
+          std::cerr << "Can't start job " << nextJob << std::endl;
+        else
+          runningJobs[ pid ] = nextJob;
+        ++nextJob;
+      }
+
+      int status;
+      pid_t pid = waitpid( -1, &status, 0 );
+      if ( pid < 0 )
+        break;
+      auto pid2job = runningJobs.find( pid );
+      if ( pid2job == runningJobs.end() )
+        continue;
+      results[ pid2job->second ] = WIFEXITED( status ) ? WEXITSTATUS( status ) : -1;
+      runningJobs.erase( pid2job );
+    }
+#endif
+
+    int nbFailed = 0;
+    for ( size_t i = 0; i < jobs.size(); ++i )
+    {
+      std::cout << "NETGEN_BATCH_JOB " << i << " " << results[i] << std::endl;
+      nbFailed += ( results[i] != 0 );
+    }
+    return nbFailed > 0;
+  }
+}
 
 /**
  * @brief Main function
@@ -44,12 +281,40 @@
  */
 int main(int argc, char *argv[]){
 
+  // Worker mode: the mesh and the shape are loaded once then jobs are read
+  // from the standard input until it is closed
+  if(argc==5 && strcmp(argv[1], "--worker") == 0){
+    std::string mesher=argv[2];
+    std::string input_mesh_file=argv[3];
+    std::string shape_file=argv[4];
+    if (mesher!="NETGEN3D"){
+      std::cerr << "Worker mode is not available for mesher:" << mesher << std::endl;
+      return 1;
+    }
+    // Replies are written on the original standard output as netgen
+    // redirects std::cout while meshing
+    std::ostream replies(std::cout.rdbuf());
+    NETGENPlugin_NETGEN_3D_SA myplugin;
+    return myplugin.runWorker(input_mesh_file,
+                              shape_file,
+                              std::cin,
+                              replies);
+  }
+
+  // Batch mode: several jobs listed in a manifest file are run in parallel
+  if((argc==3 || argc==4) && strcmp(argv[1], "--batch") == 0){
+    int nbWorkers = argc==4 ? atoi(argv[3]) : (int) std::thread::hardware_concurrency();
+    return runBatch(argv[2], std::max(1, nbWorkers));
+  }
+
   if(argc!=8||(argc==2 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help")==0))){
     std::cout << "Error in number of arguments "<< argc-1<<" given expected 7" <<std::endl;
     std::cout << "Syntax:"<<std::endl;
     std::cout << "run_mesher MESHER INPUT_MESH_FILE SHAPE_FILE HYPO_FILE" << std::endl;
     std::cout << "           ELEM_ORIENT_FILE " << std::endl;
     std::cout << "           NEW_ELEMENT_FILE OUTPUT_MESH_FILE" << std::endl;
+    std::cout << "run_mesher --worker NETGEN3D INPUT_MESH_FILE SHAPE_FILE" << std::endl;
+    std::cout << "run_mesher --batch MANIFEST_FILE [NB_WORKERS]" << std::endl;
     std::cout << std::endl;
     std::cout << " Set argument to NONE to ignore them " << std::endl;
     std::cout << std::endl;
@@ -61,65 +326,33 @@ int main(int argc, char *argv[]){
     std::cout << "  (optional) ELEM_ORIENT_FILE: binary file containing the list of element from INPUT_MESH_FILE associated to the shape and their orientation" << std::endl;
     std::cout << "  (optional) NEW_ELEMENT_FILE: (out) contains elements and nodes added by the meshing" << std::endl;
     std::cout << "  (optional) OUTPUT_MESH_FILE: (out) MED File containing the mesh after the run of the mesher" << std::endl;
+    std::cout << std::endl;
+    std::cout << "For NETGEN3D, INPUT_MESH_FILE may also contain the boundary of the solid" << std::endl;
+    std::cout << "with the orientation of its elements, ELEM_ORIENT_FILE is then ignored." << std::endl;
+    std::cout << "INPUT_MESH_FILE and NEW_ELEMENT_FILE starting with \"shm:\" designate" << std::endl;
+    std::cout << "POSIX shared memory segments instead of files." << std::endl;
+    std::cout << std::endl;
+    std::cout << "Worker mode:" << std::endl;
+    std::cout << "  INPUT_MESH_FILE and SHAPE_FILE are loaded once, then each job is read" << std::endl;
+    std::cout << "  from the standard input as four lines: SOLID_INDEX HYPO_FILE" << std::endl;
+    std::cout << "  ELEM_ORIENT_FILE NEW_ELEMENT_FILE. \"NETGEN_WORKER_DONE <error code>\" is" << std::endl;
+    std::cout << "  written on the standard output at the end of each job." << std::endl;
+    std::cout << std::endl;
+    std::cout << "Batch mode:" << std::endl;
+    std::cout << "  Each line of MANIFEST_FILE holds the seven arguments of a run. At most" << std::endl;
+    std::cout << "  NB_WORKERS (default: number of cores) runs are done at once, each one in" << std::endl;
+    std::cout << "  its own process. \"NETGEN_BATCH_JOB <index> <error code>\" is written" << std::endl;
+    std::cout << "  on the standard output for each job." << std::endl;
     return 1;
   }
-  std::string mesher=argv[1];
-  std::string input_mesh_file=argv[2];
-  std::string shape_file=argv[3];
-  std::string hypo_file=argv[4];
-  std::string element_orientation_file=argv[5];
-  std::string new_element_file=argv[6];
-  std::string output_mesh_file=argv[7];
-
-  //std::string thing;
-  //std::cin >> thing;
-
-  if (output_mesh_file == "NONE")
-    output_mesh_file = "";
-  if (element_orientation_file == "NONE")
-    element_orientation_file = "";
-  if (new_element_file == "NONE")
-    new_element_file = "";
-  int ret = 0;
-  if (mesher=="NETGEN3D"){
-    NETGENPlugin_NETGEN_3D_SA myplugin;
-    ret = myplugin.run(input_mesh_file,
-             shape_file,
-             hypo_file,
-             element_orientation_file,
-             new_element_file,
-             output_mesh_file );
-  }
-  else if ( mesher=="NETGEN1D" || 
-            mesher=="NETGEN1D2D" || 
-            mesher=="NETGEN1D2D3D" ) 
-  {
-    NETGENPlugin_NETGEN_1D2D3D_SA myplugin;    
-    NETGENPlugin_Mesher::DIM DIM = mesher=="NETGEN1D" ? NETGENPlugin_Mesher::D1 
-                                    : ( mesher=="NETGEN1D2D" ? NETGENPlugin_Mesher::D2 
-                                    : NETGENPlugin_Mesher::D3 );
-
-    ret = myplugin.run(input_mesh_file,
-                  shape_file,
-                  hypo_file,
-                  element_orientation_file,
-                  new_element_file,
-                  output_mesh_file, 
-                  DIM );
-  } 
-  else if ( mesher=="NETGEN2D" ) 
-  {
-    NETGENPlugin_NETGEN_2D_SA myplugin;    
-    ret = myplugin.run(input_mesh_file,
-                  shape_file,
-                  hypo_file,
-                  element_orientation_file,
-                  new_element_file,
-                  output_mesh_file );
-  }  
-  else {
-    std::cerr << "Unknown mesher:" << mesher << std::endl;
-    return 1;
-  }
-  return ret;
+  TMesherJob job;
+  job.mesher=argv[1];
+  job.input_mesh_file=argv[2];
+  job.shape_file=argv[3];
+  job.hypo_file=argv[4];
+  job.element_orientation_file=argv[5];
+  job.new_element_file=argv[6];
+  job.output_mesh_file=argv[7];
+
+  return runMesher(job);
 }
@@ -0,0 +1,216 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+//=============================================================================
+// File      : NETGENPlugin_SharedMemory.cxx
+// Project   : SALOME
+//=============================================================================
+//
+//
+#include "NETGENPlugin_SharedMemory.hxx"
+
+#include <utilities.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <sstream>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  const char   theShmPrefix[] = "shm:";
+  const size_t theShmPrefixLen = sizeof( theShmPrefix ) - 1;
+
+  //! return name of a segment for shm_open()
+  std::string shmName( const std::string& path )
+  {
+    return path.substr( theShmPrefixLen );
+  }
+}
+
+NETGENPlugin_SharedMemory::NETGENPlugin_SharedMemory():
+  _data(0), _size(0), _isOwner(false)
+{
+}
+
+NETGENPlugin_SharedMemory::~NETGENPlugin_SharedMemory()
+{
+  Close();
+  if ( _isOwner )
+    Unlink();
+}
+
+/**
+ * @brief Return true if the remote algorithms are to exchange data with run_mesher
+ *        via shared memory (SALOME_NETGEN_REMOTE_SHM environment variable is set)
+ */
+bool NETGENPlugin_SharedMemory::IsEnabled()
+{
+#ifdef WIN32
+  return false;
+#else
+  return std::getenv("SALOME_NETGEN_REMOTE_SHM");
+#endif
+}
+
+/**
+ * @brief Check if a file name designates a shared memory segment
+ */
+bool NETGENPlugin_SharedMemory::IsSharedMemory(const std::string& path)
+{
+  return path.compare( 0, theShmPrefixLen, theShmPrefix ) == 0;
+}
+
+/**
+ * @brief Return a name of a new segment unique within the session
+ */
+std::string NETGENPlugin_SharedMemory::NewName()
+{
+  static std::atomic<int> theCounter( 0 );
+  std::ostringstream name;
+  name << theShmPrefix << "/NETGEN_";
+#ifndef WIN32
+  name << getpid() << "_";
+#endif
+  name << ++theCounter;
+  return name.str();
+}
+
+/**
+ * @brief Remove a segment, e.g. left by a failed run_mesher
+ */
+void NETGENPlugin_SharedMemory::Remove(const std::string& path)
+{
+#ifndef WIN32
+  if ( IsSharedMemory( path ))
+    shm_unlink( shmName( path ).c_str() );
+#endif
+}
+
+/**
+ * @brief Create a segment and map it for writing
+ *
+ * @param path the segment name starting with "shm:"
+ * @param size the segment size
+ * @param removeOnClose if true the segment is removed at destruction, else
+ *        it is left for another process to read
+ * @return true if the segment is ready to be filled in
+ */
+bool NETGENPlugin_SharedMemory::Create(const std::string& path, size_t size, bool removeOnClose)
+{
+  Close();
+#ifdef WIN32
+  return false;
+#else
+  if ( !IsSharedMemory( path ))
+    return false;
+  _name = path;
+
+  int fd = shm_open( shmName( path ).c_str(), O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR );
+  if ( fd < 0 )
+  {
+    MESSAGE("Can't create shared memory " << path);
+    return false;
+  }
+  _isOwner = removeOnClose;
+  if ( size > 0 && ftruncate( fd, size ) != 0 )
+  {
+    close( fd );
+    MESSAGE("Can't allocate " << size << " bytes of shared memory " << path);
+    return false;
+  }
+  if ( size > 0 )
+  {
+    void* data = mmap( 0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if ( data != MAP_FAILED )
+    {
+      _data = (char*) data;
+      _size = size;
+    }
+  }
+  close( fd );
+  return _data || size == 0;
+#endif
+}
+
+/**
+ * @brief Map an existing segment for reading
+ *
+ * @param path the segment name starting with "shm:"
+ * @return true if the segment is mapped
+ */
+bool NETGENPlugin_SharedMemory::Open(const std::string& path)
+{
+  Close();
+#ifdef WIN32
+  return false;
+#else
+  if ( !IsSharedMemory( path ))
+    return false;
+  _name = path;
+
+  int fd = shm_open( shmName( path ).c_str(), O_RDONLY, 0 );
+  if ( fd < 0 )
+  {
+    MESSAGE("Can't open shared memory " << path);
+    return false;
+  }
+  struct stat st;
+  if ( fstat( fd, &st ) == 0 && st.st_size > 0 )
+  {
+    void* data = mmap( 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    if ( data != MAP_FAILED )
+    {
+      _data = (char*) data;
+      _size = st.st_size;
+    }
+  }
+  close( fd );
+  return _data;
+#endif
+}
+
+/**
+ * @brief Unmap the segment. It persists until Unlink()
+ */
+void NETGENPlugin_SharedMemory::Close()
+{
+#ifndef WIN32
+  if ( _data )
+    munmap( _data, _size );
+#endif
+  _data = 0;
+  _size = 0;
+}
+
+/**
+ * @brief Remove the segment name. The memory is freed once all mappings are closed
+ */
+void NETGENPlugin_SharedMemory::Unlink()
+{
+  if ( !_name.empty() )
+    Remove( _name );
+  _isOwner = false;
+}
@@ -0,0 +1,70 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+//=============================================================================
+// File      : NETGENPlugin_SharedMemory.hxx
+// Project   : SALOME
+//=============================================================================
+//
+#ifndef _NETGENPlugin_SHAREDMEMORY_HXX_
+#define _NETGENPlugin_SHAREDMEMORY_HXX_
+
+#include "NETGENPlugin_Defs.hxx"
+
+#include <cstddef>
+#include <string>
+
+/*!
+ * \brief POSIX shared memory segment used to exchange data between the
+ *        remote algorithms and run_mesher instead of files.
+ *
+ * A segment is designated by a "file name" starting with "shm:", so that
+ * it can be passed wherever a file name is expected.
+ */
+class NETGENPLUGIN_EXPORT NETGENPlugin_SharedMemory
+{
+ public:
+  NETGENPlugin_SharedMemory();
+  ~NETGENPlugin_SharedMemory();
+
+  static bool        IsEnabled();
+  static bool        IsSharedMemory(const std::string& path);
+  static std::string NewName();
+  static void        Remove(const std::string& path);
+
+  bool Create(const std::string& path, size_t size, bool removeOnClose);
+  bool Open  (const std::string& path);
+  void Close ();
+  void Unlink();
+
+  char*       Data()       { return _data; }
+  const char* Data() const { return _data; }
+  size_t      Size() const { return _size; }
+
+ private:
+  NETGENPlugin_SharedMemory(const NETGENPlugin_SharedMemory&);
+  NETGENPlugin_SharedMemory& operator=(const NETGENPlugin_SharedMemory&);
+
+  std::string _name;
+  char*       _data;
+  size_t      _size;
+  bool        _isOwner; // unlink at destruction
+};
+
+#endif
@@ -0,0 +1,332 @@
+// Copyright (C) 2007-2024  CEA, EDF, OPEN CASCADE
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+//
+// See http://www.salome-platform.org/ or email : webmaster.salome@opencascade.com
+//
+
+//=============================================================================
+// File      : NETGENPlugin_UnitTests.cxx
+// Project   : SALOME
+//=============================================================================
+//
+// Tests of the data exchanged with run_mesher and of the data persisted by
+// NETGENPlugin: new_elements.dat, the boundary of a solid, the result cache
+// and the periodicity of the hypothesis. The program returns the number of
+// failed checks.
+//
+#include "NETGENPlugin_BoundaryFile.hxx"
+#include "NETGENPlugin_Hypothesis.hxx"
+#include "NETGENPlugin_NewElementsFile.hxx"
+#include "NETGENPlugin_ResultCache.hxx"
+
+#include <SMDS_MeshNode.hxx>
+#include <SMESHDS_Mesh.hxx>
+#include <SMESH_Gen.hxx>
+#include <SMESH_Mesh.hxx>
+#include <Utils_SALOME_Exception.hxx>
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+
+namespace
+{
+  int theNbFailed = 0;
+
+#define CHECK( condition )                                              \
+  if ( !( condition ))                                                  \
+  {                                                                     \
+    std::cerr << __FILE__ << ":" << __LINE__ << ": " << #condition << " failed" << std::endl; \
+    ++theNbFailed;                                                      \
+  }
+
+  void setEnv( const char* name, const std::string& value )
+  {
+#ifdef WIN32
+    _putenv_s( name, value.c_str() );
+#else
+    setenv( name, value.c_str(), /*overwrite=*/1 );
+#endif
+  }
+
+  //! overwrite an int64 at a given offset of a file
+  void patchFile( const fs::path& file, size_t offset, int64_t value )
+  {
+    std::fstream df( file.string(), std::ios::in|std::ios::out|std::ios::binary );
+    df.seekp( offset );
+    df.write((char*) &value, sizeof( value ));
+  }
+
+  //! copy a file, replacing an existing copy
+  fs::path copyFile( const fs::path& file, const fs::path& copy )
+  {
+    fs::remove( copy );
+    fs::copy_file( file, copy );
+    return copy;
+  }
+
+  //! copy a file cut to a given size
+  fs::path truncatedCopy( const fs::path& file, size_t size )
+  {
+    fs::path copy = copyFile( file, file.string() + ".truncated" );
+    fs::resize_file( copy, size );
+    return copy;
+  }
+
+  //================================================================================
+  /*!
+   * \brief Write and read new elements: 2 old nodes, 3 new ones, a triangle and a tetrahedron
+   */
+  //================================================================================
+
+  void testNewElementsFile( const fs::path& tmpDir )
+  {
+    fs::path file = tmpDir / "new_elements.dat";
+    {
+      NETGENPlugin_NewElementsWriter writer( /*nbPremeshedNodes=*/2, /*nbNodesNew=*/5 );
+      writer.NodeIDs() = { 10, 20 };
+      writer.Coords()  = { 0,0,0, 1,0,0, 0,1,0 };
+      std::vector<int64_t>& tria = writer.AddBlock( /*dim=*/2, /*nbNodes=*/3 );
+      tria = { 1, 2, 3 };
+      std::vector<int64_t>& tetra = writer.AddBlock( /*dim=*/3, /*nbNodes=*/4 );
+      tetra = { 1, 2, 3, 4, 2, 3, 4, 5 };
+      CHECK( writer.Write( file.string() ));
+      CHECK( fs::file_size( file ) == writer.Size() );
+    }
+    {
+      NETGENPlugin_NewElementsReader reader( file.string() );
+      CHECK( reader.IsOK() );
+      CHECK( reader.NbPremeshedNodes() == 2 );
+      CHECK( reader.NbNodesNew() == 5 );
+      CHECK( reader.NbOldNodes() == 2 );
+      CHECK( reader.NodeIDs()[1] == 20 );
+      CHECK( reader.NbNewNodes() == 3 );
+      CHECK( reader.Coords()[7] == 1. );
+      CHECK( reader.NbBlocks() == 2 );
+      CHECK( reader.BlockDim( 0 ) == 2 && reader.BlockNbNodes( 0 ) == 3 && reader.BlockNbElements( 0 ) == 1 );
+      CHECK( reader.BlockDim( 1 ) == 3 && reader.BlockNbNodes( 1 ) == 4 && reader.BlockNbElements( 1 ) == 2 );
+      CHECK( reader.BlockConnectivity( 1 )[7] == 5 );
+    }
+
+    // a missing file can't be read
+    CHECK( !NETGENPlugin_NewElementsReader(( tmpDir / "missing.dat" ).string() ).IsOK() );
+
+    // a truncated file, a wrong number of nodes and a wrong number of elements are reported
+    const size_t headerSize = 48, nbNewNodesOffset = 40;
+    const size_t blockOffset = headerSize + 2 * sizeof(int64_t) + 9 * sizeof(double);
+    std::vector< fs::path > corrupted;
+    corrupted.push_back( truncatedCopy( file, fs::file_size( file ) - 8 ));
+    corrupted.push_back( truncatedCopy( file, blockOffset + 4 ));
+    fs::path wrongNbNodes = copyFile( file, tmpDir / "wrong_nb_nodes.dat" );
+    patchFile( wrongNbNodes, nbNewNodesOffset, -3 );
+    corrupted.push_back( wrongNbNodes );
+    fs::path wrongNbElems = copyFile( file, tmpDir / "wrong_nb_elems.dat" );
+    patchFile( wrongNbElems, blockOffset + 8, int64_t( 1 ) << 60 );
+    corrupted.push_back( wrongNbElems );
+
+    for ( const fs::path& badFile : corrupted )
+    {
+      bool isThrown = false;
+      try
+      {
+        NETGENPlugin_NewElementsReader reader( badFile.string() );
+      }
+      catch ( const SALOME_Exception& )
+      {
+        isThrown = true;
+      }
+      CHECK( isThrown );
+    }
+  }
+
+  //================================================================================
+  /*!
+   * \brief Write two triangles of a mesh and import them into another one
+   */
+  //================================================================================
+
+  void testBoundaryFile( SMESH_Gen& gen, const fs::path& tmpDir )
+  {
+    fs::path file = tmpDir / "boundary.dat";
+    {
+      std::unique_ptr< SMESH_Mesh > mesh( gen.CreateMesh( /*isEmbeddedMode=*/false ));
+      SMESHDS_Mesh* meshDS = mesh->GetMeshDS();
+      const SMDS_MeshNode* n1 = meshDS->AddNode( 0, 0, 0 );
+      const SMDS_MeshNode* n2 = meshDS->AddNode( 1, 0, 0 );
+      const SMDS_MeshNode* n3 = meshDS->AddNode( 0, 1, 0 );
+      const SMDS_MeshNode* n4 = meshDS->AddNode( 1, 1, 2 );
+      NETGENPlugin_BoundaryWriter writer;
+      writer.AddFace( meshDS->AddFace( n1, n2, n3 ), /*isReversed=*/false );
+      writer.AddFace( meshDS->AddFace( n2, n4, n3 ), /*isReversed=*/true );
+      CHECK( writer.Write( file.string() ));
+      CHECK( fs::file_size( file ) == writer.Size() );
+    }
+    {
+      NETGENPlugin_BoundaryReader reader( file.string() );
+      CHECK( reader.IsOK() );
+      std::unique_ptr< SMESH_Mesh > mesh( gen.CreateMesh( /*isEmbeddedMode=*/false ));
+      std::map< vtkIdType, bool > elemOrientation;
+      std::vector< smIdType >     nodeIDs;
+      CHECK( reader.Import( *mesh, elemOrientation, nodeIDs ));
+      SMESHDS_Mesh* meshDS = mesh->GetMeshDS();
+      CHECK( meshDS->NbNodes() == 4 && meshDS->NbFaces() == 2 );
+      CHECK( nodeIDs.size() == 4 );
+      CHECK( elemOrientation.size() == 2 && !elemOrientation[1] && elemOrientation[2] );
+      const SMDS_MeshElement* face = meshDS->FindElement( 2 );
+      CHECK( face && face->GetNode( 1 )->Z() == 2. );
+    }
+
+    // a missing file can't be read
+    CHECK( !NETGENPlugin_BoundaryReader(( tmpDir / "missing.dat" ).string() ).IsOK() );
+
+    // a truncated file and wrong numbers of nodes or faces are not read
+    const size_t nbNodesOffset = 16, nbFacesOffset = 24, headerSize = 32;
+    CHECK( !NETGENPlugin_BoundaryReader( truncatedCopy( file, fs::file_size( file ) - 8 ).string() ).IsOK() );
+    for ( int64_t wrongNb : { int64_t( -1 ), int64_t( 1 ) << 60 })
+      for ( size_t offset : { nbNodesOffset, nbFacesOffset })
+      {
+        fs::path badFile = copyFile( file, tmpDir / "wrong_nb.dat" );
+        patchFile( badFile, offset, wrongNb );
+        CHECK( !NETGENPlugin_BoundaryReader( badFile.string() ).IsOK() );
+      }
+
+    // a node index out of range is not imported
+    const size_t connectivityOffset = headerSize + 4 * ( sizeof(int64_t) + 3 * sizeof(double) ) + 2 * sizeof(int64_t);
+    for ( int64_t wrongIndex : { int64_t( -1 ), int64_t( 4 ) })
+    {
+      fs::path badFile = copyFile( file, tmpDir / "wrong_index.dat" );
+      patchFile( badFile, connectivityOffset + sizeof(int64_t), wrongIndex );
+      NETGENPlugin_BoundaryReader reader( badFile.string() );
+      CHECK( reader.IsOK() );
+      std::unique_ptr< SMESH_Mesh > mesh( gen.CreateMesh( /*isEmbeddedMode=*/false ));
+      std::map< vtkIdType, bool > elemOrientation;
+      std::vector< smIdType >     nodeIDs;
+      CHECK( !reader.Import( *mesh, elemOrientation, nodeIDs ));
+    }
+  }
+
+  //================================================================================
+  /*!
+   * \brief Fetch stored data and check that the least recently used data is evicted
+   */
+  //================================================================================
+
+  void testResultCache( const fs::path& tmpDir )
+  {
+    fs::path cacheDir = tmpDir / "cache";
+    setEnv( "SALOME_NETGEN_CACHE_DIR", cacheDir.string() );
+    setEnv( "SALOME_NETGEN_CACHE_SIZE", "1" ); // MB
+    CHECK( NETGENPlugin_ResultCache::IsEnabled() );
+
+    NETGENPlugin_ResultCache::Key key1, key2, key3;
+    key1.Add( std::string( "data 1" ));
+    key2.Add( std::string( "data 2" ));
+    key3.Add( 3.0 );
+    CHECK( key1.ToString() != key2.ToString() );
+
+    const std::vector<char> data1( 600 * 1024, '1' ), data2( 600 * 1024, '2' );
+    std::vector<char> fetched;
+    {
+      NETGENPlugin_ResultCache cache;
+      CHECK( !cache.Fetch( key1, fetched ));
+      CHECK( cache.Store( key1, data1 ));
+      CHECK( cache.Fetch( key1, fetched ) && fetched == data1 );
+      CHECK( !cache.Fetch( key2, fetched ));
+      // data larger than the cache is not stored
+      CHECK( !cache.Store( key3, std::vector<char>( 2 * 1024 * 1024, '3' )));
+      CHECK( !cache.Fetch( key3, fetched ));
+    }
+
+    // make key1 the least recently used, then exceed the cache size
+    fs::last_write_time( cacheDir / ( key1.ToString() + ".dat" ), std::time(0) - 100 );
+    {
+      NETGENPlugin_ResultCache cache;
+      CHECK( cache.Store( key2, data2 ));
+      CHECK( !cache.Fetch( key1, fetched ));
+      CHECK( cache.Fetch( key2, fetched ) && fetched == data2 );
+    }
+  }
+
+  //================================================================================
+  /*!
+   * \brief Save and load periodicity parameters of the hypothesis
+   */
+  //================================================================================
+
+  void testPeriodicity( SMESH_Gen& gen )
+  {
+    const double x = 1. / 3., y = 0.1, z = -2e-7, dx = 0., dy = 1. / 7., dz = 1e+8 / 3.;
+
+    NETGENPlugin_Hypothesis hyp( gen.GetANewId(), &gen );
+    hyp.SetRotationalPeriodicity( x, y, z, dx, dy, dz, 12 );
+    std::ostringstream save;
+    hyp.SaveTo( save );
+
+    NETGENPlugin_Hypothesis loaded( gen.GetANewId(), &gen );
+    std::istringstream load( save.str() );
+    loaded.LoadFrom( load );
+    CHECK( loaded.GetPeriodicity() == NETGENPlugin_Hypothesis::RotationalPeriodicity );
+    CHECK( loaded.GetNbPeriods() == 12 );
+    const double* params = loaded.GetPeriodicityParameters();
+    CHECK( params[0] == x  && params[1] == y  && params[2] == z );
+    CHECK( params[3] == dx && params[4] == dy && params[5] == dz );
+
+    // data saved without periodicity is loaded without it
+    NETGENPlugin_Hypothesis noPeriodicity( gen.GetANewId(), &gen );
+    noPeriodicity.SetMaxSize( 12.5 );
+    std::ostringstream save2;
+    noPeriodicity.SaveTo( save2 );
+    NETGENPlugin_Hypothesis loaded2( gen.GetANewId(), &gen );
+    std::istringstream load2( save2.str() );
+    loaded2.LoadFrom( load2 );
+    CHECK( load2 );
+    CHECK( loaded2.GetPeriodicity() == NETGENPlugin_Hypothesis::NoPeriodicity );
+    CHECK( loaded2.GetMaxSize() == 12.5 );
+  }
+}
+
+int main( int /*argc*/, char** /*argv*/ )
+{
+  fs::path tmpDir = fs::temp_directory_path() / fs::unique_path( "NETGENPlugin_UnitTests-%%%%-%%%%" );
+  fs::create_directories( tmpDir );
+  {
+    SMESH_Gen gen;
+    try
+    {
+      testNewElementsFile( tmpDir );
+      testBoundaryFile( gen, tmpDir );
+      testResultCache( tmpDir );
+      testPeriodicity( gen );
+    }
+    catch ( const std::exception& ex ) // SALOME_Exception included
+    {
+      std::cerr << "Unexpected exception: " << ex.what() << std::endl;
+      ++theNbFailed;
+    }
+  }
+  boost::system::error_code err;
+  fs::remove_all( tmpDir, err );
+
+  std::cout << theNbFailed << " check(s) failed" << std::endl;
+  return theNbFailed;
+}
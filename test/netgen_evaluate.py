@@ -0,0 +1,67 @@
+# Check that Evaluate() of NETGEN algorithms estimates numbers of
+# elements close to the ones generated by Compute()
+
+import salome
+salome.salome_init()
+import GEOM
+from salome.geom import geomBuilder
+geompy = geomBuilder.New()
+
+import SMESH, SALOMEDS
+from salome.smesh import smeshBuilder
+smesh =  smeshBuilder.New()
+
+# relative difference allowed between estimated and generated numbers
+tolerance = 0.35
+
+def check(mesh, entity, nbComputed):
+    nbEstimated = mesh.Evaluate()[ entity ]
+    print("%s %s: estimated %s, computed %s" % ( mesh.GetName(), entity, nbEstimated, nbComputed ))
+    assert nbComputed > 0
+    assert abs( nbEstimated - nbComputed ) <= tolerance * nbComputed, \
+        "%s: wrong estimation of %s" % ( mesh.GetName(), entity )
+
+# create a box and a cylinder
+box = geompy.MakeBoxDXDYDZ(100., 100., 100.)
+geompy.addToStudy(box, "Box")
+cylinder = geompy.MakeCylinderRH(50., 200.)
+geompy.addToStudy(cylinder, "Cylinder")
+
+# 1. Triangular mesh on the cylinder with NETGEN_1D2D algorithm
+triaN = smesh.Mesh(cylinder, "Cylinder : triangular mesh by NETGEN_1D2D")
+algo2D = triaN.Triangle(smeshBuilder.NETGEN_1D2D)
+n12_params = algo2D.Parameters()
+n12_params.SetMaxSize(10)
+n12_params.SetMinSize(1)
+n12_params.SetOptimize(True)
+
+isDone = triaN.Compute()
+assert isDone, "Compute() of %s failed" % triaN.GetName()
+check( triaN, SMESH.Entity_Triangle, triaN.NbTriangles() )
+
+# 2. Tetrahedral mesh on the box with NETGEN_1D2D3D algorithm
+tetraN = smesh.Mesh(box, "Box : tetrahedral mesh by NETGEN_1D2D3D")
+algo3D = tetraN.Tetrahedron(smeshBuilder.FULL_NETGEN)
+n123_params = algo3D.Parameters()
+n123_params.SetMaxSize(10)
+n123_params.SetMinSize(1)
+n123_params.SetOptimize(True)
+
+isDone = tetraN.Compute()
+assert isDone, "Compute() of %s failed" % tetraN.GetName()
+check( tetraN, SMESH.Entity_Triangle, tetraN.NbTriangles() )
+check( tetraN, SMESH.Entity_Tetra,    tetraN.NbTetras() )
+
+# 3. Tetrahedral mesh on the cylinder with a local size on its top face
+tetraL = smesh.Mesh(cylinder, "Cylinder : tetrahedral mesh with a local size")
+algo3D = tetraL.Tetrahedron(smeshBuilder.FULL_NETGEN)
+nl_params = algo3D.Parameters()
+nl_params.SetMaxSize(20)
+nl_params.SetMinSize(1)
+faces = geompy.SubShapeAllSortedCentres(cylinder, geompy.ShapeType["FACE"])
+geompy.addToStudyInFather(cylinder, faces[-1], "Top")
+nl_params.SetLocalSizeOnShape(faces[-1], 5)
+
+isDone = tetraL.Compute()
+assert isDone, "Compute() of %s failed" % tetraL.GetName()
+check( tetraL, SMESH.Entity_Tetra, tetraL.NbTetras() )